@@ -37,6 +37,8 @@ class Value;
 class ValueIteratorBase;
 class ValueIterator;
 class ValueConstIterator;
+class Executor;
+class ThreadPoolExecutor;
 
 } // namespace Json
 
@@ -240,6 +240,55 @@ private:
   bool collectComments_{};
 }; // Reader
 
+/** \brief The first error in a document, as CharReader::tryParse() reports
+ * it: what went wrong and where, without a message.
+ *
+ * Recording one neither allocates nor throws, so rejecting a document costs
+ * about as much as accepting it. The message is only made when asked for.
+ */
+struct JSON_API ParseError {
+  enum Code {
+    none = 0,
+    invalidUTF8,
+    unterminatedString,
+    valueExpected,
+    missingMemberName,
+    missingColon,
+    missingObjectSeparator,
+    missingArraySeparator,
+    duplicateKey,
+    keyTooLong,
+    stackLimitExceeded,
+    notANumber,
+    emptyEscape,
+    badEscape,
+    unicodeEscapeTooShort,
+    badUnicodeEscapeDigit,
+    surrogatePairTooShort,
+    missingLowSurrogate,
+    extraCharacters,
+    rootNotContainer,
+    /// From a CharReader that does not tell its errors apart.
+    other
+  };
+
+  /// The message of \a code, the same as in the errors of parse().
+  static char const* message(Code code);
+  char const* message() const { return message(code); }
+  /** The error as parse() would have formatted it, e.g.
+   * "* Line 1, Column 7\n  Missing ':' after object member name\n".
+   * \a beginDoc and \a endDoc are the document that was parsed. Columns are
+   * counted from \a beginDoc, where parse() counts those of the first line
+   * from after a byte order mark it skipped.
+   */
+  String format(char const* beginDoc, char const* endDoc) const;
+
+  Code code = none;
+  /// The offset, in the document, of the token at fault. A byte order mark
+  /// the reader skipped counts.
+  ptrdiff_t offset = 0;
+};
+
 /** Interface for reading JSON from a char array.
  */
 class JSON_API CharReader {
@@ -264,6 +313,26 @@ public:
   virtual bool parse(char const* beginDoc, char const* endDoc, Value* root,
                      String* errs) = 0;
 
+  /** \brief Same as parse(), but stops at the first error and reports it in
+   * \a error, if not NULL, which is cleared on success.
+   *
+   * Nothing is allocated to report the error, and limits such as the
+   * stackLimit setting fail the parse instead of throwing. Readers other
+   * than the built-in ones report ParseError::other at offset 0.
+   */
+  bool tryParse(char const* beginDoc, char const* endDoc, Value* root,
+                ParseError* error);
+
+  /** \brief Check that a document would parse, without building a Value.
+   *
+   * Fails where tryParse() would, and reports the error the same way. The
+   * built-in readers only run their tokenizer, and allocate nothing once
+   * they have validated a document as deeply nested as this one. Other
+   * readers parse into a Value they then discard.
+   */
+  bool validate(char const* beginDoc, char const* endDoc,
+                ParseError* error);
+
   class JSON_API Factory {
   public:
     virtual ~Factory() = default;
@@ -324,6 +393,18 @@ public:
    * - `"allowSpecialFloats": false or true`
    *   - If true, special float values (NaNs and infinities) are allowed and
    *     their values are lossfree restorable.
+   * - `"structuralIndex": false or true`
+   *   - If true, the reader first finds all the structural characters of the
+   *     document with SIMD instructions where available, then builds the
+   *     values from that index. It also rejects invalid UTF-8, and
+   *     otherwise accepts and reports errors in the same documents as the
+   *     default reader. This is only used when failIfExtra is true and
+   *     allowComments, allowSingleQuotes, allowNumericKeys and
+   *     allowDroppedNullPlaceholders are all false, as in strictMode().
+   * - `"validateUTF8": false or true`
+   *   - If true, `parse()` returns false when the document is not valid
+   *     UTF-8. Otherwise invalid sequences are copied into strings as they
+   *     are. The structuralIndex reader always validates.
    *
    * You can examine 'settings_` yourself to see the defaults. You can also
    * write and read them just like any JSON Value.
@@ -359,6 +440,322 @@ public:
   static void strictMode(Json::Value* settings);
 };
 
+/** \brief The settings of a CharReaderBuilder, read and checked once.
+ *
+ * CharReaderBuilder::newCharReader() looks up each of its settings every
+ * time. A CharReaderConfig does so once, when it is constructed, and does not
+ * change after that, so one can be shared by any number of threads.
+ *
+ * parse() reuses a reader kept by the calling thread, so that parsing a small
+ * document costs no more than the parsing itself. Each thread keeps the reader
+ * of the last config it parsed with.
+ *
+ * Usage:
+ *   \code
+ *   static const Json::CharReaderConfig config{Json::CharReaderBuilder()};
+ *   Json::Value value;
+ *   bool ok = config.parse(begin, end, &value, nullptr);
+ *   \endcode
+ */
+class JSON_API CharReaderConfig : public CharReader::Factory {
+public:
+  explicit CharReaderConfig(CharReaderBuilder const& builder);
+  ~CharReaderConfig() override;
+
+  CharReader* newCharReader() const override;
+
+  /// Same as CharReader::parse().
+  bool parse(char const* beginDoc, char const* endDoc, Value* root,
+             String* errs) const;
+  /// Same as CharReader::tryParse().
+  bool tryParse(char const* beginDoc, char const* endDoc, Value* root,
+                ParseError* error) const;
+  /// Same as CharReader::validate().
+  bool validate(char const* beginDoc, char const* endDoc,
+                ParseError* error) const;
+
+  /// The config of a default CharReaderBuilder.
+  static CharReaderConfig const& defaults();
+
+private:
+  CharReader& reader() const;
+
+  class Impl;
+  std::shared_ptr<Impl const> impl_;
+};
+
+class LazyDocument;
+
+/** \brief A value inside a LazyDocument, parsed only when asked for.
+ *
+ * Navigating with operator[] or find() only looks at the structure of the
+ * document; a Value is built when parse() or toValue() is called, and only
+ * for this subtree. A default-constructed LazyValue, or the result of looking
+ * up a missing member or index, does not exist.
+ *
+ * A LazyValue refers to its document, which must outlive it. All methods
+ * are const and may be called from several threads at once.
+ */
+class JSON_API LazyValue {
+public:
+  LazyValue() = default;
+
+  /// \c false for a missing member or index.
+  bool exists() const { return document_ != nullptr; }
+  /// Type of the value, nullValue if it does not exist. Numbers are parsed
+  /// to tell integers from reals.
+  ValueType type() const;
+  bool isNull() const { return type() == nullValue; }
+  bool isArray() const;
+  bool isObject() const;
+
+  /// Number of elements of an array, or of distinct members of an object.
+  ArrayIndex size() const;
+
+  /// Element of an array, or a missing value.
+  LazyValue operator[](ArrayIndex index) const;
+  LazyValue operator[](int index) const;
+  /// Member of an object, or a missing value. If a key appears more than
+  /// once, the last occurrence wins, as when parsing the whole object.
+  LazyValue operator[](const char* key) const;
+  LazyValue operator[](const String& key) const;
+  LazyValue find(const char* begin, const char* end) const;
+  bool isMember(const char* key) const;
+  bool isMember(const String& key) const;
+  /// Sorted names of the members of an object.
+  Value::Members getMemberNames() const;
+
+  /// Position of the value in the parsed text.
+  ptrdiff_t getOffsetStart() const;
+
+  /** Build the Value for this subtree. Offsets and error locations are
+   * relative to the whole document.
+   * \return \c false, with the messages in \a errs if it is not null, if the
+   * subtree is not valid JSON or the value does not exist.
+   */
+  bool parse(Value* value, String* errs) const;
+  /// Same as parse(), but throws a RuntimeError on failure.
+  Value toValue() const;
+
+private:
+  friend class LazyDocument;
+  LazyValue(const LazyDocument* document, size_t offset)
+      : document_(document), offset_(offset) {}
+
+  const LazyDocument* document_ = nullptr;
+  size_t offset_ = 0;
+};
+
+/** \brief A parsed document whose values are built on demand.
+ *
+ * parse() copies the text and indexes its structure: the position of each
+ * bracket and its match, and the members or elements of the root. Only the
+ * subtrees that are then parsed through a LazyValue become Values, which is
+ * much cheaper when only a few fields of a large document are needed.
+ *
+ * Usage:
+ *   \code
+ *   Json::LazyDocument doc;
+ *   Json::String errs;
+ *   if (doc.parse(begin, end, &errs))
+ *     int id = doc.root()["items"][0]["id"].toValue().asInt();
+ *   \endcode
+ *
+ * The settings of the builder apply as they do to its CharReader, but
+ * parse() only checks the structure of the document and of its root. Other
+ * errors, such as a malformed number or a missing colon in a nested object,
+ * are reported when the subtree containing them is parsed; a lookup that
+ * runs into such an error gives a missing value.
+ */
+class JSON_API LazyDocument {
+public:
+  explicit LazyDocument(const CharReaderBuilder& builder = CharReaderBuilder());
+  ~LazyDocument();
+  LazyDocument(const LazyDocument&) = delete;
+  LazyDocument& operator=(const LazyDocument&) = delete;
+
+  /** Copy and index the document [beginDoc, endDoc).
+   * \return \c false, with the messages in \a errs if it is not null, if the
+   * structure of the document is invalid. root() is then missing.
+   */
+  bool parse(const char* beginDoc, const char* endDoc, String* errs);
+
+  /// The root value, missing until a document is successfully parsed.
+  LazyValue root() const;
+
+private:
+  friend class LazyValue;
+  class Impl;
+  std::unique_ptr<Impl> impl_;
+};
+
+/** \brief Reads a document from a stream one token at a time, as they are
+ * asked for.
+ *
+ * Only a piece of the input is held at a time, so an array far larger than
+ * memory can be walked an element at a time, each read into a Value of its
+ * own and dropped before the next one is read.
+ *
+ * Usage:
+ *   \code
+ *   Json::Cursor cursor(Json::CharReaderBuilder(), sin);
+ *   if (cursor.next() == Json::Cursor::tokenArrayBegin) {
+ *     while (cursor.next() != Json::Cursor::tokenArrayEnd) {
+ *       Json::Value record;
+ *       if (!cursor.readValue(&record))
+ *         break;
+ *       process(record);
+ *     }
+ *   }
+ *   if (cursor.kind() == Json::Cursor::tokenError)
+ *     std::cerr << cursor.error().message() << "\n";
+ *   \endcode
+ *
+ * The settings of the builder apply as they do to its CharReader, and the
+ * first error ends the document, as in CharReader::tryParse(). As there, a
+ * root that strictRoot rejects is an error only once what follows it is
+ * checked, so the cursor reaches the root first. Comments are
+ * skipped, except inside the values that readValue() reads, where
+ * "collectComments" applies. skip() checks the value it moves past as
+ * next() would. With "rejectDupKeys", only a 64-bit hash of each member
+ * name of the open objects is kept, and names are told apart by it.
+ */
+class JSON_API Cursor {
+public:
+  enum Kind {
+    /// The end of the document, after the root value.
+    tokenEnd = 0,
+    /// The document is malformed; see error().
+    tokenError,
+    tokenObjectBegin,
+    tokenObjectEnd,
+    tokenArrayBegin,
+    tokenArrayEnd,
+    /// The name of a member, in name(); its value is next.
+    tokenName,
+    tokenString,
+    tokenNumber,
+    tokenBoolean,
+    tokenNull
+  };
+
+  Cursor(CharReaderBuilder const& builder, IStream& sin);
+  ~Cursor();
+  Cursor(const Cursor&) = delete;
+  Cursor& operator=(const Cursor&) = delete;
+
+  /// Moves to the next token, and returns its kind.
+  Kind next();
+  /// The kind of the token the cursor is at.
+  Kind kind() const;
+
+  /** Moves past the value at the cursor without decoding it: to the end of
+   * the object or array it begins, or past the value of the member it
+   * names. Does nothing at any other token.
+   * \return \c false on error.
+   */
+  bool skip();
+
+  /** Reads the value at the cursor into \a value, and moves past it as
+   * skip() does. The offsets in \a value are from where the value begins.
+   * \return \c false on error, or if the cursor is not at a value or a
+   * member name.
+   */
+  bool readValue(Value* value);
+
+  /// The name of the member, at a Cursor::tokenName.
+  String const& name() const;
+  /// The offset of the token at the cursor in the document.
+  ptrdiff_t offset() const;
+  /// The first error, at a Cursor::tokenError.
+  ParseError const& error() const;
+
+private:
+  class Impl;
+  std::unique_ptr<Impl> impl_;
+};
+
+/** \brief Build a CharReader that decodes MessagePack into a Value.
+ *
+ * It reads what MsgPackWriterBuilder writes, and the MessagePack written by
+ * other encoders as long as it maps to a Value: nil, booleans, integers,
+ * floats, strings, arrays and maps with string keys. The uint formats give
+ * uintValue and the other integer formats intValue; a float 32 is widened
+ * to a double. Binary and extension types are errors.
+ *
+ * Errors are reported with the byte offset at which they occur.
+ */
+class JSON_API MsgPackReaderBuilder : public CharReader::Factory {
+public:
+  /** Configuration of this builder.
+   * Available settings (case-sensitive):
+   * - `"stackLimit": integer`
+   *   - Exceeding stackLimit (nesting of arrays and maps) will cause an
+   *     exception.
+   *
+   * \sa setDefaults()
+   */
+  Json::Value settings_;
+
+  MsgPackReaderBuilder();
+  ~MsgPackReaderBuilder() override;
+
+  CharReader* newCharReader() const override;
+
+  /** \return true if 'settings' are legal and consistent;
+   *   otherwise, indicate bad settings via 'invalid'.
+   */
+  bool validate(Json::Value* invalid) const;
+
+  /** A simple way to update a specific setting.
+   */
+  Value& operator[](const String& key);
+
+  /** Called by ctor, but you can use this to reset settings_.
+   * \pre 'settings' != NULL (but Json::null is fine)
+   * \remark Defaults:
+   * \snippet src/lib_json/json_reader.cpp MsgPackReaderBuilderDefaults
+   */
+  static void setDefaults(Json::Value* settings);
+};
+
+/** \brief Map byte offsets in a document to line and column numbers.
+ *
+ * Lines end with "\n", "\r\n" or "\r", as in the error messages of
+ * CharReader. The first lookup indexes where each line starts, in one pass
+ * over the document, and every lookup is then a binary search. So it is
+ * cheap to locate many offsets, such as those of Value::getOffsetStart().
+ *
+ * The document is not copied, and must outlive the map. As the index is built
+ * by the first lookup, a map is not safe to share between threads until then.
+ *
+ * Usage:
+ *   \code
+ *   Json::SourceMap map(doc.data(), doc.data() + doc.size());
+ *   int line, column;
+ *   map.getLineAndColumn(value.getOffsetStart(), &line, &column);
+ *   \endcode
+ */
+class JSON_API SourceMap {
+public:
+  SourceMap(char const* beginDoc, char const* endDoc);
+
+  /** Find the line and column, both from 1, of the byte at \a offset.
+   * Offsets past the end of the document give the end of the document.
+   */
+  void getLineAndColumn(ptrdiff_t offset, int* line, int* column) const;
+  /// Same, as "Line 3, Column 14".
+  String getLineAndColumn(ptrdiff_t offset) const;
+
+private:
+  void buildIndex() const;
+
+  char const* begin_;
+  char const* end_;
+  // The offset at which each line starts, in order.
+  mutable std::vector<size_t> lineStarts_;
+};
+
 /** Consume entire stream and use its begin/end.
  * Someday we might have a real StreamReader, but for now this
  * is convenient.
@@ -366,6 +763,49 @@ public:
 bool JSON_API parseFromStream(CharReader::Factory const&, IStream&, Value* root,
                               String* errs);
 
+/** \brief Write the document in \a sin to \a sout as \a writer would
+ * write it once \a reader had parsed it, without building a Value.
+ *
+ * Each value is written as soon as it is read, and only a piece of the
+ * input is held at a time, so documents far larger than memory can be
+ * minified or re-indented. The output differs from writing the parsed Value
+ * in three ways: members keep their order, duplicate members are all written
+ * (unless "rejectDupKeys" rejects them), and numbers keep their text when it
+ * is valid JSON.
+ *
+ * Errors are reported as by CharReader::tryParse(), with their offset in
+ * \a sin. What was read before an error has already been written. As in a
+ * Cursor, "rejectDupKeys" tells names apart by a 64-bit hash of each.
+ *
+ * Usage:
+ *   \code
+ *   Json::StreamWriterBuilder minify;
+ *   minify["indentation"] = "";
+ *   Json::ParseError error;
+ *   if (!Json::reformat(Json::CharReaderBuilder(), minify, std::cin,
+ *                       std::cout, &error))
+ *     std::cerr << error.message() << " at " << error.offset << "\n";
+ *   \endcode
+ */
+bool JSON_API reformat(CharReaderBuilder const& reader,
+                       StreamWriterBuilder const& writer, IStream& sin,
+                       OStream& sout, ParseError* error);
+
+/** \brief Same as builder.newCharReader()->parse(), reading a large root
+ * array on \a executor.
+ *
+ * The array is cut where its elements are guessed to start, from a quick
+ * scan that keeps track of strings, and the pieces are read on tasks of
+ * their own. The calling thread then reads the document as usual, taking in
+ * the elements of each piece when it reaches where that piece begins. Where
+ * a guess was wrong, or a piece has an error, it reads the elements itself,
+ * so the result and the errors are the same as without \a executor.
+ * "structuralIndex" is ignored.
+ */
+bool JSON_API parallelParse(CharReaderBuilder const& builder,
+                            char const* beginDoc, char const* endDoc,
+                            Executor& executor, Value* root, String* errs);
+
 /** \brief Read from 'sin' into 'root'.
  *
  * Always keep comments from the input JSON.
@@ -41,6 +41,7 @@
 
 #include <array>
 #include <exception>
+#include <functional>
 #include <map>
 #include <memory>
 #include <string>
@@ -156,6 +157,65 @@ private:
   const char* c_str_;
 };
 
+/** \brief Runs a batch of independent tasks, possibly concurrently.
+ *
+ * Used by parallelCopy() and parallelEquals(). Implement it to run the work
+ * on an existing thread pool, or use ThreadPoolExecutor.
+ */
+class JSON_API Executor {
+public:
+  virtual ~Executor();
+
+  /** \brief Calls task(i) once for each i in [0, count).
+   *
+   * Calls may run concurrently and in any order. Returns once all of them
+   * have completed.
+   */
+  virtual void parallelFor(size_t count,
+                           const std::function<void(size_t)>& task) = 0;
+
+  /// Number of tasks that can usefully run at the same time.
+  virtual unsigned concurrency() const = 0;
+};
+
+/** \brief Executor backed by a fixed set of worker threads.
+ *
+ * Workers claim task indices one at a time, so tasks of uneven cost are
+ * balanced across threads. The thread calling parallelFor() runs tasks too.
+ * A parallelFor() issued from inside a task runs on the calling thread.
+ */
+class JSON_API ThreadPoolExecutor : public Executor {
+public:
+  /// \param threadCount Total number of threads, including the caller. 0
+  ///        means std::thread::hardware_concurrency().
+  explicit ThreadPoolExecutor(unsigned threadCount = 0);
+  ~ThreadPoolExecutor() override;
+
+  ThreadPoolExecutor(const ThreadPoolExecutor&) = delete;
+  ThreadPoolExecutor& operator=(const ThreadPoolExecutor&) = delete;
+
+  void parallelFor(size_t count,
+                   const std::function<void(size_t)>& task) override;
+  unsigned concurrency() const override;
+
+private:
+  class Impl;
+  std::unique_ptr<Impl> impl_;
+};
+
+/** \brief Deep copy of \a other, equivalent to Value(other).
+ *
+ * Arrays and objects with many elements, and the first few levels of the
+ * tree, are split into tasks which run on \a executor. The split containers
+ * themselves are built on the calling thread.
+ */
+JSON_API Value parallelCopy(const Value& other, Executor& executor);
+
+/// \brief Equivalent to (a == b), comparing large containers on \a executor.
+/// \see parallelCopy()
+JSON_API bool parallelEquals(const Value& a, const Value& b,
+                             Executor& executor);
+
 /** \brief Represents a <a HREF="http://www.json.org">JSON</a> value.
  *
  * This class is a discriminated union wrapper that can represents a:
@@ -192,6 +252,9 @@ private:
  */
 class JSON_API Value {
   friend class ValueIteratorBase;
+  friend Value parallelCopy(const Value& other, Executor& executor);
+  friend bool parallelEquals(const Value& a, const Value& b,
+                             Executor& executor);
 
 public:
   using Members = std::vector<String>;
@@ -362,6 +425,26 @@ public:
   /// copy values but leave comments and source offsets in place.
   void copyPayload(const Value& other);
 
+  /** \brief Share the arrays and objects of this value between its copies.
+   *
+   * Afterwards, copying this value, or any array or object within it, only
+   * adds a reference. A copy duplicates a shared container, one level deep,
+   * the first time it is modified through that copy. Any number of threads
+   * may read copies of a shared value, through const access, concurrently.
+   *
+   * Arrays and objects added later are not shared until share() is called
+   * again. Shared containers compare equal to themselves without looking at
+   * their elements, so a shared NaN equals itself.
+   *
+   * \warning A reference or iterator obtained through non-const access is
+   * only valid until the value it came from is copied. Writing through it
+   * afterwards would modify every copy.
+   */
+  void share();
+  /// True if this is an array or object whose elements are shared between
+  /// copies. \see share()
+  bool isShared() const;
+
   ValueType type() const;
 
   /// Compare payload only, not comments etc.
@@ -567,9 +650,7 @@ public:
     setComment(String(comment, strlen(comment)), placement);
   }
   /// Comments must be //... or /* ... */
-  void setComment(const char* comment, size_t len, CommentPlacement placement) {
-    setComment(String(comment, len), placement);
-  }
+  void setComment(const char* comment, size_t len, CommentPlacement placement);
   /// Comments must be //... or /* ... */
   void setComment(String comment, CommentPlacement placement);
   bool hasComment(CommentPlacement placement) const;
@@ -603,6 +684,19 @@ private:
   void releasePayload();
   void dupMeta(const Value& other);
 
+  class SharedObjectValues;
+  // Give a shared array or object its own copy of the elements, before it is
+  // modified.
+  void detachPayload();
+
+  // Compare types and scalar payloads. Arrays and objects are only compared
+  // by size; their elements are left to the caller.
+  bool shallowEquals(const Value& other) const;
+  int shallowCompare(const Value& other) const;
+  // Whether this is a shared array or object with the same elements as
+  // \a other, which makes the two equal without comparing the elements.
+  bool isSameShared(const Value& other) const;
+
   Value& resolveReference(const char* key);
   Value& resolveReference(const char* key, const char* end);
 
@@ -629,6 +723,8 @@ private:
     unsigned int value_type_ : 8;
     // Unless allocated_, string_ must be null-terminated.
     unsigned int allocated_ : 1;
+    // If shared_, map_ is a reference-counted SharedObjectValues.
+    unsigned int shared_ : 1;
   } bits_;
 
   class Comments {
@@ -640,11 +736,11 @@ private:
     Comments& operator=(Comments&& that);
     bool has(CommentPlacement slot) const;
     String get(CommentPlacement slot) const;
-    void set(CommentPlacement slot, String comment);
+    void set(CommentPlacement slot, const char* comment, size_t length);
 
   private:
-    using Array = std::array<String, numberOfCommentPlacement>;
-    std::unique_ptr<Array> ptr_;
+    // The length of each comment, then their text, in a single allocation.
+    std::unique_ptr<char[]> ptr_;
   };
   Comments comments_;
 
@@ -922,6 +1018,236 @@ public:
   pointer operator->() { return &deref(); }
 };
 
+class FrozenValueIterator;
+
+/** \brief Read-only view of a value within a FrozenDocument.
+ *
+ * Mirrors the const accessors of Value, with the same conversion rules. A
+ * FrozenValue is two pointers and is cheap to copy. It remains valid as long
+ * as the FrozenDocument it came from.
+ */
+class JSON_API FrozenValue {
+  friend class FrozenDocument;
+  friend class FrozenValueIterator;
+
+public:
+  using const_iterator = FrozenValueIterator;
+
+  /// A null value which is not part of any document.
+  FrozenValue() = default;
+
+  ValueType type() const;
+
+  const char* asCString() const; ///< Embedded zeroes could cause you trouble!
+  String asString() const;       ///< Embedded zeroes are possible.
+  /** Get raw char* of string-value.
+   *  \return false if !string. (Seg-fault if str or end are NULL.)
+   */
+  bool getString(char const** begin, char const** end) const;
+  Int asInt() const;
+  UInt asUInt() const;
+#if defined(JSON_HAS_INT64)
+  Int64 asInt64() const;
+  UInt64 asUInt64() const;
+#endif // if defined(JSON_HAS_INT64)
+  LargestInt asLargestInt() const;
+  LargestUInt asLargestUInt() const;
+  float asFloat() const;
+  double asDouble() const;
+  bool asBool() const;
+
+  bool isNull() const;
+  bool isBool() const;
+  bool isInt() const;
+  bool isInt64() const;
+  bool isUInt() const;
+  bool isUInt64() const;
+  bool isIntegral() const;
+  bool isDouble() const;
+  bool isNumeric() const;
+  bool isString() const;
+  bool isArray() const;
+  bool isObject() const;
+
+  bool isConvertibleTo(ValueType other) const;
+
+  /// Number of values in array or object
+  ArrayIndex size() const;
+
+  /// \brief Return true if empty array, empty object, or null;
+  /// otherwise, false.
+  bool empty() const;
+
+  /// Return !isNull()
+  explicit operator bool() const;
+
+  /// Return true if index < size().
+  bool isValidIndex(ArrayIndex index) const;
+
+  /// Access an array element (zero based index). Returns a null value if the
+  /// index is out of range.
+  FrozenValue operator[](ArrayIndex index) const;
+  FrozenValue operator[](int index) const;
+
+  /// Access an object member by binary search of the sorted key table.
+  /// Returns a null value if there is no such member.
+  FrozenValue operator[](const char* key) const;
+  FrozenValue operator[](const String& key) const;
+  /// Return the member named key, or \a defaultValue if there is none.
+  /// \param key may contain embedded nulls.
+  FrozenValue get(const char* begin, const char* end,
+                  const FrozenValue& defaultValue) const;
+
+  /// Return true if the object has a member named key.
+  bool isMember(const char* key) const;
+  bool isMember(const String& key) const;
+  bool isMember(const char* begin, const char* end) const;
+
+  /// Return a list of the member names, in the same order as Value.
+  Value::Members getMemberNames() const;
+
+  const_iterator begin() const;
+  const_iterator end() const;
+
+  /// Copy this value, and everything in it, into a new Value.
+  Value toValue() const;
+
+private:
+  struct Slot;
+  struct Entry;
+
+  FrozenValue(const char* base, const Slot* slot);
+
+  const Slot* slotAt(size_t offset) const;
+  const Entry* entryAt(size_t offset) const;
+  const Entry* findEntry(const char* begin, const char* end) const;
+  // This scalar as a Value, to convert it exactly as Value would.
+  Value scalar() const;
+
+  const char* base_ = nullptr;
+  const Slot* slot_ = nullptr;
+};
+
+/** \brief Iterator over the elements of a FrozenValue array or object.
+ */
+class JSON_API FrozenValueIterator {
+  friend class FrozenValue;
+
+public:
+  using iterator_category = std::forward_iterator_tag;
+  using value_type = FrozenValue;
+  using difference_type = ptrdiff_t;
+  using pointer = const FrozenValue*;
+  using reference = FrozenValue;
+
+  FrozenValueIterator() = default;
+
+  FrozenValue operator*() const;
+  FrozenValueIterator& operator++();
+  FrozenValueIterator operator++(int);
+  bool operator==(const FrozenValueIterator& other) const;
+  bool operator!=(const FrozenValueIterator& other) const;
+
+  /// Return either the index or the member name of the referenced value as a
+  /// Value.
+  Value key() const;
+
+  /// Return the index of the referenced value, or -1 if it is an object
+  /// member.
+  UInt index() const;
+
+  /// Return the member name of the referenced value, or "" if it is not an
+  /// object member.
+  String name() const;
+
+  /// Return the member name of the referenced value, or NULL if it is not an
+  /// object member. \param end Receives the end of the name.
+  char const* memberName(char const** end) const;
+
+private:
+  FrozenValueIterator(const FrozenValue& container, ArrayIndex position);
+
+  FrozenValue container_;
+  ArrayIndex position_ = 0;
+};
+
+/** \brief Immutable copy of a Value in a single contiguous buffer.
+ *
+ * The buffer holds no pointers. Children are referred to by offset, scalars
+ * are stored inline, and each object has a key table sorted in the order of
+ * Value's members. Reading it never allocates, any number of threads may read
+ * it concurrently, and destroying it is a single deallocation.
+ *
+ * Comments and source offsets are not kept. Missing elements of a sparse
+ * array become null.
+ *
+ * \code
+ * Json::FrozenDocument doc(value);
+ * Json::FrozenValue root = doc.root();
+ * int port = root["server"]["port"].asInt();
+ * \endcode
+ *
+ * Because the buffer holds no pointers, it can be saved as a snapshot and
+ * loaded back without parsing: a 24-byte header (magic "JSNP", format
+ * version, byte order mark and buffer size) followed by the buffer itself.
+ * A snapshot can be copied into a FrozenDocument, or viewed in place, for
+ * instance from a memory-mapped file. Either way it is checked first, so a
+ * truncated or corrupt snapshot is reported rather than read. Snapshots are
+ * only read on platforms with the byte order they were written with.
+ *
+ * \code
+ * std::ofstream out("config.snapshot", std::ios::binary);
+ * Json::FrozenDocument(value).writeSnapshot(out);
+ * ...
+ * Json::FrozenValue root;
+ * if (Json::FrozenDocument::viewSnapshot(begin, end, &root, &errs))
+ *   Json::Value copy = root.toValue();
+ * \endcode
+ */
+class JSON_API FrozenDocument {
+public:
+  /// A document holding null.
+  FrozenDocument();
+  explicit FrozenDocument(const Value& value);
+  FrozenDocument(FrozenDocument&& other);
+  FrozenDocument& operator=(FrozenDocument&& other);
+  ~FrozenDocument();
+
+  FrozenDocument(const FrozenDocument&) = delete;
+  FrozenDocument& operator=(const FrozenDocument&) = delete;
+
+  FrozenValue root() const;
+
+  /// The buffer, aligned for 8-byte values, and its size in bytes.
+  const char* data() const;
+  size_t size() const;
+
+  /// Write the snapshot of this document, its header then data(), to \a sout.
+  void writeSnapshot(OStream& sout) const;
+
+  /** Replace this document with a copy of the snapshot [begin, end).
+   * \return false, with a message in \a errs if it is not null, if the bytes
+   * are not a valid snapshot. The document is then unchanged.
+   */
+  bool readSnapshot(const char* begin, const char* end, String* errs);
+
+  /** Check the snapshot [begin, end) and view its root in place, without
+   * copying. \a begin must be aligned to 8 bytes, and the bytes must outlive
+   * \a root and everything read from it.
+   * \return false, with a message in \a errs if it is not null, if the bytes
+   * are not a valid snapshot. \a root is then unchanged.
+   */
+  static bool viewSnapshot(const char* begin, const char* end,
+                           FrozenValue* root, String* errs);
+
+private:
+  // Returns why [base, base + size) is not a valid buffer, or nullptr.
+  static const char* checkLayout(const char* base, size_t size);
+
+  std::unique_ptr<char[]> buffer_;
+  size_t size_ = 0;
+};
+
 inline void swap(Value& a, Value& b) { a.swap(b); }
 
 } // namespace Json
@@ -142,6 +142,201 @@ public:
   static void setDefaults(Json::Value* settings);
 };
 
+/** \brief Return the length of writeString(builder, root), without writing it.
+ *
+ * The length is exact: it counts escapes, indentation, comments and the
+ * digits of numbers as the writer would write them. Only doubles are
+ * formatted to be counted. That is cheaper than writing, and lets the caller
+ * size an output buffer, or a Content-Length, before writing.
+ *
+ * Usage:
+ *   \code
+ *   static const Json::StreamWriterConfig config(builder);
+ *   Json::String out(config.serializedSize(value), '\0');
+ *   config.write(value, &out[0], out.size());
+ *   \endcode
+ */
+size_t JSON_API serializedSize(Value const& root,
+                               StreamWriterBuilder const& builder);
+
+/** \brief Write \a root to \a sout as writeString(builder, root) does, on
+ * \a executor.
+ *
+ * Arrays and objects with many elements, and those near the root that have
+ * only a few, are written in chunks of elements, each on a task of its own,
+ * and put back in order. The output is the same, byte for byte. The calling
+ * thread writes what surrounds the chunks, and only a few chunks per thread
+ * are held in memory at a time.
+ */
+void JSON_API parallelWrite(StreamWriterBuilder const& builder,
+                            Value const& root, Executor& executor,
+                            OStream& sout);
+
+/// \brief Same as writeString(builder, root), written on \a executor.
+/// \see parallelWrite()
+String JSON_API parallelWriteString(StreamWriterBuilder const& builder,
+                                    Value const& root, Executor& executor);
+
+/** \brief The settings of a StreamWriterBuilder, read and checked once.
+ *
+ * StreamWriterBuilder::newStreamWriter() looks up each of its settings every
+ * time. A StreamWriterConfig does so once, when it is constructed, and does
+ * not change after that, so one can be shared by any number of threads.
+ *
+ * write() reuses a writer kept by the calling thread, so that writing a small
+ * Value costs no more than the writing itself. Each thread keeps the writer of
+ * the last config it wrote with.
+ *
+ * Usage:
+ *   \code
+ *   Json::StreamWriterBuilder builder;
+ *   builder["indentation"] = "";
+ *   static const Json::StreamWriterConfig config(builder);
+ *   Json::String message = config.write(value);
+ *   \endcode
+ */
+class JSON_API StreamWriterConfig : public StreamWriter::Factory {
+public:
+  /// \throw std::exception for invalid settings, as newStreamWriter() does.
+  explicit StreamWriterConfig(StreamWriterBuilder const& builder);
+  ~StreamWriterConfig() override;
+
+  StreamWriter* newStreamWriter() const override;
+
+  /// Same as writeString(*this, root).
+  String write(Value const& root) const;
+  /// Write \a root to \a sout.
+  void write(Value const& root, OStream* sout) const;
+  /// Same as serializedSize(root, builder), for the builder of this config.
+  size_t serializedSize(Value const& root) const;
+  /** Write \a root to [out, out + size), as a single pass into memory the
+   * caller sized with serializedSize(). Return the number of characters
+   * written, serializedSize(root).
+   * \throw std::exception if \a size is less than that.
+   */
+  size_t write(Value const& root, char* out, size_t size) const;
+
+  /// The config of a default StreamWriterBuilder.
+  static StreamWriterConfig const& defaults();
+
+private:
+  class Impl;
+  std::shared_ptr<Impl const> impl_;
+};
+
+/** \brief Write JSON from a sequence of calls, without building a Value.
+ *
+ * The output is the same, byte for byte, as writing the equivalent Value
+ * with a StreamWriter from the same StreamWriterBuilder, and it is written
+ * as the calls are made. Only the nesting of the open arrays and objects is
+ * kept, plus, with "commentStyle" "None", the elements of one short array
+ * that may still fit on a single line. So millions of rows can be written
+ * in constant memory.
+ *
+ * Usage:
+ *   \code
+ *   Json::StreamingWriter writer(Json::StreamWriterBuilder(), std::cout);
+ *   writer.beginObject();
+ *   writer.key("rows");
+ *   writer.beginArray();
+ *   for (const Row& row : rows) {
+ *     writer.beginObject();
+ *     writer.key("id");
+ *     writer.value(row.id);
+ *     writer.endObject();
+ *   }
+ *   writer.endArray();
+ *   writer.endObject();
+ *   \endcode
+ *
+ * Calls that would not produce a single JSON value, such as a value in an
+ * object without a key or a second root value, throw.
+ */
+class JSON_API StreamingWriter {
+public:
+  /// Write to \a sout, which must outlive the writer.
+  StreamingWriter(StreamWriterBuilder const& builder, OStream& sout);
+  /// Append to \a out, which must outlive the writer.
+  StreamingWriter(StreamWriterBuilder const& builder, String* out);
+  ~StreamingWriter();
+  StreamingWriter(const StreamingWriter&) = delete;
+  StreamingWriter& operator=(const StreamingWriter&) = delete;
+
+  void beginObject();
+  void endObject();
+  void beginArray();
+  void endArray();
+
+  /// Name the next member of the current object.
+  /// \param begin, end may contain embedded nulls.
+  void key(const char* begin, const char* end);
+  void key(const char* name);
+  void key(const String& name);
+
+  void null();
+  void value(bool value);
+  void value(Int value);
+  void value(UInt value);
+#if defined(JSON_HAS_INT64)
+  void value(Int64 value);
+  void value(UInt64 value);
+#endif // if defined(JSON_HAS_INT64)
+  void value(double value);
+  /// \param begin, end may contain embedded nulls.
+  void value(const char* begin, const char* end);
+  void value(const char* value);
+  void value(const String& value);
+  /// Write a whole Value, without its comments.
+  void value(const Value& value);
+
+  /** Write [begin, end) as it is, as a scalar. It must be a single JSON
+   * number, string, or literal, such as a number kept as it was read.
+   */
+  void rawValue(const char* begin, const char* end);
+
+  /** Give the next value (commentBefore) or the value just written
+   * (commentAfterOnSameLine, commentAfter) a comment, which is written where
+   * StreamWriter would write that comment of a Value. As with
+   * Value::setComment(), it must start with "/", and a trailing newline is
+   * dropped. With "commentStyle" "None", comments are not written.
+   */
+  void comment(const char* begin, const char* end, CommentPlacement placement);
+  void comment(const String& comment, CommentPlacement placement);
+
+  /// Return true once a complete root value has been written.
+  bool done() const;
+
+private:
+  class Impl;
+  std::unique_ptr<Impl> impl_;
+};
+
+/** \brief Build a StreamWriter that encodes a Value as MessagePack.
+ *
+ * The encoding is binary and more compact than JSON text, and cheaper to
+ * write and read. MsgPackReaderBuilder reads it back into an equal Value:
+ * - intValue uses the fixint and int formats, and uintValue always uses the
+ *   uint formats, so that the two stay distinct.
+ * - realValue is always a float 64, so no precision is lost.
+ * - Objects are maps with string keys, in the order of Value's iterators.
+ * Comments and offsets are not encoded.
+ *
+ * Usage:
+ *   \code
+ *   Json::MsgPackWriterBuilder builder;
+ *   Json::String bytes = Json::writeString(builder, value);
+ *   \endcode
+ *
+ * \sa https://github.com/msgpack/msgpack/blob/master/spec.md
+ */
+class JSON_API MsgPackWriterBuilder : public StreamWriter::Factory {
+public:
+  MsgPackWriterBuilder();
+  ~MsgPackWriterBuilder() override;
+
+  StreamWriter* newStreamWriter() const override;
+};
+
 /** \brief Abstract class for writers.
  * \deprecated Use StreamWriter. (And really, this is an implementation detail.)
  */
@@ -0,0 +1,826 @@
+// Copyright 2007-2010 Baptiste Lepilleur and The JsonCpp Authors
+// Distributed under MIT license, or public domain if desired and
+// recognized in your jurisdiction.
+// See file LICENSE for detail or copy at http://jsoncpp.sourceforge.net/LICENSE
+
+/* Micro-benchmarks for JsonCpp, built with -DJSONCPP_WITH_BENCHMARKS=ON.
+ *
+ * Usage: jsoncpp_bench [name...]
+ * Runs every benchmark, or only those whose name contains one of the
+ * arguments. Each line reports the best of a few runs, and its speedup
+ * relative to the first line of the same benchmark.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <json/json.h>
+#include <memory>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+const int runs = 5;
+
+// Best wall-clock time of `runs` calls to \a fn, after one warm-up call, in
+// milliseconds. \a reset is called after each call, outside the timed region.
+double bestOf(const std::function<void()>& fn,
+              const std::function<void()>& reset = nullptr) {
+  fn();
+  if (reset)
+    reset();
+  double best = 0;
+  for (int i = 0; i < runs; ++i) {
+    auto start = Clock::now();
+    fn();
+    std::chrono::duration<double, std::milli> elapsed = Clock::now() - start;
+    if (i == 0 || elapsed.count() < best)
+      best = elapsed.count();
+    if (reset)
+      reset();
+  }
+  return best;
+}
+
+void report(const char* name, const Json::String& variant, double ms,
+            double baselineMs) {
+  printf("%-16s %-44s %10.3f ms %8.2fx\n", name, variant.c_str(), ms,
+         baselineMs / ms);
+  fflush(stdout);
+}
+
+// Thread counts to measure: 1, 2, 4, ... up to the hardware concurrency.
+std::vector<unsigned> threadCounts() {
+  unsigned hardware = std::max(1u, std::thread::hardware_concurrency());
+  std::vector<unsigned> counts;
+  for (unsigned n = 1; n < hardware; n *= 2)
+    counts.push_back(n);
+  counts.push_back(hardware);
+  return counts;
+}
+
+// An array of \a count records, each an object with a few scalars, strings
+// and a small nested array, similar to a typical configuration snapshot.
+Json::Value makeRecords(unsigned count) {
+  Json::Value root(Json::arrayValue);
+  for (unsigned i = 0; i < count; ++i) {
+    Json::Value& record = root.append(Json::Value(Json::objectValue));
+    record["id"] = i;
+    record["name"] = "record-" + std::to_string(i);
+    record["enabled"] = i % 3 != 0;
+    record["weight"] = i * 0.25;
+    record["description"] =
+        "A moderately long string value that needs its own allocation.";
+    Json::Value& tags = record["tags"];
+    for (unsigned j = 0; j < 4; ++j)
+      tags.append("tag-" + std::to_string((i + j) % 17));
+  }
+  return root;
+}
+
+void benchCopy() {
+  const Json::Value doc = makeRecords(200000);
+  Json::Value copy;
+  auto reset = [&] { copy = Json::Value(); };
+  double serial = bestOf([&] { copy = Json::Value(doc); }, reset);
+  report("copy", "Value(const Value&)", serial, serial);
+  for (unsigned threads : threadCounts()) {
+    Json::ThreadPoolExecutor pool(threads);
+    double ms = bestOf([&] { copy = Json::parallelCopy(doc, pool); }, reset);
+    report("copy", "parallelCopy, " + std::to_string(threads) + " threads",
+           ms, serial);
+  }
+}
+
+void benchEquals() {
+  const Json::Value doc = makeRecords(200000);
+  const Json::Value same(doc);
+  bool equal = false;
+  double serial = bestOf([&] { equal = doc == same; });
+  report("equals", "operator==", serial, serial);
+  for (unsigned threads : threadCounts()) {
+    Json::ThreadPoolExecutor pool(threads);
+    double ms = bestOf([&] { equal = Json::parallelEquals(doc, same, pool); });
+    report("equals", "parallelEquals, " + std::to_string(threads) + " threads",
+           ms, serial);
+  }
+  if (!equal)
+    printf("equals: unexpected mismatch\n");
+}
+
+void benchParallelWrite() {
+  const Json::Value doc = makeRecords(200000);
+  Json::StreamWriterBuilder builder;
+  Json::String out;
+  double serial = bestOf([&] { out = Json::writeString(builder, doc); });
+  report("write", "writeString", serial, serial);
+  const Json::String expected = out;
+  for (unsigned threads : threadCounts()) {
+    Json::ThreadPoolExecutor pool(threads);
+    double ms = bestOf(
+        [&] { out = Json::parallelWriteString(builder, doc, pool); });
+    report("write",
+           "parallelWriteString, " + std::to_string(threads) + " threads", ms,
+           serial);
+  }
+  if (out != expected)
+    printf("write: unexpected mismatch\n");
+}
+
+void benchParallelParse() {
+  Json::StreamWriterBuilder writer;
+  const Json::String text = Json::writeString(writer, makeRecords(200000));
+  Json::CharReaderBuilder builder;
+  Json::Value root;
+  auto reset = [&] { root = Json::Value(); };
+  double serial = bestOf(
+      [&] {
+        Json::CharReaderConfig(builder).parse(
+            text.data(), text.data() + text.size(), &root, nullptr);
+      },
+      reset);
+  report("parallel-parse", "CharReader::parse", serial, serial);
+  for (unsigned threads : threadCounts()) {
+    Json::ThreadPoolExecutor pool(threads);
+    double ms = bestOf(
+        [&] {
+          Json::parallelParse(builder, text.data(), text.data() + text.size(),
+                              pool, &root, nullptr);
+        },
+        reset);
+    report("parallel-parse",
+           "parallelParse, " + std::to_string(threads) + " threads", ms,
+           serial);
+  }
+}
+
+void benchFrozen() {
+  const Json::Value records = makeRecords(100000);
+  Json::Value doc(Json::objectValue);
+  std::vector<Json::String> keys;
+  for (unsigned i = 0; i < records.size(); ++i) {
+    keys.push_back("key-" + std::to_string(i * 7919 % records.size()));
+    doc[keys.back()] = records[i];
+  }
+  long sum = 0;
+  double tree = bestOf([&] {
+    for (const auto& key : keys)
+      sum += doc[key]["id"].asInt();
+  });
+  report("frozen", "Value lookups", tree, tree);
+  Json::FrozenDocument frozen(doc);
+  Json::FrozenValue root = frozen.root();
+  double flat = bestOf([&] {
+    for (const auto& key : keys)
+      sum += root[key]["id"].asInt();
+  });
+  report("frozen", "FrozenValue lookups", flat, tree);
+  double build = bestOf([&] { Json::FrozenDocument copy(doc); });
+  report("frozen", "FrozenDocument(const Value&)", build, build);
+  if (sum == 0)
+    printf("frozen: unexpected sum\n");
+}
+
+void benchLazy() {
+  Json::Value doc(Json::objectValue);
+  doc["status"] = "ok";
+  doc["records"] = makeRecords(50000);
+  doc["next"] = "cursor-50000";
+  const Json::String text = Json::writeString(Json::StreamWriterBuilder(), doc);
+  const char* begin = text.data();
+  const char* end = begin + text.size();
+  Json::CharReaderBuilder builder;
+  Json::String fields;
+  double full = bestOf([&] {
+    std::unique_ptr<Json::CharReader> reader(builder.newCharReader());
+    Json::Value root;
+    reader->parse(begin, end, &root, nullptr);
+    fields = root["status"].asString() + root["next"].asString() +
+             root["records"][100]["name"].asString();
+  });
+  const Json::String size = std::to_string(text.size() >> 20) + " MB";
+  report("lazy", "CharReader, 3 fields of " + size, full, full);
+  double lazy = bestOf([&] {
+    Json::LazyDocument lazyDoc(builder);
+    lazyDoc.parse(begin, end, nullptr);
+    Json::LazyValue root = lazyDoc.root();
+    fields = root["status"].toValue().asString() +
+             root["next"].toValue().asString() +
+             root["records"][100]["name"].toValue().asString();
+  });
+  report("lazy", "LazyDocument, same fields", lazy, full);
+  if (fields.empty())
+    printf("lazy: unexpected empty fields\n");
+}
+
+// Size and speed of MessagePack against compact JSON text.
+void benchMsgPack() {
+  const Json::Value records = makeRecords(100000);
+  Json::StreamWriterBuilder textWriter;
+  textWriter["indentation"] = "";
+  Json::MsgPackWriterBuilder binaryWriter;
+  Json::CharReaderBuilder textReader;
+  Json::MsgPackReaderBuilder binaryReader;
+  struct Format {
+    const char* name;
+    Json::StreamWriter::Factory* writer;
+    Json::CharReader::Factory* reader;
+  };
+  double writeBaseline = 0;
+  double readBaseline = 0;
+  for (const Format& format : {Format{"JSON", &textWriter, &textReader},
+                               Format{"MessagePack", &binaryWriter,
+                                      &binaryReader}}) {
+    Json::String bytes;
+    double ms =
+        bestOf([&] { bytes = Json::writeString(*format.writer, records); });
+    if (!writeBaseline)
+      writeBaseline = ms;
+    const Json::String size = ", " + std::to_string(bytes.size() >> 10) + " KB";
+    report("msgpack", Json::String("write ") + format.name + size, ms,
+           writeBaseline);
+    std::unique_ptr<Json::CharReader> reader(format.reader->newCharReader());
+    Json::Value root;
+    ms = bestOf([&] {
+      reader->parse(bytes.data(), bytes.data() + bytes.size(), &root, nullptr);
+    });
+    if (!readBaseline)
+      readBaseline = ms;
+    report("msgpack", Json::String("parse ") + format.name, ms, readBaseline);
+    // JSON text does not keep uintValue apart from intValue.
+    if (format.reader == &binaryReader && root != records)
+      printf("msgpack: %s does not round-trip\n", format.name);
+  }
+}
+
+// Reloading a large document: parsing its text, against copying or viewing
+// a snapshot of it.
+void benchSnapshot() {
+  const Json::Value records = makeRecords(200000);
+  Json::StreamWriterBuilder writer;
+  writer["indentation"] = "";
+  const Json::String text = Json::writeString(writer, records);
+  std::ostringstream out;
+  Json::FrozenDocument(records).writeSnapshot(out);
+  const Json::String bytes = out.str();
+  std::vector<uint64_t> aligned((bytes.size() + 7) / 8);
+  memcpy(aligned.data(), bytes.data(), bytes.size());
+  const char* begin = reinterpret_cast<const char*>(aligned.data());
+  const char* end = begin + bytes.size();
+
+  Json::CharReaderBuilder builder;
+  std::unique_ptr<Json::CharReader> reader(builder.newCharReader());
+  Json::Value root;
+  double parse = bestOf([&] {
+    reader->parse(text.data(), text.data() + text.size(), &root, nullptr);
+  });
+  report("snapshot",
+         "parse " + std::to_string(text.size() >> 20) + " MB of text", parse,
+         parse);
+  Json::FrozenDocument doc;
+  double copy = bestOf([&] { doc.readSnapshot(begin, end, nullptr); });
+  report("snapshot",
+         "readSnapshot, " + std::to_string(bytes.size() >> 20) + " MB", copy,
+         parse);
+  Json::FrozenValue view;
+  double inPlace = bestOf(
+      [&] { Json::FrozenDocument::viewSnapshot(begin, end, &view, nullptr); });
+  report("snapshot", "viewSnapshot", inPlace, parse);
+  double toValue = bestOf([&] { root = view.toValue(); });
+  report("snapshot", "viewSnapshot, then toValue()", inPlace + toValue, parse);
+  if (root != records)
+    printf("snapshot: does not round-trip\n");
+}
+
+const char* const corpus[] = {
+#include "corpus.inc"
+};
+
+// Parses \a documents with the default settings minus comments, plus
+// failIfExtra, with and without "structuralIndex".
+void compareReaders(const char* name, const Json::String& what,
+                    const std::vector<Json::String>& documents) {
+  size_t bytes = 0;
+  for (const auto& document : documents)
+    bytes += document.size();
+  double baseline = 0;
+  for (bool structural : {false, true}) {
+    Json::CharReaderBuilder builder;
+    builder["allowComments"] = false;
+    builder["failIfExtra"] = true;
+    builder["structuralIndex"] = structural;
+    std::unique_ptr<Json::CharReader> reader(builder.newCharReader());
+    Json::Value root;
+    double ms = bestOf([&] {
+      for (const auto& document : documents)
+        reader->parse(document.data(), document.data() + document.size(),
+                      &root, nullptr);
+    });
+    if (!structural)
+      baseline = ms;
+    char throughput[32];
+    snprintf(throughput, sizeof(throughput), ", %.0f MB/s",
+             double(bytes) / 1e3 / ms);
+    report(name,
+           what + (structural ? ", structural" : ", OurReader") + throughput,
+           ms, baseline);
+  }
+}
+
+void benchParse() {
+  std::vector<Json::String> documents;
+  for (const char* path : corpus) {
+    // Skip the documents meant to fail, one of which throws.
+    if (strstr(path, "/fail_"))
+      continue;
+    std::ifstream file(path, std::ios::binary);
+    std::ostringstream text;
+    text << file.rdbuf();
+    documents.push_back(text.str());
+  }
+  // The test documents are tiny: parse each of them many times.
+  std::vector<Json::String> repeated;
+  for (int i = 0; i < 200; ++i)
+    repeated.insert(repeated.end(), documents.begin(), documents.end());
+  compareReaders("parse", "test/data", repeated);
+
+  const Json::Value records = makeRecords(100000);
+  Json::StreamWriterBuilder compact;
+  compact["indentation"] = "";
+  compareReaders("parse", "records", {Json::writeString(compact, records)});
+  compareReaders("parse", "records, indented",
+                 {Json::writeString(Json::StreamWriterBuilder(), records)});
+}
+
+// Checking strict-mode documents with validate(), against parsing them.
+void benchValidate() {
+  Json::Value records = makeRecords(100000);
+  Json::StreamWriterBuilder compact;
+  compact["indentation"] = "";
+  Json::Value strings(Json::arrayValue);
+  for (unsigned i = 0; i < 100000; ++i)
+    strings.append(Json::String(200, char('a' + i % 26)));
+  // One object with many members, each checked against the others.
+  Json::Value wide(Json::objectValue);
+  for (unsigned i = 0; i < 200000; ++i)
+    wide["member " + std::to_string(i)] = i;
+  for (const auto& doc : {std::make_pair("records", &records),
+                          std::make_pair("strings", &strings),
+                          std::make_pair("a wide object", &wide)}) {
+    const Json::String text = Json::writeString(compact, *doc.second);
+    char const* const begin = text.data();
+    char const* const end = begin + text.size();
+    Json::String const size =
+        std::to_string(text.size() / 1000000) + " MB of " + doc.first;
+    double baseline = 0;
+    for (bool structuralIndex : {false, true}) {
+      Json::CharReaderBuilder builder;
+      Json::CharReaderBuilder::strictMode(&builder.settings_);
+      builder["structuralIndex"] = structuralIndex;
+      std::unique_ptr<Json::CharReader> reader(builder.newCharReader());
+      Json::String const variant =
+          size + (structuralIndex ? ", indexed" : "");
+      Json::ParseError error;
+      Json::Value root;
+      double ms = bestOf([&] { reader->tryParse(begin, end, &root, &error); });
+      if (!structuralIndex)
+        baseline = ms;
+      report("validate", variant + ", tryParse", ms, baseline);
+      ms = bestOf([&] { reader->validate(begin, end, &error); });
+      report("validate", variant + ", validate", ms, baseline);
+      if (error.code != Json::ParseError::none)
+        printf("validate: %s\n", error.message());
+    }
+  }
+}
+
+// Cost of "validateUTF8" when parsing ASCII and mostly CJK documents.
+void benchUtf8() {
+  Json::Value ascii = makeRecords(50000);
+  Json::Value cjk(Json::arrayValue);
+  for (unsigned i = 0; i < 50000; ++i)
+    cjk.append("\xE4\xB8\xAD\xE6\x96\x87\xE6\x96\x87\xE6\x9C\xAC "
+               "\xE3\x83\x86\xE3\x82\xB9\xE3\x83\x88 "
+               "\xED\x85\x8C\xEC\x8A\xA4\xED\x8A\xB8 " +
+               std::to_string(i));
+  Json::StreamWriterBuilder writer;
+  writer["emitUTF8"] = true;
+  for (const auto& doc : {std::make_pair("ascii", &ascii),
+                          std::make_pair("cjk", &cjk)}) {
+    const Json::String text = Json::writeString(writer, *doc.second);
+    double baseline = 0;
+    for (bool validate : {false, true}) {
+      Json::CharReaderBuilder builder;
+      builder["validateUTF8"] = validate;
+      std::unique_ptr<Json::CharReader> reader(builder.newCharReader());
+      Json::Value root;
+      double ms = bestOf([&] {
+        reader->parse(text.data(), text.data() + text.size(), &root, nullptr);
+      });
+      if (!validate)
+        baseline = ms;
+      report("utf8",
+             Json::String(doc.first) + (validate ? ", validateUTF8" : ""), ms,
+             baseline);
+    }
+  }
+}
+
+// Writing strings that need escaping, with and without "emitUTF8".
+void benchEscape() {
+  Json::Value cjk(Json::arrayValue);
+  for (unsigned i = 0; i < 50000; ++i)
+    cjk.append("\xE4\xB8\xAD\xE6\x96\x87\xE6\x96\x87\xE6\x9C\xAC\xE3\x83\x86"
+               "\xE3\x82\xB9\xE3\x83\x88\xED\x85\x8C\xEC\x8A\xA4\xED\x8A\xB8 "
+               "\xF0\x9F\x98\x80 \"quoted\"\ttab " +
+               std::to_string(i));
+  for (bool emitUTF8 : {false, true}) {
+    Json::StreamWriterBuilder builder;
+    builder["indentation"] = "";
+    builder["emitUTF8"] = emitUTF8;
+    Json::String text;
+    double ms = bestOf([&] { text = Json::writeString(builder, cjk); });
+    char variant[64];
+    snprintf(variant, sizeof(variant), "cjk%s, %.0f MB/s",
+             emitUTF8 ? ", emitUTF8" : "", double(text.size()) / 1e3 / ms);
+    report("escape", variant, ms, ms);
+  }
+}
+
+// Writing and parsing integer ids and counters of various magnitudes.
+void benchIntegers() {
+  Json::Value numbers(Json::arrayValue);
+  for (unsigned i = 0; i < 1000000; ++i) {
+    if (i % 2)
+      numbers.append(Json::UInt64(i) * 2654435761U);
+    else
+      numbers.append(-Json::Int64(i % 100000));
+  }
+  Json::StreamWriterBuilder builder;
+  builder["indentation"] = "";
+  Json::String text;
+  double ms = bestOf([&] { text = Json::writeString(builder, numbers); });
+  char variant[64];
+  snprintf(variant, sizeof(variant), "write 1M integers, %.0f MB/s",
+           double(text.size()) / 1e3 / ms);
+  report("integers", variant, ms, ms);
+
+  Json::CharReaderBuilder readerBuilder;
+  std::unique_ptr<Json::CharReader> reader(readerBuilder.newCharReader());
+  Json::Value root;
+  ms = bestOf([&] {
+    reader->parse(text.data(), text.data() + text.size(), &root, nullptr);
+  });
+  snprintf(variant, sizeof(variant), "parse 1M integers, %.0f MB/s",
+           double(text.size()) / 1e3 / ms);
+  report("integers", variant, ms, ms);
+}
+
+// Writing the records of makeRecords() as they are produced, against building
+// the Value first. Both give the same text.
+void benchStreaming() {
+  const unsigned count = 200000;
+  Json::StreamWriterBuilder builder;
+  builder["commentStyle"] = "None";
+  builder["indentation"] = "  ";
+  Json::String viaValue;
+  double baseline = bestOf(
+      [&] { viaValue = Json::writeString(builder, makeRecords(count)); });
+  report("streaming", "makeRecords + writeString", baseline, baseline);
+
+  Json::String streamed;
+  double ms = bestOf(
+      [&] {
+        Json::StreamingWriter writer(builder, &streamed);
+        writer.beginArray();
+        for (unsigned i = 0; i < count; ++i) {
+          writer.beginObject();
+          writer.key("description");
+          writer.value(
+              "A moderately long string value that needs its own allocation.");
+          writer.key("enabled");
+          writer.value(i % 3 != 0);
+          writer.key("id");
+          writer.value(i);
+          writer.key("name");
+          writer.value("record-" + std::to_string(i));
+          writer.key("tags");
+          writer.beginArray();
+          for (unsigned j = 0; j < 4; ++j)
+            writer.value("tag-" + std::to_string((i + j) % 17));
+          writer.endArray();
+          writer.key("weight");
+          writer.value(i * 0.25);
+          writer.endObject();
+        }
+        writer.endArray();
+      },
+      [&] { streamed.clear(); });
+  report("streaming", "StreamingWriter", ms, baseline);
+
+  Json::StreamingWriter check(builder, &streamed);
+  check.value(makeRecords(count));
+  if (streamed != viaValue)
+    printf("streaming: output differs\n");
+}
+
+// Writing and parsing many small messages, where setting up a writer or a
+// reader costs as much as the work itself.
+void benchConfig() {
+  const unsigned count = 200000;
+  Json::Value message;
+  message["id"] = 12345;
+  message["name"] = "sensor-7";
+  message["ok"] = true;
+  message["value"] = 21.5;
+  Json::StreamWriterBuilder writerBuilder;
+  writerBuilder["indentation"] = "";
+  const Json::StreamWriterConfig writerConfig(writerBuilder);
+  Json::String text;
+  double baseline = bestOf([&] {
+    for (unsigned i = 0; i < count; ++i)
+      text = Json::writeString(writerBuilder, message);
+  });
+  report("config", "write 200k messages, writeString", baseline, baseline);
+  double ms = bestOf([&] {
+    for (unsigned i = 0; i < count; ++i)
+      text = writerConfig.write(message);
+  });
+  report("config", "write 200k messages, StreamWriterConfig", ms, baseline);
+
+  Json::CharReaderBuilder readerBuilder;
+  const Json::CharReaderConfig readerConfig(readerBuilder);
+  Json::Value root;
+  baseline = bestOf([&] {
+    for (unsigned i = 0; i < count; ++i) {
+      std::unique_ptr<Json::CharReader> reader(readerBuilder.newCharReader());
+      reader->parse(text.data(), text.data() + text.size(), &root, nullptr);
+    }
+  });
+  report("config", "parse 200k messages, newCharReader", baseline, baseline);
+  ms = bestOf([&] {
+    for (unsigned i = 0; i < count; ++i)
+      readerConfig.parse(text.data(), text.data() + text.size(), &root,
+                         nullptr);
+  });
+  report("config", "parse 200k messages, CharReaderConfig", ms, baseline);
+}
+
+// A validator that rejects as many messages as it accepts, each one at its
+// last member, reporting the errors as messages or as ParseError codes.
+void benchReject() {
+  const unsigned count = 200000;
+  const Json::String valid =
+      R"({"id":12345,"name":"sensor-7","ok":true,"value":21.5})";
+  const Json::String invalid[] = {
+      R"({"id":12345,"name":"sensor-7","ok":true "value":21.5})",
+      R"({"id":12345,"name":"sensor-7","ok":true,"id":21.5})",
+      R"({"id":12345,"name":"sensor-7","ok":true,"value":"\q"})",
+      R"({"id":12345,"name":"sensor-7","ok":true,"value":-})",
+  };
+  Json::CharReaderBuilder builder;
+  Json::CharReaderBuilder::strictMode(&builder.settings_);
+  const Json::CharReaderConfig config(builder);
+  Json::Value root;
+  size_t rejected = 0;
+  double baseline = bestOf([&] {
+    for (unsigned i = 0; i < count; ++i)
+      rejected += !config.parse(valid.data(), valid.data() + valid.size(),
+                                &root, nullptr);
+  });
+  report("reject", "accept 200k messages", baseline, baseline);
+  Json::String errs;
+  double ms = bestOf([&] {
+    for (unsigned i = 0; i < count; ++i) {
+      const Json::String& doc = invalid[i % 4];
+      rejected += !config.parse(doc.data(), doc.data() + doc.size(), &root,
+                                &errs);
+    }
+  });
+  report("reject", "reject 200k messages, parse", ms, baseline);
+  ms = bestOf([&] {
+    for (unsigned i = 0; i < count; ++i) {
+      const Json::String& doc = invalid[i % 4];
+      Json::ParseError error;
+      rejected += !config.tryParse(doc.data(), doc.data() + doc.size(), &root,
+                                   &error);
+    }
+  });
+  report("reject", "reject 200k messages, tryParse", ms, baseline);
+  if (rejected == 0)
+    printf("reject: nothing rejected\n");
+}
+
+// Parsing a configuration file with a comment on nearly every line, keeping
+// the comments or not.
+void benchComments() {
+  Json::String doc = "// A configuration file\n{\n";
+  for (unsigned i = 0; i < 100000; ++i) {
+    doc += "  // Setting " + std::to_string(i) + ", documented at length.\n";
+    if (i % 10 == 0)
+      doc += "  /* A second line\r\n     of commentary. */\r\n";
+    doc += "  \"setting" + std::to_string(i) + "\" : " + std::to_string(i) +
+           ", // in units\n";
+  }
+  doc += "  \"last\" : true\n}\n";
+  double baseline = 0;
+  for (bool collect : {false, true}) {
+    Json::CharReaderBuilder builder;
+    builder["collectComments"] = collect;
+    std::unique_ptr<Json::CharReader> reader(builder.newCharReader());
+    Json::Value root;
+    double ms = bestOf([&] {
+      reader->parse(doc.data(), doc.data() + doc.size(), &root, nullptr);
+    });
+    if (!collect)
+      baseline = ms;
+    report("comments", collect ? "collectComments" : "skip comments", ms,
+           baseline);
+  }
+}
+
+// Finding the line and column of values spread over a large document, as an
+// editor does, by scanning from the start each time or with a SourceMap.
+void benchSourceMap() {
+  Json::StreamWriterBuilder builder;
+  const Json::String doc = Json::writeString(builder, makeRecords(100000));
+  Json::CharReaderBuilder readerBuilder;
+  std::unique_ptr<Json::CharReader> reader(readerBuilder.newCharReader());
+  Json::Value root;
+  reader->parse(doc.data(), doc.data() + doc.size(), &root, nullptr);
+  std::vector<ptrdiff_t> offsets;
+  for (Json::ArrayIndex i = 0; i < root.size(); i += 100)
+    offsets.push_back(root[i]["id"].getOffsetStart());
+
+  long sum = 0;
+  double baseline = bestOf([&] {
+    for (ptrdiff_t offset : offsets) {
+      int line = 1;
+      for (ptrdiff_t i = 0; i < offset; ++i)
+        line += doc[size_t(i)] == '\n';
+      sum += line;
+    }
+  });
+  report("sourcemap", "1000 lookups, scan from the start", baseline,
+         baseline);
+  double ms = bestOf([&] {
+    Json::SourceMap map(doc.data(), doc.data() + doc.size());
+    for (ptrdiff_t offset : offsets) {
+      int line, column;
+      map.getLineAndColumn(offset, &line, &column);
+      sum += line;
+    }
+  });
+  report("sourcemap", "1000 lookups, SourceMap", ms, baseline);
+  if (sum == 0)
+    printf("sourcemap: no lines\n");
+}
+
+// Minifying and re-indenting a document read from a stream, through a Value
+// or token by token.
+void benchCursor() {
+  Json::StreamWriterBuilder writer;
+  const Json::String text = Json::writeString(writer, makeRecords(100000));
+  Json::CharReaderBuilder reader;
+  long sum = 0;
+  double baseline = bestOf([&] {
+    std::istringstream sin(text);
+    Json::Value root;
+    Json::parseFromStream(reader, sin, &root, nullptr);
+    for (const Json::Value& record : root)
+      sum += record["id"].asInt();
+  });
+  report("cursor", "parseFromStream, whole array", baseline, baseline);
+  double ms = bestOf([&] {
+    std::istringstream sin(text);
+    Json::Cursor cursor(reader, sin);
+    cursor.next();
+    Json::Value record;
+    while (cursor.next() == Json::Cursor::tokenObjectBegin &&
+           cursor.readValue(&record))
+      sum += record["id"].asInt();
+  });
+  report("cursor", "Cursor::readValue, a record at a time", ms, baseline);
+  ms = bestOf([&] {
+    std::istringstream sin(text);
+    Json::Cursor cursor(reader, sin);
+    cursor.next();
+    while (cursor.next() == Json::Cursor::tokenObjectBegin && cursor.skip())
+      ++sum;
+  });
+  report("cursor", "Cursor::skip", ms, baseline);
+  if (sum == 0)
+    printf("cursor: unexpected sum\n");
+}
+
+void benchReformat() {
+  Json::StreamWriterBuilder indent;
+  Json::StreamWriterBuilder minify;
+  minify["indentation"] = "";
+  Json::CharReaderBuilder reader;
+  const Json::Value records = makeRecords(100000);
+  struct Case {
+    const char* name;
+    Json::String text;
+    Json::StreamWriterBuilder const* writer;
+  };
+  const Case cases[] = {{"minify", writeString(indent, records), &minify},
+                        {"indent", writeString(minify, records), &indent}};
+  for (const Case& test : cases) {
+    Json::String const variant = std::to_string(test.text.size() / 1000000) +
+                                 " MB, " + test.name;
+    std::unique_ptr<Json::StreamWriter> writer(test.writer->newStreamWriter());
+    Json::String viaValue;
+    double baseline = bestOf([&] {
+      std::istringstream sin(test.text);
+      std::ostringstream sout;
+      Json::Value root;
+      Json::parseFromStream(reader, sin, &root, nullptr);
+      writer->write(root, &sout);
+      viaValue = sout.str();
+    });
+    report("reformat", variant + ", parse + write", baseline, baseline);
+    Json::String reformatted;
+    Json::ParseError error;
+    double ms = bestOf([&] {
+      std::istringstream sin(test.text);
+      std::ostringstream sout;
+      Json::reformat(reader, *test.writer, sin, sout, &error);
+      reformatted = sout.str();
+    });
+    report("reformat", variant + ", reformat", ms, baseline);
+    if (reformatted != viaValue)
+      printf("reformat: output differs\n");
+  }
+}
+
+// Writing a document into a buffer of the exact size, computed beforehand,
+// against writing it into a growing string.
+void benchSerializedSize() {
+  const Json::Value records = makeRecords(200000);
+  Json::StreamWriterBuilder builder;
+  const Json::StreamWriterConfig config(builder);
+  Json::String grown;
+  double baseline = bestOf([&] { grown = config.write(records); });
+  report("size", "write", baseline, baseline);
+  size_t size = 0;
+  double ms = bestOf([&] { size = config.serializedSize(records); });
+  report("size", "serializedSize", ms, baseline);
+  Json::String presized;
+  ms = bestOf([&] {
+    presized.assign(config.serializedSize(records), '\0');
+    config.write(records, &presized[0], presized.size());
+  });
+  report("size", "serializedSize + write to the buffer", ms, baseline);
+  if (size != grown.size() || presized != grown)
+    printf("size: output differs\n");
+}
+
+struct Benchmark {
+  const char* name;
+  void (*run)();
+};
+
+const Benchmark benchmarks[] = {
+    {"comments", benchComments},
+    {"config", benchConfig},
+    {"copy", benchCopy},
+    {"cursor", benchCursor},
+    {"equals", benchEquals},
+    {"escape", benchEscape},
+    {"frozen", benchFrozen},
+    {"integers", benchIntegers},
+    {"lazy", benchLazy},
+    {"parallel-parse", benchParallelParse},
+    {"msgpack", benchMsgPack},
+    {"parse", benchParse},
+    {"reformat", benchReformat},
+    {"reject", benchReject},
+    {"size", benchSerializedSize},
+    {"snapshot", benchSnapshot},
+    {"sourcemap", benchSourceMap},
+    {"streaming", benchStreaming},
+    {"utf8", benchUtf8},
+    {"validate", benchValidate},
+    {"write", benchParallelWrite},
+};
+
+} // namespace
+
+int main(int argc, const char* argv[]) {
+  for (const auto& benchmark : benchmarks) {
+    bool selected = argc < 2;
+    for (int i = 1; i < argc; ++i)
+      selected = selected || strstr(benchmark.name, argv[i]) != nullptr;
+    if (selected)
+      benchmark.run();
+  }
+  return 0;
+}
@@ -15,10 +15,12 @@
 
 #include <algorithm> // sort
 #include <cstdio>
+#include <cstring>
 #include <iostream>
 #include <json/json.h>
 #include <memory>
 #include <sstream>
+#include <vector>
 
 struct Options {
   Json::String path;
@@ -193,6 +195,32 @@ static Json::String useBuiltStyledStreamWriter(Json::Value const& root) {
   Json::StreamWriterBuilder builder;
   return Json::writeString(builder, root);
 }
+// Checks that root survives a snapshot round trip, both copied into a
+// FrozenDocument and viewed in place.
+static int checkSnapshot(const Json::Value& root) {
+  Json::OStringStream sout;
+  Json::FrozenDocument(root).writeSnapshot(sout);
+  Json::String const bytes = sout.str();
+  std::vector<std::uint64_t> aligned((bytes.size() + 7) / 8);
+  memcpy(aligned.data(), bytes.data(), bytes.size());
+  const char* begin = reinterpret_cast<const char*>(aligned.data());
+  const char* end = begin + bytes.size();
+  Json::String errors;
+  Json::FrozenDocument copy;
+  Json::FrozenValue view;
+  if (!copy.readSnapshot(begin, end, &errors) ||
+      !Json::FrozenDocument::viewSnapshot(begin, end, &view, &errors)) {
+    std::cerr << "Failed to read snapshot: " << std::endl
+              << errors << std::endl;
+    return 1;
+  }
+  if (copy.root().toValue() != root || view.toValue() != root) {
+    std::cerr << "Snapshot does not round-trip" << std::endl;
+    return 1;
+  }
+  return 0;
+}
+
 static int rewriteValueTree(const Json::String& rewritePath,
                             const Json::Value& root,
                             Options::writeFuncType write,
@@ -296,6 +324,10 @@ static int runTest(Options const& opts, bool use_legacy) {
   if (exitCode || opts.parseOnly) {
     return exitCode;
   }
+  exitCode = checkSnapshot(root);
+  if (exitCode) {
+    return exitCode;
+  }
 
   Json::String rewrite;
   exitCode = rewriteValueTree(rewritePath, root, opts.write, &rewrite);
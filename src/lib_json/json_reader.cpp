@@ -9,9 +9,11 @@
 #include <json/assertions.h>
 #include <json/reader.h>
 #include <json/value.h>
+#include <json/writer.h>
 #endif // if !defined(JSON_IS_AMALGAMATION)
 #include <algorithm>
 #include <cassert>
+#include <cmath>
 #include <cstring>
 #include <iostream>
 #include <istream>
@@ -20,6 +22,7 @@
 #include <set>
 #include <sstream>
 #include <utility>
+#include <vector>
 
 #include <cstdio>
 #if __cplusplus >= 201103L
@@ -870,6 +873,7 @@ public:
   bool rejectDupKeys_;
   bool allowSpecialFloats_;
   bool skipBom_;
+  bool validateUTF8_;
   size_t stackLimit_;
 }; // OurFeatures
 
@@ -878,6 +882,70 @@ OurFeatures OurFeatures::all() { return {}; }
 // Implementation of class Reader
 // ////////////////////////////////
 
+// The hashes of the member names of the objects being read, a stack of them
+// by object, looked up through an open-addressing table. Names are removed
+// in the reverse of the order they were added in, which with linear probing
+// only has to clear their slots. The memory is kept from one object and
+// one document to the next.
+class KeyTable {
+public:
+  size_t size() const { return hashes_.size(); }
+
+  // Whether a name from the \a first one on has \a hash, and is the same
+  // name to \a equal, called with its index.
+  template <typename Equal>
+  bool contains(uint64_t hash, size_t first, Equal equal) const {
+    if (slots_.empty())
+      return false;
+    size_t const mask = slots_.size() - 1;
+    for (size_t slot = slotOf(hash) & mask; slots_[slot];
+         slot = (slot + 1) & mask) {
+      size_t const index = slots_[slot] - 1;
+      if (index >= first && hashes_[index] == hash && equal(index))
+        return true;
+    }
+    return false;
+  }
+
+  void push(uint64_t hash) {
+    if (2 * (hashes_.size() + 1) > slots_.size()) {
+      slots_.assign(std::max<size_t>(64, 2 * slots_.size()), 0);
+      for (size_t index = 0; index < hashes_.size(); ++index)
+        insert(index);
+    }
+    hashes_.push_back(hash);
+    insert(hashes_.size() - 1);
+  }
+
+  // Removes the names after the first \a size ones.
+  void resize(size_t size) {
+    size_t const mask = slots_.size() - 1;
+    while (hashes_.size() > size) {
+      size_t slot = slotOf(hashes_.back()) & mask;
+      while (slots_[slot] != hashes_.size())
+        slot = (slot + 1) & mask;
+      slots_[slot] = 0;
+      hashes_.pop_back();
+    }
+  }
+
+private:
+  static size_t slotOf(uint64_t hash) {
+    return static_cast<size_t>(hash ^ (hash >> 32));
+  }
+  void insert(size_t index) {
+    size_t const mask = slots_.size() - 1;
+    size_t slot = slotOf(hashes_[index]) & mask;
+    while (slots_[slot])
+      slot = (slot + 1) & mask;
+    slots_[slot] = index + 1;
+  }
+
+  std::vector<uint64_t> hashes_;
+  // The index of the name in each slot plus one, or 0.
+  std::vector<size_t> slots_;
+};
+
 // Originally copied from the Reader class (now deprecated), used internally
 // for implementing JSON reading.
 class OurReader {
@@ -893,8 +961,41 @@ public:
   explicit OurReader(OurFeatures const& features);
   bool parse(const char* beginDoc, const char* endDoc, Value& root,
              bool collectComments = true);
+  // Reads the value starting at beginValue, a position inside the document
+  // [beginDoc, endDoc). Offsets and error locations are relative to beginDoc.
+  bool parse(const char* beginDoc, const char* beginValue, const char* endDoc,
+             Value& root, bool collectComments = true);
+  // Same as parse(), but indexes the structural characters of the whole
+  // document first. Requires allowComments, allowSingleQuotes,
+  // allowNumericKeys and allowDroppedNullPlaceholders to be false. Without
+  // a root, only validates the document.
+  bool parseStructural(const char* beginDoc, const char* endDoc, Value* root);
+  // Same as parse(), but only checks the document, without building a Value.
+  bool validate(const char* beginDoc, const char* endDoc);
+  // Same as parse(), but when the root is an array, first reads segments of
+  // it on \a executor, from where its elements are guessed to start.
+  bool parseParallel(const char* beginDoc, const char* endDoc, Value& root,
+                     bool collectComments, Executor& executor);
+  // Same as parse() and then writing the Value with \a writer, but reads
+  // \a sin a piece at a time and writes each value as it is read. Requires
+  // setFailFast().
+  bool reformat(IStream& sin, StreamingWriter& writer, bool collectComments);
+  // For Cursor: reads \a sin a token at a time, as parse() would read it.
+  // \a collectComments applies to the values read by readCursorValue().
+  // Requires setFailFast().
+  void beginCursor(IStream& sin, bool collectComments);
+  Cursor::Kind nextCursorToken();
+  // Moves past the value at the cursor, reading it into \a value if not
+  // null.
+  bool readCursorValue(Value* value);
+  Cursor::Kind cursorKind() const { return cursorKind_; }
+  String const& cursorName() const { return name_; }
+  ptrdiff_t cursorOffset() const { return documentOffset(pinned_); }
   String getFormattedErrorMessages() const;
   std::vector<StructuredError> getStructuredErrors() const;
+  // While \a error is set, the first error goes there instead, and parsing
+  // stops at it.
+  void setFailFast(ParseError* error) { failFast_ = error; }
 
 private:
   OurReader(OurReader const&);      // no impl
@@ -936,19 +1037,44 @@ private:
 
   using Errors = std::deque<ErrorInfo>;
 
+  // Elements of the root array read ahead by parseParallel(), from begin to
+  // end, and the comments they leave for the element after them. readArray()
+  // takes them in when it reaches begin, where they were read as it would
+  // read them.
+  struct Segment {
+    Location begin;
+    Location end;
+    std::deque<Value> elements;
+    String commentsBefore;
+    bool ok;
+  };
+
   bool readToken(Token& token);
   void skipSpaces();
   void skipBom(bool skipBom);
+  ptrdiff_t documentOffset(Location location) const {
+    return bomLength_ + streamOffset_ + (location - begin_);
+  }
   bool match(const Char* pattern, int patternLength);
   bool readComment();
+  void collectComment(Location begin, Location end, bool canBeOnSameLine);
   bool readCStyleComment(bool* containsNewLineResult);
   bool readCppStyleComment();
   bool readString();
   bool readStringSingleQuote();
   bool readNumber(bool checkInf);
   bool readValue();
+  bool readStructurals(Value& root);
+  bool validateStructurals();
+  bool validateValue(size_t depth, bool* isContainer);
+  bool validateObject(size_t depth);
+  bool validateArray(size_t depth);
+  bool validateNumber(Token& token);
   bool readObject(Token& token);
   bool readArray(Token& token);
+  bool takeSegment(int* index);
+  bool readSegment(const char* beginDoc, const char* endDoc,
+                   bool collectComments, Location limit, Segment& segment);
   bool decodeNumber(Token& token);
   bool decodeNumber(Token& token, Value& decoded);
   bool decodeString(Token& token);
@@ -960,21 +1086,44 @@ private:
   bool decodeUnicodeEscapeSequence(Token& token, Location& current,
                                    Location end, unsigned int& unicode);
   bool addError(const String& message, Token& token, Location extra = nullptr);
+  bool addError(ParseError::Code code, Token& token, Location extra = nullptr);
+  bool exceedLimit(ParseError::Code code, Token& token);
   bool recoverFromError(TokenType skipUntilToken);
   bool addErrorAndRecover(const String& message, Token& token,
                           TokenType skipUntilToken);
+  bool addErrorAndRecover(ParseError::Code code, Token& token,
+                          TokenType skipUntilToken);
   void skipUntilSpace();
   Value& currentValue();
   Char getNextChar();
-  void getLocationLineAndColumn(Location location, int& line,
-                                int& column) const;
-  String getLocationLineAndColumn(Location location) const;
   void addComment(Location begin, Location end, CommentPlacement placement);
   void skipCommentTokens(Token& token);
 
-  static String normalizeEOL(Location begin, Location end);
+  static void appendNormalizedEOL(String& out, Location begin, Location end);
   static bool containsNewLine(Location begin, Location end);
 
+  // A member name seen by validate(), with a hash of its decoded text.
+  struct Key {
+    Token token;
+    uint64_t hash;
+  };
+  bool validateString(Token& token, Key* key, size_t* length);
+  bool isDuplicateKey(size_t firstKey, Key const& key);
+  String keyName(Key const& key);
+
+  void readMore();
+  bool readStreamToken(Token& token);
+  void skipStreamSpaces();
+  void skipStreamCommentTokens(Token& token);
+  void reformatToken(Token& token);
+  void beginLater(String const* name, bool isObject);
+  void writePending();
+  Cursor::Kind readCursorName();
+  Cursor::Kind readCursorToken();
+  bool parseCursorValue(Location begin, Location end, size_t depth,
+                        Value& value);
+  Cursor::Kind failCursor();
+
   using Nodes = std::stack<Value*>;
 
   Nodes nodes_{};
@@ -987,13 +1136,103 @@ private:
   Value* lastValue_ = nullptr;
   bool lastValueHasAComment_ = false;
   String commentsBefore_{};
+  // A same-line comment whose line endings had to be converted.
+  String sameLineComment_{};
+  // Set by readNumber() for decodeNumber(): the end of the number token,
+  // its integral digits and whether they are the whole, in-range integer.
+  Location numberEnd_ = nullptr;
+  Value::LargestUInt numberMagnitude_ = 0;
+  bool numberIsInteger_ = false;
 
   OurFeatures const features_;
   bool collectComments_ = false;
+  std::vector<size_t> structurals_{};
+  // The names of the objects validate() is in, and the containers
+  // validateStructurals() is in, kept to reuse the memory. keyTable_ has
+  // the hashes of those names, or of the names of the objects a Cursor is
+  // in.
+  std::vector<Key> keys_{};
+  KeyTable keyTable_{};
+  struct Container {
+    bool isObject;
+    size_t firstKey;
+  };
+  std::vector<Container> containers_{};
+  ParseError* failFast_ = nullptr;
+  // The segments parseParallel() read ahead, by where they begin, and the
+  // first one parse() has not reached yet. readSegment() sets
+  // commentNeedsContext_ for a comment it cannot place without the elements
+  // before the segment.
+  std::vector<Segment>* segments_ = nullptr;
+  size_t nextSegment_ = 0;
+  bool commentNeedsContext_ = false;
+
+  // What a Cursor and reformat() read from, and what reformat() writes to.
+  // begin_, current_ and end_ are in buffer_, which holds the part of the
+  // input from begin_, at streamOffset_ in it, to end_.
+  IStream* input_ = nullptr;
+  StreamingWriter* writer_ = nullptr;
+  String buffer_{};
+  ptrdiff_t streamOffset_ = 0;
+  // The byte order mark skipBom() moved begin_ past, which offsets into the
+  // document count.
+  ptrdiff_t bomLength_ = 0;
+  bool inputDone_ = false;
+  // With validateUTF8, the end of the part of buffer_ that is valid so far,
+  // and the first invalid byte once there is one.
+  Location validEnd_ = nullptr;
+  Location invalidUTF8_ = nullptr;
+  // The name of the member being read, and the decoded text of a string
+  // with escapes.
+  String name_{};
+  String string_{};
+  // The containers reformat() has walked into but not yet given to
+  // writer_, with their names if they are members. The first pendingSize_
+  // are pending; the others are kept to reuse their names.
+  struct Pending {
+    bool isObject;
+    bool isMember;
+    String name;
+  };
+  std::vector<Pending> pending_{};
+  size_t pendingSize_ = 0;
+
+  // The containers a Cursor is in. open is, in an array, whether it has no
+  // element yet, and in an object, whether the last name was empty, as it
+  // is before the first one: readObject() then allows a closing '}'.
+  struct Level {
+    bool isObject;
+    bool open;
+    size_t firstName;
+  };
+  std::vector<Level> levels_{};
+  // What the token after the cursor may be.
+  enum CursorState {
+    cursorExpectValue,
+    cursorExpectName,
+    cursorAfterValue,
+    cursorDone
+  };
+  CursorState cursorState_ = cursorExpectValue;
+  Cursor::Kind cursorKind_ = Cursor::tokenEnd;
+  // The start of the token at the cursor, and of the container
+  // readCursorValue() is reading, kept in buffer_ by readMore(). At a
+  // scalar, cursorToken_ is its token.
+  Location pinned_ = nullptr;
+  Location valueBegin_ = nullptr;
+  Token cursorToken_{};
+  bool collectCursorComments_ = false;
 }; // OurReader
 
 // complete copy of Read impl, for OurReader
 
+// FNV-1a, to hash the member names validate() and a Cursor look for
+// duplicates of.
+static uint64_t const hashBasis = 0xcbf29ce484222325;
+static inline uint64_t hashByte(uint64_t hash, char c) {
+  return (hash ^ static_cast<unsigned char>(c)) * 0x100000001b3;
+}
+
 bool OurReader::containsNewLine(OurReader::Location begin,
                                 OurReader::Location end) {
   return std::any_of(begin, end, [](char b) { return b == '\n' || b == '\r'; });
@@ -1003,6 +1242,11 @@ OurReader::OurReader(OurFeatures const& features) : features_(features) {}
 
 bool OurReader::parse(const char* beginDoc, const char* endDoc, Value& root,
                       bool collectComments) {
+  return parse(beginDoc, beginDoc, endDoc, root, collectComments);
+}
+
+bool OurReader::parse(const char* beginDoc, const char* beginValue,
+                      const char* endDoc, Value& root, bool collectComments) {
   if (!features_.allowComments_) {
     collectComments = false;
   }
@@ -1010,7 +1254,7 @@ bool OurReader::parse(const char* beginDoc, const char* endDoc, Value& root,
   begin_ = beginDoc;
   end_ = endDoc;
   collectComments_ = collectComments;
-  current_ = begin_;
+  current_ = beginValue;
   lastValueEnd_ = nullptr;
   lastValue_ = nullptr;
   commentsBefore_.clear();
@@ -1020,43 +1264,695 @@ bool OurReader::parse(const char* beginDoc, const char* endDoc, Value& root,
   nodes_.push(&root);
 
   // skip byte order mark if it exists at the beginning of the UTF-8 text.
-  skipBom(features_.skipBom_);
+  skipBom(features_.skipBom_ && beginValue == beginDoc);
+  if (features_.validateUTF8_) {
+    Location invalid = validateUTF8(current_, end_);
+    if (invalid != end_) {
+      nodes_.pop();
+      Token token;
+      token.type_ = tokenError;
+      token.start_ = invalid;
+      token.end_ = invalid + 1;
+      return addError(ParseError::invalidUTF8, token);
+    }
+  }
   bool successful = readValue();
   nodes_.pop();
   Token token;
   skipCommentTokens(token);
   if (features_.failIfExtra_ && (token.type_ != tokenEndOfStream)) {
-    addError("Extra non-whitespace after JSON value.", token);
+    addError(ParseError::extraCharacters, token);
     return false;
   }
   if (collectComments_ && !commentsBefore_.empty())
-    root.setComment(commentsBefore_, commentAfter);
+    root.setComment(commentsBefore_.data(), commentsBefore_.size(),
+                    commentAfter);
   if (features_.strictRoot_) {
     if (!root.isArray() && !root.isObject()) {
       // Set error location to start of doc, ideally should be first token found
       // in doc
       token.type_ = tokenError;
-      token.start_ = beginDoc;
+      token.start_ = beginValue;
       token.end_ = endDoc;
-      addError(
-          "A valid JSON document must be either an array or an object value.",
-          token);
+      addError(ParseError::rootNotContainer, token);
       return false;
     }
   }
   return successful;
 }
 
+// The root array is read ahead in segments of at least this many bytes, and
+// up to this many segments per thread.
+static const size_t parallelParseMinSegment = 64 * 1024;
+static const size_t parallelParseSegmentsPerThread = 4;
+
+static inline const char* skipWhitespace(const char* current,
+                                         const char* end) {
+  while (current != end && (*current == ' ' || *current == '\t' ||
+                            *current == '\r' || *current == '\n'))
+    ++current;
+  return current;
+}
+
+// What kind of value an element starting with \a c is, or 0.
+static inline char elementKind(char c) {
+  switch (c) {
+  case '{':
+  case '[':
+  case '"':
+    return c;
+  case 't':
+  case 'f':
+  case 'n':
+    return 't';
+  default:
+    return (c >= '0' && c <= '9') || c == '-' ? '0' : 0;
+  }
+}
+
+// Whether a comma between the value ending with \a last and the one starting
+// with \a next may be between two elements of the root array, the first of
+// which starts with \a first: both start as it does, and containers end as
+// it would.
+static inline bool isElementStart(char last, char next, char first) {
+  char const close = first == '{' ? '}' : first == '[' ? ']' : 0;
+  return elementKind(next) == elementKind(first) && (!close || last == close);
+}
+
+// A guess at where an element of the root array starts, at or after \a from.
+// Whether \a from is in a string is guessed from the first quote after it,
+// which ends a string if ':', ',', ']' or '}' follows it. Returns \a end if
+// there is no such element.
+static const char* findElementStart(const char* from, const char* end,
+                                    char first) {
+  const char* current = from;
+  const char* quote = static_cast<const char*>(
+      memchr(from, '"', static_cast<size_t>(end - from)));
+  if (quote) {
+    const char* next = skipWhitespace(quote + 1, end);
+    if (next != end && memchr(":,]}", *next, 4))
+      current = quote + 1;
+  }
+  bool inString = false;
+  char last = 0;
+  for (; current < end; ++current) {
+    char const c = *current;
+    if (inString) {
+      if (c == '\\' && current + 1 != end)
+        ++current;
+      else if (c == '"')
+        inString = false;
+      continue;
+    }
+    switch (c) {
+    case '"':
+      inString = true;
+      last = c;
+      break;
+    case ' ':
+    case '\t':
+    case '\r':
+    case '\n':
+      break;
+    case ',': {
+      const char* next = skipWhitespace(current + 1, end);
+      if (next != end && isElementStart(last, *next, first))
+        return next;
+      last = c;
+    } break;
+    default:
+      last = c;
+    }
+  }
+  return end;
+}
+
+bool OurReader::parseParallel(const char* beginDoc, const char* endDoc,
+                              Value& root, bool collectComments,
+                              Executor& executor) {
+  const char* begin = beginDoc;
+  if (features_.skipBom_ && endDoc - beginDoc >= 3 &&
+      strncmp(beginDoc, "\xEF\xBB\xBF", 3) == 0)
+    begin += 3;
+  const char* first = skipWhitespace(begin, endDoc);
+  bool const isArray = first != endDoc && *first == '[';
+  if (isArray)
+    first = skipWhitespace(first + 1, endDoc);
+  size_t const size = static_cast<size_t>(endDoc - first);
+  size_t const count =
+      std::min(executor.concurrency() * parallelParseSegmentsPerThread,
+               size / parallelParseMinSegment);
+  // Each segment is looked for from its share of the array on, and is read
+  // up to where the next one is looked for.
+  std::vector<Segment> segments;
+  if (isArray && first != endDoc && elementKind(*first) != 0 &&
+      !features_.allowDroppedNullPlaceholders_ &&
+      executor.concurrency() > 1 && count > 1)
+    segments.resize(count);
+  if (!segments.empty()) {
+    auto from = [&](size_t i) {
+      return i < count ? first + size / count * i : endDoc;
+    };
+    executor.parallelFor(count, [&](size_t i) {
+      OurReader reader(features_);
+      // A limit fails the segment instead of throwing: parse() only throws
+      // if it reaches that far.
+      ParseError error;
+      reader.setFailFast(&error);
+      Segment& segment = segments[i];
+      segment.begin = first;
+      if (i == 0) {
+        reader.readSegment(begin, endDoc, collectComments, from(1), segment);
+        return;
+      }
+      for (const char* start = from(i);;) {
+        segment.begin = findElementStart(start, from(i + 1), *first);
+        if (segment.begin == from(i + 1) ||
+            reader.readSegment(begin, endDoc, collectComments, from(i + 1),
+                               segment))
+          break;
+        // The next guess is after what the failed read went through, so
+        // that the elements of a nested array are not read again from each
+        // of them. A failed read past the next segment ends this one.
+        if (reader.current_ >= from(i + 1))
+          break;
+        start = reader.current_;
+      }
+      if (!segment.ok)
+        segment.elements.clear();
+    });
+    segments_ = &segments;
+    nextSegment_ = 0;
+  }
+  bool const ok = parse(beginDoc, endDoc, root, collectComments);
+  segments_ = nullptr;
+  return ok;
+}
+
+// Bit masks of the bytes of a 64-byte block, one bit per byte.
+struct StructuralMasks {
+  uint64_t quote;
+  uint64_t backslash;
+  uint64_t op; // {}[]:,
+  uint64_t space;
+  uint64_t high; // not ASCII
+};
+
+static inline void classifyBlock(const char* block, StructuralMasks& masks) {
+  masks = StructuralMasks();
+#if defined(JSONCPP_HAS_SSE2)
+  for (unsigned chunk = 0; chunk < 4; ++chunk) {
+    __m128i const bytes =
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(block + 16 * chunk));
+    auto equal = [&bytes](char c) {
+      return _mm_cmpeq_epi8(bytes, _mm_set1_epi8(c));
+    };
+    auto bits = [chunk](__m128i matches) {
+      return uint64_t(unsigned(_mm_movemask_epi8(matches))) << (16 * chunk);
+    };
+    // Setting bit 5 maps '[' to '{' and ']' to '}'.
+    __m128i const folded = _mm_or_si128(bytes, _mm_set1_epi8(0x20));
+    __m128i const brackets =
+        _mm_or_si128(_mm_cmpeq_epi8(folded, _mm_set1_epi8('{')),
+                     _mm_cmpeq_epi8(folded, _mm_set1_epi8('}')));
+    masks.quote |= bits(equal('"'));
+    masks.backslash |= bits(equal('\\'));
+    masks.op |= bits(
+        _mm_or_si128(brackets, _mm_or_si128(equal(':'), equal(','))));
+    masks.space |=
+        bits(_mm_or_si128(_mm_or_si128(equal(' '), equal('\t')),
+                          _mm_or_si128(equal('\n'), equal('\r'))));
+    masks.high |= bits(bytes);
+  }
+#else
+  for (unsigned i = 0; i < 64; ++i) {
+    uint64_t const bit = uint64_t(1) << i;
+    switch (block[i]) {
+    case '"':
+      masks.quote |= bit;
+      break;
+    case '\\':
+      masks.backslash |= bit;
+      break;
+    case '{':
+    case '}':
+    case '[':
+    case ']':
+    case ':':
+    case ',':
+      masks.op |= bit;
+      break;
+    case ' ':
+    case '\t':
+    case '\n':
+    case '\r':
+      masks.space |= bit;
+      break;
+    default:
+      if (static_cast<unsigned char>(block[i]) >= 0x80)
+        masks.high |= bit;
+      break;
+    }
+  }
+#endif
+}
+
+/* First stage of OurReader::parseStructural(): collects the positions of
+ * the brackets, colons and commas outside strings, of each unescaped quote
+ * and of the first character of each number or literal, 64 bytes at a time.
+ * Also validates UTF-8. Returns an error, and its position in errorAt, on
+ * failure.
+ */
+static ParseError::Code indexStructurals(const char* begin, const char* end,
+                                    std::vector<size_t>& index,
+                                    size_t& errorAt) {
+  index.clear();
+  size_t const size = static_cast<size_t>(end - begin);
+  uint64_t escapeCarry = 0;   // first byte of the next block is escaped
+  uint64_t inStringCarry = 0; // all ones when a string continues
+  uint64_t delimiterCarry = 1; // last byte was a delimiter
+  bool validated = false;
+  char padded[64];
+  for (size_t offset = 0; offset < size; offset += 64) {
+    const char* block = begin + offset;
+    if (size - offset < 64) {
+      memset(padded, ' ', sizeof(padded));
+      memcpy(padded, block, size - offset);
+      block = padded;
+    }
+    StructuralMasks masks;
+    classifyBlock(block, masks);
+    // Once a non-ASCII byte is seen, validate the rest of the document at
+    // once: the blocks before it cannot end inside a sequence.
+    if (masks.high && !validated) {
+      const char* invalid = validateUTF8(begin + offset, end);
+      if (invalid != end) {
+        errorAt = static_cast<size_t>(invalid - begin);
+        return ParseError::invalidUTF8;
+      }
+      validated = true;
+    }
+
+    // A backslash escapes the next byte, unless it is escaped itself.
+    uint64_t escaped = escapeCarry;
+    uint64_t backslash = masks.backslash & ~escaped;
+    escapeCarry = 0;
+    while (backslash) {
+      unsigned const bit = countTrailingZeros(backslash);
+      if (bit == 63) {
+        escapeCarry = 1;
+        break;
+      }
+      uint64_t const next = uint64_t(2) << bit;
+      escaped |= next;
+      backslash &= ~(next | (next >> 1));
+    }
+    uint64_t const quote = masks.quote & ~escaped;
+
+    // Bytes from an opening quote up to, but excluding, its closing quote.
+    uint64_t inString = quote;
+    inString ^= inString << 1;
+    inString ^= inString << 2;
+    inString ^= inString << 4;
+    inString ^= inString << 8;
+    inString ^= inString << 16;
+    inString ^= inString << 32;
+    inString ^= inStringCarry;
+    inStringCarry = uint64_t(0) - (inString >> 63);
+
+    uint64_t const outside = ~(inString | quote);
+    uint64_t const delimiter = masks.space | masks.op | (quote & ~inString);
+    uint64_t const scalarStart = outside & ~(masks.space | masks.op) &
+                                 ((delimiter << 1) | delimiterCarry);
+    delimiterCarry = delimiter >> 63;
+
+    uint64_t structural = (masks.op & outside) | quote | scalarStart;
+    while (structural) {
+      index.push_back(offset + countTrailingZeros(structural));
+      structural &= structural - 1;
+    }
+  }
+  if (inStringCarry) {
+    errorAt = index.back();
+    return ParseError::unterminatedString;
+  }
+  return ParseError::none;
+}
+
+bool OurReader::parseStructural(const char* beginDoc, const char* endDoc,
+                                Value* root) {
+  begin_ = beginDoc;
+  end_ = endDoc;
+  collectComments_ = false;
+  current_ = begin_;
+  lastValueEnd_ = nullptr;
+  lastValue_ = nullptr;
+  commentsBefore_.clear();
+  errors_.clear();
+  while (!nodes_.empty())
+    nodes_.pop();
+  keys_.clear();
+  keyTable_.resize(0);
+  containers_.clear();
+
+  skipBom(features_.skipBom_);
+  size_t errorAt = 0;
+  ParseError::Code const code =
+      indexStructurals(begin_, end_, structurals_, errorAt);
+  if (code != ParseError::none) {
+    Token token;
+    token.type_ = tokenError;
+    token.start_ = begin_ + errorAt;
+    token.end_ = token.start_ + 1;
+    return addError(code, token);
+  }
+  return root ? readStructurals(*root) : validateStructurals();
+}
+
+bool OurReader::readStructurals(Value& root) {
+  size_t const count = structurals_.size();
+  size_t i = 0;
+  auto location = [&](size_t k) {
+    return k < count ? begin_ + structurals_[k] : end_;
+  };
+  auto peek = [&](size_t k) {
+    return k < count ? begin_[structurals_[k]] : '\0';
+  };
+  Token token;
+  // Pushes the next member or element of the current container, whose
+  // opening bracket or preceding comma was just read.
+  auto pushItem = [&]() {
+    Value& container = currentValue();
+    if (container.isArray()) {
+      nodes_.push(&container[container.size()]);
+      return true;
+    }
+    token.type_ = tokenString;
+    token.start_ = location(i);
+    token.end_ = location(i + 1) + 1;
+    String name;
+    if (peek(i) != '"') {
+      token.end_ = token.start_;
+      return addError(ParseError::missingMemberName, token);
+    }
+    if (!decodeString(token, name))
+      return false;
+    if (name.length() >= (1U << 30))
+      return exceedLimit(ParseError::keyTooLong, token);
+    if (features_.rejectDupKeys_ && container.isMember(name)) {
+      if (failFast_)
+        return addError(ParseError::duplicateKey, token);
+      return addError("Duplicate key: '" + name + "'", token);
+    }
+    i += 2;
+    if (peek(i) != ':') {
+      token.start_ = token.end_ = location(i);
+      return addError(ParseError::missingColon, token);
+    }
+    ++i;
+    nodes_.push(&container[name]);
+    return true;
+  };
+
+  Location valueEnd = begin_;
+  bool expectValue = true;
+  nodes_.push(&root);
+  for (;;) {
+    if (expectValue) {
+      token.start_ = token.end_ = location(i);
+      if (nodes_.size() > features_.stackLimit_)
+        return exceedLimit(ParseError::stackLimitExceeded, token);
+      Value& value = currentValue();
+      char const c = peek(i);
+      if (c == '{' || c == '[') {
+        Value init(c == '{' ? objectValue : arrayValue);
+        value.swapPayload(init);
+        value.setOffsetStart(token.start_ - begin_);
+        if (peek(++i) == (c == '{' ? '}' : ']')) {
+          valueEnd = location(i++) + 1;
+          value.setOffsetLimit(valueEnd - begin_);
+          expectValue = false;
+        } else if (!pushItem()) {
+          return false;
+        }
+        continue;
+      }
+      if (c == '"') {
+        token.type_ = tokenString;
+        token.end_ = location(i + 1) + 1;
+        i += 2;
+        if (!decodeString(token))
+          return false;
+      } else {
+        current_ = token.start_;
+        readToken(token);
+        ++i;
+        switch (token.type_) {
+        case tokenNumber:
+          if (!decodeNumber(token))
+            return false;
+          break;
+        case tokenTrue:
+        case tokenFalse:
+        case tokenNull: {
+          Value v = token.type_ == tokenNull ? Value()
+                                             : Value(token.type_ == tokenTrue);
+          value.swapPayload(v);
+          value.setOffsetStart(token.start_ - begin_);
+          value.setOffsetLimit(token.end_ - begin_);
+          break;
+        }
+        default:
+          return addError(ParseError::valueExpected, token);
+        }
+        // Anything between the value and the next structural character is
+        // an error, except after the root, where failIfExtra decides.
+        if (nodes_.size() > 1) {
+          skipSpaces();
+          if (current_ != location(i)) {
+            token.start_ = current_;
+            token.end_ = current_ + 1;
+            nodes_.pop();
+            return addError(currentValue().isObject()
+                                ? ParseError::missingObjectSeparator
+                                : ParseError::missingArraySeparator,
+                            token);
+          }
+        }
+      }
+      valueEnd = token.end_;
+      expectValue = false;
+    }
+
+    // The current value is complete.
+    nodes_.pop();
+    if (nodes_.empty())
+      break;
+    Value& container = currentValue();
+    char const close = container.isObject() ? '}' : ']';
+    char const c = peek(i);
+    if (c == ',') {
+      ++i;
+      if (!features_.allowTrailingCommas_ || peek(i) != close) {
+        if (!pushItem())
+          return false;
+        expectValue = true;
+        continue;
+      }
+    } else if (c != close) {
+      token.start_ = token.end_ = location(i);
+      return addError(container.isObject()
+                          ? ParseError::missingObjectSeparator
+                          : ParseError::missingArraySeparator,
+                      token);
+    }
+    valueEnd = location(i++) + 1;
+    container.setOffsetLimit(valueEnd - begin_);
+  }
+
+  if (features_.failIfExtra_) {
+    current_ = valueEnd;
+    skipSpaces();
+    if (current_ != end_) {
+      token.start_ = current_;
+      token.end_ = end_;
+      return addError(ParseError::extraCharacters, token);
+    }
+  }
+  if (features_.strictRoot_ && !root.isArray() && !root.isObject()) {
+    token.type_ = tokenError;
+    token.start_ = begin_;
+    token.end_ = end_;
+    return addError(ParseError::rootNotContainer, token);
+  }
+  return true;
+}
+
+// The validate() counterpart of readStructurals(), which it follows step by
+// step. containers_ holds the arrays and objects around the current value.
+bool OurReader::validateStructurals() {
+  size_t const count = structurals_.size();
+  size_t i = 0;
+  auto location = [&](size_t k) {
+    return k < count ? begin_ + structurals_[k] : end_;
+  };
+  auto peek = [&](size_t k) {
+    return k < count ? begin_[structurals_[k]] : '\0';
+  };
+  Token token;
+  // Checks the name of the next member of the current container, if it is
+  // an object, whose opening bracket or preceding comma was just read.
+  auto pushItem = [&]() {
+    Container const& container = containers_.back();
+    if (!container.isObject)
+      return true;
+    token.type_ = tokenString;
+    token.start_ = location(i);
+    token.end_ = location(i + 1) + 1;
+    if (peek(i) != '"') {
+      token.end_ = token.start_;
+      return addError(ParseError::missingMemberName, token);
+    }
+    Key key;
+    key.token = token;
+    size_t length = 0;
+    if (!validateString(token, &key, &length))
+      return false;
+    if (length >= (1U << 30))
+      return exceedLimit(ParseError::keyTooLong, token);
+    if (features_.rejectDupKeys_) {
+      if (isDuplicateKey(container.firstKey, key)) {
+        if (failFast_)
+          return addError(ParseError::duplicateKey, token);
+        return addError("Duplicate key: '" + keyName(key) + "'", token);
+      }
+      keys_.push_back(key);
+      keyTable_.push(key.hash);
+    }
+    i += 2;
+    if (peek(i) != ':') {
+      token.start_ = token.end_ = location(i);
+      return addError(ParseError::missingColon, token);
+    }
+    ++i;
+    return true;
+  };
+
+  Location valueEnd = begin_;
+  bool expectValue = true;
+  for (;;) {
+    if (expectValue) {
+      token.start_ = token.end_ = location(i);
+      if (containers_.size() + 1 > features_.stackLimit_)
+        return exceedLimit(ParseError::stackLimitExceeded, token);
+      char const c = peek(i);
+      if (c == '{' || c == '[') {
+        if (peek(++i) == (c == '{' ? '}' : ']')) {
+          valueEnd = location(i++) + 1;
+          expectValue = false;
+        } else {
+          containers_.push_back(Container{c == '{', keys_.size()});
+          if (!pushItem())
+            return false;
+        }
+        continue;
+      }
+      if (c == '"') {
+        token.type_ = tokenString;
+        token.end_ = location(i + 1) + 1;
+        i += 2;
+        if (!validateString(token, nullptr, nullptr))
+          return false;
+      } else {
+        current_ = token.start_;
+        readToken(token);
+        ++i;
+        switch (token.type_) {
+        case tokenNumber:
+          if (!validateNumber(token))
+            return false;
+          break;
+        case tokenTrue:
+        case tokenFalse:
+        case tokenNull:
+          break;
+        default:
+          return addError(ParseError::valueExpected, token);
+        }
+        if (!containers_.empty()) {
+          skipSpaces();
+          if (current_ != location(i)) {
+            token.start_ = current_;
+            token.end_ = current_ + 1;
+            return addError(containers_.back().isObject
+                                ? ParseError::missingObjectSeparator
+                                : ParseError::missingArraySeparator,
+                            token);
+          }
+        }
+      }
+      valueEnd = token.end_;
+      expectValue = false;
+    }
+
+    // The current value is complete.
+    if (containers_.empty())
+      break;
+    Container const& container = containers_.back();
+    char const close = container.isObject ? '}' : ']';
+    char const c = peek(i);
+    if (c == ',') {
+      ++i;
+      if (!features_.allowTrailingCommas_ || peek(i) != close) {
+        if (!pushItem())
+          return false;
+        expectValue = true;
+        continue;
+      }
+    } else if (c != close) {
+      token.start_ = token.end_ = location(i);
+      return addError(container.isObject ? ParseError::missingObjectSeparator
+                                         : ParseError::missingArraySeparator,
+                      token);
+    }
+    valueEnd = location(i++) + 1;
+    keys_.resize(container.firstKey);
+    keyTable_.resize(container.firstKey);
+    containers_.pop_back();
+  }
+
+  if (features_.failIfExtra_) {
+    current_ = valueEnd;
+    skipSpaces();
+    if (current_ != end_) {
+      token.start_ = current_;
+      token.end_ = end_;
+      return addError(ParseError::extraCharacters, token);
+    }
+  }
+  if (features_.strictRoot_ && peek(0) != '{' && peek(0) != '[') {
+    token.type_ = tokenError;
+    token.start_ = begin_;
+    token.end_ = end_;
+    return addError(ParseError::rootNotContainer, token);
+  }
+  return true;
+}
+
 bool OurReader::readValue() {
-  //  To preserve the old behaviour we cast size_t to int.
-  if (nodes_.size() > features_.stackLimit_)
-    throwRuntimeError("Exceeded stackLimit in readValue().");
   Token token;
+  //  To preserve the old behaviour we cast size_t to int.
+  if (nodes_.size() > features_.stackLimit_) {
+    token.type_ = tokenError;
+    token.start_ = token.end_ = current_;
+    return exceedLimit(ParseError::stackLimitExceeded, token);
+  }
   skipCommentTokens(token);
   bool successful = true;
 
   if (collectComments_ && !commentsBefore_.empty()) {
-    currentValue().setComment(commentsBefore_, commentBefore);
+    currentValue().setComment(commentsBefore_.data(), commentsBefore_.size(),
+                              commentBefore);
     commentsBefore_.clear();
   }
 
@@ -1127,7 +2023,7 @@ bool OurReader::readValue() {
   default:
     currentValue().setOffsetStart(token.start_ - begin_);
     currentValue().setOffsetLimit(token.end_ - begin_);
-    return addError("Syntax error: value, object or array expected.", token);
+    return addError(ParseError::valueExpected, token);
   }
 
   if (collectComments_) {
@@ -1139,833 +2035,3040 @@ bool OurReader::readValue() {
   return successful;
 }
 
-void OurReader::skipCommentTokens(Token& token) {
-  if (features_.allowComments_) {
-    do {
-      readToken(token);
-    } while (token.type_ == tokenComment);
-  } else {
-    readToken(token);
+bool OurReader::validate(const char* beginDoc, const char* endDoc) {
+  begin_ = beginDoc;
+  end_ = endDoc;
+  collectComments_ = false;
+  current_ = begin_;
+  errors_.clear();
+  keys_.clear();
+  keyTable_.resize(0);
+
+  skipBom(features_.skipBom_);
+  if (features_.validateUTF8_) {
+    Location invalid = validateUTF8(current_, end_);
+    if (invalid != end_) {
+      Token token;
+      token.type_ = tokenError;
+      token.start_ = invalid;
+      token.end_ = invalid + 1;
+      return addError(ParseError::invalidUTF8, token);
+    }
+  }
+  bool isContainer = false;
+  bool successful = validateValue(1, &isContainer);
+  Token token;
+  skipCommentTokens(token);
+  if (features_.failIfExtra_ && (token.type_ != tokenEndOfStream)) {
+    addError(ParseError::extraCharacters, token);
+    return false;
+  }
+  if (features_.strictRoot_ && !isContainer) {
+    token.type_ = tokenError;
+    token.start_ = beginDoc;
+    token.end_ = endDoc;
+    addError(ParseError::rootNotContainer, token);
+    return false;
   }
+  return successful;
 }
 
-bool OurReader::readToken(Token& token) {
-  skipSpaces();
-  token.start_ = current_;
-  Char c = getNextChar();
-  bool ok = true;
-  switch (c) {
-  case '{':
-    token.type_ = tokenObjectBegin;
-    break;
-  case '}':
-    token.type_ = tokenObjectEnd;
-    break;
-  case '[':
-    token.type_ = tokenArrayBegin;
-    break;
-  case ']':
-    token.type_ = tokenArrayEnd;
-    break;
-  case '"':
-    token.type_ = tokenString;
-    ok = readString();
-    break;
-  case '\'':
-    if (features_.allowSingleQuotes_) {
-      token.type_ = tokenString;
-      ok = readStringSingleQuote();
-    } else {
-      // If we don't allow single quotes, this is a failure case.
-      ok = false;
-    }
-    break;
-  case '/':
-    token.type_ = tokenComment;
-    ok = readComment();
-    break;
-  case '0':
-  case '1':
-  case '2':
-  case '3':
-  case '4':
-  case '5':
-  case '6':
-  case '7':
-  case '8':
-  case '9':
-    token.type_ = tokenNumber;
-    readNumber(false);
-    break;
-  case '-':
-    if (readNumber(true)) {
-      token.type_ = tokenNumber;
-    } else {
-      token.type_ = tokenNegInf;
-      ok = features_.allowSpecialFloats_ && match("nfinity", 7);
+// The validate() counterparts of readValue(), readObject() and readArray()
+// follow them step by step, so that they fail where those would.
+bool OurReader::validateValue(size_t depth, bool* isContainer) {
+  Token token;
+  if (depth > features_.stackLimit_) {
+    token.type_ = tokenError;
+    token.start_ = token.end_ = current_;
+    return exceedLimit(ParseError::stackLimitExceeded, token);
+  }
+  skipCommentTokens(token);
+  if (isContainer)
+    *isContainer = token.type_ == tokenObjectBegin ||
+                   token.type_ == tokenArrayBegin;
+
+  switch (token.type_) {
+  case tokenObjectBegin:
+    return validateObject(depth);
+  case tokenArrayBegin:
+    return validateArray(depth);
+  case tokenNumber:
+    return validateNumber(token);
+  case tokenString:
+    return validateString(token, nullptr, nullptr);
+  case tokenTrue:
+  case tokenFalse:
+  case tokenNull:
+  case tokenNaN:
+  case tokenPosInf:
+  case tokenNegInf:
+    return true;
+  case tokenArraySeparator:
+  case tokenObjectEnd:
+  case tokenArrayEnd:
+    if (features_.allowDroppedNullPlaceholders_) {
+      current_--;
+      return true;
+    } // else, fall through ...
+  default:
+    return addError(ParseError::valueExpected, token);
+  }
+}
+
+bool OurReader::validateObject(size_t depth) {
+  size_t const firstKey = keys_.size();
+  Key key;
+  Token& tokenName = key.token;
+  size_t length = 0;
+  while (readToken(tokenName)) {
+    bool initialTokenOk = true;
+    while (tokenName.type_ == tokenComment && initialTokenOk)
+      initialTokenOk = readToken(tokenName);
+    if (!initialTokenOk)
+      break;
+    if (tokenName.type_ == tokenObjectEnd &&
+        (length == 0 || features_.allowTrailingCommas_)) {
+      keys_.resize(firstKey);
+      keyTable_.resize(firstKey);
+      return true;
     }
-    break;
-  case '+':
-    if (readNumber(true)) {
-      token.type_ = tokenNumber;
+    if (tokenName.type_ == tokenString) {
+      if (!validateString(tokenName, &key, &length))
+        return recoverFromError(tokenObjectEnd);
+    } else if (tokenName.type_ == tokenNumber && features_.allowNumericKeys_) {
+      if (!validateNumber(tokenName))
+        return recoverFromError(tokenObjectEnd);
+      String const name = keyName(key);
+      length = name.size();
+      key.hash = hashBasis;
+      for (char c : name)
+        key.hash = hashByte(key.hash, c);
     } else {
-      token.type_ = tokenPosInf;
-      ok = features_.allowSpecialFloats_ && match("nfinity", 7);
+      break;
     }
-    break;
-  case 't':
-    token.type_ = tokenTrue;
-    ok = match("rue", 3);
-    break;
-  case 'f':
-    token.type_ = tokenFalse;
-    ok = match("alse", 4);
-    break;
-  case 'n':
-    token.type_ = tokenNull;
-    ok = match("ull", 3);
-    break;
-  case 'N':
-    if (features_.allowSpecialFloats_) {
-      token.type_ = tokenNaN;
-      ok = match("aN", 2);
-    } else {
-      ok = false;
+    if (length >= (1U << 30))
+      return exceedLimit(ParseError::keyTooLong, tokenName);
+    if (features_.rejectDupKeys_) {
+      if (isDuplicateKey(firstKey, key)) {
+        if (failFast_)
+          return addErrorAndRecover(ParseError::duplicateKey, tokenName,
+                                    tokenObjectEnd);
+        String msg = "Duplicate key: '" + keyName(key) + "'";
+        return addErrorAndRecover(msg, tokenName, tokenObjectEnd);
+      }
+      keys_.push_back(key);
+      keyTable_.push(key.hash);
     }
-    break;
-  case 'I':
-    if (features_.allowSpecialFloats_) {
-      token.type_ = tokenPosInf;
-      ok = match("nfinity", 7);
-    } else {
-      ok = false;
+
+    Token colon;
+    if (!readToken(colon) || colon.type_ != tokenMemberSeparator) {
+      return addErrorAndRecover(ParseError::missingColon, colon,
+                                tokenObjectEnd);
+    }
+    if (!validateValue(depth + 1, nullptr))
+      return recoverFromError(tokenObjectEnd);
+
+    Token comma;
+    if (!readToken(comma) ||
+        (comma.type_ != tokenObjectEnd && comma.type_ != tokenArraySeparator &&
+         comma.type_ != tokenComment)) {
+      return addErrorAndRecover(ParseError::missingObjectSeparator, comma,
+                                tokenObjectEnd);
+    }
+    bool finalizeTokenOk = true;
+    while (comma.type_ == tokenComment && finalizeTokenOk)
+      finalizeTokenOk = readToken(comma);
+    if (comma.type_ == tokenObjectEnd) {
+      keys_.resize(firstKey);
+      keyTable_.resize(firstKey);
+      return true;
     }
-    break;
-  case ',':
-    token.type_ = tokenArraySeparator;
-    break;
-  case ':':
-    token.type_ = tokenMemberSeparator;
-    break;
-  case 0:
-    token.type_ = tokenEndOfStream;
-    break;
-  default:
-    ok = false;
-    break;
   }
-  if (!ok)
-    token.type_ = tokenError;
-  token.end_ = current_;
-  return ok;
+  return addErrorAndRecover(ParseError::missingMemberName, tokenName,
+                            tokenObjectEnd);
 }
 
-void OurReader::skipSpaces() {
-  while (current_ != end_) {
-    Char c = *current_;
-    if (c == ' ' || c == '\t' || c == '\r' || c == '\n')
+bool OurReader::validateArray(size_t depth) {
+  bool empty = true;
+  for (;;) {
+    skipSpaces();
+    if (current_ != end_ && *current_ == ']' &&
+        (empty || (features_.allowTrailingCommas_ &&
+                   !features_.allowDroppedNullPlaceholders_))) {
       ++current_;
-    else
-      break;
+      return true;
+    }
+    empty = false;
+    if (!validateValue(depth + 1, nullptr))
+      return recoverFromError(tokenArrayEnd);
+
+    Token currentToken;
+    bool ok = readToken(currentToken);
+    while (currentToken.type_ == tokenComment && ok) {
+      ok = readToken(currentToken);
+    }
+    bool badTokenType = (currentToken.type_ != tokenArraySeparator &&
+                         currentToken.type_ != tokenArrayEnd);
+    if (!ok || badTokenType) {
+      return addErrorAndRecover(ParseError::missingArraySeparator,
+                                currentToken, tokenArrayEnd);
+    }
+    if (currentToken.type_ == tokenArrayEnd)
+      return true;
   }
 }
 
-void OurReader::skipBom(bool skipBom) {
-  // The default behavior is to skip BOM.
-  if (skipBom) {
-    if ((end_ - begin_) >= 3 && strncmp(begin_, "\xEF\xBB\xBF", 3) == 0) {
-      begin_ += 3;
-      current_ = begin_;
+// Same as decodeNumber(), which only fails on a double that is malformed or
+// too large, but without a String or a stream unless the exponent is so
+// large that strtod() has to tell.
+bool OurReader::validateNumber(Token& token) {
+  assert(token.end_ == numberEnd_);
+  if (numberIsInteger_)
+    return true;
+  // readNumber() has matched [+-]?[0-9]*(\.[0-9]*)?([eE][+-]?[0-9]*)?
+  Location p = token.start_;
+  Location const end = token.end_;
+  if (*p == '+' || *p == '-')
+    ++p;
+  int digits = 0;
+  int integralDigits = 0; // without leading zeros
+  for (; p != end && *p >= '0' && *p <= '9'; ++p, ++digits)
+    integralDigits += integralDigits > 0 || *p != '0';
+  if (p != end && *p == '.')
+    for (++p; p != end && *p >= '0' && *p <= '9'; ++p)
+      ++digits;
+  bool wellFormed = digits > 0;
+  int exponent = 0;
+  if (p != end) {
+    ++p; // 'e' or 'E'
+    bool const negative = p != end && *p == '-';
+    if (p != end && (*p == '+' || *p == '-'))
+      ++p;
+    wellFormed = wellFormed && p != end;
+    for (; p != end && exponent < 100000; ++p)
+      exponent = exponent * 10 + (*p - '0');
+    if (negative)
+      exponent = -exponent;
+  }
+  // Below 10^307, well away from the largest double.
+  if (wellFormed && integralDigits + exponent <= 307)
+    return true;
+  if (!wellFormed && failFast_)
+    return addError(ParseError::notANumber, token);
+  char buffer[64];
+  auto const length = static_cast<size_t>(token.end_ - token.start_);
+  if (length < sizeof(buffer)) {
+    memcpy(buffer, token.start_, length);
+    buffer[length] = '\0';
+    char* parsed = nullptr;
+    double const value = strtod(buffer, &parsed);
+    if (parsed == buffer + length) {
+      if (std::isfinite(value))
+        return true;
+      if (failFast_)
+        return addError(ParseError::notANumber, token);
     }
   }
+  Value decoded;
+  return decodeDouble(token, decoded);
 }
 
-bool OurReader::match(const Char* pattern, int patternLength) {
-  if (end_ - current_ < patternLength)
-    return false;
-  int index = patternLength;
-  while (index--)
-    if (current_[index] != pattern[index])
-      return false;
-  current_ += patternLength;
+// Same as decodeString(), but only checks the escape sequences. For a member
+// name, also hashes the decoded name into key->hash and stores its length.
+bool OurReader::validateString(Token& token, Key* key, size_t* length) {
+  Location current = token.start_ + 1; // skip '"'
+  Location end = token.end_ - 1;       // do not include '"'
+  if (!key && !memchr(current, '\\', static_cast<size_t>(end - current)))
+    return true;
+  uint64_t hash = hashBasis;
+  size_t decodedLength = 0;
+  auto decoded = [&](char c) {
+    hash = hashByte(hash, c);
+    ++decodedLength;
+  };
+  while (current != end) {
+    Char c = *current++;
+    if (c == '"')
+      break;
+    if (c == '\\') {
+      if (current == end)
+        return addError(ParseError::emptyEscape, token, current);
+      Char escape = *current++;
+      switch (escape) {
+      case '"':
+      case '/':
+      case '\\':
+        decoded(escape);
+        break;
+      case 'b':
+        decoded('\b');
+        break;
+      case 'f':
+        decoded('\f');
+        break;
+      case 'n':
+        decoded('\n');
+        break;
+      case 'r':
+        decoded('\r');
+        break;
+      case 't':
+        decoded('\t');
+        break;
+      case 'u': {
+        unsigned int unicode;
+        if (!decodeUnicodeCodePoint(token, current, end, unicode))
+          return false;
+        for (char byte : codePointToUTF8(unicode))
+          decoded(byte);
+      } break;
+      default:
+        return addError(ParseError::badEscape, token, current);
+      }
+    } else {
+      decoded(c);
+    }
+  }
+  if (key) {
+    key->hash = hash;
+    *length = decodedLength;
+  }
   return true;
 }
 
-bool OurReader::readComment() {
-  const Location commentBegin = current_ - 1;
-  const Char c = getNextChar();
-  bool successful = false;
-  bool cStyleWithEmbeddedNewline = false;
+bool OurReader::isDuplicateKey(size_t firstKey, Key const& key) {
+  Location const begin = key.token.start_;
+  auto const length = static_cast<size_t>(key.token.end_ - begin);
+  return keyTable_.contains(key.hash, firstKey, [&](size_t index) {
+    Key const& other = keys_[index];
+    // Names without escapes are equal when their tokens are.
+    Location const otherBegin = other.token.start_;
+    auto const otherLength =
+        static_cast<size_t>(other.token.end_ - otherBegin);
+    if (*begin == '"' && *otherBegin == '"' && !memchr(begin, '\\', length) &&
+        !memchr(otherBegin, '\\', otherLength))
+      return length == otherLength && memcmp(begin, otherBegin, length) == 0;
+    return keyName(key) == keyName(other);
+  });
+}
 
-  const bool isCStyleComment = (c == '*');
-  const bool isCppStyleComment = (c == '/');
-  if (isCStyleComment) {
-    successful = readCStyleComment(&cStyleWithEmbeddedNewline);
-  } else if (isCppStyleComment) {
-    successful = readCppStyleComment();
+// The name readObject() would have decoded from the token of \a key.
+String OurReader::keyName(Key const& key) {
+  Token token = key.token;
+  String name;
+  if (token.type_ == tokenString) {
+    decodeString(token, name);
+    return name;
   }
+  // decodeNumber() expects the number readNumber() has just scanned.
+  Location const current = current_;
+  current_ = token.start_ + 1;
+  readNumber(false);
+  current_ = current;
+  Value number;
+  decodeNumber(token, number);
+  return number.asString();
+}
 
-  if (!successful)
+// Whether [begin, end), a number readNumber() has matched, is one in JSON's
+// stricter grammar too: no '+', no leading zeros, and digits on both sides
+// of a '.'.
+static bool isJsonNumber(const char* begin, const char* end) {
+  auto digit = [&end](const char* p) {
+    return p != end && *p >= '0' && *p <= '9';
+  };
+  const char* p = begin;
+  if (*p == '-')
+    ++p;
+  if (!digit(p))
     return false;
+  if (*p++ == '0') {
+    if (digit(p))
+      return false;
+  } else {
+    while (digit(p))
+      ++p;
+  }
+  if (p != end && *p == '.') {
+    if (!digit(++p))
+      return false;
+    while (digit(p))
+      ++p;
+  }
+  if (p != end && (*p == 'e' || *p == 'E')) {
+    ++p;
+    if (p != end && (*p == '+' || *p == '-'))
+      ++p;
+    if (!digit(p))
+      return false;
+    while (digit(p))
+      ++p;
+  }
+  return p == end;
+}
 
-  if (collectComments_) {
-    CommentPlacement placement = commentBefore;
-
-    if (!lastValueHasAComment_) {
-      if (lastValueEnd_ && !containsNewLine(lastValueEnd_, commentBegin)) {
-        if (isCppStyleComment || !cStyleWithEmbeddedNewline) {
-          placement = commentAfterOnSameLine;
-          lastValueHasAComment_ = true;
-        }
+bool OurReader::reformat(IStream& sin, StreamingWriter& writer,
+                         bool collectComments) {
+  writer_ = &writer;
+  beginCursor(sin, false);
+  collectComments_ = collectComments && features_.allowComments_;
+  lastValueHasAComment_ = false;
+  pendingSize_ = 0;
+
+  // Walks the document as a Cursor does. A container is given to writer_
+  // only once something in it, or its end, is: parse() gives a comment on
+  // the same line as the value before it to that value, even after the
+  // start of another container, as in "{}, { //".
+  bool isMember = false;
+  Cursor::Kind kind;
+  while ((kind = nextCursorToken()) > Cursor::tokenError) {
+    if (kind == Cursor::tokenName) {
+      isMember = true;
+      continue;
+    }
+    if (kind == Cursor::tokenObjectEnd || kind == Cursor::tokenArrayEnd) {
+      writePending();
+      if (kind == Cursor::tokenObjectEnd)
+        writer.endObject();
+      else
+        writer.endArray();
+    } else {
+      if (collectComments_ && !commentsBefore_.empty()) {
+        writePending();
+        writer.comment(commentsBefore_, commentBefore);
+        commentsBefore_.clear();
       }
+      String const* name = isMember ? &name_ : nullptr;
+      isMember = false;
+      if (kind == Cursor::tokenObjectBegin ||
+          kind == Cursor::tokenArrayBegin) {
+        beginLater(name, kind == Cursor::tokenObjectBegin);
+        continue;
+      }
+      writePending();
+      if (name)
+        writer.key(*name);
+      reformatToken(cursorToken_);
+    }
+    if (collectComments_) {
+      lastValueEnd_ = current_;
+      lastValueHasAComment_ = false;
     }
-
-    addComment(commentBegin, current_, placement);
   }
-  return true;
+  bool successful = kind == Cursor::tokenEnd;
+  if (successful && collectComments_ && !commentsBefore_.empty())
+    writer.comment(commentsBefore_, commentAfter);
+  // parse() checks the whole document before anything else.
+  pinned_ = nullptr;
+  while (features_.validateUTF8_ && !invalidUTF8_ && !inputDone_) {
+    current_ = end_;
+    readMore();
+  }
+  if (invalidUTF8_) {
+    failFast_->code = ParseError::invalidUTF8;
+    failFast_->offset = documentOffset(invalidUTF8_);
+    successful = false;
+  }
+
+  input_ = nullptr;
+  writer_ = nullptr;
+  streamOffset_ = 0;
+  return successful;
 }
 
-String OurReader::normalizeEOL(OurReader::Location begin,
-                               OurReader::Location end) {
-  String normalized;
-  normalized.reserve(static_cast<size_t>(end - begin));
-  OurReader::Location current = begin;
-  while (current != end) {
-    char c = *current++;
-    if (c == '\r') {
-      if (current != end && *current == '\n')
-        // convert dos EOL
-        ++current;
-      // convert Mac EOL
-      normalized += '\n';
+// Drops the part of buffer_ before current_, and reads more of the input
+// after the rest.
+void OurReader::readMore() {
+  static size_t const bufferSize = 64 * 1024;
+  // The part not yet checked for UTF-8 is kept, to check it whole, and so
+  // are the token at a Cursor and the value it is reading.
+  Location keep = std::min(current_, validEnd_);
+  if (pinned_)
+    keep = std::min(keep, pinned_);
+  if (valueBegin_)
+    keep = std::min(keep, valueBegin_);
+  // All that matters of where the last value ended, for the placement of a
+  // comment, is whether a newline follows it.
+  ptrdiff_t lastValueEnd = -1;
+  if (lastValueEnd_ && lastValueEnd_ >= keep)
+    lastValueEnd = lastValueEnd_ - keep;
+  else if (lastValueEnd_ && !containsNewLine(lastValueEnd_, keep))
+    lastValueEnd = 0;
+  ptrdiff_t const current = current_ - keep;
+  ptrdiff_t const validEnd = validEnd_ - keep;
+  ptrdiff_t const pinned = pinned_ ? pinned_ - keep : -1;
+  ptrdiff_t const valueBegin = valueBegin_ ? valueBegin_ - keep : -1;
+  streamOffset_ += keep - begin_;
+
+  buffer_.erase(0, static_cast<size_t>(keep - buffer_.data()));
+  size_t const kept = buffer_.size();
+  // Grow the buffer when a single token fills half of it.
+  buffer_.resize(std::max(bufferSize, 2 * kept));
+  auto const wanted = static_cast<std::streamsize>(buffer_.size() - kept);
+  input_->read(&buffer_[kept], wanted);
+  std::streamsize const read = input_->gcount();
+  buffer_.resize(kept + static_cast<size_t>(read));
+  inputDone_ = read < wanted;
+
+  begin_ = buffer_.data();
+  end_ = begin_ + buffer_.size();
+  current_ = begin_ + current;
+  validEnd_ = begin_ + validEnd;
+  pinned_ = pinned < 0 ? nullptr : begin_ + pinned;
+  valueBegin_ = valueBegin < 0 ? nullptr : begin_ + valueBegin;
+  lastValueEnd_ = lastValueEnd < 0 ? nullptr : begin_ + lastValueEnd;
+  if (features_.validateUTF8_) {
+    Location const invalid = validateUTF8(validEnd_, end_);
+    // A character may be cut at the end of the buffer.
+    if (invalid == end_ || (!inputDone_ && end_ - invalid < 4)) {
+      validEnd_ = invalid;
     } else {
-      normalized += c;
+      // Stop there, as if the input ended.
+      invalidUTF8_ = invalid;
+      validEnd_ = end_ = invalid;
+      inputDone_ = true;
     }
+  } else {
+    validEnd_ = end_;
   }
-  return normalized;
 }
 
-void OurReader::addComment(Location begin, Location end,
-                           CommentPlacement placement) {
-  assert(collectComments_);
-  const String& normalized = normalizeEOL(begin, end);
-  if (placement == commentAfterOnSameLine) {
-    assert(lastValue_ != nullptr);
-    lastValue_->setComment(normalized, placement);
-  } else {
-    commentsBefore_ += normalized;
+// readToken(), reading more of the input first when the token may not be
+// whole: when it ends so near the end of the buffer that a literal might
+// have been cut short. Comments are collected once the token is whole.
+bool OurReader::readStreamToken(Token& token) {
+  bool const collectComments = collectComments_;
+  collectComments_ = false;
+  bool ok;
+  for (;;) {
+    Location const start = current_;
+    ok = readToken(token);
+    if (end_ - current_ >= 16 || inputDone_)
+      break;
+    current_ = start;
+    readMore();
   }
+  collectComments_ = collectComments;
+  if (ok && collectComments_ && token.type_ == tokenComment)
+    collectComment(token.start_, token.end_,
+                   token.start_[1] == '/' ||
+                       !memchr(token.start_, '\n',
+                               static_cast<size_t>(token.end_ - token.start_)));
+  return ok;
 }
 
-bool OurReader::readCStyleComment(bool* containsNewLineResult) {
-  *containsNewLineResult = false;
+void OurReader::skipStreamSpaces() {
+  skipSpaces();
+  while (current_ == end_ && !inputDone_) {
+    readMore();
+    skipSpaces();
+  }
+}
 
-  while ((current_ + 1) < end_) {
-    Char c = getNextChar();
-    if (c == '*' && *current_ == '/')
-      break;
-    if (c == '\n')
-      *containsNewLineResult = true;
+void OurReader::skipStreamCommentTokens(Token& token) {
+  if (features_.allowComments_) {
+    do {
+      readStreamToken(token);
+    } while (token.type_ == tokenComment);
+  } else {
+    readStreamToken(token);
   }
+}
 
-  return getNextChar() == '/';
+void OurReader::beginLater(String const* name, bool isObject) {
+  if (pendingSize_ == pending_.size())
+    pending_.emplace_back();
+  Pending& pending = pending_[pendingSize_++];
+  pending.isObject = isObject;
+  pending.isMember = name != nullptr;
+  if (name)
+    pending.name = *name;
 }
 
-bool OurReader::readCppStyleComment() {
-  while (current_ != end_) {
-    Char c = getNextChar();
-    if (c == '\n')
-      break;
-    if (c == '\r') {
-      // Consume DOS EOL. It will be normalized in addComment.
-      if (current_ != end_ && *current_ == '\n')
-        getNextChar();
-      // Break on Moc OS 9 EOL.
+void OurReader::writePending() {
+  for (size_t index = 0; index < pendingSize_; ++index) {
+    Pending const& pending = pending_[index];
+    if (pending.isMember)
+      writer_->key(pending.name);
+    if (pending.isObject)
+      writer_->beginObject();
+    else
+      writer_->beginArray();
+  }
+  pendingSize_ = 0;
+}
+
+// Writes the scalar at the cursor, whose token readCursorToken() has
+// checked. A double-quoted string without escapes is written from the input
+// as it is; others are decoded first.
+void OurReader::reformatToken(Token& token) {
+  switch (token.type_) {
+  case tokenNumber:
+    if (isJsonNumber(token.start_, token.end_)) {
+      writer_->rawValue(token.start_, token.end_);
+    } else {
+      Value decoded;
+      decodeNumber(token, decoded);
+      writer_->value(decoded);
+    }
+    break;
+  case tokenString: {
+    Location const begin = token.start_ + 1;
+    Location const end = token.end_ - 1;
+    if (*token.start_ == '"' &&
+        !memchr(begin, '\\', static_cast<size_t>(end - begin))) {
+      writer_->value(begin, end);
       break;
     }
+    string_.clear();
+    decodeString(token, string_);
+    writer_->value(string_);
+  } break;
+  case tokenTrue:
+    writer_->value(true);
+    break;
+  case tokenFalse:
+    writer_->value(false);
+    break;
+  case tokenNaN:
+    writer_->value(std::numeric_limits<double>::quiet_NaN());
+    break;
+  case tokenPosInf:
+    writer_->value(std::numeric_limits<double>::infinity());
+    break;
+  case tokenNegInf:
+    writer_->value(-std::numeric_limits<double>::infinity());
+    break;
+  default: // null, or a dropped null placeholder
+    writer_->null();
+    break;
   }
-  return true;
 }
 
-bool OurReader::readNumber(bool checkInf) {
-  Location p = current_;
-  if (checkInf && p != end_ && *p == 'I') {
-    current_ = ++p;
-    return false;
+// The Cursor counterparts of readValue(), readObject() and readArray() read
+// the same tokens in the same order, one step of theirs at a time, with the
+// containers the cursor is in in levels_. reformat() and readCursorValue()
+// walk the document with them too.
+void OurReader::beginCursor(IStream& sin, bool collectComments) {
+  assert(failFast_);
+  input_ = &sin;
+  collectComments_ = false;
+  collectCursorComments_ = collectComments;
+  buffer_.clear();
+  begin_ = end_ = current_ = buffer_.data();
+  streamOffset_ = 0;
+  inputDone_ = false;
+  validEnd_ = begin_;
+  invalidUTF8_ = nullptr;
+  pinned_ = nullptr;
+  valueBegin_ = nullptr;
+  lastValueEnd_ = nullptr;
+  lastValue_ = nullptr;
+  commentsBefore_.clear();
+  errors_.clear();
+  keyTable_.resize(0);
+  levels_.clear();
+  cursorState_ = cursorExpectValue;
+  cursorKind_ = Cursor::tokenEnd;
+
+  readMore();
+  skipBom(features_.skipBom_);
+  pinned_ = current_;
+}
+
+Cursor::Kind OurReader::nextCursorToken() {
+  switch (cursorState_) {
+  case cursorDone:
+    return cursorKind_ == Cursor::tokenError ? cursorKind_
+                                             : cursorKind_ = Cursor::tokenEnd;
+  case cursorExpectName:
+    return readCursorName();
+  case cursorExpectValue:
+    return readCursorToken();
+  case cursorAfterValue:
+    break;
   }
-  char c = '0'; // stopgap for already consumed character
-  // integral part
-  while (c >= '0' && c <= '9')
-    c = (current_ = p) < end_ ? *p++ : '\0';
-  // fractional part
-  if (c == '.') {
-    c = (current_ = p) < end_ ? *p++ : '\0';
-    while (c >= '0' && c <= '9')
-      c = (current_ = p) < end_ ? *p++ : '\0';
+
+  Token token;
+  if (levels_.empty()) {
+    skipStreamCommentTokens(token);
+    pinned_ = token.start_;
+    if (features_.failIfExtra_ && (token.type_ != tokenEndOfStream)) {
+      addError(ParseError::extraCharacters, token);
+      return failCursor();
+    }
+    // The root has just ended, at the token the cursor was at.
+    if (features_.strictRoot_ && cursorKind_ != Cursor::tokenObjectEnd &&
+        cursorKind_ != Cursor::tokenArrayEnd) {
+      // At the start of the document, as parse() reports it.
+      failFast_->code = ParseError::rootNotContainer;
+      failFast_->offset = 0;
+      return failCursor();
+    }
+    // parse() checks the whole document before anything else.
+    Location const end = pinned_;
+    pinned_ = nullptr;
+    while (features_.validateUTF8_ && !invalidUTF8_ && !inputDone_) {
+      current_ = end_;
+      readMore();
+    }
+    pinned_ = invalidUTF8_ ? invalidUTF8_ : std::min(end, end_);
+    if (invalidUTF8_)
+      return failCursor();
+    cursorState_ = cursorDone;
+    return cursorKind_ = Cursor::tokenEnd;
   }
-  // exponential part
-  if (c == 'e' || c == 'E') {
-    c = (current_ = p) < end_ ? *p++ : '\0';
-    if (c == '+' || c == '-')
-      c = (current_ = p) < end_ ? *p++ : '\0';
-    while (c >= '0' && c <= '9')
-      c = (current_ = p) < end_ ? *p++ : '\0';
+
+  Level const level = levels_.back();
+  bool ok = readStreamToken(token);
+  if (level.isObject) {
+    if (!ok ||
+        (token.type_ != tokenObjectEnd && token.type_ != tokenArraySeparator &&
+         token.type_ != tokenComment)) {
+      addError(ParseError::missingObjectSeparator, token);
+      return failCursor();
+    }
+    while (token.type_ == tokenComment && ok)
+      ok = readStreamToken(token);
+    if (token.type_ != tokenObjectEnd)
+      return readCursorName();
+  } else {
+    while (token.type_ == tokenComment && ok)
+      ok = readStreamToken(token);
+    if (!ok || (token.type_ != tokenArraySeparator &&
+                token.type_ != tokenArrayEnd)) {
+      addError(ParseError::missingArraySeparator, token);
+      return failCursor();
+    }
+    if (token.type_ == tokenArraySeparator)
+      return readCursorToken();
   }
-  return true;
+  pinned_ = token.start_;
+  keyTable_.resize(level.firstName);
+  levels_.pop_back();
+  return cursorKind_ =
+             level.isObject ? Cursor::tokenObjectEnd : Cursor::tokenArrayEnd;
 }
-bool OurReader::readString() {
-  Char c = 0;
-  while (current_ != end_) {
-    c = getNextChar();
-    if (c == '\\')
-      getNextChar();
-    else if (c == '"')
-      break;
+
+// Reads the name of a member, or the end of the object, after its '{' or a
+// ','.
+Cursor::Kind OurReader::readCursorName() {
+  Level& level = levels_.back();
+  Token tokenName;
+  bool ok = readStreamToken(tokenName);
+  while (tokenName.type_ == tokenComment && ok)
+    ok = readStreamToken(tokenName);
+  pinned_ = tokenName.start_;
+  if (ok && tokenName.type_ == tokenObjectEnd &&
+      (level.open || features_.allowTrailingCommas_)) {
+    keyTable_.resize(level.firstName);
+    levels_.pop_back();
+    cursorState_ = cursorAfterValue;
+    return cursorKind_ = Cursor::tokenObjectEnd;
   }
-  return c == '"';
+  name_.clear();
+  if (ok && tokenName.type_ == tokenString) {
+    if (!decodeString(tokenName, name_))
+      return failCursor();
+  } else if (ok && tokenName.type_ == tokenNumber &&
+             features_.allowNumericKeys_) {
+    Value numberName;
+    if (!decodeNumber(tokenName, numberName))
+      return failCursor();
+    name_ = numberName.asString();
+  } else {
+    addError(ParseError::missingMemberName, tokenName);
+    return failCursor();
+  }
+  level.open = name_.empty();
+  if (name_.length() >= (1U << 30)) {
+    exceedLimit(ParseError::keyTooLong, tokenName);
+    return failCursor();
+  }
+  // Only the hash of each name is kept, so that an object with many
+  // members does not hold their text.
+  if (features_.rejectDupKeys_) {
+    uint64_t hash = hashBasis;
+    for (char c : name_)
+      hash = hashByte(hash, c);
+    if (keyTable_.contains(hash, level.firstName,
+                           [](size_t) { return true; })) {
+      addError(ParseError::duplicateKey, tokenName);
+      return failCursor();
+    }
+    keyTable_.push(hash);
+  }
+
+  Token colon;
+  if (!readStreamToken(colon) || colon.type_ != tokenMemberSeparator) {
+    addError(ParseError::missingColon, colon);
+    return failCursor();
+  }
+  cursorState_ = cursorExpectValue;
+  return cursorKind_ = Cursor::tokenName;
 }
 
-bool OurReader::readStringSingleQuote() {
-  Char c = 0;
-  while (current_ != end_) {
-    c = getNextChar();
-    if (c == '\\')
-      getNextChar();
-    else if (c == '\'')
+// Reads the first token of a value, or, in an array, its end.
+Cursor::Kind OurReader::readCursorToken() {
+  if (!levels_.empty() && !levels_.back().isObject) {
+    Level& level = levels_.back();
+    skipStreamSpaces();
+    if (current_ != end_ && *current_ == ']' &&
+        (level.open || (features_.allowTrailingCommas_ &&
+                        !features_.allowDroppedNullPlaceholders_))) {
+      pinned_ = current_++;
+      levels_.pop_back();
+      cursorState_ = cursorAfterValue;
+      return cursorKind_ = Cursor::tokenArrayEnd;
+    }
+    level.open = false;
+  }
+
+  Token token;
+  if (levels_.size() + 1 > features_.stackLimit_) {
+    token.type_ = tokenError;
+    token.start_ = token.end_ = current_;
+    pinned_ = current_;
+    exceedLimit(ParseError::stackLimitExceeded, token);
+    return failCursor();
+  }
+  skipStreamCommentTokens(token);
+  pinned_ = token.start_;
+  cursorToken_ = token;
+  cursorState_ = cursorAfterValue;
+  Cursor::Kind kind;
+  switch (token.type_) {
+  case tokenObjectBegin:
+    levels_.push_back(Level{true, true, keyTable_.size()});
+    cursorState_ = cursorExpectName;
+    return cursorKind_ = Cursor::tokenObjectBegin;
+  case tokenArrayBegin:
+    levels_.push_back(Level{false, true, keyTable_.size()});
+    cursorState_ = cursorExpectValue;
+    return cursorKind_ = Cursor::tokenArrayBegin;
+  case tokenNumber:
+    if (!validateNumber(token))
+      return failCursor();
+    kind = Cursor::tokenNumber;
+    break;
+  case tokenString:
+    if (!validateString(token, nullptr, nullptr))
+      return failCursor();
+    kind = Cursor::tokenString;
+    break;
+  case tokenTrue:
+  case tokenFalse:
+    kind = Cursor::tokenBoolean;
+    break;
+  case tokenNull:
+    kind = Cursor::tokenNull;
+    break;
+  case tokenNaN:
+  case tokenPosInf:
+  case tokenNegInf:
+    kind = Cursor::tokenNumber;
+    break;
+  case tokenArraySeparator:
+  case tokenObjectEnd:
+  case tokenArrayEnd:
+    if (features_.allowDroppedNullPlaceholders_) {
+      pinned_ = --current_;
+      kind = Cursor::tokenNull;
       break;
+    } // else, fall through ...
+  default:
+    addError(ParseError::valueExpected, token);
+    return failCursor();
   }
-  return c == '\'';
+  return cursorKind_ = kind;
 }
 
-bool OurReader::readObject(Token& token) {
-  Token tokenName;
-  String name;
-  Value init(objectValue);
-  currentValue().swapPayload(init);
-  currentValue().setOffsetStart(token.start_ - begin_);
-  while (readToken(tokenName)) {
-    bool initialTokenOk = true;
-    while (tokenName.type_ == tokenComment && initialTokenOk)
-      initialTokenOk = readToken(tokenName);
-    if (!initialTokenOk)
-      break;
-    if (tokenName.type_ == tokenObjectEnd &&
-        (name.empty() ||
-         features_.allowTrailingCommas_)) // empty object or trailing comma
+bool OurReader::readCursorValue(Value* value) {
+  if (cursorKind_ == Cursor::tokenName &&
+      nextCursorToken() == Cursor::tokenError)
+    return false;
+  switch (cursorKind_) {
+  case Cursor::tokenObjectBegin:
+  case Cursor::tokenArrayBegin:
+    break;
+  case Cursor::tokenString:
+  case Cursor::tokenNumber:
+  case Cursor::tokenBoolean:
+  case Cursor::tokenNull:
+    if (!value)
+      return true;
+    if (pinned_ == current_) {
+      // A dropped null placeholder.
+      *value = Value();
       return true;
-    name.clear();
-    if (tokenName.type_ == tokenString) {
-      if (!decodeString(tokenName, name))
-        return recoverFromError(tokenObjectEnd);
-    } else if (tokenName.type_ == tokenNumber && features_.allowNumericKeys_) {
-      Value numberName;
-      if (!decodeNumber(tokenName, numberName))
-        return recoverFromError(tokenObjectEnd);
-      name = numberName.asString();
-    } else {
-      break;
-    }
-    if (name.length() >= (1U << 30))
-      throwRuntimeError("keylength >= 2^30");
-    if (features_.rejectDupKeys_ && currentValue().isMember(name)) {
-      String msg = "Duplicate key: '" + name + "'";
-      return addErrorAndRecover(msg, tokenName, tokenObjectEnd);
     }
+    if (parseCursorValue(pinned_, current_, levels_.size(), *value))
+      return true;
+    failCursor();
+    return false;
+  default:
+    return !value && cursorKind_ != Cursor::tokenError;
+  }
 
-    Token colon;
-    if (!readToken(colon) || colon.type_ != tokenMemberSeparator) {
-      return addErrorAndRecover("Missing ':' after object member name", colon,
-                                tokenObjectEnd);
-    }
-    Value& value = currentValue()[name];
-    nodes_.push(&value);
-    bool ok = readValue();
-    nodes_.pop();
-    if (!ok) // error already set
-      return recoverFromError(tokenObjectEnd);
+  // Steps through the container as next() would, keeping it in buffer_.
+  size_t const depth = levels_.size();
+  valueBegin_ = pinned_;
+  Cursor::Kind kind;
+  do {
+    kind = nextCursorToken();
+  } while (kind != Cursor::tokenError && levels_.size() >= depth);
+  Location const begin = valueBegin_;
+  valueBegin_ = nullptr;
+  if (kind == Cursor::tokenError)
+    return false;
+  if (value && !parseCursorValue(begin, current_, depth - 1, *value)) {
+    failCursor();
+    return false;
+  }
+  return true;
+}
 
-    Token comma;
-    if (!readToken(comma) ||
-        (comma.type_ != tokenObjectEnd && comma.type_ != tokenArraySeparator &&
-         comma.type_ != tokenComment)) {
-      return addErrorAndRecover("Missing ',' or '}' in object declaration",
-                                comma, tokenObjectEnd);
+// Parses the value from \a begin to \a end, in \a depth containers.
+bool OurReader::parseCursorValue(Location begin, Location end, size_t depth,
+                                 Value& value) {
+  OurFeatures features = features_;
+  features.strictRoot_ = false;
+  features.failIfExtra_ = false;
+  features.skipBom_ = false;
+  features.validateUTF8_ = false; // checked by readMore()
+  features.stackLimit_ -= std::min(features.stackLimit_, depth);
+  OurReader reader(features);
+  ParseError error;
+  reader.setFailFast(&error);
+  if (reader.parse(begin, end, value, collectCursorComments_))
+    return true;
+  if (failFast_->code == ParseError::none) {
+    failFast_->code = error.code;
+    failFast_->offset = documentOffset(begin) + error.offset;
+  }
+  return false;
+}
+
+Cursor::Kind OurReader::failCursor() {
+  // parse() checks the whole document before anything else.
+  if (invalidUTF8_) {
+    failFast_->code = ParseError::invalidUTF8;
+    failFast_->offset = documentOffset(invalidUTF8_);
+  }
+  cursorState_ = cursorDone;
+  return cursorKind_ = Cursor::tokenError;
+}
+
+void OurReader::skipCommentTokens(Token& token) {
+  if (features_.allowComments_) {
+    do {
+      readToken(token);
+    } while (token.type_ == tokenComment);
+  } else {
+    readToken(token);
+  }
+}
+
+bool OurReader::readToken(Token& token) {
+  skipSpaces();
+  token.start_ = current_;
+  Char c = getNextChar();
+  bool ok = true;
+  switch (c) {
+  case '{':
+    token.type_ = tokenObjectBegin;
+    break;
+  case '}':
+    token.type_ = tokenObjectEnd;
+    break;
+  case '[':
+    token.type_ = tokenArrayBegin;
+    break;
+  case ']':
+    token.type_ = tokenArrayEnd;
+    break;
+  case '"':
+    token.type_ = tokenString;
+    ok = readString();
+    break;
+  case '\'':
+    if (features_.allowSingleQuotes_) {
+      token.type_ = tokenString;
+      ok = readStringSingleQuote();
+    } else {
+      // If we don't allow single quotes, this is a failure case.
+      ok = false;
     }
-    bool finalizeTokenOk = true;
-    while (comma.type_ == tokenComment && finalizeTokenOk)
-      finalizeTokenOk = readToken(comma);
-    if (comma.type_ == tokenObjectEnd)
+    break;
+  case '/':
+    token.type_ = tokenComment;
+    ok = readComment();
+    break;
+  case '0':
+  case '1':
+  case '2':
+  case '3':
+  case '4':
+  case '5':
+  case '6':
+  case '7':
+  case '8':
+  case '9':
+    token.type_ = tokenNumber;
+    readNumber(false);
+    break;
+  case '-':
+    if (readNumber(true)) {
+      token.type_ = tokenNumber;
+    } else {
+      token.type_ = tokenNegInf;
+      ok = features_.allowSpecialFloats_ && match("nfinity", 7);
+    }
+    break;
+  case '+':
+    if (readNumber(true)) {
+      token.type_ = tokenNumber;
+    } else {
+      token.type_ = tokenPosInf;
+      ok = features_.allowSpecialFloats_ && match("nfinity", 7);
+    }
+    break;
+  case 't':
+    token.type_ = tokenTrue;
+    ok = match("rue", 3);
+    break;
+  case 'f':
+    token.type_ = tokenFalse;
+    ok = match("alse", 4);
+    break;
+  case 'n':
+    token.type_ = tokenNull;
+    ok = match("ull", 3);
+    break;
+  case 'N':
+    if (features_.allowSpecialFloats_) {
+      token.type_ = tokenNaN;
+      ok = match("aN", 2);
+    } else {
+      ok = false;
+    }
+    break;
+  case 'I':
+    if (features_.allowSpecialFloats_) {
+      token.type_ = tokenPosInf;
+      ok = match("nfinity", 7);
+    } else {
+      ok = false;
+    }
+    break;
+  case ',':
+    token.type_ = tokenArraySeparator;
+    break;
+  case ':':
+    token.type_ = tokenMemberSeparator;
+    break;
+  case 0:
+    token.type_ = tokenEndOfStream;
+    break;
+  default:
+    ok = false;
+    break;
+  }
+  if (!ok)
+    token.type_ = tokenError;
+  token.end_ = current_;
+  return ok;
+}
+
+void OurReader::skipSpaces() {
+  while (current_ != end_) {
+    Char c = *current_;
+    if (c == ' ' || c == '\t' || c == '\r' || c == '\n')
+      ++current_;
+    else
+      break;
+  }
+}
+
+void OurReader::skipBom(bool skipBom) {
+  bomLength_ = 0;
+  // The default behavior is to skip BOM.
+  if (skipBom) {
+    if ((end_ - begin_) >= 3 && strncmp(begin_, "\xEF\xBB\xBF", 3) == 0) {
+      begin_ += 3;
+      current_ = begin_;
+      bomLength_ = 3;
+    }
+  }
+}
+
+bool OurReader::match(const Char* pattern, int patternLength) {
+  if (end_ - current_ < patternLength)
+    return false;
+  int index = patternLength;
+  while (index--)
+    if (current_[index] != pattern[index])
+      return false;
+  current_ += patternLength;
+  return true;
+}
+
+bool OurReader::readComment() {
+  const Location commentBegin = current_ - 1;
+  const Char c = getNextChar();
+  bool successful = false;
+  bool cStyleWithEmbeddedNewline = false;
+
+  const bool isCStyleComment = (c == '*');
+  const bool isCppStyleComment = (c == '/');
+  if (isCStyleComment) {
+    successful = readCStyleComment(&cStyleWithEmbeddedNewline);
+  } else if (isCppStyleComment) {
+    successful = readCppStyleComment();
+  }
+
+  if (!successful)
+    return false;
+
+  if (collectComments_)
+    collectComment(commentBegin, current_,
+                   isCppStyleComment || !cStyleWithEmbeddedNewline);
+  return true;
+}
+
+// Gives the comment [begin, end) to the value before it, if it is the first
+// on the same line and \a canBeOnSameLine, or else to the next value.
+void OurReader::collectComment(Location begin, Location end,
+                               bool canBeOnSameLine) {
+  CommentPlacement placement = commentBefore;
+
+  if (!lastValueEnd_)
+    commentNeedsContext_ = true;
+  if (!lastValueHasAComment_) {
+    if (lastValueEnd_ && !containsNewLine(lastValueEnd_, begin)) {
+      if (canBeOnSameLine) {
+        placement = commentAfterOnSameLine;
+        lastValueHasAComment_ = true;
+      }
+    }
+  }
+
+  addComment(begin, end, placement);
+}
+
+void OurReader::appendNormalizedEOL(String& out, OurReader::Location begin,
+                                    OurReader::Location end) {
+  OurReader::Location current = static_cast<OurReader::Location>(
+      memchr(begin, '\r', static_cast<size_t>(end - begin)));
+  if (!current) {
+    out.append(begin, end);
+    return;
+  }
+  out.append(begin, current);
+  while (current != end) {
+    char c = *current++;
+    if (c == '\r') {
+      if (current != end && *current == '\n')
+        // convert dos EOL
+        ++current;
+      // convert Mac EOL
+      out += '\n';
+    } else {
+      out += c;
+    }
+  }
+}
+
+void OurReader::addComment(Location begin, Location end,
+                           CommentPlacement placement) {
+  assert(collectComments_);
+  if (placement != commentAfterOnSameLine) {
+    appendNormalizedEOL(commentsBefore_, begin, end);
+    return;
+  }
+  assert(lastValue_ != nullptr || writer_ != nullptr);
+  // Most comments have no '\r', and are set from the document itself.
+  if (memchr(begin, '\r', static_cast<size_t>(end - begin))) {
+    sameLineComment_.clear();
+    appendNormalizedEOL(sameLineComment_, begin, end);
+    begin = sameLineComment_.data();
+    end = begin + sameLineComment_.size();
+  }
+  if (writer_) {
+    writer_->comment(begin, end, placement);
+    return;
+  }
+  lastValue_->setComment(begin, static_cast<size_t>(end - begin), placement);
+}
+
+bool OurReader::readCStyleComment(bool* containsNewLineResult) {
+  *containsNewLineResult = false;
+
+  while ((current_ + 1) < end_) {
+    Char c = getNextChar();
+    if (c == '*' && *current_ == '/')
+      break;
+    if (c == '\n')
+      *containsNewLineResult = true;
+  }
+
+  return getNextChar() == '/';
+}
+
+bool OurReader::readCppStyleComment() {
+  while (current_ != end_) {
+    Char c = getNextChar();
+    if (c == '\n')
+      break;
+    if (c == '\r') {
+      // Consume DOS EOL. It will be normalized in addComment.
+      if (current_ != end_ && *current_ == '\n')
+        getNextChar();
+      // Break on Moc OS 9 EOL.
+      break;
+    }
+  }
+  return true;
+}
+
+// Reads 8 bytes so that the first one is the lowest, whatever the byte order.
+static inline uint64_t loadLittleEndian64(const char* p) {
+  uint64_t word = 0;
+  for (int i = 7; i >= 0; --i)
+    word = word << 8 | static_cast<unsigned char>(p[i]);
+  return word;
+}
+
+// Whether each byte of \a word is an ASCII digit.
+static inline bool isEightDigits(uint64_t word) {
+  return ((word & 0xF0F0F0F0F0F0F0F0) |
+          (((word + 0x0606060606060606) & 0xF0F0F0F0F0F0F0F0) >> 4)) ==
+         0x3333333333333333;
+}
+
+// Value of the 8 digits in \a word, the first of which is the lowest byte:
+// adjacent digits are combined into pairs, then quads, then the whole.
+static inline uint32_t parseEightDigits(uint64_t word) {
+  uint64_t const mask = 0x000000FF000000FF;
+  uint64_t const mul1 = 100 + (1000000ULL << 32);
+  uint64_t const mul2 = 1 + (10000ULL << 32);
+  word -= 0x3030303030303030;
+  word = (word * 10) + (word >> 8);
+  word = (((word & mask) * mul1) + (((word >> 16) & mask) * mul2)) >> 32;
+  return static_cast<uint32_t>(word);
+}
+
+bool OurReader::readNumber(bool checkInf) {
+  Location p = current_;
+  if (checkInf && p != end_ && *p == 'I') {
+    current_ = ++p;
+    return false;
+  }
+  // integral part, decoded while it is scanned. The token's first character,
+  // a digit or a sign, has already been consumed.
+  Location const first = p - 1;
+  bool const isNegative = *first == '-';
+  bool fits = *first != '+';
+  Value::LargestUInt value = 0;
+  if (*first >= '0' && *first <= '9')
+    value = static_cast<Value::UInt>(*first - '0');
+  static constexpr Value::LargestUInt threshold = Value::maxLargestUInt / 10;
+  static constexpr Value::UInt maxLastDigit = Value::maxLargestUInt % 10;
+  while (end_ - p >= 8) {
+    uint64_t const word = loadLittleEndian64(p);
+    if (!isEightDigits(word))
+      break;
+    Value::UInt const digits = parseEightDigits(word);
+    if (value > (Value::maxLargestUInt - digits) / 100000000)
+      fits = false;
+    value = value * 100000000 + digits;
+    p += 8;
+  }
+  while (p != end_ && *p >= '0' && *p <= '9') {
+    const auto digit = static_cast<Value::UInt>(*p++ - '0');
+    if (value > threshold || (value == threshold && digit > maxLastDigit))
+      fits = false;
+    value = value * 10 + digit;
+  }
+  Location const integralEnd = p;
+  char c = (current_ = p) < end_ ? *p++ : '\0';
+  // fractional part
+  if (c == '.') {
+    c = (current_ = p) < end_ ? *p++ : '\0';
+    while (c >= '0' && c <= '9')
+      c = (current_ = p) < end_ ? *p++ : '\0';
+  }
+  // exponential part
+  if (c == 'e' || c == 'E') {
+    c = (current_ = p) < end_ ? *p++ : '\0';
+    if (c == '+' || c == '-')
+      c = (current_ = p) < end_ ? *p++ : '\0';
+    while (c >= '0' && c <= '9')
+      c = (current_ = p) < end_ ? *p++ : '\0';
+  }
+  // The magnitude of minLargestInt is maxLargestInt + 1.
+  if (isNegative && value > Value::LargestUInt(Value::maxLargestInt) + 1)
+    fits = false;
+  numberEnd_ = current_;
+  numberMagnitude_ = value;
+  numberIsInteger_ = fits && current_ == integralEnd;
+  return true;
+}
+bool OurReader::readString() {
+  // The string ends at the first quote that does not follow an odd number
+  // of backslashes.
+  Location const begin = current_;
+  while (current_ != end_) {
+    auto quote = static_cast<Location>(
+        memchr(current_, '"', static_cast<size_t>(end_ - current_)));
+    if (!quote)
+      break;
+    Location escapes = quote;
+    while (escapes != begin && escapes[-1] == '\\')
+      --escapes;
+    current_ = quote + 1;
+    if ((quote - escapes) % 2 == 0)
       return true;
   }
-  return addErrorAndRecover("Missing '}' or object member name", tokenName,
-                            tokenObjectEnd);
+  current_ = end_;
+  return false;
+}
+
+bool OurReader::readStringSingleQuote() {
+  Char c = 0;
+  while (current_ != end_) {
+    c = getNextChar();
+    if (c == '\\')
+      getNextChar();
+    else if (c == '\'')
+      break;
+  }
+  return c == '\'';
+}
+
+bool OurReader::readObject(Token& token) {
+  Token tokenName;
+  String name;
+  Value init(objectValue);
+  currentValue().swapPayload(init);
+  currentValue().setOffsetStart(token.start_ - begin_);
+  while (readToken(tokenName)) {
+    bool initialTokenOk = true;
+    while (tokenName.type_ == tokenComment && initialTokenOk)
+      initialTokenOk = readToken(tokenName);
+    if (!initialTokenOk)
+      break;
+    if (tokenName.type_ == tokenObjectEnd &&
+        (name.empty() ||
+         features_.allowTrailingCommas_)) // empty object or trailing comma
+      return true;
+    name.clear();
+    if (tokenName.type_ == tokenString) {
+      if (!decodeString(tokenName, name))
+        return recoverFromError(tokenObjectEnd);
+    } else if (tokenName.type_ == tokenNumber && features_.allowNumericKeys_) {
+      Value numberName;
+      if (!decodeNumber(tokenName, numberName))
+        return recoverFromError(tokenObjectEnd);
+      name = numberName.asString();
+    } else {
+      break;
+    }
+    if (name.length() >= (1U << 30))
+      return exceedLimit(ParseError::keyTooLong, tokenName);
+    if (features_.rejectDupKeys_ && currentValue().isMember(name)) {
+      if (failFast_)
+        return addErrorAndRecover(ParseError::duplicateKey, tokenName,
+                                  tokenObjectEnd);
+      String msg = "Duplicate key: '" + name + "'";
+      return addErrorAndRecover(msg, tokenName, tokenObjectEnd);
+    }
+
+    Token colon;
+    if (!readToken(colon) || colon.type_ != tokenMemberSeparator) {
+      return addErrorAndRecover(ParseError::missingColon, colon,
+                                tokenObjectEnd);
+    }
+    Value& value = currentValue()[name];
+    nodes_.push(&value);
+    bool ok = readValue();
+    nodes_.pop();
+    if (!ok) // error already set
+      return recoverFromError(tokenObjectEnd);
+
+    Token comma;
+    if (!readToken(comma) ||
+        (comma.type_ != tokenObjectEnd && comma.type_ != tokenArraySeparator &&
+         comma.type_ != tokenComment)) {
+      return addErrorAndRecover(ParseError::missingObjectSeparator, comma,
+                                tokenObjectEnd);
+    }
+    bool finalizeTokenOk = true;
+    while (comma.type_ == tokenComment && finalizeTokenOk)
+      finalizeTokenOk = readToken(comma);
+    if (comma.type_ == tokenObjectEnd)
+      return true;
+  }
+  return addErrorAndRecover(ParseError::missingMemberName, tokenName,
+                            tokenObjectEnd);
+}
+
+bool OurReader::readArray(Token& token) {
+  Value init(arrayValue);
+  currentValue().swapPayload(init);
+  currentValue().setOffsetStart(token.start_ - begin_);
+  int index = 0;
+  for (;;) {
+    skipSpaces();
+    if (current_ != end_ && *current_ == ']' &&
+        (index == 0 ||
+         (features_.allowTrailingCommas_ &&
+          !features_.allowDroppedNullPlaceholders_))) // empty array or trailing
+                                                      // comma
+    {
+      Token endArray;
+      readToken(endArray);
+      return true;
+    }
+    // Elements read ahead are taken in only from the root array.
+    if (!segments_ || nodes_.size() != 1 || !takeSegment(&index)) {
+      Value& value = currentValue()[index++];
+      nodes_.push(&value);
+      bool ok = readValue();
+      nodes_.pop();
+      if (!ok) // error already set
+        return recoverFromError(tokenArrayEnd);
+    }
+
+    Token currentToken;
+    // Accept Comment after last item in the array.
+    bool ok = readToken(currentToken);
+    while (currentToken.type_ == tokenComment && ok) {
+      ok = readToken(currentToken);
+    }
+    bool badTokenType = (currentToken.type_ != tokenArraySeparator &&
+                         currentToken.type_ != tokenArrayEnd);
+    if (!ok || badTokenType) {
+      return addErrorAndRecover(ParseError::missingArraySeparator,
+                                currentToken, tokenArrayEnd);
+    }
+    if (currentToken.type_ == tokenArrayEnd)
+      break;
+  }
+  return true;
+}
+
+// Takes in the segment read ahead from current_, if there is one that was
+// read without error, as the elements from *index on.
+bool OurReader::takeSegment(int* index) {
+  std::vector<Segment>& segments = *segments_;
+  while (nextSegment_ < segments.size() &&
+         segments[nextSegment_].begin < current_)
+    ++nextSegment_;
+  if (nextSegment_ == segments.size() ||
+      segments[nextSegment_].begin != current_ ||
+      !segments[nextSegment_].ok ||
+      (collectComments_ && !commentsBefore_.empty()))
+    return false;
+  Segment& segment = segments[nextSegment_++];
+  Value& array = currentValue();
+  for (Value& element : segment.elements)
+    array[(*index)++].swap(element);
+  segment.elements.clear();
+  current_ = segment.end;
+  if (collectComments_) {
+    lastValueEnd_ = current_;
+    lastValueHasAComment_ = false;
+    lastValue_ = &array[*index - 1];
+    commentsBefore_.swap(segment.commentsBefore);
+  }
+  return true;
+}
+
+// Reads elements of the root array from segment.begin as readArray() would,
+// up to the end of the array, or up to the first that starts at or after
+// \a limit where findElementStart() would find it. The segment is not ok if
+// there is an error, or a comment that would have gone to the element before
+// the segment. Returns false if it ends where the root array cannot, so that
+// segment.begin was not where one of its elements starts.
+bool OurReader::readSegment(const char* beginDoc, const char* endDoc,
+                            bool collectComments, Location limit,
+                            Segment& segment) {
+  begin_ = beginDoc;
+  end_ = endDoc;
+  collectComments_ = collectComments && features_.allowComments_;
+  current_ = segment.begin;
+  lastValueEnd_ = nullptr;
+  lastValue_ = nullptr;
+  commentsBefore_.clear();
+  errors_.clear();
+  commentNeedsContext_ = false;
+  while (!nodes_.empty())
+    nodes_.pop();
+  // Stands for the root array, so that the stack limit applies as in parse().
+  Value root;
+  nodes_.push(&root);
+  segment.elements.clear();
+  segment.ok = false;
+  char const first = *segment.begin;
+  for (;;) {
+    segment.elements.emplace_back();
+    nodes_.push(&segment.elements.back());
+    bool ok = readValue();
+    nodes_.pop();
+    if (!ok)
+      return false;
+    if (commentNeedsContext_)
+      return true;
+    segment.end = current_;
+    segment.commentsBefore = commentsBefore_;
+    Location const separator = skipWhitespace(current_, end_);
+    if (separator != end_ && *separator == ',') {
+      Location const next = skipWhitespace(separator + 1, end_);
+      if (next >= limit && next != end_ &&
+          isElementStart(current_[-1], *next, first)) {
+        segment.ok = true;
+        return true;
+      }
+    }
+
+    Token token;
+    ok = readToken(token);
+    while (token.type_ == tokenComment && ok)
+      ok = readToken(token);
+    if (!ok || (token.type_ != tokenArraySeparator &&
+                token.type_ != tokenArrayEnd))
+      return false;
+    if (token.type_ == tokenArrayEnd)
+      break;
+    skipSpaces();
+    if (current_ != end_ && *current_ == ']' && features_.allowTrailingCommas_) {
+      readToken(token);
+      break;
+    }
+  }
+  // Only comments may follow the root array.
+  collectComments_ = false;
+  Token token;
+  skipCommentTokens(token);
+  if (token.type_ != tokenEndOfStream)
+    return false;
+  segment.ok = true;
+  return true;
+}
+
+bool OurReader::decodeNumber(Token& token) {
+  Value decoded;
+  if (!decodeNumber(token, decoded))
+    return false;
+  currentValue().swapPayload(decoded);
+  currentValue().setOffsetStart(token.start_ - begin_);
+  currentValue().setOffsetLimit(token.end_ - begin_);
+  return true;
+}
+
+bool OurReader::decodeNumber(Token& token, Value& decoded) {
+  // readNumber() has decoded the integer while scanning the token. If the
+  // number has a fraction or an exponent, or does not fit in an integer,
+  // we decode it as a double.
+  assert(token.end_ == numberEnd_);
+  if (!numberIsInteger_)
+    return decodeDouble(token, decoded);
+
+  Value::LargestUInt const value = numberMagnitude_;
+  if (*token.start_ == '-') {
+    // Negate without overflowing on minLargestInt, whose magnitude is only
+    // representable as an unsigned integer.
+    static_assert(Value::minLargestInt / 10 >= -Value::maxLargestInt,
+                  "The absolute value of minLargestInt must be only 1 "
+                  "magnitude larger than maxLargest Int");
+    const auto last_digit = static_cast<Value::UInt>(value % 10);
+    decoded = -Value::LargestInt(value / 10) * 10 - last_digit;
+  } else if (value <= Value::LargestUInt(Value::maxLargestInt)) {
+    decoded = Value::LargestInt(value);
+  } else {
+    decoded = value;
+  }
+
+  return true;
+}
+
+bool OurReader::decodeDouble(Token& token) {
+  Value decoded;
+  if (!decodeDouble(token, decoded))
+    return false;
+  currentValue().swapPayload(decoded);
+  currentValue().setOffsetStart(token.start_ - begin_);
+  currentValue().setOffsetLimit(token.end_ - begin_);
+  return true;
+}
+
+bool OurReader::decodeDouble(Token& token, Value& decoded) {
+  double value = 0;
+  const String buffer(token.start_, token.end_);
+  IStringStream is(buffer);
+  if (!(is >> value)) {
+    if (failFast_)
+      return addError(ParseError::notANumber, token);
+    return addError(
+        "'" + String(token.start_, token.end_) + "' is not a number.", token);
+  }
+  decoded = value;
+  return true;
+}
+
+bool OurReader::decodeString(Token& token) {
+  String decoded_string;
+  if (!decodeString(token, decoded_string))
+    return false;
+  Value decoded(decoded_string);
+  currentValue().swapPayload(decoded);
+  currentValue().setOffsetStart(token.start_ - begin_);
+  currentValue().setOffsetLimit(token.end_ - begin_);
+  return true;
+}
+
+bool OurReader::decodeString(Token& token, String& decoded) {
+  decoded.reserve(static_cast<size_t>(token.end_ - token.start_ - 2));
+  Location current = token.start_ + 1; // skip '"'
+  Location end = token.end_ - 1;       // do not include '"'
+  while (current != end) {
+    Char c = *current++;
+    if (c == '"')
+      break;
+    if (c == '\\') {
+      if (current == end)
+        return addError(ParseError::emptyEscape, token, current);
+      Char escape = *current++;
+      switch (escape) {
+      case '"':
+        decoded += '"';
+        break;
+      case '/':
+        decoded += '/';
+        break;
+      case '\\':
+        decoded += '\\';
+        break;
+      case 'b':
+        decoded += '\b';
+        break;
+      case 'f':
+        decoded += '\f';
+        break;
+      case 'n':
+        decoded += '\n';
+        break;
+      case 'r':
+        decoded += '\r';
+        break;
+      case 't':
+        decoded += '\t';
+        break;
+      case 'u': {
+        unsigned int unicode;
+        if (!decodeUnicodeCodePoint(token, current, end, unicode))
+          return false;
+        decoded += codePointToUTF8(unicode);
+      } break;
+      default:
+        return addError(ParseError::badEscape, token, current);
+      }
+    } else {
+      // Copy the whole run of unescaped characters at once.
+      Location run = current - 1;
+      while (current != end && *current != '"' && *current != '\\')
+        ++current;
+      decoded.append(run, current);
+    }
+  }
+  return true;
+}
+
+bool OurReader::decodeUnicodeCodePoint(Token& token, Location& current,
+                                       Location end, unsigned int& unicode) {
+
+  if (!decodeUnicodeEscapeSequence(token, current, end, unicode))
+    return false;
+  if (unicode >= 0xD800 && unicode <= 0xDBFF) {
+    // surrogate pairs
+    if (end - current < 6)
+      return addError(ParseError::surrogatePairTooShort, token, current);
+    if (*(current++) == '\\' && *(current++) == 'u') {
+      unsigned int surrogatePair;
+      if (decodeUnicodeEscapeSequence(token, current, end, surrogatePair)) {
+        unicode = 0x10000 + ((unicode & 0x3FF) << 10) + (surrogatePair & 0x3FF);
+      } else
+        return false;
+    } else
+      return addError(ParseError::missingLowSurrogate, token, current);
+  }
+  return true;
+}
+
+bool OurReader::decodeUnicodeEscapeSequence(Token& token, Location& current,
+                                            Location end,
+                                            unsigned int& ret_unicode) {
+  if (end - current < 4)
+    return addError(ParseError::unicodeEscapeTooShort, token, current);
+  int unicode = 0;
+  for (int index = 0; index < 4; ++index) {
+    Char c = *current++;
+    unicode *= 16;
+    if (c >= '0' && c <= '9')
+      unicode += c - '0';
+    else if (c >= 'a' && c <= 'f')
+      unicode += c - 'a' + 10;
+    else if (c >= 'A' && c <= 'F')
+      unicode += c - 'A' + 10;
+    else
+      return addError(ParseError::badUnicodeEscapeDigit, token, current);
+  }
+  ret_unicode = static_cast<unsigned int>(unicode);
+  return true;
+}
+
+bool OurReader::addError(const String& message, Token& token, Location extra) {
+  ErrorInfo info;
+  info.token_ = token;
+  info.message_ = message;
+  info.extra_ = extra;
+  errors_.push_back(info);
+  return false;
+}
+
+bool OurReader::addError(ParseError::Code code, Token& token, Location extra) {
+  if (!failFast_)
+    return addError(ParseError::message(code), token, extra);
+  // Only the first error counts: the ones after it follow from it.
+  if (failFast_->code == ParseError::none) {
+    failFast_->code = code;
+    failFast_->offset = documentOffset(token.start_);
+  }
+  return false;
+}
+
+// Limits throw, as they always have, unless parsing fails fast.
+bool OurReader::exceedLimit(ParseError::Code code, Token& token) {
+  if (!failFast_)
+    throwRuntimeError(ParseError::message(code));
+  return addError(code, token);
+}
+
+bool OurReader::recoverFromError(TokenType skipUntilToken) {
+  if (failFast_)
+    return false;
+  size_t errorCount = errors_.size();
+  Token skip;
+  for (;;) {
+    if (!readToken(skip))
+      errors_.resize(errorCount); // discard errors caused by recovery
+    if (skip.type_ == skipUntilToken || skip.type_ == tokenEndOfStream)
+      break;
+  }
+  errors_.resize(errorCount);
+  return false;
+}
+
+bool OurReader::addErrorAndRecover(const String& message, Token& token,
+                                   TokenType skipUntilToken) {
+  addError(message, token);
+  return recoverFromError(skipUntilToken);
+}
+
+bool OurReader::addErrorAndRecover(ParseError::Code code, Token& token,
+                                   TokenType skipUntilToken) {
+  addError(code, token);
+  return recoverFromError(skipUntilToken);
+}
+
+Value& OurReader::currentValue() { return *(nodes_.top()); }
+
+OurReader::Char OurReader::getNextChar() {
+  if (current_ == end_)
+    return 0;
+  return *current_++;
+}
+
+String OurReader::getFormattedErrorMessages() const {
+  String formattedMessage;
+  SourceMap const sourceMap(begin_, end_);
+  for (const auto& error : errors_) {
+    formattedMessage +=
+        "* " + sourceMap.getLineAndColumn(error.token_.start_ - begin_) + "\n";
+    formattedMessage += "  " + error.message_ + "\n";
+    if (error.extra_)
+      formattedMessage += "See " +
+                          sourceMap.getLineAndColumn(error.extra_ - begin_) +
+                          " for detail.\n";
+  }
+  return formattedMessage;
+}
+
+std::vector<OurReader::StructuredError> OurReader::getStructuredErrors() const {
+  std::vector<OurReader::StructuredError> allErrors;
+  for (const auto& error : errors_) {
+    OurReader::StructuredError structured;
+    structured.offset_start = error.token_.start_ - begin_;
+    structured.offset_limit = error.token_.end_ - begin_;
+    structured.message = error.message_;
+    allErrors.push_back(structured);
+  }
+  return allErrors;
+}
+
+// A built-in reader, to which CharReader::tryParse() and validate() hand
+// documents. They are not virtual, so that the layout of CharReader stays
+// the one readers built against older headers have.
+class OurCharReaderBase : public CharReader {
+public:
+  virtual bool tryParseDocument(char const* beginDoc, char const* endDoc,
+                                Value* root, ParseError* error) = 0;
+  virtual bool validateDocument(char const* beginDoc, char const* endDoc,
+                                ParseError* error) = 0;
+};
+
+class OurCharReader : public OurCharReaderBase {
+  bool const collectComments_;
+  OurReader reader_;
+
+public:
+  OurCharReader(bool collectComments, OurFeatures const& features)
+      : collectComments_(collectComments), reader_(features) {}
+  bool parse(char const* beginDoc, char const* endDoc, Value* root,
+             String* errs) override {
+    reader_.setFailFast(nullptr);
+    bool ok = reader_.parse(beginDoc, endDoc, *root, collectComments_);
+    if (errs) {
+      *errs = reader_.getFormattedErrorMessages();
+    }
+    return ok;
+  }
+  bool tryParseDocument(char const* beginDoc, char const* endDoc, Value* root,
+                        ParseError* error) override {
+    ParseError ignored;
+    *(error ? error : &ignored) = ParseError();
+    reader_.setFailFast(error ? error : &ignored);
+    bool ok = reader_.parse(beginDoc, endDoc, *root, collectComments_);
+    reader_.setFailFast(nullptr);
+    return ok;
+  }
+  bool validateDocument(char const* beginDoc, char const* endDoc,
+                        ParseError* error) override {
+    ParseError ignored;
+    *(error ? error : &ignored) = ParseError();
+    reader_.setFailFast(error ? error : &ignored);
+    bool ok = reader_.validate(beginDoc, endDoc);
+    reader_.setFailFast(nullptr);
+    return ok;
+  }
+};
+
+// Reads documents with OurReader::parseStructural(), and has a second
+// OurReader read those it rejects, to report their errors as OurCharReader
+// would, all of them. Both reject invalid UTF-8.
+class OurStructuralCharReader : public OurCharReaderBase {
+  OurReader reader_;
+  OurReader errorReader_;
+
+  static OurFeatures validatingUTF8(OurFeatures features) {
+    features.validateUTF8_ = true;
+    return features;
+  }
+
+public:
+  explicit OurStructuralCharReader(OurFeatures const& features)
+      : reader_(features), errorReader_(validatingUTF8(features)) {}
+  bool parse(char const* beginDoc, char const* endDoc, Value* root,
+             String* errs) override {
+    reader_.setFailFast(nullptr);
+    errorReader_.setFailFast(nullptr);
+    bool ok = reader_.parseStructural(beginDoc, endDoc, root);
+    if (!ok)
+      ok = errorReader_.parse(beginDoc, endDoc, *root, false);
+    if (errs) {
+      *errs = ok ? String() : errorReader_.getFormattedErrorMessages();
+    }
+    return ok;
+  }
+  bool tryParseDocument(char const* beginDoc, char const* endDoc, Value* root,
+                        ParseError* error) override {
+    ParseError ignored;
+    ParseError* const failFast = error ? error : &ignored;
+    *failFast = ParseError();
+    reader_.setFailFast(failFast);
+    bool ok = reader_.parseStructural(beginDoc, endDoc, root);
+    if (!ok) {
+      *failFast = ParseError();
+      errorReader_.setFailFast(failFast);
+      ok = errorReader_.parse(beginDoc, endDoc, *root, false);
+      errorReader_.setFailFast(nullptr);
+    }
+    reader_.setFailFast(nullptr);
+    return ok;
+  }
+  bool validateDocument(char const* beginDoc, char const* endDoc,
+                        ParseError* error) override {
+    ParseError ignored;
+    ParseError* const failFast = error ? error : &ignored;
+    *failFast = ParseError();
+    reader_.setFailFast(failFast);
+    bool ok = reader_.parseStructural(beginDoc, endDoc, nullptr);
+    if (!ok) {
+      *failFast = ParseError();
+      errorReader_.setFailFast(failFast);
+      ok = errorReader_.validate(beginDoc, endDoc);
+      errorReader_.setFailFast(nullptr);
+    }
+    reader_.setFailFast(nullptr);
+    return ok;
+  }
+};
+
+static OurFeatures featuresFromSettings(Value const& settings) {
+  OurFeatures features = OurFeatures::all();
+  features.allowComments_ = settings["allowComments"].asBool();
+  features.allowTrailingCommas_ = settings["allowTrailingCommas"].asBool();
+  features.strictRoot_ = settings["strictRoot"].asBool();
+  features.allowDroppedNullPlaceholders_ =
+      settings["allowDroppedNullPlaceholders"].asBool();
+  features.allowNumericKeys_ = settings["allowNumericKeys"].asBool();
+  features.allowSingleQuotes_ = settings["allowSingleQuotes"].asBool();
+
+  // Stack limit is always a size_t, so we get this as an unsigned int
+  // regardless of it we have 64-bit integer support enabled.
+  features.stackLimit_ = static_cast<size_t>(settings["stackLimit"].asUInt());
+  features.failIfExtra_ = settings["failIfExtra"].asBool();
+  features.rejectDupKeys_ = settings["rejectDupKeys"].asBool();
+  features.allowSpecialFloats_ = settings["allowSpecialFloats"].asBool();
+  features.skipBom_ = settings["skipBom"].asBool();
+  features.validateUTF8_ = settings["validateUTF8"].asBool();
+  return features;
+}
+
+// The settings of a CharReaderBuilder, as its readers use them.
+struct ReaderOptions {
+  explicit ReaderOptions(Value const& settings)
+      : collectComments(settings["collectComments"].asBool()),
+        features(featuresFromSettings(settings)) {
+    // Without failIfExtra, OurReader ignores what follows the root, which
+    // the structural index would have to read.
+    structuralIndex = settings["structuralIndex"].asBool() &&
+                      features.failIfExtra_ && !features.allowComments_ &&
+                      !features.allowSingleQuotes_ &&
+                      !features.allowNumericKeys_ &&
+                      !features.allowDroppedNullPlaceholders_;
+  }
+  CharReader* newCharReader() const {
+    if (structuralIndex)
+      return new OurStructuralCharReader(features);
+    return new OurCharReader(collectComments, features);
+  }
+
+  bool collectComments;
+  OurFeatures features;
+  bool structuralIndex;
+};
+
+bool CharReader::tryParse(char const* beginDoc, char const* endDoc,
+                          Value* root, ParseError* error) {
+  if (auto* reader = dynamic_cast<OurCharReaderBase*>(this))
+    return reader->tryParseDocument(beginDoc, endDoc, root, error);
+  bool const ok = parse(beginDoc, endDoc, root, nullptr);
+  if (error) {
+    *error = ParseError();
+    if (!ok)
+      error->code = ParseError::other;
+  }
+  return ok;
+}
+
+bool CharReader::validate(char const* beginDoc, char const* endDoc,
+                          ParseError* error) {
+  if (auto* reader = dynamic_cast<OurCharReaderBase*>(this))
+    return reader->validateDocument(beginDoc, endDoc, error);
+  Value root;
+  return tryParse(beginDoc, endDoc, &root, error);
+}
+
+CharReaderBuilder::CharReaderBuilder() { setDefaults(&settings_); }
+CharReaderBuilder::~CharReaderBuilder() = default;
+CharReader* CharReaderBuilder::newCharReader() const {
+  return ReaderOptions(settings_).newCharReader();
+}
+
+bool CharReaderBuilder::validate(Json::Value* invalid) const {
+  static const auto& valid_keys = *new std::set<String>{
+      "collectComments",
+      "allowComments",
+      "allowTrailingCommas",
+      "strictRoot",
+      "allowDroppedNullPlaceholders",
+      "allowNumericKeys",
+      "allowSingleQuotes",
+      "stackLimit",
+      "failIfExtra",
+      "rejectDupKeys",
+      "allowSpecialFloats",
+      "skipBom",
+      "structuralIndex",
+      "validateUTF8",
+  };
+  for (auto si = settings_.begin(); si != settings_.end(); ++si) {
+    auto key = si.name();
+    if (valid_keys.count(key))
+      continue;
+    if (invalid)
+      (*invalid)[std::move(key)] = *si;
+    else
+      return false;
+  }
+  return invalid ? invalid->empty() : true;
+}
+
+Value& CharReaderBuilder::operator[](const String& key) {
+  return settings_[key];
+}
+// static
+void CharReaderBuilder::strictMode(Json::Value* settings) {
+  //! [CharReaderBuilderStrictMode]
+  (*settings)["allowComments"] = false;
+  (*settings)["allowTrailingCommas"] = false;
+  (*settings)["strictRoot"] = true;
+  (*settings)["allowDroppedNullPlaceholders"] = false;
+  (*settings)["allowNumericKeys"] = false;
+  (*settings)["allowSingleQuotes"] = false;
+  (*settings)["stackLimit"] = 1000;
+  (*settings)["failIfExtra"] = true;
+  (*settings)["rejectDupKeys"] = true;
+  (*settings)["allowSpecialFloats"] = false;
+  (*settings)["skipBom"] = true;
+  //! [CharReaderBuilderStrictMode]
+}
+// static
+void CharReaderBuilder::setDefaults(Json::Value* settings) {
+  //! [CharReaderBuilderDefaults]
+  (*settings)["collectComments"] = true;
+  (*settings)["allowComments"] = true;
+  (*settings)["allowTrailingCommas"] = true;
+  (*settings)["strictRoot"] = false;
+  (*settings)["allowDroppedNullPlaceholders"] = false;
+  (*settings)["allowNumericKeys"] = false;
+  (*settings)["allowSingleQuotes"] = false;
+  (*settings)["stackLimit"] = 1000;
+  (*settings)["failIfExtra"] = false;
+  (*settings)["rejectDupKeys"] = false;
+  (*settings)["allowSpecialFloats"] = false;
+  (*settings)["skipBom"] = true;
+  (*settings)["structuralIndex"] = false;
+  (*settings)["validateUTF8"] = false;
+  //! [CharReaderBuilderDefaults]
+}
+
+// class CharReaderConfig
+// //////////////////////////////////////////////////////////////////
+
+class CharReaderConfig::Impl {
+public:
+  explicit Impl(Value const& settings) : options_(settings) {}
+
+  ReaderOptions const options_;
+};
+
+CharReaderConfig::CharReaderConfig(CharReaderBuilder const& builder)
+    : impl_(std::make_shared<Impl const>(builder.settings_)) {}
+
+CharReaderConfig::~CharReaderConfig() = default;
+
+CharReader* CharReaderConfig::newCharReader() const {
+  return impl_->options_.newCharReader();
+}
+
+CharReader& CharReaderConfig::reader() const {
+  // The reader of the last config this thread parsed with. Holding on to that
+  // config also keeps another one from being made at the same address.
+  thread_local std::shared_ptr<Impl const> config;
+  thread_local CharReaderPtr reader;
+  if (config != impl_) {
+    reader.reset(newCharReader());
+    config = impl_;
+  }
+  return *reader;
+}
+
+bool CharReaderConfig::parse(char const* beginDoc, char const* endDoc,
+                             Value* root, String* errs) const {
+  return reader().parse(beginDoc, endDoc, root, errs);
+}
+
+bool CharReaderConfig::tryParse(char const* beginDoc, char const* endDoc,
+                                Value* root, ParseError* error) const {
+  return reader().tryParse(beginDoc, endDoc, root, error);
+}
+
+bool CharReaderConfig::validate(char const* beginDoc, char const* endDoc,
+                                ParseError* error) const {
+  return reader().validate(beginDoc, endDoc, error);
+}
+
+// static
+CharReaderConfig const& CharReaderConfig::defaults() {
+  static CharReaderConfig const& config =
+      *new CharReaderConfig(CharReaderBuilder());
+  return config;
+}
+
+// class MsgPackReader
+// //////////////////////////////////////////////////////////////////
+
+class MsgPackReader : public CharReader {
+public:
+  explicit MsgPackReader(size_t stackLimit) : stackLimit_(stackLimit) {}
+  bool parse(char const* beginDoc, char const* endDoc, Value* root,
+             String* errs) override;
+
+private:
+  bool readValue(Value& value, size_t depth);
+  bool readString(size_t size, Value& value);
+  bool readArray(size_t size, Value& value, size_t depth);
+  bool readMap(size_t size, Value& value, size_t depth);
+  // Reads a big-endian unsigned integer of \a bytes bytes.
+  bool readBigEndian(unsigned bytes, uint64_t& value);
+  bool addError(const char* message, const unsigned char* at);
+
+  size_t const stackLimit_;
+  const unsigned char* begin_ = nullptr;
+  const unsigned char* current_ = nullptr;
+  const unsigned char* end_ = nullptr;
+  String error_;
+};
+
+bool MsgPackReader::parse(char const* beginDoc, char const* endDoc,
+                          Value* root, String* errs) {
+  begin_ = current_ = reinterpret_cast<const unsigned char*>(beginDoc);
+  end_ = reinterpret_cast<const unsigned char*>(endDoc);
+  error_.clear();
+  Value value;
+  bool ok = readValue(value, 0);
+  if (ok && current_ != end_)
+    ok = addError("Extra data after MessagePack value.", current_);
+  if (ok)
+    root->swap(value);
+  if (errs)
+    *errs = error_;
+  return ok;
+}
+
+bool MsgPackReader::readValue(Value& value, size_t depth) {
+  if (depth > stackLimit_)
+    throwRuntimeError("Exceeded stackLimit in readValue().");
+  if (current_ == end_)
+    return addError("Unexpected end of MessagePack data.", current_);
+  const unsigned char* const start = current_;
+  unsigned const code = *current_++;
+  uint64_t bits = 0;
+  if (code <= 0x7f) {
+    value = LargestInt(code);
+    return true;
+  }
+  if (code >= 0xe0) {
+    value = LargestInt(static_cast<signed char>(code));
+    return true;
+  }
+  if (code <= 0x8f)
+    return readMap(code & 0x0f, value, depth);
+  if (code <= 0x9f)
+    return readArray(code & 0x0f, value, depth);
+  if (code <= 0xbf)
+    return readString(code & 0x1f, value);
+  switch (code) {
+  case 0xc0:
+    value = Value();
+    return true;
+  case 0xc2:
+  case 0xc3:
+    value = code == 0xc3;
+    return true;
+  case 0xca: {
+    if (!readBigEndian(4, bits))
+      return false;
+    auto const narrow = static_cast<uint32_t>(bits);
+    float real;
+    static_assert(sizeof(real) == sizeof(narrow), "float must be 32-bit");
+    memcpy(&real, &narrow, sizeof(real));
+    value = double(real);
+    return true;
+  }
+  case 0xcb: {
+    if (!readBigEndian(8, bits))
+      return false;
+    double real;
+    static_assert(sizeof(real) == sizeof(bits), "double must be 64-bit");
+    memcpy(&real, &bits, sizeof(real));
+    value = real;
+    return true;
+  }
+  case 0xcc:
+  case 0xcd:
+  case 0xce:
+  case 0xcf:
+    if (!readBigEndian(1U << (code - 0xcc), bits))
+      return false;
+    value = LargestUInt(bits);
+    return true;
+  case 0xd0:
+  case 0xd1:
+  case 0xd2:
+  case 0xd3: {
+    unsigned const bytes = 1U << (code - 0xd0);
+    if (!readBigEndian(bytes, bits))
+      return false;
+    // Sign-extend from the width of the format.
+    unsigned const shift = 64 - 8 * bytes;
+    value = LargestInt(static_cast<int64_t>(bits << shift) >> shift);
+    return true;
+  }
+  case 0xd9:
+  case 0xda:
+  case 0xdb:
+    return readBigEndian(1U << (code - 0xd9), bits) &&
+           readString(static_cast<size_t>(bits), value);
+  case 0xdc:
+  case 0xdd:
+    return readBigEndian(2U << (code - 0xdc), bits) &&
+           readArray(static_cast<size_t>(bits), value, depth);
+  case 0xde:
+  case 0xdf:
+    return readBigEndian(2U << (code - 0xde), bits) &&
+           readMap(static_cast<size_t>(bits), value, depth);
+  default:
+    return addError("Unsupported MessagePack type.", start);
+  }
 }
 
-bool OurReader::readArray(Token& token) {
-  Value init(arrayValue);
-  currentValue().swapPayload(init);
-  currentValue().setOffsetStart(token.start_ - begin_);
-  int index = 0;
-  for (;;) {
-    skipSpaces();
-    if (current_ != end_ && *current_ == ']' &&
-        (index == 0 ||
-         (features_.allowTrailingCommas_ &&
-          !features_.allowDroppedNullPlaceholders_))) // empty array or trailing
-                                                      // comma
-    {
-      Token endArray;
-      readToken(endArray);
-      return true;
-    }
-    Value& value = currentValue()[index++];
-    nodes_.push(&value);
-    bool ok = readValue();
-    nodes_.pop();
-    if (!ok) // error already set
-      return recoverFromError(tokenArrayEnd);
+bool MsgPackReader::readString(size_t size, Value& value) {
+  if (size > static_cast<size_t>(end_ - current_))
+    return addError("Unexpected end of MessagePack data.", end_);
+  char const* const begin = reinterpret_cast<char const*>(current_);
+  current_ += size;
+  value = Value(begin, begin + size);
+  return true;
+}
 
-    Token currentToken;
-    // Accept Comment after last item in the array.
-    ok = readToken(currentToken);
-    while (currentToken.type_ == tokenComment && ok) {
-      ok = readToken(currentToken);
-    }
-    bool badTokenType = (currentToken.type_ != tokenArraySeparator &&
-                         currentToken.type_ != tokenArrayEnd);
-    if (!ok || badTokenType) {
-      return addErrorAndRecover("Missing ',' or ']' in array declaration",
-                                currentToken, tokenArrayEnd);
+bool MsgPackReader::readArray(size_t size, Value& value, size_t depth) {
+  Value array(arrayValue);
+  for (size_t index = 0; index < size; ++index) {
+    if (!readValue(array.append(Value()), depth + 1))
+      return false;
+  }
+  value.swap(array);
+  return true;
+}
+
+bool MsgPackReader::readMap(size_t size, Value& value, size_t depth) {
+  Value object(objectValue);
+  for (size_t index = 0; index < size; ++index) {
+    if (current_ == end_)
+      return addError("Unexpected end of MessagePack data.", current_);
+    const unsigned char* const start = current_;
+    unsigned const code = *current_++;
+    uint64_t length = code & 0x1f;
+    if (code >= 0xd9 && code <= 0xdb) {
+      if (!readBigEndian(1U << (code - 0xd9), length))
+        return false;
+    } else if (code < 0xa0 || code > 0xbf) {
+      return addError("MessagePack map keys must be strings.", start);
     }
-    if (currentToken.type_ == tokenArrayEnd)
-      break;
+    if (length > static_cast<uint64_t>(end_ - current_))
+      return addError("Unexpected end of MessagePack data.", end_);
+    char const* const name = reinterpret_cast<char const*>(current_);
+    current_ += length;
+    if (!readValue(*object.demand(name, name + length), depth + 1))
+      return false;
   }
+  value.swap(object);
   return true;
 }
 
-bool OurReader::decodeNumber(Token& token) {
-  Value decoded;
-  if (!decodeNumber(token, decoded))
-    return false;
-  currentValue().swapPayload(decoded);
-  currentValue().setOffsetStart(token.start_ - begin_);
-  currentValue().setOffsetLimit(token.end_ - begin_);
+bool MsgPackReader::readBigEndian(unsigned bytes, uint64_t& value) {
+  if (bytes > static_cast<size_t>(end_ - current_))
+    return addError("Unexpected end of MessagePack data.", end_);
+  value = 0;
+  for (unsigned i = 0; i < bytes; ++i)
+    value = value << 8 | *current_++;
   return true;
 }
 
-bool OurReader::decodeNumber(Token& token, Value& decoded) {
-  // Attempts to parse the number as an integer. If the number is
-  // larger than the maximum supported value of an integer then
-  // we decode the number as a double.
-  Location current = token.start_;
-  const bool isNegative = *current == '-';
-  if (isNegative) {
-    ++current;
+bool MsgPackReader::addError(const char* message, const unsigned char* at) {
+  error_ = "* Offset " + std::to_string(at - begin_) + "\n  " + message + "\n";
+  return false;
+}
+
+MsgPackReaderBuilder::MsgPackReaderBuilder() { setDefaults(&settings_); }
+MsgPackReaderBuilder::~MsgPackReaderBuilder() = default;
+CharReader* MsgPackReaderBuilder::newCharReader() const {
+  // As for CharReaderBuilder, stackLimit is read as an unsigned int.
+  return new MsgPackReader(
+      static_cast<size_t>(settings_["stackLimit"].asUInt()));
+}
+
+bool MsgPackReaderBuilder::validate(Json::Value* invalid) const {
+  static const auto& valid_keys = *new std::set<String>{
+      "stackLimit",
+  };
+  for (auto si = settings_.begin(); si != settings_.end(); ++si) {
+    auto key = si.name();
+    if (valid_keys.count(key))
+      continue;
+    if (invalid)
+      (*invalid)[std::move(key)] = *si;
+    else
+      return false;
   }
+  return invalid ? invalid->empty() : true;
+}
 
-  // We assume we can represent the largest and smallest integer types as
-  // unsigned integers with separate sign. This is only true if they can fit
-  // into an unsigned integer.
-  static_assert(Value::maxLargestInt <= Value::maxLargestUInt,
-                "Int must be smaller than UInt");
-
-  // We need to convert minLargestInt into a positive number. The easiest way
-  // to do this conversion is to assume our "threshold" value of minLargestInt
-  // divided by 10 can fit in maxLargestInt when absolute valued. This should
-  // be a safe assumption.
-  static_assert(Value::minLargestInt <= -Value::maxLargestInt,
-                "The absolute value of minLargestInt must be greater than or "
-                "equal to maxLargestInt");
-  static_assert(Value::minLargestInt / 10 >= -Value::maxLargestInt,
-                "The absolute value of minLargestInt must be only 1 magnitude "
-                "larger than maxLargest Int");
-
-  static constexpr Value::LargestUInt positive_threshold =
-      Value::maxLargestUInt / 10;
-  static constexpr Value::UInt positive_last_digit = Value::maxLargestUInt % 10;
-
-  // For the negative values, we have to be more careful. Since typically
-  // -Value::minLargestInt will cause an overflow, we first divide by 10 and
-  // then take the inverse. This assumes that minLargestInt is only a single
-  // power of 10 different in magnitude, which we check above. For the last
-  // digit, we take the modulus before negating for the same reason.
-  static constexpr auto negative_threshold =
-      Value::LargestUInt(-(Value::minLargestInt / 10));
-  static constexpr auto negative_last_digit =
-      Value::UInt(-(Value::minLargestInt % 10));
-
-  const Value::LargestUInt threshold =
-      isNegative ? negative_threshold : positive_threshold;
-  const Value::UInt max_last_digit =
-      isNegative ? negative_last_digit : positive_last_digit;
+Value& MsgPackReaderBuilder::operator[](const String& key) {
+  return settings_[key];
+}
+// static
+void MsgPackReaderBuilder::setDefaults(Json::Value* settings) {
+  //! [MsgPackReaderBuilderDefaults]
+  (*settings)["stackLimit"] = 1000;
+  //! [MsgPackReaderBuilderDefaults]
+}
 
-  Value::LargestUInt value = 0;
-  while (current < token.end_) {
-    Char c = *current++;
-    if (c < '0' || c > '9')
-      return decodeDouble(token, decoded);
+// class LazyDocument
+// //////////////////////////////////////////////////////////////////
 
-    const auto digit(static_cast<Value::UInt>(c - '0'));
-    if (value >= threshold) {
-      // We've hit or exceeded the max value divided by 10 (rounded down). If
-      // a) we've only just touched the limit, meaing value == threshold,
-      // b) this is the last digit, or
-      // c) it's small enough to fit in that rounding delta, we're okay.
-      // Otherwise treat this number as a double to avoid overflow.
-      if (value > threshold || current != token.end_ ||
-          digit > max_last_digit) {
-        return decodeDouble(token, decoded);
-      }
+class LazyDocument::Impl {
+public:
+  static size_t const npos = static_cast<size_t>(-1);
+
+  // A member of an object, or an element of an array (key is npos).
+  struct Item {
+    size_t key;
+    size_t keyEnd;
+    size_t value;
+  };
+  struct Member {
+    String name;
+    size_t key;
+    size_t value;
+  };
+
+  explicit Impl(Value const& settings)
+      : features_(featuresFromSettings(settings)),
+        collectComments_(settings["collectComments"].asBool()) {}
+
+  bool parse(const char* beginDoc, const char* endDoc, String* errs);
+  bool parseValue(size_t offset, Value* value, String* errs) const;
+
+  size_t closeOf(size_t open) const;
+  size_t skipSpace(size_t pos, size_t end) const;
+  size_t skipString(size_t pos, size_t end) const;
+  size_t skipValue(size_t pos, size_t end) const;
+  bool decodeKey(Item const& item, String* name) const;
+  bool keyEquals(Item const& item, const char* begin, const char* end) const;
+
+  // Calls visit(item) for each member or element of the container opening
+  // at \a open, until it returns false. Returns an error message, and its
+  // position in \a errorAt, if the container is malformed.
+  template <typename Visit>
+  const char* walk(size_t open, size_t* errorAt, Visit visit) const;
+
+  String text_;
+  OurFeatures const features_;
+  bool const collectComments_;
+  size_t root_ = npos;
+  // Position of each bracket, in order, and of the bracket closing it.
+  std::vector<size_t> opens_;
+  std::vector<size_t> closes_;
+  // Members of the root object, sorted by name, or elements of the root
+  // array.
+  std::vector<Member> rootMembers_;
+  std::vector<size_t> rootElements_;
+
+private:
+  const char* indexStructure(size_t* errorAt);
+  const char* indexRoot(size_t* errorAt, String* message);
+  String formatError(size_t pos, String const& message) const;
+};
+
+size_t const LazyDocument::Impl::npos;
+
+size_t LazyDocument::Impl::closeOf(size_t open) const {
+  auto it = std::lower_bound(opens_.begin(), opens_.end(), open);
+  return closes_[static_cast<size_t>(it - opens_.begin())];
+}
+
+size_t LazyDocument::Impl::skipSpace(size_t pos, size_t end) const {
+  while (pos < end) {
+    char const c = text_[pos];
+    if (c == ' ' || c == '\t' || c == '\r' || c == '\n') {
+      ++pos;
+    } else if (c == '/' && features_.allowComments_ && pos + 1 < end &&
+               text_[pos + 1] == '/') {
+      pos = std::min(text_.find_first_of("\r\n", pos + 2), end);
+    } else if (c == '/' && features_.allowComments_ && pos + 1 < end &&
+               text_[pos + 1] == '*') {
+      size_t const close = text_.find("*/", pos + 2);
+      pos = close == npos ? end : std::min(close + 2, end);
+    } else {
+      break;
     }
-    value = value * 10 + digit;
   }
+  return pos;
+}
 
-  if (isNegative) {
-    // We use the same magnitude assumption here, just in case.
-    const auto last_digit = static_cast<Value::UInt>(value % 10);
-    decoded = -Value::LargestInt(value / 10) * 10 - last_digit;
-  } else if (value <= Value::LargestUInt(Value::maxLargestInt)) {
-    decoded = Value::LargestInt(value);
-  } else {
-    decoded = value;
+size_t LazyDocument::Impl::skipString(size_t pos, size_t end) const {
+  char const quote = text_[pos++];
+  while (pos < end) {
+    char const c = text_[pos++];
+    if (c == '\\')
+      ++pos;
+    else if (c == quote)
+      return pos;
   }
+  return npos;
+}
 
-  return true;
+size_t LazyDocument::Impl::skipValue(size_t pos, size_t end) const {
+  if (pos >= end)
+    return pos;
+  switch (text_[pos]) {
+  case '{':
+  case '[':
+    return closeOf(pos) + 1;
+  case '"':
+    return std::min(skipString(pos, end), end);
+  case '\'':
+    if (features_.allowSingleQuotes_)
+      return std::min(skipString(pos, end), end);
+    break;
+  default:
+    break;
+  }
+  // A number or a literal.
+  while (pos < end && !strchr(",:[]{}\"'/ \t\r\n", text_[pos]))
+    ++pos;
+  return pos;
 }
 
-bool OurReader::decodeDouble(Token& token) {
+template <typename Visit>
+const char* LazyDocument::Impl::walk(size_t open, size_t* errorAt,
+                                     Visit visit) const {
+  bool const object = text_[open] == '{';
+  size_t const close = closeOf(open);
+  size_t pos = skipSpace(open + 1, close);
+  for (bool first = true;; first = false) {
+    if (pos == close) {
+      // Same rules as OurReader::readObject() and OurReader::readArray().
+      if (first || (features_.allowTrailingCommas_ &&
+                    (object || !features_.allowDroppedNullPlaceholders_)))
+        return nullptr;
+    }
+    Item item{npos, npos, pos};
+    if (object) {
+      char const c = pos == close ? '}' : text_[pos];
+      bool const isKey =
+          c == '"' || (c == '\'' && features_.allowSingleQuotes_) ||
+          (features_.allowNumericKeys_ && (c == '-' || (c >= '0' && c <= '9')));
+      if (!isKey) {
+        *errorAt = pos;
+        return "Missing '}' or object member name";
+      }
+      item.key = pos;
+      item.keyEnd = skipValue(pos, close);
+      pos = skipSpace(item.keyEnd, close);
+      if (pos == close || text_[pos] != ':') {
+        *errorAt = pos;
+        return "Missing ':' after object member name";
+      }
+      pos = skipSpace(pos + 1, close);
+      item.value = pos;
+    }
+    size_t const valueEnd = skipValue(pos, close);
+    if (valueEnd == pos && !features_.allowDroppedNullPlaceholders_) {
+      *errorAt = pos;
+      return "Syntax error: value, object or array expected.";
+    }
+    if (!visit(item))
+      return nullptr;
+    pos = skipSpace(valueEnd, close);
+    if (pos == close)
+      return nullptr;
+    if (text_[pos] != ',') {
+      *errorAt = pos;
+      return object ? "Missing ',' or '}' in object declaration"
+                    : "Missing ',' or ']' in array declaration";
+    }
+    pos = skipSpace(pos + 1, close);
+  }
+}
+
+bool LazyDocument::Impl::decodeKey(Item const& item, String* name) const {
+  char const quote = text_[item.key];
+  if (quote == '"' || quote == '\'') {
+    const char* begin = text_.data() + item.key + 1;
+    const char* end = text_.data() + item.keyEnd - 1;
+    if (std::find(begin, end, '\\') == end) {
+      name->assign(begin, end);
+      return true;
+    }
+  }
   Value decoded;
-  if (!decodeDouble(token, decoded))
+  if (!parseValue(item.key, &decoded, nullptr))
     return false;
-  currentValue().swapPayload(decoded);
-  currentValue().setOffsetStart(token.start_ - begin_);
-  currentValue().setOffsetLimit(token.end_ - begin_);
+  *name = decoded.asString();
   return true;
 }
 
-bool OurReader::decodeDouble(Token& token, Value& decoded) {
-  double value = 0;
-  const String buffer(token.start_, token.end_);
-  IStringStream is(buffer);
-  if (!(is >> value)) {
-    return addError(
-        "'" + String(token.start_, token.end_) + "' is not a number.", token);
+bool LazyDocument::Impl::keyEquals(Item const& item, const char* begin,
+                                   const char* end) const {
+  char const quote = text_[item.key];
+  if (quote == '"' || quote == '\'') {
+    const char* keyBegin = text_.data() + item.key + 1;
+    const char* keyEnd = text_.data() + item.keyEnd - 1;
+    if (std::find(keyBegin, keyEnd, '\\') == keyEnd)
+      return keyEnd - keyBegin == end - begin &&
+             std::equal(keyBegin, keyEnd, begin);
   }
-  decoded = value;
-  return true;
+  String name;
+  return decodeKey(item, &name) && name.size() == size_t(end - begin) &&
+         std::equal(name.begin(), name.end(), begin);
 }
 
-bool OurReader::decodeString(Token& token) {
-  String decoded_string;
-  if (!decodeString(token, decoded_string))
-    return false;
-  Value decoded(decoded_string);
-  currentValue().swapPayload(decoded);
-  currentValue().setOffsetStart(token.start_ - begin_);
-  currentValue().setOffsetLimit(token.end_ - begin_);
-  return true;
+bool LazyDocument::Impl::parseValue(size_t offset, Value* value,
+                                    String* errs) const {
+  char const c = text_[offset];
+  if (c == ',' || c == ']' || c == '}') {
+    // A dropped null placeholder.
+    *value = Value();
+    if (errs)
+      errs->clear();
+    return true;
+  }
+  OurFeatures features = features_;
+  features.strictRoot_ = false;
+  features.failIfExtra_ = false;
+  features.skipBom_ = false;
+  features.validateUTF8_ = false; // checked by indexStructure()
+  OurReader reader(features);
+  const char* begin = text_.data();
+  bool const ok =
+      reader.parse(begin, begin + offset,
+                   begin + skipValue(offset, text_.size()), *value,
+                   collectComments_);
+  if (errs)
+    *errs = reader.getFormattedErrorMessages();
+  return ok;
 }
 
-bool OurReader::decodeString(Token& token, String& decoded) {
-  decoded.reserve(static_cast<size_t>(token.end_ - token.start_ - 2));
-  Location current = token.start_ + 1; // skip '"'
-  Location end = token.end_ - 1;       // do not include '"'
-  while (current != end) {
-    Char c = *current++;
-    if (c == '"')
-      break;
-    if (c == '\\') {
-      if (current == end)
-        return addError("Empty escape sequence in string", token, current);
-      Char escape = *current++;
-      switch (escape) {
-      case '"':
-        decoded += '"';
-        break;
-      case '/':
-        decoded += '/';
-        break;
-      case '\\':
-        decoded += '\\';
-        break;
-      case 'b':
-        decoded += '\b';
-        break;
-      case 'f':
-        decoded += '\f';
-        break;
-      case 'n':
-        decoded += '\n';
-        break;
-      case 'r':
-        decoded += '\r';
-        break;
-      case 't':
-        decoded += '\t';
-        break;
-      case 'u': {
-        unsigned int unicode;
-        if (!decodeUnicodeCodePoint(token, current, end, unicode))
-          return false;
-        decoded += codePointToUTF8(unicode);
-      } break;
-      default:
-        return addError("Bad escape sequence in string", token, current);
+const char* LazyDocument::Impl::indexStructure(size_t* errorAt) {
+  if (features_.validateUTF8_) {
+    const char* const end = text_.data() + text_.size();
+    const char* invalid = validateUTF8(text_.data(), end);
+    if (invalid != end) {
+      *errorAt = static_cast<size_t>(invalid - text_.data());
+      return "Invalid UTF-8 sequence";
+    }
+  }
+  std::vector<size_t> pending;
+  size_t const size = text_.size();
+  size_t pos = 0;
+  while (pos < size) {
+    char const c = text_[pos];
+    if (c == '"' || (c == '\'' && features_.allowSingleQuotes_)) {
+      size_t const end = skipString(pos, size);
+      if (end == npos) {
+        *errorAt = pos;
+        return "Missing closing quote of string";
       }
-    } else {
-      decoded += c;
+      pos = end;
+      continue;
+    }
+    if (c == '/' && features_.allowComments_ && pos + 1 < size) {
+      if (text_[pos + 1] == '/') {
+        pos = std::min(text_.find_first_of("\r\n", pos + 2), size);
+        continue;
+      }
+      if (text_[pos + 1] == '*') {
+        size_t const close = text_.find("*/", pos + 2);
+        if (close == npos) {
+          *errorAt = pos;
+          return "Missing '*/' at end of comment";
+        }
+        pos = close + 2;
+        continue;
+      }
+    } else if (c == '[' || c == '{') {
+      if (pending.size() >= features_.stackLimit_)
+        throwRuntimeError("Exceeded stackLimit in readValue().");
+      pending.push_back(opens_.size());
+      opens_.push_back(pos);
+      closes_.push_back(npos);
+    } else if (c == ']' || c == '}') {
+      if (pending.empty() ||
+          text_[opens_[pending.back()]] != (c == ']' ? '[' : '{')) {
+        *errorAt = pos;
+        return c == ']' ? "Unexpected ']' without a matching '['"
+                        : "Unexpected '}' without a matching '{'";
+      }
+      closes_[pending.back()] = pos;
+      pending.pop_back();
     }
+    ++pos;
   }
-  return true;
-}
-
-bool OurReader::decodeUnicodeCodePoint(Token& token, Location& current,
-                                       Location end, unsigned int& unicode) {
-
-  if (!decodeUnicodeEscapeSequence(token, current, end, unicode))
-    return false;
-  if (unicode >= 0xD800 && unicode <= 0xDBFF) {
-    // surrogate pairs
-    if (end - current < 6)
-      return addError(
-          "additional six characters expected to parse unicode surrogate pair.",
-          token, current);
-    if (*(current++) == '\\' && *(current++) == 'u') {
-      unsigned int surrogatePair;
-      if (decodeUnicodeEscapeSequence(token, current, end, surrogatePair)) {
-        unicode = 0x10000 + ((unicode & 0x3FF) << 10) + (surrogatePair & 0x3FF);
-      } else
-        return false;
-    } else
-      return addError("expecting another \\u token to begin the second half of "
-                      "a unicode surrogate pair",
-                      token, current);
+  if (!pending.empty()) {
+    *errorAt = opens_[pending.back()];
+    return text_[*errorAt] == '[' ? "Missing ']' at end of array"
+                                  : "Missing '}' at end of object";
   }
-  return true;
+  return nullptr;
 }
 
-bool OurReader::decodeUnicodeEscapeSequence(Token& token, Location& current,
-                                            Location end,
-                                            unsigned int& ret_unicode) {
-  if (end - current < 4)
-    return addError(
-        "Bad unicode escape sequence in string: four digits expected.", token,
-        current);
-  int unicode = 0;
-  for (int index = 0; index < 4; ++index) {
-    Char c = *current++;
-    unicode *= 16;
-    if (c >= '0' && c <= '9')
-      unicode += c - '0';
-    else if (c >= 'a' && c <= 'f')
-      unicode += c - 'a' + 10;
-    else if (c >= 'A' && c <= 'F')
-      unicode += c - 'A' + 10;
-    else
-      return addError(
-          "Bad unicode escape sequence in string: hexadecimal digit expected.",
-          token, current);
+const char* LazyDocument::Impl::indexRoot(size_t* errorAt, String* message) {
+  size_t const size = text_.size();
+  size_t const root = skipSpace(0, size);
+  size_t const rootEnd = skipValue(root, size);
+  *errorAt = root;
+  if (rootEnd == root)
+    return "Syntax error: value, object or array expected.";
+  if (features_.strictRoot_ && text_[root] != '[' && text_[root] != '{') {
+    *errorAt = 0;
+    return "A valid JSON document must be either an array or an object value.";
   }
-  ret_unicode = static_cast<unsigned int>(unicode);
-  return true;
+  if (features_.failIfExtra_) {
+    *errorAt = skipSpace(rootEnd, size);
+    if (*errorAt != size)
+      return "Extra non-whitespace after JSON value.";
+  }
+  if (text_[root] == '[' || text_[root] == '{') {
+    size_t badKey = npos;
+    const char* error = walk(root, errorAt, [&](Item const& item) {
+      if (item.key == npos) {
+        rootElements_.push_back(item.value);
+        return true;
+      }
+      Member member{String(), item.key, item.value};
+      if (!decodeKey(item, &member.name)) {
+        badKey = item.key;
+        return false;
+      }
+      rootMembers_.push_back(std::move(member));
+      return true;
+    });
+    if (badKey != npos) {
+      Value ignored;
+      parseValue(badKey, &ignored, message);
+      return "";
+    }
+    if (error)
+      return error;
+    // Keep the last of duplicate members, as OurReader does.
+    std::stable_sort(rootMembers_.begin(), rootMembers_.end(),
+                     [](Member const& a, Member const& b) {
+                       return a.name < b.name;
+                     });
+    size_t kept = 0;
+    for (size_t i = 0; i < rootMembers_.size(); ++i) {
+      if (i + 1 < rootMembers_.size() &&
+          rootMembers_[i].name == rootMembers_[i + 1].name) {
+        if (features_.rejectDupKeys_) {
+          *errorAt = rootMembers_[i + 1].key;
+          *message = "Duplicate key: '" + rootMembers_[i].name + "'";
+          return message->c_str();
+        }
+        continue;
+      }
+      if (kept != i)
+        rootMembers_[kept] = std::move(rootMembers_[i]);
+      ++kept;
+    }
+    rootMembers_.resize(kept);
+  }
+  root_ = root;
+  return nullptr;
 }
 
-bool OurReader::addError(const String& message, Token& token, Location extra) {
-  ErrorInfo info;
-  info.token_ = token;
-  info.message_ = message;
-  info.extra_ = extra;
-  errors_.push_back(info);
-  return false;
+String LazyDocument::Impl::formatError(size_t pos,
+                                       String const& message) const {
+  SourceMap const sourceMap(text_.data(), text_.data() + text_.size());
+  return "* " + sourceMap.getLineAndColumn(static_cast<ptrdiff_t>(pos)) +
+         "\n  " + message + "\n";
 }
 
-bool OurReader::recoverFromError(TokenType skipUntilToken) {
-  size_t errorCount = errors_.size();
-  Token skip;
-  for (;;) {
-    if (!readToken(skip))
-      errors_.resize(errorCount); // discard errors caused by recovery
-    if (skip.type_ == skipUntilToken || skip.type_ == tokenEndOfStream)
-      break;
+bool LazyDocument::Impl::parse(const char* beginDoc, const char* endDoc,
+                               String* errs) {
+  text_.assign(beginDoc, endDoc);
+  // Skip the byte order mark here, so that offsets match OurReader's.
+  if (features_.skipBom_ && text_.compare(0, 3, "\xEF\xBB\xBF") == 0)
+    text_.erase(0, 3);
+  root_ = npos;
+  opens_.clear();
+  closes_.clear();
+  rootMembers_.clear();
+  rootElements_.clear();
+
+  size_t errorAt = 0;
+  String message;
+  const char* error = indexStructure(&errorAt);
+  if (!error)
+    error = indexRoot(&errorAt, &message);
+  if (!error) {
+    if (errs)
+      errs->clear();
+    return true;
   }
-  errors_.resize(errorCount);
+  rootMembers_.clear();
+  rootElements_.clear();
+  // An empty error means that message is already formatted.
+  if (errs)
+    *errs = *error ? formatError(errorAt, error) : message;
   return false;
 }
 
-bool OurReader::addErrorAndRecover(const String& message, Token& token,
-                                   TokenType skipUntilToken) {
-  addError(message, token);
-  return recoverFromError(skipUntilToken);
+LazyDocument::LazyDocument(const CharReaderBuilder& builder)
+    : impl_(new Impl(builder.settings_)) {}
+
+LazyDocument::~LazyDocument() = default;
+
+bool LazyDocument::parse(const char* beginDoc, const char* endDoc,
+                         String* errs) {
+  return impl_->parse(beginDoc, endDoc, errs);
 }
 
-Value& OurReader::currentValue() { return *(nodes_.top()); }
+LazyValue LazyDocument::root() const {
+  if (impl_->root_ == Impl::npos)
+    return LazyValue();
+  return LazyValue(this, impl_->root_);
+}
 
-OurReader::Char OurReader::getNextChar() {
-  if (current_ == end_)
+// class LazyValue
+// //////////////////////////////////////////////////////////////////
+
+ValueType LazyValue::type() const {
+  if (!document_)
+    return nullValue;
+  switch (document_->impl_->text_[offset_]) {
+  case '{':
+    return objectValue;
+  case '[':
+    return arrayValue;
+  case '"':
+    return stringValue;
+  case 't':
+  case 'f':
+    return booleanValue;
+  case 'n':
+  case ',':
+  case ']':
+  case '}':
+    return nullValue;
+  default:
+    break;
+  }
+  Value value;
+  return parse(&value, nullptr) ? value.type() : nullValue;
+}
+
+bool LazyValue::isArray() const {
+  return document_ && document_->impl_->text_[offset_] == '[';
+}
+
+bool LazyValue::isObject() const {
+  return document_ && document_->impl_->text_[offset_] == '{';
+}
+
+ArrayIndex LazyValue::size() const {
+  if (isObject())
+    return ArrayIndex(getMemberNames().size());
+  if (!isArray())
     return 0;
-  return *current_++;
+  LazyDocument::Impl const& doc = *document_->impl_;
+  if (offset_ == doc.root_)
+    return ArrayIndex(doc.rootElements_.size());
+  ArrayIndex count = 0;
+  size_t errorAt;
+  if (doc.walk(offset_, &errorAt, [&](LazyDocument::Impl::Item const&) {
+        ++count;
+        return true;
+      }))
+    return 0;
+  return count;
 }
 
-void OurReader::getLocationLineAndColumn(Location location, int& line,
-                                         int& column) const {
-  Location current = begin_;
-  Location lastLineStart = current;
-  line = 0;
-  while (current < location && current != end_) {
-    Char c = *current++;
-    if (c == '\r') {
-      if (*current == '\n')
-        ++current;
-      lastLineStart = current;
-      ++line;
-    } else if (c == '\n') {
-      lastLineStart = current;
-      ++line;
-    }
+LazyValue LazyValue::operator[](ArrayIndex index) const {
+  if (!isArray())
+    return LazyValue();
+  LazyDocument::Impl const& doc = *document_->impl_;
+  if (offset_ == doc.root_) {
+    if (index >= doc.rootElements_.size())
+      return LazyValue();
+    return LazyValue(document_, doc.rootElements_[index]);
   }
-  // column & line start at 1
-  column = int(location - lastLineStart) + 1;
-  ++line;
+  size_t found = LazyDocument::Impl::npos;
+  ArrayIndex position = 0;
+  size_t errorAt;
+  if (doc.walk(offset_, &errorAt, [&](LazyDocument::Impl::Item const& item) {
+        if (position++ != index)
+          return true;
+        found = item.value;
+        return false;
+      }) ||
+      found == LazyDocument::Impl::npos)
+    return LazyValue();
+  return LazyValue(document_, found);
 }
 
-String OurReader::getLocationLineAndColumn(Location location) const {
-  int line, column;
-  getLocationLineAndColumn(location, line, column);
-  char buffer[18 + 16 + 16 + 1];
-  jsoncpp_snprintf(buffer, sizeof(buffer), "Line %d, Column %d", line, column);
-  return buffer;
+LazyValue LazyValue::operator[](int index) const {
+  JSON_ASSERT_MESSAGE(
+      index >= 0,
+      "in Json::LazyValue::operator[](int index) const: index cannot be "
+      "negative");
+  return (*this)[ArrayIndex(index)];
 }
 
-String OurReader::getFormattedErrorMessages() const {
-  String formattedMessage;
-  for (const auto& error : errors_) {
-    formattedMessage +=
-        "* " + getLocationLineAndColumn(error.token_.start_) + "\n";
-    formattedMessage += "  " + error.message_ + "\n";
-    if (error.extra_)
-      formattedMessage +=
-          "See " + getLocationLineAndColumn(error.extra_) + " for detail.\n";
+LazyValue LazyValue::operator[](const char* key) const {
+  return find(key, key + strlen(key));
+}
+
+LazyValue LazyValue::operator[](const String& key) const {
+  return find(key.data(), key.data() + key.length());
+}
+
+LazyValue LazyValue::find(const char* begin, const char* end) const {
+  if (!isObject())
+    return LazyValue();
+  LazyDocument::Impl const& doc = *document_->impl_;
+  if (offset_ == doc.root_) {
+    size_t const length = size_t(end - begin);
+    auto it = std::lower_bound(
+        doc.rootMembers_.begin(), doc.rootMembers_.end(), begin,
+        [length](LazyDocument::Impl::Member const& member, const char* key) {
+          return member.name.compare(0, member.name.size(), key, length) < 0;
+        });
+    if (it == doc.rootMembers_.end() ||
+        it->name.compare(0, it->name.size(), begin, length) != 0)
+      return LazyValue();
+    return LazyValue(document_, it->value);
   }
-  return formattedMessage;
+  size_t found = LazyDocument::Impl::npos;
+  size_t errorAt;
+  if (doc.walk(offset_, &errorAt, [&](LazyDocument::Impl::Item const& item) {
+        if (doc.keyEquals(item, begin, end))
+          found = item.value;
+        return true;
+      }) ||
+      found == LazyDocument::Impl::npos)
+    return LazyValue();
+  return LazyValue(document_, found);
 }
 
-std::vector<OurReader::StructuredError> OurReader::getStructuredErrors() const {
-  std::vector<OurReader::StructuredError> allErrors;
-  for (const auto& error : errors_) {
-    OurReader::StructuredError structured;
-    structured.offset_start = error.token_.start_ - begin_;
-    structured.offset_limit = error.token_.end_ - begin_;
-    structured.message = error.message_;
-    allErrors.push_back(structured);
+bool LazyValue::isMember(const char* key) const {
+  return (*this)[key].exists();
+}
+
+bool LazyValue::isMember(const String& key) const {
+  return (*this)[key].exists();
+}
+
+Value::Members LazyValue::getMemberNames() const {
+  Value::Members names;
+  if (!isObject())
+    return names;
+  LazyDocument::Impl const& doc = *document_->impl_;
+  if (offset_ == doc.root_) {
+    for (const auto& member : doc.rootMembers_)
+      names.push_back(member.name);
+    return names;
   }
-  return allErrors;
+  bool decoded = true;
+  size_t errorAt;
+  if (doc.walk(offset_, &errorAt, [&](LazyDocument::Impl::Item const& item) {
+        names.emplace_back();
+        decoded = doc.decodeKey(item, &names.back());
+        return decoded;
+      }) ||
+      !decoded)
+    return Value::Members();
+  std::sort(names.begin(), names.end());
+  names.erase(std::unique(names.begin(), names.end()), names.end());
+  return names;
 }
 
-class OurCharReader : public CharReader {
-  bool const collectComments_;
-  OurReader reader_;
+ptrdiff_t LazyValue::getOffsetStart() const {
+  return static_cast<ptrdiff_t>(offset_);
+}
+
+bool LazyValue::parse(Value* value, String* errs) const {
+  if (!document_) {
+    if (errs)
+      *errs = "* Value does not exist\n";
+    return false;
+  }
+  return document_->impl_->parseValue(offset_, value, errs);
+}
+
+Value LazyValue::toValue() const {
+  Value value;
+  String errs;
+  if (!parse(&value, &errs))
+    throwRuntimeError(errs);
+  return value;
+}
 
+// class Cursor
+// //////////////////////////////////////////////////////////////////
+
+class Cursor::Impl {
 public:
-  OurCharReader(bool collectComments, OurFeatures const& features)
-      : collectComments_(collectComments), reader_(features) {}
-  bool parse(char const* beginDoc, char const* endDoc, Value* root,
-             String* errs) override {
-    bool ok = reader_.parse(beginDoc, endDoc, *root, collectComments_);
-    if (errs) {
-      *errs = reader_.getFormattedErrorMessages();
-    }
-    return ok;
+  Impl(ReaderOptions const& options, IStream& sin) : reader_(options.features) {
+    reader_.setFailFast(&error_);
+    reader_.beginCursor(sin, options.collectComments);
   }
+
+  OurReader reader_;
+  ParseError error_;
 };
 
-CharReaderBuilder::CharReaderBuilder() { setDefaults(&settings_); }
-CharReaderBuilder::~CharReaderBuilder() = default;
-CharReader* CharReaderBuilder::newCharReader() const {
-  bool collectComments = settings_["collectComments"].asBool();
-  OurFeatures features = OurFeatures::all();
-  features.allowComments_ = settings_["allowComments"].asBool();
-  features.allowTrailingCommas_ = settings_["allowTrailingCommas"].asBool();
-  features.strictRoot_ = settings_["strictRoot"].asBool();
-  features.allowDroppedNullPlaceholders_ =
-      settings_["allowDroppedNullPlaceholders"].asBool();
-  features.allowNumericKeys_ = settings_["allowNumericKeys"].asBool();
-  features.allowSingleQuotes_ = settings_["allowSingleQuotes"].asBool();
+Cursor::Cursor(CharReaderBuilder const& builder, IStream& sin)
+    : impl_(new Impl(ReaderOptions(builder.settings_), sin)) {}
 
-  // Stack limit is always a size_t, so we get this as an unsigned int
-  // regardless of it we have 64-bit integer support enabled.
-  features.stackLimit_ = static_cast<size_t>(settings_["stackLimit"].asUInt());
-  features.failIfExtra_ = settings_["failIfExtra"].asBool();
-  features.rejectDupKeys_ = settings_["rejectDupKeys"].asBool();
-  features.allowSpecialFloats_ = settings_["allowSpecialFloats"].asBool();
-  features.skipBom_ = settings_["skipBom"].asBool();
-  return new OurCharReader(collectComments, features);
+Cursor::~Cursor() = default;
+
+Cursor::Kind Cursor::next() { return impl_->reader_.nextCursorToken(); }
+
+Cursor::Kind Cursor::kind() const { return impl_->reader_.cursorKind(); }
+
+bool Cursor::skip() { return impl_->reader_.readCursorValue(nullptr); }
+
+bool Cursor::readValue(Value* value) {
+  return impl_->reader_.readCursorValue(value);
 }
 
-bool CharReaderBuilder::validate(Json::Value* invalid) const {
-  static const auto& valid_keys = *new std::set<String>{
-      "collectComments",
-      "allowComments",
-      "allowTrailingCommas",
-      "strictRoot",
-      "allowDroppedNullPlaceholders",
-      "allowNumericKeys",
-      "allowSingleQuotes",
-      "stackLimit",
-      "failIfExtra",
-      "rejectDupKeys",
-      "allowSpecialFloats",
-      "skipBom",
-  };
-  for (auto si = settings_.begin(); si != settings_.end(); ++si) {
-    auto key = si.name();
-    if (valid_keys.count(key))
-      continue;
-    if (invalid)
-      (*invalid)[std::move(key)] = *si;
-    else
-      return false;
+String const& Cursor::name() const { return impl_->reader_.cursorName(); }
+
+ptrdiff_t Cursor::offset() const { return impl_->reader_.cursorOffset(); }
+
+ParseError const& Cursor::error() const { return impl_->error_; }
+
+// class SourceMap
+// //////////////////////////////////////////////////////////////////
+
+SourceMap::SourceMap(char const* beginDoc, char const* endDoc)
+    : begin_(beginDoc), end_(endDoc) {}
+
+void SourceMap::buildIndex() const {
+  lineStarts_.push_back(0);
+  size_t const size = static_cast<size_t>(end_ - begin_);
+  // Most documents have no '\r', and then memchr() finds each '\n' scanning
+  // many bytes at a time.
+  if (!memchr(begin_, '\r', size)) {
+    char const* current = begin_;
+    while ((current = static_cast<char const*>(memchr(
+                current, '\n', static_cast<size_t>(end_ - current)))) !=
+           nullptr) {
+      ++current;
+      lineStarts_.push_back(static_cast<size_t>(current - begin_));
+    }
+    return;
+  }
+  for (char const* current = begin_; current != end_;) {
+    char c = *current++;
+    if (c == '\r' && current != end_ && *current == '\n')
+      ++current;
+    if (c == '\r' || c == '\n')
+      lineStarts_.push_back(static_cast<size_t>(current - begin_));
   }
-  return invalid ? invalid->empty() : true;
 }
 
-Value& CharReaderBuilder::operator[](const String& key) {
-  return settings_[key];
-}
-// static
-void CharReaderBuilder::strictMode(Json::Value* settings) {
-  //! [CharReaderBuilderStrictMode]
-  (*settings)["allowComments"] = false;
-  (*settings)["allowTrailingCommas"] = false;
-  (*settings)["strictRoot"] = true;
-  (*settings)["allowDroppedNullPlaceholders"] = false;
-  (*settings)["allowNumericKeys"] = false;
-  (*settings)["allowSingleQuotes"] = false;
-  (*settings)["stackLimit"] = 1000;
-  (*settings)["failIfExtra"] = true;
-  (*settings)["rejectDupKeys"] = true;
-  (*settings)["allowSpecialFloats"] = false;
-  (*settings)["skipBom"] = true;
-  //! [CharReaderBuilderStrictMode]
+void SourceMap::getLineAndColumn(ptrdiff_t offset, int* line,
+                                 int* column) const {
+  if (lineStarts_.empty())
+    buildIndex();
+  size_t const size = static_cast<size_t>(end_ - begin_);
+  size_t const position =
+      offset < 0 ? 0 : std::min(static_cast<size_t>(offset), size);
+  auto const lineStart =
+      std::upper_bound(lineStarts_.begin(), lineStarts_.end(), position) - 1;
+  // column & line start at 1
+  *line = int(lineStart - lineStarts_.begin()) + 1;
+  *column = int(position - *lineStart) + 1;
 }
-// static
-void CharReaderBuilder::setDefaults(Json::Value* settings) {
-  //! [CharReaderBuilderDefaults]
-  (*settings)["collectComments"] = true;
-  (*settings)["allowComments"] = true;
-  (*settings)["allowTrailingCommas"] = true;
-  (*settings)["strictRoot"] = false;
-  (*settings)["allowDroppedNullPlaceholders"] = false;
-  (*settings)["allowNumericKeys"] = false;
-  (*settings)["allowSingleQuotes"] = false;
-  (*settings)["stackLimit"] = 1000;
-  (*settings)["failIfExtra"] = false;
-  (*settings)["rejectDupKeys"] = false;
-  (*settings)["allowSpecialFloats"] = false;
-  (*settings)["skipBom"] = true;
-  //! [CharReaderBuilderDefaults]
+
+String SourceMap::getLineAndColumn(ptrdiff_t offset) const {
+  int line, column;
+  getLineAndColumn(offset, &line, &column);
+  char buffer[18 + 16 + 16 + 1];
+  jsoncpp_snprintf(buffer, sizeof(buffer), "Line %d, Column %d", line, column);
+  return buffer;
 }
 
 //////////////////////////////////
+// class ParseError
+// //////////////////////////////////////////////////////////////////
+
+char const* ParseError::message(Code code) {
+  switch (code) {
+  case none:
+    return "";
+  case invalidUTF8:
+    return "Invalid UTF-8 sequence";
+  case unterminatedString:
+    return "Missing '\"' at end of string";
+  case valueExpected:
+    return "Syntax error: value, object or array expected.";
+  case missingMemberName:
+    return "Missing '}' or object member name";
+  case missingColon:
+    return "Missing ':' after object member name";
+  case missingObjectSeparator:
+    return "Missing ',' or '}' in object declaration";
+  case missingArraySeparator:
+    return "Missing ',' or ']' in array declaration";
+  case duplicateKey:
+    return "Duplicate key";
+  case keyTooLong:
+    return "keylength >= 2^30";
+  case stackLimitExceeded:
+    return "Exceeded stackLimit in readValue().";
+  case notANumber:
+    return "Not a number.";
+  case emptyEscape:
+    return "Empty escape sequence in string";
+  case badEscape:
+    return "Bad escape sequence in string";
+  case unicodeEscapeTooShort:
+    return "Bad unicode escape sequence in string: four digits expected.";
+  case badUnicodeEscapeDigit:
+    return "Bad unicode escape sequence in string: hexadecimal digit "
+           "expected.";
+  case surrogatePairTooShort:
+    return "additional six characters expected to parse unicode surrogate "
+           "pair.";
+  case missingLowSurrogate:
+    return "expecting another \\u token to begin the second half of a "
+           "unicode surrogate pair";
+  case extraCharacters:
+    return "Extra non-whitespace after JSON value.";
+  case rootNotContainer:
+    return "A valid JSON document must be either an array or an object "
+           "value.";
+  case other:
+    break;
+  }
+  return "Syntax error";
+}
+
+String ParseError::format(char const* beginDoc, char const* endDoc) const {
+  if (code == none)
+    return String();
+  return "* " + SourceMap(beginDoc, endDoc).getLineAndColumn(offset) +
+         "\n  " + message() + "\n";
+}
+
 // global functions
 
 bool parseFromStream(CharReader::Factory const& fact, IStream& sin, Value* root,
@@ -1980,10 +5083,37 @@ bool parseFromStream(CharReader::Factory const& fact, IStream& sin, Value* root,
   return reader->parse(begin, end, root, errs);
 }
 
+bool reformat(CharReaderBuilder const& reader,
+              StreamWriterBuilder const& writer, IStream& sin, OStream& sout,
+              ParseError* error) {
+  ReaderOptions const options(reader.settings_);
+  OurReader ourReader(options.features);
+  StreamingWriter streamingWriter(writer, sout);
+  ParseError ignored;
+  *(error ? error : &ignored) = ParseError();
+  ourReader.setFailFast(error ? error : &ignored);
+  return ourReader.reformat(sin, streamingWriter, options.collectComments);
+}
+
+bool parallelParse(CharReaderBuilder const& builder, char const* beginDoc,
+                   char const* endDoc, Executor& executor, Value* root,
+                   String* errs) {
+  ReaderOptions const options(builder.settings_);
+  OurReader reader(options.features);
+  bool const ok = reader.parseParallel(beginDoc, endDoc, *root,
+                                       options.collectComments, executor);
+  if (errs)
+    *errs = reader.getFormattedErrorMessages();
+  return ok;
+}
+
 IStream& operator>>(IStream& sin, Value& root) {
-  CharReaderBuilder b;
+  OStringStream ssin;
+  ssin << sin.rdbuf();
+  String doc = ssin.str();
   String errs;
-  bool ok = parseFromStream(b, sin, &root, &errs);
+  bool ok = CharReaderConfig::defaults().parse(
+      doc.data(), doc.data() + doc.size(), &root, &errs);
   if (!ok) {
     throwRuntimeError(errs);
   }
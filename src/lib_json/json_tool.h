@@ -19,6 +19,19 @@
 #include <clocale>
 #endif
 
+#include <cstdint>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) ||                                    \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define JSONCPP_HAS_SSE2 1
+#include <emmintrin.h>
+#endif
+
+#if defined(_MSC_VER) && defined(_M_X64)
+#include <intrin.h>
+#endif
+
 /* This header provides common string manipulation support, such as UTF-8,
  * portable conversion from/to string...
  *
@@ -64,6 +77,105 @@ static inline String codePointToUTF8(unsigned int cp) {
   return result;
 }
 
+/// Number of trailing zero bits of \a value, which must not be zero.
+static inline unsigned countTrailingZeros(uint64_t value) {
+#if defined(__GNUC__) || defined(__clang__)
+  return static_cast<unsigned>(__builtin_ctzll(value));
+#elif defined(_MSC_VER) && defined(_M_X64)
+  unsigned long index;
+  _BitScanForward64(&index, value);
+  return static_cast<unsigned>(index);
+#else
+  unsigned count = 0;
+  for (; !(value & 1); value >>= 1)
+    ++count;
+  return count;
+#endif
+}
+
+/// Number of ASCII bytes at the start of [begin, end).
+static inline size_t asciiPrefixLength(const unsigned char* begin,
+                                       const unsigned char* end) {
+  const unsigned char* p = begin;
+#if defined(JSONCPP_HAS_SSE2)
+  auto load = [](const unsigned char* at) {
+    return _mm_loadu_si128(reinterpret_cast<const __m128i*>(at));
+  };
+  while (end - p >= 64) {
+    __m128i const any =
+        _mm_or_si128(_mm_or_si128(load(p), load(p + 16)),
+                     _mm_or_si128(load(p + 32), load(p + 48)));
+    if (_mm_movemask_epi8(any))
+      break;
+    p += 64;
+  }
+  while (end - p >= 16) {
+    int const high = _mm_movemask_epi8(load(p));
+    if (high)
+      return static_cast<size_t>(p - begin) +
+             countTrailingZeros(static_cast<unsigned>(high));
+    p += 16;
+  }
+#else
+  while (end - p >= 8) {
+    uint64_t word;
+    memcpy(&word, p, sizeof(word));
+    if (word & 0x8080808080808080ULL)
+      break;
+    p += 8;
+  }
+#endif
+  while (p != end && *p < 0x80)
+    ++p;
+  return static_cast<size_t>(p - begin);
+}
+
+/** Returns the first byte of [begin, end) that does not belong to a
+ * well-formed UTF-8 sequence, or \a end if there is none. Overlong forms,
+ * surrogates and code points above U+10FFFF are rejected, as in RFC 3629.
+ */
+static inline const char* validateUTF8(const char* begin, const char* end) {
+  auto p = reinterpret_cast<const unsigned char*>(begin);
+  auto const last = reinterpret_cast<const unsigned char*>(end);
+  while (p != last) {
+    if (*p < 0x80) {
+      p += asciiPrefixLength(p, last);
+      if (p == last)
+        break;
+    }
+    unsigned char const c = *p;
+    // Length of the sequence, and the range of its second byte.
+    ptrdiff_t length;
+    unsigned char low = 0x80;
+    unsigned char high = 0xBF;
+    if (c >= 0xC2 && c <= 0xDF) {
+      length = 2;
+    } else if (c >= 0xE0 && c <= 0xEF) {
+      length = 3;
+      if (c == 0xE0)
+        low = 0xA0;
+      else if (c == 0xED)
+        high = 0x9F;
+    } else if (c >= 0xF0 && c <= 0xF4) {
+      length = 4;
+      if (c == 0xF0)
+        low = 0x90;
+      else if (c == 0xF4)
+        high = 0x8F;
+    } else {
+      break;
+    }
+    if (last - p < length || p[1] < low || p[1] > high)
+      break;
+    if (length > 2 && (p[2] & 0xC0) != 0x80)
+      break;
+    if (length > 3 && (p[3] & 0xC0) != 0x80)
+      break;
+    p += length;
+  }
+  return reinterpret_cast<const char*>(p);
+}
+
 enum {
   /// Constant that specify the size of the buffer that must be passed to
   /// uintToString.
@@ -74,16 +186,46 @@ enum {
 using UIntToStringBuffer = char[uintToStringBufferSize];
 
 /** Converts an unsigned integer to string.
+ * Writes two digits per division, using a table of the pairs "00" to "99".
  * @param value Unsigned integer to convert to string
  * @param current Input/Output string buffer.
  *        Must have at least uintToStringBufferSize chars free.
  */
 static inline void uintToString(LargestUInt value, char*& current) {
+  static const char digitPairs[] = "0001020304050607080910111213141516171819"
+                                   "2021222324252627282930313233343536373839"
+                                   "4041424344454647484950515253545556575859"
+                                   "6061626364656667686970717273747576777879"
+                                   "8081828384858687888990919293949596979899";
   *--current = 0;
-  do {
-    *--current = static_cast<char>(value % 10U + static_cast<unsigned>('0'));
-    value /= 10;
-  } while (value != 0);
+  while (value >= 100) {
+    unsigned const pair = static_cast<unsigned>(value % 100U) * 2;
+    value /= 100;
+    *--current = digitPairs[pair + 1];
+    *--current = digitPairs[pair];
+  }
+  if (value >= 10) {
+    unsigned const pair = static_cast<unsigned>(value) * 2;
+    *--current = digitPairs[pair + 1];
+    *--current = digitPairs[pair];
+  } else {
+    *--current = static_cast<char>(value + static_cast<unsigned>('0'));
+  }
+}
+
+/** Converts a signed integer to string, as uintToString() does.
+ * @param value Signed integer to convert to string
+ * @param current Input/Output string buffer.
+ *        Must have at least uintToStringBufferSize chars free.
+ */
+static inline void intToString(LargestInt value, char*& current) {
+  if (value < 0) {
+    // Negate in unsigned arithmetic, which is also correct for the minimum.
+    uintToString(LargestUInt(0) - LargestUInt(value), current);
+    *--current = '-';
+  } else {
+    uintToString(LargestUInt(value), current);
+  }
 }
 
 /** Change ',' to '.' everywhere in buffer.
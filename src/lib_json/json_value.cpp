@@ -9,13 +9,19 @@
 #include <json/writer.h>
 #endif // if !defined(JSON_IS_AMALGAMATION)
 #include <algorithm>
+#include <atomic>
 #include <cassert>
 #include <cmath>
+#include <condition_variable>
 #include <cstddef>
+#include <cstdint>
 #include <cstring>
 #include <iostream>
+#include <mutex>
 #include <sstream>
+#include <thread>
 #include <utility>
+#include <vector>
 
 // Provide implementation equivalent of std::snprintf for older _MSC compilers
 #if defined(_MSC_VER) && _MSC_VER < 1900
@@ -48,14 +54,6 @@ int JSON_API msvc_pre1900_c99_snprintf(char* outBuf, size_t size,
 #define JSON_ASSERT_UNREACHABLE assert(false)
 
 namespace Json {
-template <typename T>
-static std::unique_ptr<T> cloneUnique(const std::unique_ptr<T>& p) {
-  std::unique_ptr<T> r;
-  if (p) {
-    r = std::unique_ptr<T>(new T(*p));
-  }
-  return r;
-}
 
 // This is a walkaround to avoid the static initialization of Value::null.
 // kNull must be word-aligned to avoid crashing on ARM.  We use an alignment of
@@ -340,6 +338,18 @@ bool Value::CZString::isStaticString() const {
 // //////////////////////////////////////////////////////////////////
 // //////////////////////////////////////////////////////////////////
 
+// Array or object elements shared between copies of a Value, see share().
+// Each copy holds a reference, and the last one deletes the elements.
+class Value::SharedObjectValues : public ObjectValues {
+public:
+  explicit SharedObjectValues(ObjectValues&& elements)
+      : ObjectValues(std::move(elements)) {}
+  explicit SharedObjectValues(const ObjectValues& elements)
+      : ObjectValues(elements) {}
+
+  std::atomic<size_t> refs{1};
+};
+
 /*! \internal Default constructor initialization must be equivalent to:
  * memset( this, 0, sizeof(Value) )
  * This optimization is used in ValueInternalMap fast allocator.
@@ -479,32 +489,83 @@ ValueType Value::type() const {
   return static_cast<ValueType>(bits_.value_type_);
 }
 
+// Unshared containers are always compared element by element, so that one
+// holding NaN is unequal to itself, as a scalar NaN is.
+bool Value::isSameShared(const Value& other) const {
+  return bits_.shared_ && value_.map_ == other.value_.map_;
+}
+
 int Value::compare(const Value& other) const {
-  if (*this < other)
-    return -1;
-  if (*this > other)
-    return 1;
-  return 0;
+  int result = shallowCompare(other);
+  if (result != 0 || (type() != arrayValue && type() != objectValue) ||
+      isSameShared(other))
+    return result;
+  // Walk both trees in lockstep with an explicit stack, so that comparing
+  // deeply nested documents cannot overflow the call stack.
+  struct Frame {
+    ObjectValues::const_iterator it;
+    ObjectValues::const_iterator end;
+    ObjectValues::const_iterator otherIt;
+  };
+  std::vector<Frame> pending;
+  Frame frame{value_.map_->begin(), value_.map_->end(),
+              other.value_.map_->begin()};
+  for (;;) {
+    if (frame.it == frame.end) {
+      if (pending.empty())
+        return 0;
+      frame = pending.back();
+      pending.pop_back();
+      continue;
+    }
+    const ObjectValues::value_type& entry = *frame.it++;
+    const ObjectValues::value_type& otherEntry = *frame.otherIt++;
+    if (entry.first < otherEntry.first)
+      return -1;
+    if (otherEntry.first < entry.first)
+      return 1;
+    const Value& child = entry.second;
+    const Value& otherChild = otherEntry.second;
+    result = child.shallowCompare(otherChild);
+    if (result != 0)
+      return result;
+    if ((child.type() == arrayValue || child.type() == objectValue) &&
+        !child.isSameShared(otherChild)) {
+      pending.push_back(frame);
+      frame = Frame{child.value_.map_->begin(), child.value_.map_->end(),
+                    otherChild.value_.map_->begin()};
+    }
+  }
 }
 
-bool Value::operator<(const Value& other) const {
+int Value::shallowCompare(const Value& other) const {
   int typeDelta = type() - other.type();
   if (typeDelta)
-    return typeDelta < 0;
+    return typeDelta < 0 ? -1 : 1;
   switch (type()) {
   case nullValue:
-    return false;
+    return 0;
   case intValue:
-    return value_.int_ < other.value_.int_;
+    return value_.int_ < other.value_.int_
+               ? -1
+               : (other.value_.int_ < value_.int_ ? 1 : 0);
   case uintValue:
-    return value_.uint_ < other.value_.uint_;
+    return value_.uint_ < other.value_.uint_
+               ? -1
+               : (other.value_.uint_ < value_.uint_ ? 1 : 0);
   case realValue:
-    return value_.real_ < other.value_.real_;
+    return value_.real_ < other.value_.real_
+               ? -1
+               : (other.value_.real_ < value_.real_ ? 1 : 0);
   case booleanValue:
-    return value_.bool_ < other.value_.bool_;
+    return value_.bool_ < other.value_.bool_
+               ? -1
+               : (other.value_.bool_ < value_.bool_ ? 1 : 0);
   case stringValue: {
     if ((value_.string_ == nullptr) || (other.value_.string_ == nullptr)) {
-      return other.value_.string_ != nullptr;
+      if (other.value_.string_ != nullptr)
+        return -1;
+      return value_.string_ != nullptr ? 1 : 0;
     }
     unsigned this_len;
     unsigned other_len;
@@ -518,25 +579,25 @@ bool Value::operator<(const Value& other) const {
     JSON_ASSERT(this_str && other_str);
     int comp = memcmp(this_str, other_str, min_len);
     if (comp < 0)
-      return true;
+      return -1;
     if (comp > 0)
-      return false;
-    return (this_len < other_len);
+      return 1;
+    return this_len < other_len ? -1 : (other_len < this_len ? 1 : 0);
   }
   case arrayValue:
   case objectValue: {
     auto thisSize = value_.map_->size();
     auto otherSize = other.value_.map_->size();
-    if (thisSize != otherSize)
-      return thisSize < otherSize;
-    return (*value_.map_) < (*other.value_.map_);
+    return thisSize < otherSize ? -1 : (otherSize < thisSize ? 1 : 0);
   }
   default:
     JSON_ASSERT_UNREACHABLE;
   }
-  return false; // unreachable
+  return 0; // unreachable
 }
 
+bool Value::operator<(const Value& other) const { return compare(other) < 0; }
+
 bool Value::operator<=(const Value& other) const { return !(other < *this); }
 
 bool Value::operator>=(const Value& other) const { return !(*this < other); }
@@ -544,6 +605,36 @@ bool Value::operator>=(const Value& other) const { return !(*this < other); }
 bool Value::operator>(const Value& other) const { return other < *this; }
 
 bool Value::operator==(const Value& other) const {
+  if (!shallowEquals(other))
+    return false;
+  if ((type() != arrayValue && type() != objectValue) ||
+      isSameShared(other))
+    return true;
+  // Same explicit-stack walk as compare(), for deeply nested documents.
+  std::vector<std::pair<const ObjectValues*, const ObjectValues*>> pending;
+  const ObjectValues* map = value_.map_;
+  const ObjectValues* otherMap = other.value_.map_;
+  for (;;) {
+    auto otherIt = otherMap->begin();
+    for (const auto& entry : *map) {
+      const Value& child = entry.second;
+      const Value& otherChild = otherIt->second;
+      if (!(entry.first == otherIt->first) || !child.shallowEquals(otherChild))
+        return false;
+      if ((child.type() == arrayValue || child.type() == objectValue) &&
+          !child.isSameShared(otherChild))
+        pending.emplace_back(child.value_.map_, otherChild.value_.map_);
+      ++otherIt;
+    }
+    if (pending.empty())
+      return true;
+    map = pending.back().first;
+    otherMap = pending.back().second;
+    pending.pop_back();
+  }
+}
+
+bool Value::shallowEquals(const Value& other) const {
   if (type() != other.type())
     return false;
   switch (type()) {
@@ -577,8 +668,7 @@ bool Value::operator==(const Value& other) const {
   }
   case arrayValue:
   case objectValue:
-    return value_.map_->size() == other.value_.map_->size() &&
-           (*value_.map_) == (*other.value_.map_);
+    return value_.map_->size() == other.value_.map_->size();
   default:
     JSON_ASSERT_UNREACHABLE;
   }
@@ -896,6 +986,7 @@ void Value::clear() {
   switch (type()) {
   case arrayValue:
   case objectValue:
+    detachPayload();
     value_.map_->clear();
     break;
   default:
@@ -908,6 +999,7 @@ void Value::resize(ArrayIndex newSize) {
                       "in Json::Value::resize(): requires arrayValue");
   if (type() == nullValue)
     *this = Value(arrayValue);
+  detachPayload();
   ArrayIndex oldSize = size();
   if (newSize == 0)
     clear();
@@ -927,13 +1019,13 @@ Value& Value::operator[](ArrayIndex index) {
       "in Json::Value::operator[](ArrayIndex): requires arrayValue");
   if (type() == nullValue)
     *this = Value(arrayValue);
+  detachPayload();
   CZString key(index);
   auto it = value_.map_->lower_bound(key);
   if (it != value_.map_->end() && (*it).first == key)
     return (*it).second;
 
-  ObjectValues::value_type defaultValue(key, nullSingleton());
-  it = value_.map_->insert(it, defaultValue);
+  it = value_.map_->emplace_hint(it, key, Value());
   return (*it).second;
 }
 
@@ -967,6 +1059,7 @@ const Value& Value::operator[](int index) const {
 void Value::initBasic(ValueType type, bool allocated) {
   setType(type);
   setIsAllocated(allocated);
+  bits_.shared_ = false;
   comments_ = Comments{};
   start_ = 0;
   limit_ = 0;
@@ -975,6 +1068,7 @@ void Value::initBasic(ValueType type, bool allocated) {
 void Value::dupPayload(const Value& other) {
   setType(other.type());
   setIsAllocated(false);
+  bits_.shared_ = false;
   switch (type()) {
   case nullValue:
   case intValue:
@@ -996,9 +1090,44 @@ void Value::dupPayload(const Value& other) {
     }
     break;
   case arrayValue:
-  case objectValue:
-    value_.map_ = new ObjectValues(*other.value_.map_);
-    break;
+  case objectValue: {
+    if (other.bits_.shared_) {
+      static_cast<SharedObjectValues*>(other.value_.map_)
+          ->refs.fetch_add(1, std::memory_order_relaxed);
+      value_.map_ = other.value_.map_;
+      bits_.shared_ = true;
+      break;
+    }
+    // Copy one level at a time from an explicit work list instead of through
+    // the recursive std::map copy constructor, so that deeply nested
+    // documents cannot overflow the stack. Nested containers are inserted as
+    // empty shells and filled in when their turn comes.
+    std::unique_ptr<ObjectValues> map(new ObjectValues);
+    std::vector<std::pair<ObjectValues*, const ObjectValues*>> pending;
+    ObjectValues* target = map.get();
+    const ObjectValues* source = other.value_.map_;
+    for (;;) {
+      for (const auto& entry : *source) {
+        const Value& child = entry.second;
+        if ((child.type() == arrayValue || child.type() == objectValue) &&
+            !child.bits_.shared_) {
+          Value shell(child.type());
+          shell.dupMeta(child);
+          auto it = target->emplace_hint(target->end(), entry.first,
+                                         std::move(shell));
+          pending.emplace_back(it->second.value_.map_, child.value_.map_);
+        } else {
+          target->emplace_hint(target->end(), entry);
+        }
+      }
+      if (pending.empty())
+        break;
+      target = pending.back().first;
+      source = pending.back().second;
+      pending.pop_back();
+    }
+    value_.map_ = map.release();
+  } break;
   default:
     JSON_ASSERT_UNREACHABLE;
   }
@@ -1017,9 +1146,47 @@ void Value::releasePayload() {
       releasePrefixedStringValue(value_.string_);
     break;
   case arrayValue:
-  case objectValue:
-    delete value_.map_;
-    break;
+  case objectValue: {
+    // Drops a reference to a shared map, returning true for the last one.
+    auto release = [](ObjectValues* map) {
+      return static_cast<SharedObjectValues*>(map)->refs.fetch_sub(
+                 1, std::memory_order_acq_rel) == 1;
+    };
+    if (bits_.shared_ && !release(value_.map_))
+      break;
+    // Detach non-empty or shared nested containers before deleting each map,
+    // so that destroying a deeply nested document does not recurse once per
+    // level. Each pending map is flagged if it is a SharedObjectValues.
+    std::vector<std::pair<ObjectValues*, bool>> pending;
+    ObjectValues* map = value_.map_;
+    bool shared = bits_.shared_;
+    for (;;) {
+      for (auto& entry : *map) {
+        Value& child = entry.second;
+        if (child.type() != arrayValue && child.type() != objectValue)
+          continue;
+        if (child.bits_.shared_) {
+          if (release(child.value_.map_))
+            pending.emplace_back(child.value_.map_, true);
+        } else if (!child.value_.map_->empty()) {
+          pending.emplace_back(child.value_.map_, false);
+        } else {
+          continue;
+        }
+        child.setType(nullValue);
+        child.bits_.shared_ = false;
+      }
+      if (shared)
+        delete static_cast<SharedObjectValues*>(map);
+      else
+        delete map;
+      if (pending.empty())
+        break;
+      map = pending.back().first;
+      shared = pending.back().second;
+      pending.pop_back();
+    }
+  } break;
   default:
     JSON_ASSERT_UNREACHABLE;
   }
@@ -1031,6 +1198,47 @@ void Value::dupMeta(const Value& other) {
   limit_ = other.limit_;
 }
 
+void Value::share() {
+  std::vector<Value*> pending{this};
+  while (!pending.empty()) {
+    Value& value = *pending.back();
+    pending.pop_back();
+    if (value.type() != arrayValue && value.type() != objectValue)
+      continue;
+    if (value.bits_.shared_) {
+      // Other copies may be reading these elements; leave them alone.
+      if (static_cast<SharedObjectValues*>(value.value_.map_)
+              ->refs.load(std::memory_order_acquire) != 1)
+        continue;
+    } else {
+      auto* shared = new SharedObjectValues(std::move(*value.value_.map_));
+      delete value.value_.map_;
+      value.value_.map_ = shared;
+      value.bits_.shared_ = true;
+    }
+    for (auto& entry : *value.value_.map_)
+      pending.push_back(&entry.second);
+  }
+}
+
+bool Value::isShared() const { return bits_.shared_; }
+
+void Value::detachPayload() {
+  if (!bits_.shared_)
+    return;
+  auto* shared = static_cast<SharedObjectValues*>(value_.map_);
+  if (shared->refs.load(std::memory_order_acquire) == 1)
+    return;
+  // Shared elements only gain a reference, so this copies a single level.
+  value_.map_ = new SharedObjectValues(static_cast<ObjectValues&>(*shared));
+  // Drop our reference to the old elements, deleting them if the other
+  // copies went away meanwhile.
+  Value previous;
+  previous.setType(type());
+  previous.bits_.shared_ = true;
+  previous.value_.map_ = shared;
+}
+
 // Access an object value by name, create a null member if it does not exist.
 // @pre Type of '*this' is object or null.
 // @param key is null-terminated.
@@ -1040,14 +1248,15 @@ Value& Value::resolveReference(const char* key) {
       "in Json::Value::resolveReference(): requires objectValue");
   if (type() == nullValue)
     *this = Value(objectValue);
+  detachPayload();
   CZString actualKey(key, static_cast<unsigned>(strlen(key)),
                      CZString::noDuplication); // NOTE!
   auto it = value_.map_->lower_bound(actualKey);
   if (it != value_.map_->end() && (*it).first == actualKey)
     return (*it).second;
 
-  ObjectValues::value_type defaultValue(actualKey, nullSingleton());
-  it = value_.map_->insert(it, defaultValue);
+  // Copying the key duplicates it when needed.
+  it = value_.map_->emplace_hint(it, actualKey, Value());
   Value& value = (*it).second;
   return value;
 }
@@ -1059,14 +1268,15 @@ Value& Value::resolveReference(char const* key, char const* end) {
       "in Json::Value::resolveReference(key, end): requires objectValue");
   if (type() == nullValue)
     *this = Value(objectValue);
+  detachPayload();
   CZString actualKey(key, static_cast<unsigned>(end - key),
                      CZString::duplicateOnCopy);
   auto it = value_.map_->lower_bound(actualKey);
   if (it != value_.map_->end() && (*it).first == actualKey)
     return (*it).second;
 
-  ObjectValues::value_type defaultValue(actualKey, nullSingleton());
-  it = value_.map_->insert(it, defaultValue);
+  // Copying the key duplicates it when needed.
+  it = value_.map_->emplace_hint(it, actualKey, Value());
   Value& value = (*it).second;
   return value;
 }
@@ -1130,6 +1340,7 @@ Value& Value::append(Value&& value) {
   if (type() == nullValue) {
     *this = Value(arrayValue);
   }
+  detachPayload();
   return this->value_.map_->emplace(size(), std::move(value)).first->second;
 }
 
@@ -1167,6 +1378,7 @@ bool Value::removeMember(const char* begin, const char* end, Value* removed) {
   if (type() != objectValue) {
     return false;
   }
+  detachPayload();
   CZString actualKey(begin, static_cast<unsigned>(end - begin),
                      CZString::noDuplication);
   auto it = value_.map_->find(actualKey);
@@ -1189,6 +1401,7 @@ void Value::removeMember(const char* key) {
   if (type() == nullValue)
     return;
 
+  detachPayload();
   CZString actualKey(key, unsigned(strlen(key)), CZString::noDuplication);
   value_.map_->erase(actualKey);
 }
@@ -1198,6 +1411,7 @@ bool Value::removeIndex(ArrayIndex index, Value* removed) {
   if (type() != arrayValue) {
     return false;
   }
+  detachPayload();
   CZString key(index);
   auto it = value_.map_->find(key);
   if (it == value_.map_->end()) {
@@ -1370,13 +1584,34 @@ bool Value::isArray() const { return type() == arrayValue; }
 
 bool Value::isObject() const { return type() == objectValue; }
 
+// A Comments block holds the length of each comment, then their text.
+using CommentLengths = std::array<size_t, numberOfCommentPlacement>;
+
+static CommentLengths commentLengths(const char* block) {
+  CommentLengths lengths;
+  memcpy(lengths.data(), block, sizeof(lengths));
+  return lengths;
+}
+
+static std::unique_ptr<char[]> cloneComments(const std::unique_ptr<char[]>& p) {
+  std::unique_ptr<char[]> r;
+  if (p) {
+    size_t size = sizeof(CommentLengths);
+    for (size_t length : commentLengths(p.get()))
+      size += length;
+    r.reset(new char[size]);
+    memcpy(r.get(), p.get(), size);
+  }
+  return r;
+}
+
 Value::Comments::Comments(const Comments& that)
-    : ptr_{cloneUnique(that.ptr_)} {}
+    : ptr_{cloneComments(that.ptr_)} {}
 
 Value::Comments::Comments(Comments&& that) : ptr_{std::move(that.ptr_)} {}
 
 Value::Comments& Value::Comments::operator=(const Comments& that) {
-  ptr_ = cloneUnique(that.ptr_);
+  ptr_ = cloneComments(that.ptr_);
   return *this;
 }
 
@@ -1386,35 +1621,69 @@ Value::Comments& Value::Comments::operator=(Comments&& that) {
 }
 
 bool Value::Comments::has(CommentPlacement slot) const {
-  return ptr_ && !(*ptr_)[slot].empty();
+  return ptr_ && commentLengths(ptr_.get())[slot] != 0;
 }
 
 String Value::Comments::get(CommentPlacement slot) const {
   if (!ptr_)
     return {};
-  return (*ptr_)[slot];
+  const CommentLengths lengths = commentLengths(ptr_.get());
+  const char* text = ptr_.get() + sizeof(lengths);
+  for (int i = 0; i < slot; ++i)
+    text += lengths[i];
+  return String(text, lengths[slot]);
 }
 
-void Value::Comments::set(CommentPlacement slot, String comment) {
-  if (!ptr_) {
-    ptr_ = std::unique_ptr<Array>(new Array());
-  }
+void Value::Comments::set(CommentPlacement slot, const char* comment,
+                          size_t length) {
   // check comments array boundry.
-  if (slot < CommentPlacement::numberOfCommentPlacement) {
-    (*ptr_)[slot] = std::move(comment);
+  if (slot >= CommentPlacement::numberOfCommentPlacement)
+    return;
+  CommentLengths lengths{};
+  if (ptr_)
+    lengths = commentLengths(ptr_.get());
+  CommentLengths newLengths = lengths;
+  newLengths[slot] = length;
+  size_t size = sizeof(newLengths);
+  for (size_t newLength : newLengths)
+    size += newLength;
+  if (size == sizeof(newLengths)) {
+    ptr_.reset();
+    return;
+  }
+  std::unique_ptr<char[]> block(new char[size]);
+  memcpy(block.get(), newLengths.data(), sizeof(newLengths));
+  char* out = block.get() + sizeof(newLengths);
+  const char* in = ptr_ ? ptr_.get() + sizeof(lengths) : nullptr;
+  for (int i = 0; i < numberOfCommentPlacement; ++i) {
+    if (i == slot) {
+      if (length)
+        memcpy(out, comment, length);
+    } else if (lengths[i]) {
+      memcpy(out, in, lengths[i]);
+    }
+    out += newLengths[i];
+    if (in)
+      in += lengths[i];
   }
+  ptr_ = std::move(block);
 }
 
-void Value::setComment(String comment, CommentPlacement placement) {
-  if (!comment.empty() && (comment.back() == '\n')) {
+void Value::setComment(const char* comment, size_t len,
+                       CommentPlacement placement) {
+  if (len > 0 && comment[len - 1] == '\n') {
     // Always discard trailing newline, to aid indentation.
-    comment.pop_back();
+    --len;
   }
-  JSON_ASSERT(!comment.empty());
+  JSON_ASSERT(len > 0);
   JSON_ASSERT_MESSAGE(
-      comment[0] == '\0' || comment[0] == '/',
+      len == 0 || comment[0] == '\0' || comment[0] == '/',
       "in Json::Value::setComment(): Comments must start with /");
-  comments_.set(placement, std::move(comment));
+  comments_.set(placement, comment, len);
+}
+
+void Value::setComment(String comment, CommentPlacement placement) {
+  setComment(comment.data(), comment.size(), placement);
 }
 
 bool Value::hasComment(CommentPlacement placement) const {
@@ -1434,10 +1703,8 @@ ptrdiff_t Value::getOffsetStart() const { return start_; }
 ptrdiff_t Value::getOffsetLimit() const { return limit_; }
 
 String Value::toStyledString() const {
-  StreamWriterBuilder builder;
-
   String out = this->hasComment(commentBefore) ? "\n" : "";
-  out += Json::writeString(builder, *this);
+  out += StreamWriterConfig::defaults().write(*this);
   out += '\n';
 
   return out;
@@ -1473,6 +1740,7 @@ Value::iterator Value::begin() {
   switch (type()) {
   case arrayValue:
   case objectValue:
+    detachPayload();
     if (value_.map_)
       return iterator(value_.map_->begin());
     break;
@@ -1486,6 +1754,7 @@ Value::iterator Value::end() {
   switch (type()) {
   case arrayValue:
   case objectValue:
+    detachPayload();
     if (value_.map_)
       return iterator(value_.map_->end());
     break;
@@ -1631,4 +1900,857 @@ Value& Path::make(Value& root) const {
   return *node;
 }
 
+// class FrozenValue
+// //////////////////////////////////////////////////////////////////
+
+// A value within a FrozenDocument buffer. Arrays point at a run of size
+// slots, objects at a run of size entries sorted by key, and strings at size
+// bytes followed by a null. All offsets are from the start of the buffer,
+// which is zero-filled so that missing array elements read as null.
+struct FrozenValue::Slot {
+  std::uint8_t type;
+  std::uint8_t reserved[3];
+  std::uint32_t size;
+  union {
+    std::int64_t int_;
+    std::uint64_t uint_;
+    double real_;
+    std::uint64_t offset_;
+  };
+};
+
+struct FrozenValue::Entry {
+  std::uint64_t keyOffset;
+  std::uint32_t keyLength;
+  std::uint32_t reserved;
+  Slot value;
+};
+
+static_assert(sizeof(std::uint64_t) == 8 && sizeof(double) == 8,
+              "FrozenValue slots assume 8-byte payloads");
+
+static size_t frozenAlign(size_t size) { return (size + 7) & ~size_t(7); }
+
+FrozenValue::FrozenValue(const char* base, const Slot* slot)
+    : base_(base), slot_(slot) {}
+
+const FrozenValue::Slot* FrozenValue::slotAt(size_t offset) const {
+  return reinterpret_cast<const Slot*>(base_ + offset);
+}
+
+const FrozenValue::Entry* FrozenValue::entryAt(size_t offset) const {
+  return reinterpret_cast<const Entry*>(base_ + offset);
+}
+
+ValueType FrozenValue::type() const {
+  return slot_ ? static_cast<ValueType>(slot_->type) : nullValue;
+}
+
+Value FrozenValue::scalar() const {
+  switch (type()) {
+  case intValue:
+    return Value(static_cast<LargestInt>(slot_->int_));
+  case uintValue:
+    return Value(static_cast<LargestUInt>(slot_->uint_));
+  case realValue:
+    return Value(slot_->real_);
+  case booleanValue:
+    return Value(slot_->uint_ != 0);
+  case stringValue:
+    return Value(base_ + slot_->offset_, base_ + slot_->offset_ + slot_->size);
+  case arrayValue:
+  case objectValue:
+    return Value(type());
+  default:
+    return Value();
+  }
+}
+
+const char* FrozenValue::asCString() const {
+  JSON_ASSERT_MESSAGE(type() == stringValue,
+                      "in Json::FrozenValue::asCString(): requires stringValue");
+  return base_ + slot_->offset_;
+}
+
+String FrozenValue::asString() const {
+  if (type() == stringValue)
+    return String(base_ + slot_->offset_, slot_->size);
+  return scalar().asString();
+}
+
+bool FrozenValue::getString(char const** begin, char const** end) const {
+  if (type() != stringValue)
+    return false;
+  *begin = base_ + slot_->offset_;
+  *end = *begin + slot_->size;
+  return true;
+}
+
+Int FrozenValue::asInt() const { return scalar().asInt(); }
+UInt FrozenValue::asUInt() const { return scalar().asUInt(); }
+#if defined(JSON_HAS_INT64)
+Int64 FrozenValue::asInt64() const { return scalar().asInt64(); }
+UInt64 FrozenValue::asUInt64() const { return scalar().asUInt64(); }
+#endif // if defined(JSON_HAS_INT64)
+LargestInt FrozenValue::asLargestInt() const {
+  return scalar().asLargestInt();
+}
+LargestUInt FrozenValue::asLargestUInt() const {
+  return scalar().asLargestUInt();
+}
+float FrozenValue::asFloat() const { return scalar().asFloat(); }
+double FrozenValue::asDouble() const { return scalar().asDouble(); }
+bool FrozenValue::asBool() const { return scalar().asBool(); }
+
+bool FrozenValue::isNull() const { return type() == nullValue; }
+bool FrozenValue::isBool() const { return type() == booleanValue; }
+bool FrozenValue::isInt() const { return isNumeric() && scalar().isInt(); }
+bool FrozenValue::isInt64() const {
+  return isNumeric() && scalar().isInt64();
+}
+bool FrozenValue::isUInt() const { return isNumeric() && scalar().isUInt(); }
+bool FrozenValue::isUInt64() const {
+  return isNumeric() && scalar().isUInt64();
+}
+bool FrozenValue::isIntegral() const {
+  return isNumeric() && scalar().isIntegral();
+}
+bool FrozenValue::isDouble() const {
+  return type() == intValue || type() == uintValue || type() == realValue;
+}
+bool FrozenValue::isNumeric() const { return isDouble(); }
+bool FrozenValue::isString() const { return type() == stringValue; }
+bool FrozenValue::isArray() const { return type() == arrayValue; }
+bool FrozenValue::isObject() const { return type() == objectValue; }
+
+bool FrozenValue::isConvertibleTo(ValueType other) const {
+  if ((isArray() || isObject()) && other == nullValue)
+    return empty();
+  return scalar().isConvertibleTo(other);
+}
+
+ArrayIndex FrozenValue::size() const {
+  return isArray() || isObject() ? slot_->size : 0;
+}
+
+bool FrozenValue::empty() const {
+  if (isNull() || isArray() || isObject())
+    return size() == 0U;
+  return false;
+}
+
+FrozenValue::operator bool() const { return !isNull(); }
+
+bool FrozenValue::isValidIndex(ArrayIndex index) const {
+  return index < size();
+}
+
+FrozenValue FrozenValue::operator[](ArrayIndex index) const {
+  JSON_ASSERT_MESSAGE(
+      type() == nullValue || type() == arrayValue,
+      "in Json::FrozenValue::operator[](ArrayIndex): requires arrayValue");
+  if (index >= size())
+    return FrozenValue();
+  return FrozenValue(base_, slotAt(slot_->offset_ + index * sizeof(Slot)));
+}
+
+FrozenValue FrozenValue::operator[](int index) const {
+  JSON_ASSERT_MESSAGE(
+      index >= 0,
+      "in Json::FrozenValue::operator[](int index): index cannot be negative");
+  return (*this)[ArrayIndex(index)];
+}
+
+const FrozenValue::Entry* FrozenValue::findEntry(const char* begin,
+                                                 const char* end) const {
+  JSON_ASSERT_MESSAGE(type() == nullValue || type() == objectValue,
+                      "in Json::FrozenValue::find(begin, end): requires "
+                      "objectValue or nullValue");
+  if (type() != objectValue)
+    return nullptr;
+  // Same order as Value::CZString: bytewise, then shorter first.
+  size_t length = static_cast<size_t>(end - begin);
+  auto keyLess = [&](const Entry& entry, const char* key, size_t keyLength) {
+    size_t minLength = std::min<size_t>(entry.keyLength, keyLength);
+    int comp = memcmp(base_ + entry.keyOffset, key, minLength);
+    return comp < 0 || (comp == 0 && entry.keyLength < keyLength);
+  };
+  const Entry* first = entryAt(slot_->offset_);
+  const Entry* last = first + slot_->size;
+  const Entry* found = std::lower_bound(
+      first, last, begin, [&](const Entry& entry, const char* key) {
+        return keyLess(entry, key, length);
+      });
+  if (found == last || found->keyLength != length ||
+      memcmp(base_ + found->keyOffset, begin, length) != 0)
+    return nullptr;
+  return found;
+}
+
+FrozenValue FrozenValue::operator[](const char* key) const {
+  return get(key, key + strlen(key), FrozenValue());
+}
+
+FrozenValue FrozenValue::operator[](const String& key) const {
+  return get(key.data(), key.data() + key.length(), FrozenValue());
+}
+
+FrozenValue FrozenValue::get(const char* begin, const char* end,
+                             const FrozenValue& defaultValue) const {
+  const Entry* entry = findEntry(begin, end);
+  return entry ? FrozenValue(base_, &entry->value) : defaultValue;
+}
+
+bool FrozenValue::isMember(const char* key) const {
+  return isMember(key, key + strlen(key));
+}
+
+bool FrozenValue::isMember(const String& key) const {
+  return isMember(key.data(), key.data() + key.length());
+}
+
+bool FrozenValue::isMember(const char* begin, const char* end) const {
+  return findEntry(begin, end) != nullptr;
+}
+
+Value::Members FrozenValue::getMemberNames() const {
+  JSON_ASSERT_MESSAGE(
+      type() == nullValue || type() == objectValue,
+      "in Json::FrozenValue::getMemberNames(), value must be objectValue");
+  Value::Members members;
+  members.reserve(size());
+  for (auto it = begin(); it != end(); ++it)
+    members.push_back(it.name());
+  return members;
+}
+
+FrozenValue::const_iterator FrozenValue::begin() const {
+  return const_iterator(*this, 0);
+}
+
+FrozenValue::const_iterator FrozenValue::end() const {
+  return const_iterator(*this, size());
+}
+
+Value FrozenValue::toValue() const {
+  Value root;
+  std::vector<std::pair<Value*, FrozenValue>> pending{{&root, *this}};
+  while (!pending.empty()) {
+    Value& target = *pending.back().first;
+    FrozenValue source = pending.back().second;
+    pending.pop_back();
+    if (!source.isArray() && !source.isObject()) {
+      target = source.scalar();
+      continue;
+    }
+    target = Value(source.type());
+    for (auto it = source.begin(); it != source.end(); ++it) {
+      char const* keyEnd;
+      char const* key = it.memberName(&keyEnd);
+      Value* child = key ? target.demand(key, keyEnd)
+                         : &target.append(Value());
+      pending.emplace_back(child, *it);
+    }
+  }
+  return root;
+}
+
+// class FrozenValueIterator
+// //////////////////////////////////////////////////////////////////
+
+FrozenValueIterator::FrozenValueIterator(const FrozenValue& container,
+                                         ArrayIndex position)
+    : container_(container), position_(position) {}
+
+FrozenValue FrozenValueIterator::operator*() const {
+  if (container_.isObject())
+    return FrozenValue(container_.base_,
+                       &container_
+                            .entryAt(container_.slot_->offset_ +
+                                     position_ * sizeof(FrozenValue::Entry))
+                            ->value);
+  return container_[position_];
+}
+
+FrozenValueIterator& FrozenValueIterator::operator++() {
+  ++position_;
+  return *this;
+}
+
+FrozenValueIterator FrozenValueIterator::operator++(int) {
+  FrozenValueIterator previous(*this);
+  ++position_;
+  return previous;
+}
+
+bool FrozenValueIterator::operator==(const FrozenValueIterator& other) const {
+  return container_.slot_ == other.container_.slot_ &&
+         position_ == other.position_;
+}
+
+bool FrozenValueIterator::operator!=(const FrozenValueIterator& other) const {
+  return !(*this == other);
+}
+
+Value FrozenValueIterator::key() const {
+  char const* end;
+  char const* name = memberName(&end);
+  if (!name)
+    return Value(position_);
+  return Value(name, end);
+}
+
+UInt FrozenValueIterator::index() const {
+  if (container_.isObject())
+    return Value::UInt(-1);
+  return position_;
+}
+
+String FrozenValueIterator::name() const {
+  char const* end;
+  char const* key = memberName(&end);
+  if (!key)
+    return String();
+  return String(key, end);
+}
+
+char const* FrozenValueIterator::memberName(char const** end) const {
+  if (!container_.isObject()) {
+    *end = nullptr;
+    return nullptr;
+  }
+  const FrozenValue::Entry* entry = container_.entryAt(
+      container_.slot_->offset_ + position_ * sizeof(FrozenValue::Entry));
+  const char* name = container_.base_ + entry->keyOffset;
+  *end = name + entry->keyLength;
+  return name;
+}
+
+// class FrozenDocument
+// //////////////////////////////////////////////////////////////////
+
+FrozenDocument::FrozenDocument() : FrozenDocument(Value()) {}
+
+FrozenDocument::FrozenDocument(const Value& value) {
+  using Slot = FrozenValue::Slot;
+  using Entry = FrozenValue::Entry;
+  // Size the buffer first, so that it is a single, exact allocation. Both
+  // passes use an explicit stack, like the rest of Value.
+  size_t total = sizeof(Slot);
+  std::vector<const Value*> stack{&value};
+  while (!stack.empty()) {
+    const Value& node = *stack.back();
+    stack.pop_back();
+    char const* begin = nullptr;
+    char const* end = nullptr;
+    switch (node.type()) {
+    case stringValue:
+      node.getString(&begin, &end);
+      total += frozenAlign(static_cast<size_t>(end - begin) + 1);
+      break;
+    case arrayValue:
+      total += node.size() * sizeof(Slot);
+      for (const auto& child : node)
+        stack.push_back(&child);
+      break;
+    case objectValue:
+      total += node.size() * sizeof(Entry);
+      for (auto it = node.begin(); it != node.end(); ++it) {
+        begin = it.memberName(&end);
+        total += frozenAlign(static_cast<size_t>(end - begin) + 1);
+        stack.push_back(&*it);
+      }
+      break;
+    default:
+      break;
+    }
+  }
+
+  buffer_.reset(new char[total]());
+  size_ = total;
+  char* base = buffer_.get();
+  size_t used = sizeof(Slot);
+  auto allocate = [&](size_t bytes) {
+    size_t offset = used;
+    used += frozenAlign(bytes);
+    return offset;
+  };
+  auto copyString = [&](char const* begin, char const* end) {
+    size_t offset = allocate(static_cast<size_t>(end - begin) + 1);
+    memcpy(base + offset, begin, static_cast<size_t>(end - begin));
+    return offset;
+  };
+  std::vector<std::pair<size_t, const Value*>> pending{{0, &value}};
+  while (!pending.empty()) {
+    Slot& slot = *reinterpret_cast<Slot*>(base + pending.back().first);
+    const Value& node = *pending.back().second;
+    pending.pop_back();
+    slot.type = static_cast<std::uint8_t>(node.type());
+    char const* begin = nullptr;
+    char const* end = nullptr;
+    switch (node.type()) {
+    case nullValue:
+      break;
+    case intValue:
+      slot.int_ = node.asLargestInt();
+      break;
+    case uintValue:
+      slot.uint_ = node.asLargestUInt();
+      break;
+    case realValue:
+      slot.real_ = node.asDouble();
+      break;
+    case booleanValue:
+      slot.uint_ = node.asBool();
+      break;
+    case stringValue:
+      node.getString(&begin, &end);
+      slot.size = static_cast<std::uint32_t>(end - begin);
+      slot.offset_ = copyString(begin, end);
+      break;
+    case arrayValue:
+      slot.size = node.size();
+      slot.offset_ = allocate(slot.size * sizeof(Slot));
+      // Elements missing from a sparse array stay zero, that is null.
+      for (auto it = node.begin(); it != node.end(); ++it)
+        pending.emplace_back(slot.offset_ + it.index() * sizeof(Slot), &*it);
+      break;
+    case objectValue: {
+      slot.size = node.size();
+      slot.offset_ = allocate(slot.size * sizeof(Entry));
+      size_t offset = slot.offset_;
+      for (auto it = node.begin(); it != node.end(); ++it) {
+        Entry& entry = *reinterpret_cast<Entry*>(base + offset);
+        begin = it.memberName(&end);
+        entry.keyOffset = copyString(begin, end);
+        entry.keyLength = static_cast<std::uint32_t>(end - begin);
+        pending.emplace_back(offset + offsetof(Entry, value), &*it);
+        offset += sizeof(Entry);
+      }
+    } break;
+    default:
+      JSON_ASSERT_UNREACHABLE;
+    }
+  }
+  JSON_ASSERT(used == total);
+}
+
+FrozenDocument::FrozenDocument(FrozenDocument&& other) = default;
+
+FrozenDocument& FrozenDocument::operator=(FrozenDocument&& other) = default;
+
+FrozenDocument::~FrozenDocument() = default;
+
+FrozenValue FrozenDocument::root() const {
+  if (!buffer_)
+    return FrozenValue();
+  return FrozenValue(buffer_.get(),
+                     reinterpret_cast<const FrozenValue::Slot*>(buffer_.get()));
+}
+
+const char* FrozenDocument::data() const { return buffer_.get(); }
+
+size_t FrozenDocument::size() const { return size_; }
+
+// The header of a snapshot, which the FrozenDocument buffer follows.
+struct SnapshotHeader {
+  char magic[4];
+  std::uint32_t version;
+  // snapshotByteOrder as written, which reads differently on a platform with
+  // another byte order.
+  std::uint32_t byteOrder;
+  std::uint32_t reserved;
+  std::uint64_t size;
+};
+
+static_assert(sizeof(SnapshotHeader) == 24,
+              "The buffer must follow the header at an 8-byte boundary");
+
+static char const snapshotMagic[4] = {'J', 'S', 'N', 'P'};
+static std::uint32_t const snapshotVersion = 1;
+static std::uint32_t const snapshotByteOrder = 0x01020304;
+
+// Checks that the buffer [base, base + size) is laid out exactly as the
+// constructor lays it out, which is the only layout for a given Value: every
+// run of slots, entries or characters starts where the previous one ended,
+// in the order the constructor allocates them. So every offset is in bounds,
+// strings are terminated, and no run is shared or cyclic.
+const char* FrozenDocument::checkLayout(const char* base, size_t size) {
+  using Slot = FrozenValue::Slot;
+  using Entry = FrozenValue::Entry;
+  if (size < sizeof(Slot) || size % 8 != 0)
+    return "Invalid snapshot size";
+  std::uint64_t used = sizeof(Slot);
+  auto allocate = [&](std::uint64_t offset, std::uint64_t bytes) {
+    if (offset != used || bytes > size - used)
+      return false;
+    used += frozenAlign(static_cast<size_t>(bytes));
+    return true;
+  };
+  auto isString = [&](std::uint64_t offset, std::uint32_t length) {
+    return allocate(offset, std::uint64_t(length) + 1) &&
+           base[offset + length] == 0;
+  };
+  std::vector<size_t> pending{0};
+  while (!pending.empty()) {
+    const Slot& slot = *reinterpret_cast<const Slot*>(base + pending.back());
+    pending.pop_back();
+    switch (slot.type) {
+    case nullValue:
+    case intValue:
+    case uintValue:
+    case realValue:
+    case booleanValue:
+      break;
+    case stringValue:
+      if (!isString(slot.offset_, slot.size))
+        return "Invalid string in snapshot";
+      break;
+    case arrayValue:
+      if (!allocate(slot.offset_, std::uint64_t(slot.size) * sizeof(Slot)))
+        return "Invalid array in snapshot";
+      for (size_t i = 0; i < slot.size; ++i)
+        pending.push_back(static_cast<size_t>(slot.offset_) + i * sizeof(Slot));
+      break;
+    case objectValue:
+      if (!allocate(slot.offset_, std::uint64_t(slot.size) * sizeof(Entry)))
+        return "Invalid object in snapshot";
+      for (size_t i = 0; i < slot.size; ++i) {
+        size_t const offset = static_cast<size_t>(slot.offset_) +
+                              i * sizeof(Entry);
+        const Entry& entry = *reinterpret_cast<const Entry*>(base + offset);
+        if (!isString(entry.keyOffset, entry.keyLength))
+          return "Invalid object key in snapshot";
+        pending.push_back(offset + offsetof(Entry, value));
+      }
+      break;
+    default:
+      return "Invalid value type in snapshot";
+    }
+  }
+  if (used != size)
+    return "Unused bytes at end of snapshot";
+  return nullptr;
+}
+
+// Checks the header of the snapshot [begin, end), and returns its buffer
+// size, or sets \a error.
+static size_t checkSnapshotHeader(const char* begin, const char* end,
+                                  const char** error) {
+  SnapshotHeader header;
+  if (static_cast<size_t>(end - begin) < sizeof(header)) {
+    *error = "Truncated snapshot header";
+    return 0;
+  }
+  memcpy(&header, begin, sizeof(header));
+  if (memcmp(header.magic, snapshotMagic, sizeof(header.magic)) != 0)
+    *error = "Not a snapshot";
+  else if (header.version != snapshotVersion)
+    *error = "Unsupported snapshot version";
+  else if (header.byteOrder != snapshotByteOrder)
+    *error = "Snapshot was written with another byte order";
+  else if (header.size != static_cast<size_t>(end - begin) - sizeof(header))
+    *error = "Snapshot size does not match its header";
+  else
+    return static_cast<size_t>(header.size);
+  return 0;
+}
+
+static bool snapshotError(const char* message, String* errs) {
+  if (errs)
+    *errs = String("* ") + message + "\n";
+  return false;
+}
+
+void FrozenDocument::writeSnapshot(OStream& sout) const {
+  SnapshotHeader header{};
+  memcpy(header.magic, snapshotMagic, sizeof(header.magic));
+  header.version = snapshotVersion;
+  header.byteOrder = snapshotByteOrder;
+  header.size = size_;
+  sout.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  sout.write(buffer_.get(), static_cast<std::streamsize>(size_));
+}
+
+bool FrozenDocument::readSnapshot(const char* begin, const char* end,
+                                  String* errs) {
+  const char* error = nullptr;
+  size_t const size = checkSnapshotHeader(begin, end, &error);
+  if (error)
+    return snapshotError(error, errs);
+  // Copy before checking, since the bytes may not be aligned.
+  std::unique_ptr<char[]> buffer(new char[size]);
+  memcpy(buffer.get(), begin + sizeof(SnapshotHeader), size);
+  error = checkLayout(buffer.get(), size);
+  if (error)
+    return snapshotError(error, errs);
+  buffer_ = std::move(buffer);
+  size_ = size;
+  return true;
+}
+
+bool FrozenDocument::viewSnapshot(const char* begin, const char* end,
+                                  FrozenValue* root, String* errs) {
+  if (reinterpret_cast<std::uintptr_t>(begin) % 8 != 0)
+    return snapshotError("Snapshot is not aligned to 8 bytes", errs);
+  const char* error = nullptr;
+  size_t const size = checkSnapshotHeader(begin, end, &error);
+  const char* const base = begin + sizeof(SnapshotHeader);
+  if (!error)
+    error = checkLayout(base, size);
+  if (error)
+    return snapshotError(error, errs);
+  *root = FrozenValue(base, reinterpret_cast<const FrozenValue::Slot*>(base));
+  return true;
+}
+
+// class Executor
+// //////////////////////////////////////////////////////////////////
+
+Executor::~Executor() = default;
+
+// class ThreadPoolExecutor
+// //////////////////////////////////////////////////////////////////
+
+class ThreadPoolExecutor::Impl {
+public:
+  explicit Impl(unsigned threadCount);
+  ~Impl();
+
+  void parallelFor(size_t count, const std::function<void(size_t)>& task);
+  unsigned concurrency() const { return concurrency_; }
+
+private:
+  void workerLoop();
+  void runTasks(const std::function<void(size_t)>& task, size_t count);
+
+  unsigned concurrency_;
+  std::vector<std::thread> workers_;
+  std::mutex submitMutex_; // Serializes parallelFor() callers.
+  std::mutex mutex_;       // Guards the job state below.
+  std::condition_variable jobReady_;
+  std::condition_variable jobDone_;
+  const std::function<void(size_t)>* task_ = nullptr;
+  size_t count_ = 0;
+  std::atomic<size_t> next_{0};
+  unsigned generation_ = 0;
+  unsigned busy_ = 0;
+  bool stopping_ = false;
+#if JSON_USE_EXCEPTION
+  std::exception_ptr error_;
+#endif
+};
+
+// The pool whose task the current thread is running, if any.
+static thread_local const void* currentPool = nullptr;
+
+ThreadPoolExecutor::Impl::Impl(unsigned threadCount)
+    : concurrency_(threadCount ? threadCount
+                               : std::max(1u, std::thread::hardware_concurrency())) {
+  workers_.reserve(concurrency_ - 1);
+  for (unsigned i = 1; i < concurrency_; ++i)
+    workers_.emplace_back(&Impl::workerLoop, this);
+}
+
+ThreadPoolExecutor::Impl::~Impl() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+  }
+  jobReady_.notify_all();
+  for (auto& worker : workers_)
+    worker.join();
+}
+
+void ThreadPoolExecutor::Impl::parallelFor(
+    size_t count, const std::function<void(size_t)>& task) {
+  if (currentPool == this || workers_.empty() || count < 2) {
+    for (size_t i = 0; i < count; ++i)
+      task(i);
+    return;
+  }
+  std::lock_guard<std::mutex> submitLock(submitMutex_);
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    task_ = &task;
+    count_ = count;
+    next_ = 0;
+    ++generation_;
+    ++busy_;
+  }
+  jobReady_.notify_all();
+  runTasks(task, count);
+  std::unique_lock<std::mutex> lock(mutex_);
+  --busy_;
+  jobDone_.wait(lock, [this] { return busy_ == 0; });
+  task_ = nullptr;
+#if JSON_USE_EXCEPTION
+  if (error_) {
+    std::exception_ptr error;
+    std::swap(error, error_);
+    std::rethrow_exception(error);
+  }
+#endif
+}
+
+void ThreadPoolExecutor::Impl::workerLoop() {
+  unsigned seen = 0;
+  std::unique_lock<std::mutex> lock(mutex_);
+  for (;;) {
+    jobReady_.wait(lock,
+                   [&] { return stopping_ || generation_ != seen; });
+    if (stopping_)
+      return;
+    seen = generation_;
+    // The job may already be over; only join one that is still running.
+    const std::function<void(size_t)>* task = task_;
+    size_t count = count_;
+    if (!task)
+      continue;
+    ++busy_;
+    lock.unlock();
+    runTasks(*task, count);
+    lock.lock();
+    if (--busy_ == 0)
+      jobDone_.notify_all();
+  }
+}
+
+void ThreadPoolExecutor::Impl::runTasks(
+    const std::function<void(size_t)>& task, size_t count) {
+  const void* outer = currentPool;
+  currentPool = this;
+  for (;;) {
+    size_t index = next_.fetch_add(1);
+    if (index >= count)
+      break;
+#if JSON_USE_EXCEPTION
+    try {
+      task(index);
+    } catch (...) {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (!error_)
+        error_ = std::current_exception();
+      next_ = count; // Abandon the remaining tasks.
+    }
+#else
+    task(index);
+#endif
+  }
+  currentPool = outer;
+}
+
+ThreadPoolExecutor::ThreadPoolExecutor(unsigned threadCount)
+    : impl_(new Impl(threadCount)) {}
+
+ThreadPoolExecutor::~ThreadPoolExecutor() = default;
+
+void ThreadPoolExecutor::parallelFor(size_t count,
+                                     const std::function<void(size_t)>& task) {
+  impl_->parallelFor(count, task);
+}
+
+unsigned ThreadPoolExecutor::concurrency() const {
+  return impl_->concurrency();
+}
+
+// parallelCopy(), parallelEquals()
+// //////////////////////////////////////////////////////////////////
+
+// Containers with at least this many elements are always split into one task
+// per element.
+static const ArrayIndex parallelSplitSize = 1024;
+
+// Smaller containers are split as well while there are fewer than this many
+// tasks per thread, so that a few large subtrees near the root still spread
+// across the executor.
+static const size_t parallelTasksPerThread = 16;
+
+static bool shouldSplit(const Value& value, size_t taskCount,
+                        const Executor& executor) {
+  // Copying or comparing a shared container is already cheap.
+  if ((!value.isArray() && !value.isObject()) || value.isShared())
+    return false;
+  return value.size() >= parallelSplitSize ||
+         taskCount < executor.concurrency() * parallelTasksPerThread;
+}
+
+// Runs task(i) for each i in [0, count) in a few contiguous batches per
+// thread, to keep the scheduling overhead per element small.
+template <typename Task>
+static void runBatched(Executor& executor, size_t count, const Task& task) {
+  size_t batches = std::min<size_t>(count, executor.concurrency() * 8);
+  if (batches < 2) {
+    for (size_t i = 0; i < count; ++i)
+      task(i);
+    return;
+  }
+  executor.parallelFor(batches, [&](size_t batch) {
+    size_t end = count * (batch + 1) / batches;
+    for (size_t i = count * batch / batches; i < end; ++i)
+      task(i);
+  });
+}
+
+Value parallelCopy(const Value& other, Executor& executor) {
+  if (executor.concurrency() < 2)
+    return Value(other);
+  // Breadth-first, split containers into shells holding null placeholders
+  // and queue their elements. Whatever is not split becomes a task which
+  // copies the whole subtree.
+  Value root;
+  std::vector<std::pair<Value*, const Value*>> queue{{&root, &other}};
+  std::vector<std::pair<Value*, const Value*>> tasks;
+  for (size_t next = 0; next < queue.size(); ++next) {
+    Value& target = *queue[next].first;
+    const Value& source = *queue[next].second;
+    if (!shouldSplit(source, tasks.size() + queue.size() - next, executor)) {
+      tasks.emplace_back(&target, &source);
+      continue;
+    }
+    target = Value(source.type());
+    target.dupMeta(source);
+    Value::ObjectValues& map = *target.value_.map_;
+    for (const auto& entry : *source.value_.map_) {
+      auto it = map.emplace_hint(map.end(), entry.first, Value());
+      queue.emplace_back(&it->second, &entry.second);
+    }
+  }
+  // Each task writes to its own, already inserted, element.
+  runBatched(executor, tasks.size(),
+             [&](size_t i) { *tasks[i].first = *tasks[i].second; });
+  return root;
+}
+
+bool parallelEquals(const Value& a, const Value& b, Executor& executor) {
+  if (executor.concurrency() < 2)
+    return a == b;
+  std::vector<std::pair<const Value*, const Value*>> queue{{&a, &b}};
+  std::vector<std::pair<const Value*, const Value*>> tasks;
+  for (size_t next = 0; next < queue.size(); ++next) {
+    const Value& x = *queue[next].first;
+    const Value& y = *queue[next].second;
+    if (!shouldSplit(x, tasks.size() + queue.size() - next, executor)) {
+      tasks.emplace_back(&x, &y);
+      continue;
+    }
+    if (!x.shallowEquals(y))
+      return false;
+    auto yIt = y.value_.map_->begin();
+    for (const auto& entry : *x.value_.map_) {
+      if (!(entry.first == yIt->first))
+        return false;
+      queue.emplace_back(&entry.second, &yIt->second);
+      ++yIt;
+    }
+  }
+  std::atomic<bool> equal{true};
+  runBatched(executor, tasks.size(), [&](size_t i) {
+    if (equal.load(std::memory_order_relaxed) &&
+        !(*tasks[i].first == *tasks[i].second))
+      equal.store(false, std::memory_order_relaxed);
+  });
+  return equal.load();
+}
+
 } // namespace Json
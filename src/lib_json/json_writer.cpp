@@ -94,15 +94,7 @@ using StreamWriterPtr = std::auto_ptr<StreamWriter>;
 String valueToString(LargestInt value) {
   UIntToStringBuffer buffer;
   char* current = buffer + sizeof(buffer);
-  if (value == Value::minLargestInt) {
-    uintToString(LargestUInt(Value::maxLargestInt) + 1, current);
-    *--current = '-';
-  } else if (value < 0) {
-    uintToString(LargestUInt(-value), current);
-    *--current = '-';
-  } else {
-    uintToString(LargestUInt(value), current);
-  }
+  intToString(value, current);
   assert(current >= buffer);
   return current;
 }
@@ -175,14 +167,6 @@ String valueToString(double value, unsigned int precision,
 
 String valueToString(bool value) { return value ? "true" : "false"; }
 
-static bool doesAnyCharRequireEscaping(char const* s, size_t n) {
-  assert(s || !n);
-
-  return std::any_of(s, s + n, [](unsigned char c) {
-    return c == '\\' || c == '"' || c < 0x20 || c > 0x7F;
-  });
-}
-
 static unsigned int utf8ToCodepoint(const char*& s, const char* e) {
   const unsigned int REPLACEMENT_CHARACTER = 0xFFFD;
 
@@ -251,23 +235,120 @@ static const char hex2[] = "000102030405060708090a0b0c0d0e0f"
                            "e0e1e2e3e4e5e6e7e8e9eaebecedeeef"
                            "f0f1f2f3f4f5f6f7f8f9fafbfcfdfeff";
 
-static String toHex16Bit(unsigned int x) {
-  const unsigned int hi = (x >> 8) & 0xff;
-  const unsigned int lo = x & 0xff;
-  String result(4, ' ');
-  result[0] = hex2[2 * hi];
-  result[1] = hex2[2 * hi + 1];
-  result[2] = hex2[2 * lo];
-  result[3] = hex2[2 * lo + 1];
-  return result;
+// Writes the escape sequence "\\uXXXX" for \a ch at \a out.
+static char* appendHex(char* out, unsigned ch) {
+  const unsigned int hi = (ch >> 8) & 0xff;
+  const unsigned int lo = ch & 0xff;
+  *out++ = '\\';
+  *out++ = 'u';
+  *out++ = hex2[2 * hi];
+  *out++ = hex2[2 * hi + 1];
+  *out++ = hex2[2 * lo];
+  *out++ = hex2[2 * lo + 1];
+  return out;
 }
 
-static void appendRaw(String& result, unsigned ch) {
-  result += static_cast<char>(ch);
+// Whether \a c is copied to a quoted string as is.
+static bool isPlainChar(char c, bool emitUTF8) {
+  auto const byte = static_cast<unsigned char>(c);
+  return byte >= 0x20 && byte != '"' && byte != '\\' &&
+         (emitUTF8 || byte < 0x80);
 }
 
-static void appendHex(String& result, unsigned ch) {
-  result.append("\\u").append(toHex16Bit(ch));
+// Length of the prefix of [begin, end) made of plain characters.
+static size_t plainPrefixLength(const char* begin, const char* end,
+                                bool emitUTF8) {
+  const char* p = begin;
+#if defined(JSONCPP_HAS_SSE2)
+  __m128i const space = _mm_set1_epi8(' ');
+  __m128i const quote = _mm_set1_epi8('"');
+  __m128i const backslash = _mm_set1_epi8('\\');
+  __m128i const minusOne = _mm_set1_epi8(-1);
+  while (end - p >= 16) {
+    __m128i const bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+    // The comparison is signed: bytes above 0x7F are below ' ' too.
+    __m128i special = _mm_cmplt_epi8(bytes, space);
+    if (emitUTF8)
+      special = _mm_and_si128(special, _mm_cmpgt_epi8(bytes, minusOne));
+    special = _mm_or_si128(special,
+                           _mm_or_si128(_mm_cmpeq_epi8(bytes, quote),
+                                        _mm_cmpeq_epi8(bytes, backslash)));
+    int const mask = _mm_movemask_epi8(special);
+    if (mask)
+      return static_cast<size_t>(p - begin) +
+             countTrailingZeros(static_cast<unsigned>(mask));
+    p += 16;
+  }
+#endif
+  while (p != end && isPlainChar(*p, emitUTF8))
+    ++p;
+  return static_cast<size_t>(p - begin);
+}
+
+// Writes the escaped form of the character at \a c, which is not plain, and
+// moves \a c past it. Needs room for 12 characters at \a out.
+static char* appendEscaped(const char*& c, const char* end, char* out,
+                           bool emitUTF8) {
+  char const ch = *c++;
+  char escape = 0;
+  switch (ch) {
+  case '\"':
+    escape = '"';
+    break;
+  case '\\':
+    escape = '\\';
+    break;
+  case '\b':
+    escape = 'b';
+    break;
+  case '\f':
+    escape = 'f';
+    break;
+  case '\n':
+    escape = 'n';
+    break;
+  case '\r':
+    escape = 'r';
+    break;
+  case '\t':
+    escape = 't';
+    break;
+  // case '/':
+  // Even though \/ is considered a legal escape in JSON, a bare
+  // slash is also legal, so I see no reason to escape it.
+  // (I hope I am not misunderstanding something.)
+  // blep notes: actually escaping \/ may be useful in javascript to avoid </
+  // sequence.
+  // Should add a flag to allow this compatibility mode and prevent this
+  // sequence from occurring.
+  default:
+    break;
+  }
+  if (escape) {
+    *out++ = '\\';
+    *out++ = escape;
+    return out;
+  }
+  unsigned codepoint = static_cast<unsigned char>(ch);
+  if (!emitUTF8) {
+    --c;
+    codepoint = utf8ToCodepoint(c, end); // modifies `c`
+    ++c;
+  }
+  if (codepoint < 0x20) {
+    out = appendHex(out, codepoint);
+  } else if (codepoint < 0x80 || emitUTF8) {
+    *out++ = static_cast<char>(codepoint);
+  } else if (codepoint < 0x10000) {
+    // Basic Multilingual Plane
+    out = appendHex(out, codepoint);
+  } else {
+    // Extended Unicode. Encode 20 bits as a surrogate pair.
+    codepoint -= 0x10000;
+    out = appendHex(out, 0xd800 + ((codepoint >> 10) & 0x3ff));
+    out = appendHex(out, 0xdc00 + (codepoint & 0x3ff));
+  }
+  return out;
 }
 
 static String valueToQuotedStringN(const char* value, unsigned length,
@@ -275,75 +356,25 @@ static String valueToQuotedStringN(const char* value, unsigned length,
   if (value == nullptr)
     return "";
 
-  if (!doesAnyCharRequireEscaping(value, length))
-    return String("\"") + value + "\"";
-  // We have to walk value and escape any special characters.
-  // Appending to String is not efficient, but this should be rare.
-  // (Note: forward slashes are *not* rare, but I am not escaping them.)
-  String::size_type maxsize = length * 2 + 3; // allescaped+quotes+NULL
-  String result;
-  result.reserve(maxsize); // to avoid lots of mallocs
-  result += "\"";
   char const* end = value + length;
-  for (const char* c = value; c != end; ++c) {
-    switch (*c) {
-    case '\"':
-      result += "\\\"";
-      break;
-    case '\\':
-      result += "\\\\";
-      break;
-    case '\b':
-      result += "\\b";
-      break;
-    case '\f':
-      result += "\\f";
-      break;
-    case '\n':
-      result += "\\n";
-      break;
-    case '\r':
-      result += "\\r";
-      break;
-    case '\t':
-      result += "\\t";
-      break;
-    // case '/':
-    // Even though \/ is considered a legal escape in JSON, a bare
-    // slash is also legal, so I see no reason to escape it.
-    // (I hope I am not misunderstanding something.)
-    // blep notes: actually escaping \/ may be useful in javascript to avoid </
-    // sequence.
-    // Should add a flag to allow this compatibility mode and prevent this
-    // sequence from occurring.
-    default: {
-      if (emitUTF8) {
-        unsigned codepoint = static_cast<unsigned char>(*c);
-        if (codepoint < 0x20) {
-          appendHex(result, codepoint);
-        } else {
-          appendRaw(result, codepoint);
-        }
-      } else {
-        unsigned codepoint = utf8ToCodepoint(c, end); // modifies `c`
-        if (codepoint < 0x20) {
-          appendHex(result, codepoint);
-        } else if (codepoint < 0x80) {
-          appendRaw(result, codepoint);
-        } else if (codepoint < 0x10000) {
-          // Basic Multilingual Plane
-          appendHex(result, codepoint);
-        } else {
-          // Extended Unicode. Encode 20 bits as a surrogate pair.
-          codepoint -= 0x10000;
-          appendHex(result, 0xd800 + ((codepoint >> 10) & 0x3ff));
-          appendHex(result, 0xdc00 + (codepoint & 0x3ff));
-        }
-      }
-    } break;
-    }
+  size_t plain = plainPrefixLength(value, end, emitUTF8);
+  String result;
+  result.reserve(plain == length ? length + 2 : length * 2 + 3);
+  result += '"';
+  for (const char* c = value; c != end;) {
+    result.append(c, plain);
+    c += plain;
+    // Escape the following run of special characters, such as a run of
+    // non-ASCII text, through a local buffer.
+    char buffer[256];
+    char* out = buffer;
+    while (c != end && out + 12 <= buffer + sizeof(buffer) &&
+           !isPlainChar(*c, emitUTF8))
+      out = appendEscaped(c, end, out, emitUTF8);
+    result.append(buffer, static_cast<size_t>(out - buffer));
+    plain = plainPrefixLength(c, end, emitUTF8);
   }
-  result += "\"";
+  result += '"';
   return result;
 }
 
@@ -382,12 +413,20 @@ void FastWriter::writeValue(const Value& value) {
     if (!dropNullPlaceholders_)
       document_ += "null";
     break;
-  case intValue:
-    document_ += valueToString(value.asLargestInt());
+  case intValue: {
+    UIntToStringBuffer buffer;
+    char* current = buffer + sizeof(buffer);
+    intToString(value.asLargestInt(), current);
+    document_.append(current, buffer + sizeof(buffer) - 1);
     break;
-  case uintValue:
-    document_ += valueToString(value.asLargestUInt());
+  }
+  case uintValue: {
+    UIntToStringBuffer buffer;
+    char* current = buffer + sizeof(buffer);
+    uintToString(value.asLargestUInt(), current);
+    document_.append(current, buffer + sizeof(buffer) - 1);
     break;
+  }
   case realValue:
     document_ += valueToString(value.asDouble());
     break;
@@ -414,16 +453,16 @@ void FastWriter::writeValue(const Value& value) {
     document_ += ']';
   } break;
   case objectValue: {
-    Value::Members members(value.getMemberNames());
     document_ += '{';
-    for (auto it = members.begin(); it != members.end(); ++it) {
-      const String& name = *it;
-      if (it != members.begin())
+    for (auto it = value.begin(); it != value.end(); ++it) {
+      char const* end;
+      char const* name = it.memberName(&end);
+      if (it != value.begin())
         document_ += ',';
-      document_ += valueToQuotedStringN(name.data(),
-                                        static_cast<unsigned>(name.length()));
+      document_ +=
+          valueToQuotedStringN(name, static_cast<unsigned>(end - name));
       document_ += yamlCompatibilityEnabled_ ? ": " : ":";
-      writeValue(value[name]);
+      writeValue(*it);
     }
     document_ += '}';
   } break;
@@ -478,21 +517,21 @@ void StyledWriter::writeValue(const Value& value) {
     writeArrayValue(value);
     break;
   case objectValue: {
-    Value::Members members(value.getMemberNames());
-    if (members.empty())
+    if (value.empty())
       pushValue("{}");
     else {
       writeWithIndent("{");
       indent();
-      auto it = members.begin();
+      auto it = value.begin();
       for (;;) {
-        const String& name = *it;
-        const Value& childValue = value[name];
+        char const* end;
+        char const* name = it.memberName(&end);
+        const Value& childValue = *it;
         writeCommentBeforeValue(childValue);
-        writeWithIndent(valueToQuotedString(name.c_str()));
+        writeWithIndent(valueToQuotedString(name));
         document_ += " : ";
         writeValue(childValue);
-        if (++it == members.end()) {
+        if (++it == value.end()) {
           writeCommentAfterValueOnSameLine(childValue);
           break;
         }
@@ -696,21 +735,21 @@ void StyledStreamWriter::writeValue(const Value& value) {
     writeArrayValue(value);
     break;
   case objectValue: {
-    Value::Members members(value.getMemberNames());
-    if (members.empty())
+    if (value.empty())
       pushValue("{}");
     else {
       writeWithIndent("{");
       indent();
-      auto it = members.begin();
+      auto it = value.begin();
       for (;;) {
-        const String& name = *it;
-        const Value& childValue = value[name];
+        char const* end;
+        char const* name = it.memberName(&end);
+        const Value& childValue = *it;
         writeCommentBeforeValue(childValue);
-        writeWithIndent(valueToQuotedString(name.c_str()));
+        writeWithIndent(valueToQuotedString(name));
         *document_ << " : ";
         writeValue(childValue);
-        if (++it == members.end()) {
+        if (++it == value.end()) {
           writeCommentAfterValueOnSameLine(childValue);
           break;
         }
@@ -875,6 +914,8 @@ struct CommentStyle {
 };
 
 struct BuiltStyledStreamWriter : public StreamWriter {
+  friend class ParallelStyledWriter;
+
   BuiltStyledStreamWriter(String indentation, CommentStyle::Enum cs,
                           String colonSymbol, String nullSymbol,
                           String endingLineFeedSymbol, bool useSpecialFloats,
@@ -886,7 +927,10 @@ private:
   void writeValue(Value const& value);
   void writeArrayValue(Value const& value);
   bool isMultilineArray(Value const& value);
+  void beginChild(Value const& childValue, char const* name, char const* end);
+  void endChild(Value const& childValue, bool last);
   void pushValue(String const& value);
+  void pushValue(char const* begin, char const* end);
   void writeIndent();
   void writeWithIndent(String const& value);
   void indent();
@@ -895,9 +939,10 @@ private:
   void writeCommentAfterValueOnSameLine(Value const& root);
   static bool hasCommentForValue(const Value& value);
 
-  using ChildValues = std::vector<String>;
-
-  ChildValues childValues_;
+  // The text of the first elements of the array being laid out, back to
+  // back, and where each one ends. Reused from one array to the next.
+  String childText_;
+  std::vector<size_t> childEnds_;
   String indentString_;
   unsigned int rightMargin_;
   String indentation_;
@@ -942,12 +987,20 @@ void BuiltStyledStreamWriter::writeValue(Value const& value) {
   case nullValue:
     pushValue(nullSymbol_);
     break;
-  case intValue:
-    pushValue(valueToString(value.asLargestInt()));
+  case intValue: {
+    UIntToStringBuffer buffer;
+    char* current = buffer + sizeof(buffer);
+    intToString(value.asLargestInt(), current);
+    pushValue(current, buffer + sizeof(buffer) - 1);
     break;
-  case uintValue:
-    pushValue(valueToString(value.asLargestUInt()));
+  }
+  case uintValue: {
+    UIntToStringBuffer buffer;
+    char* current = buffer + sizeof(buffer);
+    uintToString(value.asLargestUInt(), current);
+    pushValue(current, buffer + sizeof(buffer) - 1);
     break;
+  }
   case realValue:
     pushValue(valueToString(value.asDouble(), useSpecialFloats_, precision_,
                             precisionType_));
@@ -971,27 +1024,18 @@ void BuiltStyledStreamWriter::writeValue(Value const& value) {
     writeArrayValue(value);
     break;
   case objectValue: {
-    Value::Members members(value.getMemberNames());
-    if (members.empty())
+    if (value.empty())
       pushValue("{}");
     else {
       writeWithIndent("{");
       indent();
-      auto it = members.begin();
-      for (;;) {
-        String const& name = *it;
-        Value const& childValue = value[name];
-        writeCommentBeforeValue(childValue);
-        writeWithIndent(valueToQuotedStringN(
-            name.data(), static_cast<unsigned>(name.length()), emitUTF8_));
-        *sout_ << colonSymbol_;
+      for (auto it = value.begin(); it != value.end();) {
+        char const* end;
+        char const* name = it.memberName(&end);
+        Value const& childValue = *it;
+        beginChild(childValue, name, end);
         writeValue(childValue);
-        if (++it == members.end()) {
-          writeCommentAfterValueOnSameLine(childValue);
-          break;
-        }
-        *sout_ << ",";
-        writeCommentAfterValueOnSameLine(childValue);
+        endChild(childValue, ++it == value.end());
       }
       unindent();
       writeWithIndent("}");
@@ -1009,39 +1053,35 @@ void BuiltStyledStreamWriter::writeArrayValue(Value const& value) {
     if (isMultiLine) {
       writeWithIndent("[");
       indent();
-      bool hasChildValue = !childValues_.empty();
-      unsigned index = 0;
-      for (;;) {
+      // The elements laid out by isMultilineArray() are scalars or empty, so
+      // writing the others does not touch childText_.
+      size_t const formatted = childEnds_.size();
+      for (unsigned index = 0; index < size; ++index) {
         Value const& childValue = value[index];
-        writeCommentBeforeValue(childValue);
-        if (hasChildValue)
-          writeWithIndent(childValues_[index]);
-        else {
-          if (!indented_)
-            writeIndent();
-          indented_ = true;
+        beginChild(childValue, nullptr, nullptr);
+        if (index < formatted) {
+          size_t const begin = index > 0 ? childEnds_[index - 1] : 0;
+          sout_->write(childText_.data() + begin,
+                       static_cast<std::streamsize>(childEnds_[index] - begin));
+        } else {
           writeValue(childValue);
-          indented_ = false;
-        }
-        if (++index == size) {
-          writeCommentAfterValueOnSameLine(childValue);
-          break;
         }
-        *sout_ << ",";
-        writeCommentAfterValueOnSameLine(childValue);
+        endChild(childValue, index + 1 == size);
       }
       unindent();
       writeWithIndent("]");
     } else // output on a single line
     {
-      assert(childValues_.size() == size);
+      assert(childEnds_.size() == size);
       *sout_ << "[";
       if (!indentation_.empty())
         *sout_ << " ";
       for (unsigned index = 0; index < size; ++index) {
+        size_t const begin = index > 0 ? childEnds_[index - 1] : 0;
         if (index > 0)
           *sout_ << ((!indentation_.empty()) ? ", " : ",");
-        *sout_ << childValues_[index];
+        sout_->write(childText_.data() + begin,
+                     static_cast<std::streamsize>(childEnds_[index] - begin));
       }
       if (!indentation_.empty())
         *sout_ << " ";
@@ -1053,7 +1093,8 @@ void BuiltStyledStreamWriter::writeArrayValue(Value const& value) {
 bool BuiltStyledStreamWriter::isMultilineArray(Value const& value) {
   ArrayIndex const size = value.size();
   bool isMultiLine = size * 3 >= rightMargin_;
-  childValues_.clear();
+  childText_.clear();
+  childEnds_.clear();
   for (ArrayIndex index = 0; index < size && !isMultiLine; ++index) {
     Value const& childValue = value[index];
     isMultiLine = ((childValue.isArray() || childValue.isObject()) &&
@@ -1061,29 +1102,60 @@ bool BuiltStyledStreamWriter::isMultilineArray(Value const& value) {
   }
   if (!isMultiLine) // check if line length > max line length
   {
-    childValues_.reserve(size);
+    // Lay out the elements until the line turns out to be too long. Those
+    // already laid out are then written from childText_, the others as usual.
     addChildValues_ = true;
-    ArrayIndex lineLength = 4 + (size - 1) * 2; // '[ ' + ', '*n + ' ]'
-    for (ArrayIndex index = 0; index < size; ++index) {
-      if (hasCommentForValue(value[index])) {
-        isMultiLine = true;
-      }
+    size_t const lineLength = 4 + (size - 1) * 2; // '[ ' + ', '*n + ' ]'
+    for (ArrayIndex index = 0; index < size && !isMultiLine; ++index) {
+      isMultiLine = hasCommentForValue(value[index]);
       writeValue(value[index]);
-      lineLength += static_cast<ArrayIndex>(childValues_[index].length());
+      childEnds_.push_back(childText_.size());
+      isMultiLine =
+          isMultiLine || lineLength + childText_.size() >= rightMargin_;
     }
     addChildValues_ = false;
-    isMultiLine = isMultiLine || lineLength >= rightMargin_;
   }
   return isMultiLine;
 }
 
+// Writes what precedes a member of an object named [name, end), or an element
+// of an array if \a name is null, laid out on multiple lines.
+void BuiltStyledStreamWriter::beginChild(Value const& childValue,
+                                         char const* name, char const* end) {
+  writeCommentBeforeValue(childValue);
+  if (name) {
+    writeWithIndent(valueToQuotedStringN(
+        name, static_cast<unsigned>(end - name), emitUTF8_));
+    *sout_ << colonSymbol_;
+  } else {
+    if (!indented_)
+      writeIndent();
+    indented_ = true;
+  }
+}
+
+// Writes what follows a member or an element, \a last in its container.
+void BuiltStyledStreamWriter::endChild(Value const& childValue, bool last) {
+  indented_ = false;
+  if (!last)
+    *sout_ << ",";
+  writeCommentAfterValueOnSameLine(childValue);
+}
+
 void BuiltStyledStreamWriter::pushValue(String const& value) {
   if (addChildValues_)
-    childValues_.push_back(value);
+    childText_ += value;
   else
     *sout_ << value;
 }
 
+void BuiltStyledStreamWriter::pushValue(char const* begin, char const* end) {
+  if (addChildValues_)
+    childText_.append(begin, end);
+  else
+    sout_->write(begin, end - begin);
+}
+
 void BuiltStyledStreamWriter::writeIndent() {
   // blep intended this to look at the so-far-written string
   // to determine whether we are already indented, but
@@ -1158,16 +1230,31 @@ StreamWriter::~StreamWriter() = default;
 StreamWriter::Factory::~Factory() = default;
 StreamWriterBuilder::StreamWriterBuilder() { setDefaults(&settings_); }
 StreamWriterBuilder::~StreamWriterBuilder() = default;
-StreamWriter* StreamWriterBuilder::newStreamWriter() const {
-  const String indentation = settings_["indentation"].asString();
-  const String cs_str = settings_["commentStyle"].asString();
-  const String pt_str = settings_["precisionType"].asString();
-  const bool eyc = settings_["enableYAMLCompatibility"].asBool();
-  const bool dnp = settings_["dropNullPlaceholders"].asBool();
-  const bool usf = settings_["useSpecialFloats"].asBool();
-  const bool emitUTF8 = settings_["emitUTF8"].asBool();
-  unsigned int pre = settings_["precision"].asUInt();
-  CommentStyle::Enum cs = CommentStyle::All;
+// The options of a StreamWriterBuilder, as its writers use them.
+struct WriterOptions {
+  explicit WriterOptions(Value const& settings);
+
+  String indentation;
+  CommentStyle::Enum cs;
+  String colonSymbol;
+  String nullSymbol;
+  String endingLineFeedSymbol;
+  bool useSpecialFloats;
+  bool emitUTF8;
+  unsigned int precision;
+  PrecisionType precisionType;
+};
+
+WriterOptions::WriterOptions(Value const& settings) {
+  indentation = settings["indentation"].asString();
+  const String cs_str = settings["commentStyle"].asString();
+  const String pt_str = settings["precisionType"].asString();
+  const bool eyc = settings["enableYAMLCompatibility"].asBool();
+  const bool dnp = settings["dropNullPlaceholders"].asBool();
+  useSpecialFloats = settings["useSpecialFloats"].asBool();
+  emitUTF8 = settings["emitUTF8"].asBool();
+  precision = settings["precision"].asUInt();
+  cs = CommentStyle::All;
   if (cs_str == "All") {
     cs = CommentStyle::All;
   } else if (cs_str == "None") {
@@ -1175,7 +1262,7 @@ StreamWriter* StreamWriterBuilder::newStreamWriter() const {
   } else {
     throwRuntimeError("commentStyle must be 'All' or 'None'");
   }
-  PrecisionType precisionType(significantDigits);
+  precisionType = PrecisionType::significantDigits;
   if (pt_str == "significant") {
     precisionType = PrecisionType::significantDigits;
   } else if (pt_str == "decimal") {
@@ -1183,22 +1270,30 @@ StreamWriter* StreamWriterBuilder::newStreamWriter() const {
   } else {
     throwRuntimeError("precisionType must be 'significant' or 'decimal'");
   }
-  String colonSymbol = " : ";
+  colonSymbol = " : ";
   if (eyc) {
     colonSymbol = ": ";
   } else if (indentation.empty()) {
     colonSymbol = ":";
   }
-  String nullSymbol = "null";
+  nullSymbol = "null";
   if (dnp) {
     nullSymbol.clear();
   }
-  if (pre > 17)
-    pre = 17;
-  String endingLineFeedSymbol;
-  return new BuiltStyledStreamWriter(indentation, cs, colonSymbol, nullSymbol,
-                                     endingLineFeedSymbol, usf, emitUTF8, pre,
-                                     precisionType);
+  if (precision > 17)
+    precision = 17;
+}
+
+static BuiltStyledStreamWriter*
+newBuiltStyledStreamWriter(WriterOptions const& options) {
+  return new BuiltStyledStreamWriter(
+      options.indentation, options.cs, options.colonSymbol, options.nullSymbol,
+      options.endingLineFeedSymbol, options.useSpecialFloats, options.emitUTF8,
+      options.precision, options.precisionType);
+}
+
+StreamWriter* StreamWriterBuilder::newStreamWriter() const {
+  return newBuiltStyledStreamWriter(WriterOptions(settings_));
 }
 
 bool StreamWriterBuilder::validate(Json::Value* invalid) const {
@@ -1241,6 +1336,1146 @@ void StreamWriterBuilder::setDefaults(Json::Value* settings) {
   //! [StreamWriterBuilderDefaults]
 }
 
+// class SerializedSizer
+// //////////////////////////////////////////////////////////////////
+
+namespace {
+// Counts what BuiltStyledStreamWriter writes, following it step by step, with
+// the indentation kept as a length. Only doubles are formatted.
+class SerializedSizer {
+public:
+  explicit SerializedSizer(WriterOptions const& options) : options_(options) {}
+
+  size_t size(Value const& root);
+
+private:
+  void addValue(Value const& value);
+  void addArray(Value const& value);
+  bool isMultilineArray(Value const& value, size_t* elementsSize) const;
+  size_t scalarSize(Value const& value) const;
+  size_t quotedSize(char const* begin, char const* end) const;
+  void addIndent() {
+    if (!options_.indentation.empty())
+      size_ += 1 + indentSize_;
+  }
+  void addWithIndent(size_t length) {
+    if (!indented_)
+      addIndent();
+    size_ += length;
+    indented_ = false;
+  }
+  void addCommentBefore(Value const& value);
+  void addCommentAfter(Value const& value);
+
+  WriterOptions const& options_;
+  size_t size_ = 0;
+  size_t indentSize_ = 0;
+  bool indented_ = true;
+};
+
+size_t decimalLength(LargestUInt value) {
+  size_t length = 1;
+  for (; value >= 100; value /= 100)
+    length += 2;
+  return length + (value >= 10);
+}
+
+size_t SerializedSizer::size(Value const& root) {
+  size_ = 0;
+  indentSize_ = 0;
+  indented_ = true;
+  addCommentBefore(root);
+  if (!indented_)
+    addIndent();
+  indented_ = true;
+  addValue(root);
+  addCommentAfter(root);
+  return size_ + options_.endingLineFeedSymbol.size();
+}
+
+void SerializedSizer::addValue(Value const& value) {
+  if (value.type() == arrayValue) {
+    addArray(value);
+  } else if (value.type() != objectValue || value.empty()) {
+    size_ += scalarSize(value);
+  } else {
+    size_t const colonSize = options_.colonSymbol.size();
+    addWithIndent(1);
+    indentSize_ += options_.indentation.size();
+    auto it = value.begin();
+    for (;;) {
+      char const* end;
+      char const* name = it.memberName(&end);
+      Value const& childValue = *it;
+      addCommentBefore(childValue);
+      addWithIndent(quotedSize(name, end));
+      size_ += colonSize;
+      addValue(childValue);
+      if (++it == value.end()) {
+        addCommentAfter(childValue);
+        break;
+      }
+      size_ += 1;
+      addCommentAfter(childValue);
+    }
+    indentSize_ -= options_.indentation.size();
+    addWithIndent(1);
+  }
+}
+
+void SerializedSizer::addArray(Value const& value) {
+  ArrayIndex const size = value.size();
+  size_t elementsSize = 0;
+  if (size == 0) {
+    size_ += 2;
+  } else if (options_.cs == CommentStyle::All ||
+             isMultilineArray(value, &elementsSize)) {
+    addWithIndent(1);
+    indentSize_ += options_.indentation.size();
+    // Iterators, rather than operator[], do not look each element up. An
+    // index the array holds no element at, left by resize(), is a null.
+    auto it = value.begin();
+    for (ArrayIndex index = 0;; ++index) {
+      bool const hole = it.index() != index;
+      Value const& childValue = hole ? Value::nullSingleton() : *it;
+      if (!hole)
+        ++it;
+      addCommentBefore(childValue);
+      if (!indented_)
+        addIndent();
+      indented_ = true;
+      addValue(childValue);
+      indented_ = false;
+      if (index + 1 == size) {
+        addCommentAfter(childValue);
+        break;
+      }
+      size_ += 1;
+      addCommentAfter(childValue);
+    }
+    indentSize_ -= options_.indentation.size();
+    addWithIndent(1);
+  } else {
+    // "[ a, b ]", or "[a,b]" without indentation.
+    size_t const padding = options_.indentation.empty() ? 0 : 1;
+    size_ += 2 + 2 * padding + elementsSize + (size - 1) * (1 + padding);
+  }
+}
+
+// As BuiltStyledStreamWriter::isMultilineArray(). On a single line, the
+// elements take \a elementsSize.
+bool SerializedSizer::isMultilineArray(Value const& value,
+                                       size_t* elementsSize) const {
+  ArrayIndex const rightMargin = 74;
+  ArrayIndex const size = value.size();
+  if (size * 3 >= rightMargin)
+    return true;
+  for (Value const& childValue : value) {
+    if ((childValue.isArray() || childValue.isObject()) &&
+        !childValue.empty())
+      return true;
+  }
+  size_t const lineLength = 4 + (size - 1) * 2;
+  ArrayIndex present = 0;
+  for (Value const& childValue : value) {
+    if (childValue.hasComment(commentBefore) ||
+        childValue.hasComment(commentAfterOnSameLine) ||
+        childValue.hasComment(commentAfter))
+      return true;
+    *elementsSize += scalarSize(childValue);
+    if (lineLength + *elementsSize >= rightMargin)
+      return true;
+    ++present;
+  }
+  // The indices without an element, which are written as nulls.
+  *elementsSize += (size - present) * options_.nullSymbol.size();
+  return lineLength + *elementsSize >= rightMargin;
+}
+
+// The size of a value that is not a non-empty container.
+size_t SerializedSizer::scalarSize(Value const& value) const {
+  switch (value.type()) {
+  case nullValue:
+    return options_.nullSymbol.size();
+  case intValue: {
+    LargestInt const number = value.asLargestInt();
+    if (number < 0)
+      return 1 + decimalLength(~LargestUInt(number) + 1);
+    return decimalLength(LargestUInt(number));
+  }
+  case uintValue:
+    return decimalLength(value.asLargestUInt());
+  case realValue:
+    return valueToString(value.asDouble(), options_.useSpecialFloats,
+                         options_.precision, options_.precisionType)
+        .size();
+  case stringValue: {
+    char const* str;
+    char const* end;
+    return value.getString(&str, &end) ? quotedSize(str, end) : 0;
+  }
+  case booleanValue:
+    return value.asBool() ? 4 : 5;
+  default:
+    return 2; // "[]" or "{}"
+  }
+}
+
+// The size of valueToQuotedStringN(begin, end - begin).
+size_t SerializedSizer::quotedSize(char const* begin, char const* end) const {
+  bool const emitUTF8 = options_.emitUTF8;
+  size_t size = 2;
+  for (char const* c = begin;;) {
+    size_t const plain = plainPrefixLength(c, end, emitUTF8);
+    size += plain;
+    c += plain;
+    if (c == end)
+      return size;
+    char escaped[12];
+    size += static_cast<size_t>(appendEscaped(c, end, escaped, emitUTF8) -
+                                escaped);
+  }
+}
+
+void SerializedSizer::addCommentBefore(Value const& value) {
+  if (options_.cs == CommentStyle::None || !value.hasComment(commentBefore))
+    return;
+  if (!indented_)
+    addIndent();
+  String const comment = value.getComment(commentBefore);
+  size_ += comment.size();
+  // The lines that begin another comment are indented.
+  for (size_t index = 0; index + 1 < comment.size(); ++index)
+    if (comment[index] == '\n' && comment[index + 1] == '/')
+      size_ += indentSize_;
+  indented_ = false;
+}
+
+void SerializedSizer::addCommentAfter(Value const& value) {
+  if (options_.cs == CommentStyle::None)
+    return;
+  if (value.hasComment(commentAfterOnSameLine))
+    size_ += 1 + value.getComment(commentAfterOnSameLine).size();
+  if (value.hasComment(commentAfter)) {
+    addIndent();
+    size_ += value.getComment(commentAfter).size();
+  }
+}
+} // namespace
+
+size_t serializedSize(Value const& root, StreamWriterBuilder const& builder) {
+  WriterOptions const options(builder.settings_);
+  return SerializedSizer(options).size(root);
+}
+
+// class StreamWriterConfig
+// //////////////////////////////////////////////////////////////////
+
+class StreamWriterConfig::Impl {
+public:
+  explicit Impl(Value const& settings) : options_(settings) {}
+
+  WriterOptions const options_;
+};
+
+namespace {
+// Appends what is written to it to a String, without a copy at the end as
+// with an OStringStream.
+class StringAppendBuf : public std::streambuf {
+public:
+  void setTarget(String* out) { out_ = out; }
+
+protected:
+  int_type overflow(int_type c) override {
+    if (!traits_type::eq_int_type(c, traits_type::eof()))
+      out_->push_back(traits_type::to_char_type(c));
+    return traits_type::not_eof(c);
+  }
+  std::streamsize xsputn(const char* s, std::streamsize n) override {
+    out_->append(s, static_cast<size_t>(n));
+    return n;
+  }
+
+private:
+  String* out_ = nullptr;
+};
+
+// Writes to an array of characters, and fails once it is full.
+class ArrayBuf : public std::streambuf {
+public:
+  void setTarget(char* out, size_t size) { setp(out, out + size); }
+  size_t written() const { return static_cast<size_t>(pptr() - pbase()); }
+};
+} // namespace
+
+StreamWriterConfig::StreamWriterConfig(StreamWriterBuilder const& builder)
+    : impl_(std::make_shared<Impl const>(builder.settings_)) {}
+
+StreamWriterConfig::~StreamWriterConfig() = default;
+
+StreamWriter* StreamWriterConfig::newStreamWriter() const {
+  return newBuiltStyledStreamWriter(impl_->options_);
+}
+
+String StreamWriterConfig::write(Value const& root) const {
+  thread_local StringAppendBuf buffer;
+  thread_local OStream sout(&buffer);
+  String out;
+  buffer.setTarget(&out);
+  sout.clear();
+  write(root, &sout);
+  return out;
+}
+
+void StreamWriterConfig::write(Value const& root, OStream* sout) const {
+  // The writer of the last config this thread wrote with. Holding on to that
+  // config also keeps another one from being made at the same address.
+  thread_local std::shared_ptr<Impl const> config;
+  thread_local StreamWriterPtr writer;
+  if (config != impl_) {
+    writer.reset(newStreamWriter());
+    config = impl_;
+  }
+  writer->write(root, sout);
+}
+
+size_t StreamWriterConfig::serializedSize(Value const& root) const {
+  return SerializedSizer(impl_->options_).size(root);
+}
+
+size_t StreamWriterConfig::write(Value const& root, char* out,
+                                 size_t size) const {
+  thread_local ArrayBuf buffer;
+  thread_local OStream sout(&buffer);
+  buffer.setTarget(out, size);
+  sout.clear();
+  write(root, &sout);
+  if (!sout)
+    throwRuntimeError("StreamWriterConfig::write: the buffer is too small");
+  return buffer.written();
+}
+
+// static
+StreamWriterConfig const& StreamWriterConfig::defaults() {
+  static StreamWriterConfig const& config =
+      *new StreamWriterConfig(StreamWriterBuilder());
+  return config;
+}
+
+// parallelWrite(), parallelWriteString()
+// //////////////////////////////////////////////////////////////////
+
+// Arrays and objects with at least this many elements are written in chunks.
+static const ArrayIndex parallelWriteSplitSize = 1024;
+
+// At most this many elements per chunk, and this many chunks per thread at a
+// time, so that only part of the output is held in memory at once.
+static const ArrayIndex parallelWriteChunkSize = 4096;
+static const size_t parallelWriteChunksPerThread = 8;
+
+// Writes a document as BuiltStyledStreamWriter does. The calling thread
+// writes it down to its large arrays and objects, leaving out runs of their
+// elements as chunks. Each chunk is then written on the executor by a writer
+// of its own, starting at the indentation of its container, and put back in
+// its place. Every element of a container laid out on multiple lines begins
+// with indented_ false, so a chunk can start at any of them.
+class ParallelStyledWriter {
+public:
+  ParallelStyledWriter(WriterOptions const& options, Executor& executor)
+      : options_(options), executor_(executor),
+        writer_(newBuiltStyledStreamWriter(options)), text_(&buffer_) {
+    buffer_.setTarget(&skeleton_);
+  }
+
+  void write(Value const& root, OStream& sout);
+
+private:
+  struct Chunk {
+    Value const* container;
+    // The first member, in an object.
+    Value::const_iterator member;
+    ArrayIndex index;
+    ArrayIndex count;
+    String indentString;
+    // Where the chunk goes in skeleton_.
+    size_t offset;
+  };
+
+  void writeValue(Value const& value);
+  bool isSplit(Value const& childValue, ArrayIndex siblings) const;
+  void queueChunk(Chunk* chunk, Value::const_iterator next,
+                  ArrayIndex nextIndex);
+  void writeChunk(Chunk const& chunk, String* out) const;
+
+  WriterOptions const& options_;
+  Executor& executor_;
+  std::unique_ptr<BuiltStyledStreamWriter> const writer_;
+  // What the calling thread writes, without the chunks.
+  String skeleton_;
+  StringAppendBuf buffer_;
+  OStream text_;
+  std::vector<Chunk> chunks_;
+};
+
+void ParallelStyledWriter::write(Value const& root, OStream& sout) {
+  BuiltStyledStreamWriter& writer = *writer_;
+  writer.sout_ = &text_;
+  writer.indented_ = true;
+  writer.writeCommentBeforeValue(root);
+  if (!writer.indented_)
+    writer.writeIndent();
+  writer.indented_ = true;
+  writeValue(root);
+  writer.writeCommentAfterValueOnSameLine(root);
+  text_ << writer.endingLineFeedSymbol_;
+
+  size_t const batch = executor_.concurrency() * parallelWriteChunksPerThread;
+  std::vector<String> outputs(std::min(batch, chunks_.size()));
+  size_t written = 0;
+  for (size_t first = 0; first < chunks_.size(); first += batch) {
+    size_t const count = std::min(batch, chunks_.size() - first);
+    executor_.parallelFor(count, [&](size_t i) {
+      writeChunk(chunks_[first + i], &outputs[i]);
+    });
+    for (size_t i = 0; i < count; ++i) {
+      size_t const offset = chunks_[first + i].offset;
+      sout.write(skeleton_.data() + written,
+                 static_cast<std::streamsize>(offset - written));
+      sout.write(outputs[i].data(),
+                 static_cast<std::streamsize>(outputs[i].size()));
+      written = offset;
+      outputs[i].clear();
+    }
+  }
+  sout.write(skeleton_.data() + written,
+             static_cast<std::streamsize>(skeleton_.size() - written));
+}
+
+// As BuiltStyledStreamWriter::writeValue(), queueing chunks of the elements
+// of a container laid out on multiple lines, and writing those that are split
+// in turn.
+void ParallelStyledWriter::writeValue(Value const& value) {
+  BuiltStyledStreamWriter& writer = *writer_;
+  bool const isObject = value.type() == objectValue;
+  if ((!isObject && value.type() != arrayValue) || value.empty() ||
+      (!isObject && writer.cs_ != CommentStyle::All &&
+       !writer.isMultilineArray(value))) {
+    writer.writeValue(value);
+    return;
+  }
+  writer.writeWithIndent(isObject ? "{" : "[");
+  writer.indent();
+  ArrayIndex const size = value.size();
+  size_t const chunks = executor_.concurrency() * parallelWriteChunksPerThread;
+  ArrayIndex const chunkSize = std::max<ArrayIndex>(
+      1, std::min(parallelWriteChunkSize,
+                  static_cast<ArrayIndex>(size / chunks)));
+  Value::const_iterator member = value.begin();
+  Chunk chunk{&value, member, 0, 0, writer.indentString_, 0};
+  for (ArrayIndex index = 0; index < size; ++index) {
+    Value::const_iterator const current = member;
+    if (isObject)
+      ++member;
+    Value const& childValue = isObject ? *current : value[index];
+    if (!isSplit(childValue, size)) {
+      if (++chunk.count == chunkSize)
+        queueChunk(&chunk, member, index + 1);
+      continue;
+    }
+    queueChunk(&chunk, current, index);
+    char const* name = nullptr;
+    char const* end = nullptr;
+    if (isObject)
+      name = current.memberName(&end);
+    writer.beginChild(childValue, name, end);
+    writeValue(childValue);
+    writer.endChild(childValue, index + 1 == size);
+    queueChunk(&chunk, member, index + 1);
+  }
+  queueChunk(&chunk, member, size);
+  writer.unindent();
+  writer.writeWithIndent(isObject ? "}" : "]");
+}
+
+// Whether the calling thread writes \a childValue itself, rather than as part
+// of a chunk. Containers with few elements are, so that their children are
+// spread over the executor.
+bool ParallelStyledWriter::isSplit(Value const& childValue,
+                                   ArrayIndex siblings) const {
+  if ((!childValue.isArray() && !childValue.isObject()) || childValue.empty())
+    return false;
+  return childValue.size() >= parallelWriteSplitSize ||
+         siblings < executor_.concurrency();
+}
+
+// Queues \a chunk, unless it is empty, and starts the next one after it.
+void ParallelStyledWriter::queueChunk(Chunk* chunk, Value::const_iterator next,
+                                      ArrayIndex nextIndex) {
+  if (chunk->count > 0) {
+    chunk->offset = skeleton_.size();
+    chunks_.push_back(*chunk);
+  }
+  chunk->member = next;
+  chunk->index = nextIndex;
+  chunk->count = 0;
+}
+
+void ParallelStyledWriter::writeChunk(Chunk const& chunk, String* out) const {
+  StringAppendBuf buffer;
+  buffer.setTarget(out);
+  OStream sout(&buffer);
+  std::unique_ptr<BuiltStyledStreamWriter> const writer(
+      newBuiltStyledStreamWriter(options_));
+  writer->sout_ = &sout;
+  writer->indentString_ = chunk.indentString;
+  writer->indented_ = false;
+  Value const& container = *chunk.container;
+  bool const isObject = container.type() == objectValue;
+  ArrayIndex const size = container.size();
+  Value::const_iterator member = chunk.member;
+  for (ArrayIndex index = chunk.index; index < chunk.index + chunk.count;
+       ++index) {
+    char const* name = nullptr;
+    char const* end = nullptr;
+    if (isObject)
+      name = member.memberName(&end);
+    Value const& childValue = isObject ? *member++ : container[index];
+    writer->beginChild(childValue, name, end);
+    writer->writeValue(childValue);
+    writer->endChild(childValue, index + 1 == size);
+  }
+}
+
+void parallelWrite(StreamWriterBuilder const& builder, Value const& root,
+                   Executor& executor, OStream& sout) {
+  WriterOptions const options(builder.settings_);
+  if (executor.concurrency() < 2) {
+    StreamWriterPtr const writer(newBuiltStyledStreamWriter(options));
+    writer->write(root, &sout);
+    return;
+  }
+  ParallelStyledWriter(options, executor).write(root, sout);
+}
+
+String parallelWriteString(StreamWriterBuilder const& builder,
+                           Value const& root, Executor& executor) {
+  String out;
+  StringAppendBuf buffer;
+  buffer.setTarget(&out);
+  OStream sout(&buffer);
+  parallelWrite(builder, root, executor, sout);
+  return out;
+}
+
+// class StreamingWriter
+// //////////////////////////////////////////////////////////////////
+
+// Follows BuiltStyledStreamWriter call by call, so that the output is the
+// same, with one difference. BuiltStyledStreamWriter looks at an array before
+// writing it, to put it on a single line if it is short. Here, such an array
+// is buffered until it ends, or until it turns out not to be short.
+// Comments are held until BuiltStyledStreamWriter would write them: before
+// the next element or member, or after the "," that follows their value.
+class StreamingWriter::Impl {
+public:
+  Impl(StreamWriterBuilder const& builder, OStream* sout, String* out)
+      : options_(builder.settings_), sout_(sout), out_(out),
+        singleLineArrays_(options_.cs == CommentStyle::None &&
+                          !options_.indentation.empty()) {}
+
+  void beginContainer(bool isObject);
+  void endContainer(bool isObject);
+  void key(const char* begin, const char* end);
+  void comment(const char* begin, const char* end,
+               CommentPlacement placement);
+  void scalar(const char* begin, const char* end) {
+    beginValue();
+    writeScalar(begin, end);
+    endValue();
+  }
+  void scalar(const String& text) {
+    scalar(text.data(), text.data() + text.size());
+  }
+  void integer(LargestInt value) {
+    UIntToStringBuffer buffer;
+    char* current = buffer + sizeof(buffer);
+    intToString(value, current);
+    scalar(current, buffer + sizeof(buffer) - 1);
+  }
+  void integer(LargestUInt value) {
+    UIntToStringBuffer buffer;
+    char* current = buffer + sizeof(buffer);
+    uintToString(value, current);
+    scalar(current, buffer + sizeof(buffer) - 1);
+  }
+  void writeValue(const Value& value);
+
+  WriterOptions const options_;
+  bool done_ = false;
+
+private:
+  struct Container {
+    bool isObject;
+    // Whether it has a member or element yet. Until then it may be empty,
+    // and nothing is written for it.
+    bool open;
+    // Whether the elements of this array are in singleLine_, for now.
+    bool buffered;
+    ArrayIndex size;
+  };
+
+  void beginValue();
+  void endValue();
+  void open(Container& container);
+  void beginElement(Container& array);
+  void writeScalar(const char* begin, const char* end);
+  void flushSingleLine(Container& array);
+  void writeCommentBefore();
+  void writeCommentsAfter();
+  void write(const char* begin, const char* end) {
+    if (out_)
+      out_->append(begin, end);
+    else
+      sout_->write(begin, end - begin);
+  }
+  void write(const String& text) {
+    write(text.data(), text.data() + text.size());
+  }
+  void writeIndent() {
+    if (!options_.indentation.empty()) {
+      write("\n");
+      write(indentString_);
+    }
+  }
+  void writeWithIndent(const String& text) {
+    if (!indented_)
+      writeIndent();
+    write(text);
+    indented_ = false;
+  }
+  void indent() { indentString_ += options_.indentation; }
+  void unindent() {
+    indentString_.resize(indentString_.size() - options_.indentation.size());
+  }
+
+  OStream* const sout_;
+  String* const out_;
+  bool const singleLineArrays_;
+  std::vector<Container> stack_;
+  bool keyPending_ = false;
+  bool indented_ = true;
+  String indentString_;
+  // Whether the last call ended a value, which comments after a value are
+  // for, and whether the next value has a comment.
+  bool valueEnded_ = false;
+  bool nextHasComment_ = false;
+  // The comments of the next value, and of the last one.
+  String commentBefore_;
+  String commentAfterOnSameLine_;
+  String commentAfter_;
+  // Elements of the innermost array while it may still fit on a line, with
+  // their total length and indented_ as it was when the array began.
+  std::vector<String> singleLine_;
+  ArrayIndex singleLineLength_ = 0;
+  bool singleLineIndented_ = false;
+};
+
+void StreamingWriter::Impl::beginValue() {
+  bool const hasComment = nextHasComment_;
+  valueEnded_ = false;
+  nextHasComment_ = false;
+  if (stack_.empty()) {
+    if (done_)
+      throwLogicError("StreamingWriter: a second root value");
+    writeCommentBefore();
+    if (!indented_)
+      writeIndent();
+    indented_ = true;
+    return;
+  }
+  Container& container = stack_.back();
+  if (container.isObject) {
+    if (!keyPending_)
+      throwLogicError("StreamingWriter: object member without a key");
+    keyPending_ = false;
+    return;
+  }
+  if (!container.open)
+    open(container);
+  if (container.buffered && hasComment)
+    flushSingleLine(container);
+  if (!container.buffered)
+    beginElement(container);
+}
+
+void StreamingWriter::Impl::endValue() {
+  if (stack_.empty()) {
+    write(options_.endingLineFeedSymbol);
+    done_ = true;
+  } else if (!stack_.back().buffered) {
+    indented_ = false;
+  }
+  valueEnded_ = true;
+}
+
+// Writes what precedes an element of a multi-line array.
+void StreamingWriter::Impl::beginElement(Container& array) {
+  if (array.size++ > 0)
+    write(",");
+  writeCommentsAfter();
+  writeCommentBefore();
+  if (!indented_)
+    writeIndent();
+  indented_ = true;
+}
+
+// Writes the opening of \a container, the innermost one, as it is about to
+// get its first member or element.
+void StreamingWriter::Impl::open(Container& container) {
+  container.open = true;
+  // It is no longer an empty container, which a short array could hold.
+  if (stack_.size() > 1 && stack_[stack_.size() - 2].buffered) {
+    Container& parent = stack_[stack_.size() - 2];
+    flushSingleLine(parent);
+    beginElement(parent);
+  }
+  if (container.isObject) {
+    writeWithIndent("{");
+    indent();
+  } else if (singleLineArrays_) {
+    container.buffered = true;
+    singleLine_.clear();
+    singleLineLength_ = 0;
+    singleLineIndented_ = indented_;
+  } else {
+    writeWithIndent("[");
+    indent();
+  }
+}
+
+void StreamingWriter::Impl::writeScalar(const char* begin, const char* end) {
+  if (stack_.empty() || !stack_.back().buffered) {
+    write(begin, end);
+    return;
+  }
+  singleLine_.emplace_back(begin, end);
+  singleLineLength_ += static_cast<ArrayIndex>(end - begin);
+  // As BuiltStyledStreamWriter::isMultilineArray(), with its right margin.
+  ArrayIndex const rightMargin = 74;
+  auto const size = static_cast<ArrayIndex>(singleLine_.size());
+  if (size * 3 >= rightMargin ||
+      4 + (size - 1) * 2 + singleLineLength_ >= rightMargin)
+    flushSingleLine(stack_.back());
+}
+
+// Writes the buffered elements of \a array on multiple lines, as it turned
+// out not to be short.
+void StreamingWriter::Impl::flushSingleLine(Container& array) {
+  array.buffered = false;
+  indented_ = singleLineIndented_;
+  writeWithIndent("[");
+  indent();
+  for (const String& element : singleLine_) {
+    beginElement(array);
+    write(element);
+    indented_ = false;
+  }
+  singleLine_.clear();
+}
+
+// As BuiltStyledStreamWriter::writeCommentBeforeValue().
+void StreamingWriter::Impl::writeCommentBefore() {
+  if (commentBefore_.empty())
+    return;
+  if (!indented_)
+    writeIndent();
+  // Indent the lines that begin another comment.
+  char const* line = commentBefore_.data();
+  char const* const end = line + commentBefore_.size();
+  for (char const* c = line; c != end; ++c) {
+    if (*c == '\n' && c + 1 != end && c[1] == '/') {
+      write(line, c + 1);
+      write(indentString_);
+      line = c + 1;
+    }
+  }
+  write(line, end);
+  indented_ = false;
+  commentBefore_.clear();
+}
+
+// As BuiltStyledStreamWriter::writeCommentAfterValueOnSameLine().
+void StreamingWriter::Impl::writeCommentsAfter() {
+  if (!commentAfterOnSameLine_.empty()) {
+    write(" ");
+    write(commentAfterOnSameLine_);
+    commentAfterOnSameLine_.clear();
+  }
+  if (!commentAfter_.empty()) {
+    writeIndent();
+    write(commentAfter_);
+    commentAfter_.clear();
+  }
+}
+
+void StreamingWriter::Impl::comment(const char* begin, const char* end,
+                                    CommentPlacement placement) {
+  // As Value::setComment().
+  if (begin != end && end[-1] == '\n')
+    --end;
+  if (begin == end || *begin != '/')
+    throwLogicError("StreamingWriter: comments must start with /");
+  // A comment after a value that is not the last thing written, such as one
+  // after the key of an array, goes before the next value instead.
+  bool const before = placement == commentBefore || !valueEnded_;
+  if (options_.cs == CommentStyle::None) {
+    // Comments are not written, but an array with a comment on an element
+    // is still not put on a single line.
+    if (before)
+      nextHasComment_ = true;
+    else if (!stack_.empty() && stack_.back().buffered)
+      flushSingleLine(stack_.back());
+    return;
+  }
+  if (before) {
+    if (!commentBefore_.empty())
+      commentBefore_ += '\n';
+    commentBefore_.append(begin, end);
+    return;
+  }
+  String& comment = placement == commentAfterOnSameLine
+                        ? commentAfterOnSameLine_
+                        : commentAfter_;
+  comment.assign(begin, end);
+  // Nothing follows the root value to wait for.
+  if (stack_.empty())
+    writeCommentsAfter();
+}
+
+void StreamingWriter::Impl::beginContainer(bool isObject) {
+  beginValue();
+  stack_.push_back(Container{isObject, false, false, 0});
+}
+
+void StreamingWriter::Impl::endContainer(bool isObject) {
+  if (stack_.empty() || stack_.back().isObject != isObject)
+    throwLogicError(isObject ? "StreamingWriter: no object to end"
+                             : "StreamingWriter: no array to end");
+  if (keyPending_)
+    throwLogicError("StreamingWriter: object member without a value");
+  Container const container = stack_.back();
+  stack_.pop_back();
+  if (!container.open) {
+    // Its parent has already begun the value, as for a scalar.
+    char const* const empty = isObject ? "{}" : "[]";
+    writeScalar(empty, empty + 2);
+  } else if (container.buffered) {
+    write("[ ");
+    for (size_t index = 0; index < singleLine_.size(); ++index) {
+      if (index > 0)
+        write(", ");
+      write(singleLine_[index]);
+    }
+    write(" ]");
+    singleLine_.clear();
+  } else {
+    writeCommentsAfter();
+    unindent();
+    writeWithIndent(isObject ? "}" : "]");
+  }
+  endValue();
+}
+
+void StreamingWriter::Impl::key(const char* begin, const char* end) {
+  if (stack_.empty() || !stack_.back().isObject)
+    throwLogicError("StreamingWriter: key outside of an object");
+  if (keyPending_)
+    throwLogicError("StreamingWriter: object member without a value");
+  Container& object = stack_.back();
+  if (!object.open)
+    open(object);
+  if (object.size++ > 0)
+    write(",");
+  writeCommentsAfter();
+  writeCommentBefore();
+  valueEnded_ = false;
+  writeWithIndent(valueToQuotedStringN(
+      begin, static_cast<unsigned>(end - begin), options_.emitUTF8));
+  write(options_.colonSymbol);
+  keyPending_ = true;
+}
+
+void StreamingWriter::Impl::writeValue(const Value& value) {
+  switch (value.type()) {
+  case nullValue:
+    scalar(options_.nullSymbol);
+    break;
+  case intValue:
+    integer(value.asLargestInt());
+    break;
+  case uintValue:
+    integer(value.asLargestUInt());
+    break;
+  case realValue:
+    scalar(valueToString(value.asDouble(), options_.useSpecialFloats,
+                         options_.precision, options_.precisionType));
+    break;
+  case stringValue: {
+    char const* str;
+    char const* end;
+    if (value.getString(&str, &end))
+      scalar(valueToQuotedStringN(str, static_cast<unsigned>(end - str),
+                                  options_.emitUTF8));
+    else
+      scalar(String());
+    break;
+  }
+  case booleanValue:
+    scalar(valueToString(value.asBool()));
+    break;
+  case arrayValue: {
+    beginContainer(false);
+    ArrayIndex const size = value.size();
+    for (ArrayIndex index = 0; index < size; ++index)
+      writeValue(value[index]);
+    endContainer(false);
+    break;
+  }
+  case objectValue:
+    beginContainer(true);
+    for (auto it = value.begin(); it != value.end(); ++it) {
+      char const* end;
+      char const* name = it.memberName(&end);
+      key(name, end);
+      writeValue(*it);
+    }
+    endContainer(true);
+    break;
+  }
+}
+
+StreamingWriter::StreamingWriter(StreamWriterBuilder const& builder,
+                                 OStream& sout)
+    : impl_(new Impl(builder, &sout, nullptr)) {}
+
+StreamingWriter::StreamingWriter(StreamWriterBuilder const& builder,
+                                 String* out)
+    : impl_(new Impl(builder, nullptr, out)) {}
+
+StreamingWriter::~StreamingWriter() = default;
+
+void StreamingWriter::beginObject() { impl_->beginContainer(true); }
+void StreamingWriter::endObject() { impl_->endContainer(true); }
+void StreamingWriter::beginArray() { impl_->beginContainer(false); }
+void StreamingWriter::endArray() { impl_->endContainer(false); }
+
+void StreamingWriter::key(const char* begin, const char* end) {
+  impl_->key(begin, end);
+}
+void StreamingWriter::key(const char* name) {
+  impl_->key(name, name + strlen(name));
+}
+void StreamingWriter::key(const String& name) {
+  impl_->key(name.data(), name.data() + name.size());
+}
+
+void StreamingWriter::null() { impl_->scalar(impl_->options_.nullSymbol); }
+void StreamingWriter::value(bool value) {
+  impl_->scalar(valueToString(value));
+}
+void StreamingWriter::value(Int value) { impl_->integer(LargestInt(value)); }
+void StreamingWriter::value(UInt value) {
+  impl_->integer(LargestUInt(value));
+}
+#if defined(JSON_HAS_INT64)
+void StreamingWriter::value(Int64 value) { impl_->integer(value); }
+void StreamingWriter::value(UInt64 value) { impl_->integer(value); }
+#endif // if defined(JSON_HAS_INT64)
+void StreamingWriter::value(double value) {
+  WriterOptions const& options = impl_->options_;
+  impl_->scalar(valueToString(value, options.useSpecialFloats,
+                              options.precision, options.precisionType));
+}
+void StreamingWriter::value(const char* begin, const char* end) {
+  impl_->scalar(valueToQuotedStringN(begin, static_cast<unsigned>(end - begin),
+                                     impl_->options_.emitUTF8));
+}
+void StreamingWriter::value(const char* value) {
+  this->value(value, value + strlen(value));
+}
+void StreamingWriter::value(const String& value) {
+  this->value(value.data(), value.data() + value.size());
+}
+void StreamingWriter::value(const Value& value) { impl_->writeValue(value); }
+
+void StreamingWriter::rawValue(const char* begin, const char* end) {
+  impl_->scalar(begin, end);
+}
+
+void StreamingWriter::comment(const char* begin, const char* end,
+                              CommentPlacement placement) {
+  impl_->comment(begin, end, placement);
+}
+void StreamingWriter::comment(const String& comment,
+                              CommentPlacement placement) {
+  impl_->comment(comment.data(), comment.data() + comment.size(), placement);
+}
+
+bool StreamingWriter::done() const { return impl_->done_; }
+
+// class MsgPackWriter
+// //////////////////////////////////////////////////////////////////
+
+struct MsgPackWriter : public StreamWriter {
+  int write(Value const& root, OStream* sout) override;
+
+private:
+  void writeValue(Value const& value);
+  void writeInt(LargestInt value);
+  void writeUInt(LargestUInt value);
+  void writeString(char const* begin, char const* end);
+  // Writes the header of a string, array or map of \a size items: \a fixed
+  // or'ed with the size if it is below \a fixedLimit, otherwise the first of
+  // the 8 (if \a code8 is not 0), 16 and 32-bit codes that can hold it.
+  void writeSize(size_t size, unsigned fixed, size_t fixedLimit,
+                 unsigned code8, unsigned code16);
+  void writeCode(unsigned code) { buffer_ += static_cast<char>(code); }
+  void writeBigEndian(uint64_t value, unsigned bytes);
+
+  String buffer_;
+};
+
+int MsgPackWriter::write(Value const& root, OStream* sout) {
+  buffer_.clear();
+  writeValue(root);
+  sout->write(buffer_.data(), static_cast<std::streamsize>(buffer_.size()));
+  return 0;
+}
+
+void MsgPackWriter::writeValue(Value const& value) {
+  switch (value.type()) {
+  case nullValue:
+    writeCode(0xc0);
+    break;
+  case booleanValue:
+    writeCode(value.asBool() ? 0xc3 : 0xc2);
+    break;
+  case intValue:
+    writeInt(value.asLargestInt());
+    break;
+  case uintValue:
+    writeUInt(value.asLargestUInt());
+    break;
+  case realValue: {
+    double const real = value.asDouble();
+    uint64_t bits;
+    static_assert(sizeof(bits) == sizeof(real), "double must be 64-bit");
+    memcpy(&bits, &real, sizeof(bits));
+    writeCode(0xcb);
+    writeBigEndian(bits, 8);
+    break;
+  }
+  case stringValue: {
+    char const* str;
+    char const* end;
+    if (value.getString(&str, &end))
+      writeString(str, end);
+    else
+      writeString(nullptr, nullptr);
+    break;
+  }
+  case arrayValue: {
+    ArrayIndex const size = value.size();
+    writeSize(size, 0x90, 16, 0, 0xdc);
+    for (ArrayIndex index = 0; index < size; ++index)
+      writeValue(value[index]);
+    break;
+  }
+  case objectValue: {
+    writeSize(value.size(), 0x80, 16, 0, 0xde);
+    for (auto it = value.begin(); it != value.end(); ++it) {
+      char const* end;
+      char const* name = it.memberName(&end);
+      writeString(name, end);
+      writeValue(*it);
+    }
+    break;
+  }
+  }
+}
+
+void MsgPackWriter::writeInt(LargestInt value) {
+  if (value >= -32 && value <= 127) {
+    // positive or negative fixint
+    writeCode(static_cast<unsigned char>(value));
+  } else if (value >= -128 && value <= 127) {
+    writeCode(0xd0);
+    writeBigEndian(static_cast<uint64_t>(value), 1);
+  } else if (value >= -32768 && value <= 32767) {
+    writeCode(0xd1);
+    writeBigEndian(static_cast<uint64_t>(value), 2);
+  } else if (value >= -2147483647 - 1 && value <= 2147483647) {
+    writeCode(0xd2);
+    writeBigEndian(static_cast<uint64_t>(value), 4);
+  } else {
+    writeCode(0xd3);
+    writeBigEndian(static_cast<uint64_t>(value), 8);
+  }
+}
+
+void MsgPackWriter::writeUInt(LargestUInt value) {
+  if (value <= 0xff) {
+    writeCode(0xcc);
+    writeBigEndian(value, 1);
+  } else if (value <= 0xffff) {
+    writeCode(0xcd);
+    writeBigEndian(value, 2);
+  } else if (value <= 0xffffffff) {
+    writeCode(0xce);
+    writeBigEndian(value, 4);
+  } else {
+    writeCode(0xcf);
+    writeBigEndian(value, 8);
+  }
+}
+
+void MsgPackWriter::writeString(char const* begin, char const* end) {
+  size_t const size = static_cast<size_t>(end - begin);
+  writeSize(size, 0xa0, 32, 0xd9, 0xda);
+  buffer_.append(begin, size);
+}
+
+void MsgPackWriter::writeSize(size_t size, unsigned fixed, size_t fixedLimit,
+                              unsigned code8, unsigned code16) {
+  if (size < fixedLimit) {
+    writeCode(fixed | static_cast<unsigned>(size));
+  } else if (code8 && size <= 0xff) {
+    writeCode(code8);
+    writeBigEndian(size, 1);
+  } else if (size <= 0xffff) {
+    writeCode(code16);
+    writeBigEndian(size, 2);
+  } else {
+    if (size > 0xffffffff)
+      throwRuntimeError("MessagePack sizes are limited to 2^32 - 1");
+    writeCode(code16 + 1);
+    writeBigEndian(size, 4);
+  }
+}
+
+void MsgPackWriter::writeBigEndian(uint64_t value, unsigned bytes) {
+  char big[8];
+  for (unsigned i = bytes; i-- > 0; value >>= 8)
+    big[i] = static_cast<char>(value & 0xff);
+  buffer_.append(big, bytes);
+}
+
+MsgPackWriterBuilder::MsgPackWriterBuilder() = default;
+MsgPackWriterBuilder::~MsgPackWriterBuilder() = default;
+StreamWriter* MsgPackWriterBuilder::newStreamWriter() const {
+  return new MsgPackWriter;
+}
+
 String writeString(StreamWriter::Factory const& factory, Value const& root) {
   OStringStream sout;
   StreamWriterPtr const writer(factory.newStreamWriter());
@@ -1249,9 +2484,7 @@ String writeString(StreamWriter::Factory const& factory, Value const& root) {
 }
 
 OStream& operator<<(OStream& sout, Value const& root) {
-  StreamWriterBuilder builder;
-  StreamWriterPtr const writer(builder.newStreamWriter());
-  writer->write(root, &sout);
+  StreamWriterConfig::defaults().write(root, &sout);
   return sout;
 }
 
@@ -12,6 +12,8 @@
 
 #include "fuzz.h"
 #include "jsontest.h"
+#include <atomic>
+#include <chrono>
 #include <cmath>
 #include <cstring>
 #include <functional>
@@ -22,8 +24,10 @@
 #include <json/json.h>
 #include <limits>
 #include <memory>
+#include <random>
 #include <sstream>
 #include <string>
+#include <thread>
 
 using CharReaderPtr = std::unique_ptr<Json::CharReader>;
 
@@ -1625,6 +1629,113 @@ JSONTEST_FIXTURE_LOCAL(ValueTest, compareType) {
                                    Json::Value(Json::objectValue)));
 }
 
+JSONTEST_FIXTURE_LOCAL(ValueTest, deeplyNested) {
+  // Copying, comparing and destroying must not recurse once per level.
+  const int depth = 1000000;
+  Json::Value root;
+  Json::Value* node = &root;
+  for (int i = 0; i < depth; ++i) {
+    node = i % 2 ? &node->append(Json::Value(Json::objectValue))
+                 : &(*node)["key"];
+  }
+  *node = "leaf";
+  Json::Value copy(root);
+  JSONTEST_ASSERT(copy == root);
+  JSONTEST_ASSERT(!(copy != root));
+  JSONTEST_ASSERT(copy.compare(root) == 0);
+
+  node = &copy;
+  for (int i = 0; i < depth; ++i)
+    node = i % 2 ? &(*node)[0] : &(*node)["key"];
+  JSONTEST_ASSERT(node->isString());
+  *node = "other leaf";
+  JSONTEST_ASSERT(!(copy == root));
+  JSONTEST_ASSERT(root < copy);
+  JSONTEST_ASSERT(copy > root);
+  JSONTEST_ASSERT(copy.compare(root) > 0);
+
+  Json::Value assigned;
+  assigned = copy;
+  JSONTEST_ASSERT(assigned == copy);
+}
+
+JSONTEST_FIXTURE_LOCAL(ValueTest, shareCopyOnWrite) {
+  Json::Value original;
+  original["array"].append(1);
+  original["array"].append("two");
+  original["array"][2]["three"] = 3;
+  original["string"] = "text";
+  original["array"].setComment("// comment", Json::commentAfter);
+  const Json::Value expected = original;
+  JSONTEST_ASSERT(!original.isShared());
+  original.share();
+  JSONTEST_ASSERT(original.isShared());
+  JSONTEST_ASSERT(original["array"].isShared());
+  JSONTEST_ASSERT(!original["string"].isShared());
+  JSONTEST_ASSERT(original == expected);
+
+  Json::Value copy = original;
+  const Json::Value& constOriginal = original;
+  const Json::Value& constCopy = copy;
+  JSONTEST_ASSERT(copy.isShared());
+  JSONTEST_ASSERT(&constCopy["array"] == &constOriginal["array"]);
+
+  copy["array"][2]["three"] = 4;
+  JSONTEST_ASSERT(&constCopy["array"] != &constOriginal["array"]);
+  JSONTEST_ASSERT(&constCopy["string"] != &constOriginal["string"]);
+  JSONTEST_ASSERT_EQUAL(4, constCopy["array"][2]["three"].asInt());
+  JSONTEST_ASSERT(original == expected);
+  JSONTEST_ASSERT(copy != original);
+  JSONTEST_ASSERT_STRING_EQUAL(
+      "// comment", copy["array"].getComment(Json::commentAfter));
+
+  copy = original;
+  copy["array"].append(5);
+  copy["array"].removeIndex(0, nullptr);
+  copy.removeMember("string");
+  for (auto& element : copy["array"])
+    element = "replaced";
+  JSONTEST_ASSERT(original == expected);
+  JSONTEST_ASSERT_EQUAL(3u, copy["array"].size());
+  JSONTEST_ASSERT_STRING_EQUAL("replaced", copy["array"][2].asString());
+
+  copy = original;
+  copy["array"].resize(1);
+  JSONTEST_ASSERT_EQUAL(1u, copy["array"].size());
+  copy.clear();
+  JSONTEST_ASSERT(copy.empty());
+  JSONTEST_ASSERT(original == expected);
+
+  // Copies outlive the original, and can be read from several threads.
+  copy = original;
+  original = Json::Value();
+  std::vector<std::thread> readers;
+  std::atomic<int> matches{0};
+  for (int i = 0; i < 4; ++i) {
+    readers.emplace_back([&] {
+      for (int j = 0; j < 1000; ++j) {
+        Json::Value local = copy;
+        const Json::Value& constLocal = local;
+        if (constLocal == expected)
+          ++matches;
+        local["array"][0] = j;
+      }
+    });
+  }
+  for (auto& reader : readers)
+    reader.join();
+  JSONTEST_ASSERT_EQUAL(4000, matches.load());
+  JSONTEST_ASSERT(copy == expected);
+
+  // Only shared containers equal themselves without comparing elements.
+  Json::Value nan;
+  nan.append(std::numeric_limits<double>::quiet_NaN());
+  const Json::Value& constNan = nan;
+  JSONTEST_ASSERT(!(constNan == constNan));
+  nan.share();
+  JSONTEST_ASSERT(constNan == constNan);
+}
+
 JSONTEST_FIXTURE_LOCAL(ValueTest, CopyObject) {
   Json::Value arrayVal;
   arrayVal.append("val1");
@@ -1881,6 +1992,33 @@ JSONTEST_FIXTURE_LOCAL(ValueTest, CommentBefore) {
   }
 }
 
+JSONTEST_FIXTURE_LOCAL(ValueTest, commentSlots) {
+  Json::Value val(1);
+  val.setComment(Json::String("/* after */"), Json::commentAfter);
+  val.setComment("// before\n", 10, Json::commentBefore);
+  val.setComment(Json::String("// same line"), Json::commentAfterOnSameLine);
+  Json::Value copy(val);
+  val.setComment(Json::String("// changed"), Json::commentAfterOnSameLine);
+  JSONTEST_ASSERT_STRING_EQUAL("// before",
+                               val.getComment(Json::commentBefore));
+  JSONTEST_ASSERT_STRING_EQUAL("// changed",
+                               val.getComment(Json::commentAfterOnSameLine));
+  JSONTEST_ASSERT_STRING_EQUAL("/* after */",
+                               val.getComment(Json::commentAfter));
+  JSONTEST_ASSERT_STRING_EQUAL("// same line",
+                               copy.getComment(Json::commentAfterOnSameLine));
+  JSONTEST_ASSERT_STRING_EQUAL("/* after */",
+                               copy.getComment(Json::commentAfter));
+
+  Json::Value one(2);
+  one.setComment(Json::String("// only"), Json::commentAfter);
+  JSONTEST_ASSERT(!one.hasComment(Json::commentBefore));
+  JSONTEST_ASSERT(one.hasComment(Json::commentAfter));
+  JSONTEST_ASSERT_STRING_EQUAL("", one.getComment(Json::commentBefore));
+  one = copy;
+  JSONTEST_ASSERT(one.hasComment(Json::commentBefore));
+}
+
 JSONTEST_FIXTURE_LOCAL(ValueTest, zeroes) {
   char const cstr[] = "h\0i";
   Json::String binary(cstr, sizeof(cstr)); // include trailing 0
@@ -2183,6 +2321,26 @@ JSONTEST_FIXTURE_LOCAL(FastWriterTest, writeNestedObjects) {
   JSONTEST_ASSERT_STRING_EQUAL(expected, result);
 }
 
+JSONTEST_FIXTURE_LOCAL(FastWriterTest, memberNames) {
+  Json::Value root;
+  root["b"] = 2;
+  root[Json::String("a\0z", 3)] = 1;
+  root["c"] = Json::objectValue;
+
+  Json::FastWriter writer;
+  JSONTEST_ASSERT_STRING_EQUAL("{\"a\\u0000z\":1,\"b\":2,\"c\":{}}\n",
+                               writer.write(root));
+  Json::StreamWriterBuilder builder;
+  builder["indentation"] = "";
+  JSONTEST_ASSERT_STRING_EQUAL("{\"a\\u0000z\":1,\"b\":2,\"c\":{}}",
+                               Json::writeString(builder, root));
+  // StyledWriter has always stopped member names at a null character.
+  Json::StyledWriter styled;
+  JSONTEST_ASSERT_STRING_EQUAL(
+      "{\n   \"a\" : 1,\n   \"b\" : 2,\n   \"c\" : {}\n}\n",
+      styled.write(root));
+}
+
 struct StyledWriterTest : JsonTest::TestCase {};
 
 JSONTEST_FIXTURE_LOCAL(StyledWriterTest, writeNumericValue) {
@@ -2466,6 +2624,29 @@ JSONTEST_FIXTURE_LOCAL(StreamWriterTest, writeNumericValue) {
   JSONTEST_ASSERT_STRING_EQUAL(expected, result);
 }
 
+JSONTEST_FIXTURE_LOCAL(StreamWriterTest, writeIntegers) {
+  Json::StreamWriterBuilder writer;
+  writer["indentation"] = "";
+  Json::Value root(Json::arrayValue);
+  Json::String expected = "[";
+  for (Json::LargestInt value :
+       {Json::LargestInt(0), Json::LargestInt(9), Json::LargestInt(10),
+        Json::LargestInt(99), Json::LargestInt(100), Json::LargestInt(-1),
+        Json::LargestInt(-10), Json::LargestInt(-101),
+        Json::Value::minLargestInt, Json::Value::maxLargestInt}) {
+    root.append(value);
+    expected += std::to_string(value) + ",";
+  }
+  root.append(Json::Value::maxLargestUInt);
+  expected += std::to_string(Json::Value::maxLargestUInt) + "]";
+  JSONTEST_ASSERT_STRING_EQUAL(expected, Json::writeString(writer, root));
+  for (unsigned i = 0; i < root.size(); ++i)
+    JSONTEST_ASSERT_STRING_EQUAL(Json::writeString(writer, root[i]),
+                                 root[i].isInt64()
+                                     ? Json::valueToString(root[i].asInt64())
+                                     : Json::valueToString(root[i].asUInt64()));
+}
+
 JSONTEST_FIXTURE_LOCAL(StreamWriterTest, writeArrays) {
   Json::StreamWriterBuilder writer;
   const Json::String expected("{\n"
@@ -2640,6 +2821,29 @@ JSONTEST_FIXTURE_LOCAL(StreamWriterTest, unicode) {
                   "\"\\t\\n\\ud806\\udca1=\\u0133\\ud82c\\udd1b\\uff67\"\n}");
 }
 
+// Long runs of escaped and plain characters, spanning several blocks.
+JSONTEST_FIXTURE_LOCAL(StreamWriterTest, escapeLongRuns) {
+  Json::String raw;
+  Json::String escaped;
+  for (int i = 0; i < 100; ++i) {
+    raw += "\xE4\xB8\xAD\xF0\x9F\x98\x80";
+    escaped += "\\u4e2d\\ud83d\\ude00";
+  }
+  Json::String utf8 = raw;
+  for (int i = 0; i < 40; ++i) {
+    raw += "plain text, \"quoted\"\t";
+    escaped += "plain text, \\\"quoted\\\"\\t";
+    utf8 += "plain text, \\\"quoted\\\"\\t";
+  }
+  Json::StreamWriterBuilder b;
+  b.settings_["indentation"] = "";
+  JSONTEST_ASSERT_STRING_EQUAL("\"" + escaped + "\"",
+                               Json::writeString(b, Json::Value(raw)));
+  b.settings_["emitUTF8"] = true;
+  JSONTEST_ASSERT_STRING_EQUAL("\"" + utf8 + "\"",
+                               Json::writeString(b, Json::Value(raw)));
+}
+
 // Control chars should be escaped regardless of UTF-8 input encoding.
 JSONTEST_FIXTURE_LOCAL(StreamWriterTest, escapeControlCharacters) {
   auto uEscape = [](unsigned ch) {
@@ -2730,6 +2934,108 @@ JSONTEST_FIXTURE_LOCAL(StreamWriterTest, escapeTabCharacterWindows) {
 }
 #endif
 
+struct StreamingWriterTest : JsonTest::TestCase {};
+
+JSONTEST_FIXTURE_LOCAL(StreamingWriterTest, sameAsStreamWriter) {
+  Json::Value root;
+  root["empty"] = Json::Value(Json::objectValue);
+  root["emptyArray"] = Json::Value(Json::arrayValue);
+  root["short"].append(1);
+  root["short"].append("two");
+  root["short"].append(Json::Value(Json::arrayValue));
+  root["short"].append(Json::Value());
+  for (int i = 0; i < 30; ++i)
+    root["many"].append(i);
+  for (int i = 0; i < 8; ++i)
+    root["long"].append("a string that is long enough");
+  root["nested"].append(1);
+  root["nested"].append(Json::Value(Json::objectValue));
+  root["nested"].append(root["short"]);
+  root["rows"][0u]["id"] = 1;
+  root["rows"][1]["name"] = "caf\xC3\xA9";
+  root["rows"][1]["tags"] = root["short"];
+  root["numbers"].append(-(Json::Int64(1) << 40));
+  root["numbers"].append(Json::UInt64(-1));
+  root["numbers"].append(0.1);
+
+  std::vector<Json::StreamWriterBuilder> builders(5);
+  builders[1]["commentStyle"] = "None";
+  builders[2]["indentation"] = "";
+  builders[3]["commentStyle"] = "None";
+  builders[3]["emitUTF8"] = true;
+  builders[3]["precision"] = 5;
+  builders[4]["commentStyle"] = "None";
+  builders[4]["dropNullPlaceholders"] = true;
+  builders[4]["enableYAMLCompatibility"] = true;
+  for (const Json::StreamWriterBuilder& builder : builders) {
+    const Json::String expected = Json::writeString(builder, root);
+    Json::String out;
+    Json::StreamingWriter writer(builder, &out);
+    writer.value(root);
+    JSONTEST_ASSERT(writer.done());
+    JSONTEST_ASSERT_STRING_EQUAL(expected, out);
+
+    Json::OStringStream sout;
+    Json::StreamingWriter streamWriter(builder, sout);
+    streamWriter.value(root);
+    JSONTEST_ASSERT_STRING_EQUAL(expected, sout.str());
+  }
+}
+
+JSONTEST_FIXTURE_LOCAL(StreamingWriterTest, calls) {
+  Json::StreamWriterBuilder builder;
+  builder["commentStyle"] = "None";
+  builder["indentation"] = "  ";
+  Json::String out;
+  Json::StreamingWriter writer(builder, &out);
+  writer.beginObject();
+  writer.key("id");
+  writer.value(7u);
+  writer.key(Json::String("raw"));
+  const char raw[] = "1.50";
+  writer.rawValue(raw, raw + sizeof(raw) - 1);
+  writer.key("tags");
+  writer.beginArray();
+  writer.value("a");
+  writer.value(true);
+  writer.null();
+  writer.endArray();
+  writer.key("none");
+  writer.beginArray();
+  writer.endArray();
+  writer.endObject();
+  JSONTEST_ASSERT(writer.done());
+  JSONTEST_ASSERT_STRING_EQUAL("{\n  \"id\" : 7,\n  \"raw\" : 1.50,\n"
+                               "  \"tags\" : [ \"a\", true, null ],\n"
+                               "  \"none\" : []\n}",
+                               out);
+}
+
+JSONTEST_FIXTURE_LOCAL(StreamingWriterTest, misuse) {
+  Json::StreamWriterBuilder builder;
+  Json::String out;
+  {
+    Json::StreamingWriter writer(builder, &out);
+    writer.beginObject();
+    JSONTEST_ASSERT_THROWS(writer.value(1));
+    JSONTEST_ASSERT_THROWS(writer.endArray());
+    writer.key("a");
+    JSONTEST_ASSERT_THROWS(writer.key("b"));
+    JSONTEST_ASSERT_THROWS(writer.endObject());
+    writer.value(1);
+    writer.endObject();
+    JSONTEST_ASSERT_THROWS(writer.value(2));
+  }
+  {
+    Json::StreamingWriter writer(builder, &out);
+    JSONTEST_ASSERT_THROWS(writer.key("a"));
+    JSONTEST_ASSERT_THROWS(writer.endObject());
+    writer.beginArray();
+    JSONTEST_ASSERT_THROWS(writer.key("a"));
+    JSONTEST_ASSERT(!writer.done());
+  }
+}
+
 struct ReaderTest : JsonTest::TestCase {
   void setStrictMode() {
     reader = std::unique_ptr<Json::Reader>(
@@ -2989,6 +3295,37 @@ JSONTEST_FIXTURE_LOCAL(CharReaderTest, parseNumber) {
     JSONTEST_ASSERT(errs.empty());
     JSONTEST_ASSERT_EQUAL(1.1111111111111111e+020, root[0]);
   }
+  {
+    // Integers at the limits, with and without runs of 8 digits.
+    char const doc[] = "[18446744073709551615, 18446744073709551616,"
+                       " -9223372036854775808, -9223372036854775809,"
+                       " 9223372036854775807, 9223372036854775808,"
+                       " 0000000000000000000000012345678, -12345678,"
+                       " 1234567, 123456789.5, 123456789e1, -0, -]";
+    bool ok = reader->parse(doc, doc + std::strlen(doc), &root, &errs);
+    JSONTEST_ASSERT(ok);
+    JSONTEST_ASSERT(errs.empty());
+    JSONTEST_ASSERT(root[0].isUInt64());
+    JSONTEST_ASSERT_EQUAL(Json::Value::maxUInt64, root[0].asUInt64());
+    JSONTEST_ASSERT_EQUAL(Json::realValue, root[1].type());
+    JSONTEST_ASSERT_EQUAL(18446744073709551616.0, root[1].asDouble());
+    JSONTEST_ASSERT_EQUAL(Json::intValue, root[2].type());
+    JSONTEST_ASSERT_EQUAL(Json::Value::minInt64, root[2].asInt64());
+    JSONTEST_ASSERT_EQUAL(Json::realValue, root[3].type());
+    JSONTEST_ASSERT_EQUAL(Json::intValue, root[4].type());
+    JSONTEST_ASSERT_EQUAL(Json::Value::maxInt64, root[4].asInt64());
+    JSONTEST_ASSERT_EQUAL(Json::uintValue, root[5].type());
+    JSONTEST_ASSERT_EQUAL(12345678, root[6].asInt());
+    JSONTEST_ASSERT_EQUAL(-12345678, root[7].asInt());
+    JSONTEST_ASSERT_EQUAL(1234567, root[8].asInt());
+    JSONTEST_ASSERT_EQUAL(Json::realValue, root[9].type());
+    JSONTEST_ASSERT_EQUAL(123456789.5, root[9].asDouble());
+    JSONTEST_ASSERT_EQUAL(Json::realValue, root[10].type());
+    JSONTEST_ASSERT_EQUAL(1234567890.0, root[10].asDouble());
+    JSONTEST_ASSERT_EQUAL(Json::intValue, root[11].type());
+    JSONTEST_ASSERT_EQUAL(0, root[11].asInt());
+    JSONTEST_ASSERT_EQUAL(Json::intValue, root[12].type());
+  }
 }
 
 JSONTEST_FIXTURE_LOCAL(CharReaderTest, parseString) {
@@ -3060,6 +3397,21 @@ JSONTEST_FIXTURE_LOCAL(CharReaderTest, parseString) {
   }
 }
 
+JSONTEST_FIXTURE_LOCAL(CharReaderTest, parseCommentLineEndings) {
+  Json::CharReaderBuilder b;
+  CharReaderPtr reader(b.newCharReader());
+  Json::Value root;
+  char const doc[] = "/* one\r\n two\r three */\r\n[ 1, /* a\r\nb */\r\n"
+                     "2 // c\r\n]";
+  JSONTEST_ASSERT(reader->parse(doc, doc + std::strlen(doc), &root, nullptr));
+  JSONTEST_ASSERT_STRING_EQUAL("/* one\n two\n three */",
+                               root.getComment(Json::commentBefore));
+  JSONTEST_ASSERT_STRING_EQUAL("/* a\nb */",
+                               root[1].getComment(Json::commentBefore));
+  JSONTEST_ASSERT_STRING_EQUAL(
+      "// c", root[1].getComment(Json::commentAfterOnSameLine));
+}
+
 JSONTEST_FIXTURE_LOCAL(CharReaderTest, parseComment) {
   Json::CharReaderBuilder b;
   CharReaderPtr reader(b.newCharReader());
@@ -3198,6 +3550,553 @@ JSONTEST_FIXTURE_LOCAL(CharReaderTest, parseWithStackLimit) {
   }
 }
 
+JSONTEST_FIXTURE_LOCAL(CharReaderTest, parseWithStructuralIndex) {
+  Json::CharReaderBuilder b;
+  Json::CharReaderBuilder::strictMode(&b.settings_);
+  CharReaderPtr reference(b.newCharReader());
+  b.settings_["structuralIndex"] = true;
+  CharReaderPtr reader(b.newCharReader());
+  Json::String errs;
+  Json::Value expected;
+  Json::Value root;
+  // Long enough for strings, escapes and numbers to cross 64-byte blocks.
+  char const doc[] =
+      "{ \"name\" : \"a string with \\\"escaped\\\" quotes, commas, "
+      "[brackets] and {braces}\",\n"
+      "  \"backslashes\" : [\"\\\\\", \"\\\\\\\\\", \"x\\\\\\\"y\"],\n"
+      "  \"utf8\" : \"\xC3\xA9\xE4\xB8\xAD\xF0\x9F\x98\x80\\u00e9\",\n"
+      "  \"numbers\" : [0, -1, 12345678901234567890, 1.5e-3, +7],\n"
+      "  \"literals\" : [true, false, null, {}, [], {\"\" : \"\"}] }";
+  JSONTEST_ASSERT(
+      reference->parse(doc, doc + std::strlen(doc), &expected, &errs));
+  bool ok = reader->parse(doc, doc + std::strlen(doc), &root, &errs);
+  JSONTEST_ASSERT(ok);
+  JSONTEST_ASSERT(errs.empty());
+  JSONTEST_ASSERT(root == expected);
+  JSONTEST_ASSERT_EQUAL(expected["numbers"][2].getOffsetStart(),
+                        root["numbers"][2].getOffsetStart());
+  JSONTEST_ASSERT_EQUAL(expected["literals"].getOffsetLimit(),
+                        root["literals"].getOffsetLimit());
+
+  char const missingComma[] = "[1, 2 3]";
+  ok = reader->parse(missingComma, missingComma + std::strlen(missingComma),
+                     &root, &errs);
+  JSONTEST_ASSERT(!ok);
+  JSONTEST_ASSERT_STRING_EQUAL(
+      "* Line 1, Column 7\n  Missing ',' or ']' in array declaration\n", errs);
+  char const unterminated[] = "[\"abc\\\"]";
+  ok = reader->parse(unterminated, unterminated + std::strlen(unterminated),
+                     &root, &errs);
+  JSONTEST_ASSERT(!ok);
+  JSONTEST_ASSERT_STRING_EQUAL(
+      "* Line 1, Column 2\n  Syntax error: value, object or array expected.\n",
+      errs);
+  char const invalidUTF8[] = "[\"\xC0\xAF\"]";
+  ok = reader->parse(invalidUTF8, invalidUTF8 + std::strlen(invalidUTF8),
+                     &root, &errs);
+  JSONTEST_ASSERT(!ok);
+  JSONTEST_ASSERT_STRING_EQUAL("* Line 1, Column 3\n  Invalid UTF-8 sequence\n",
+                               errs);
+  char const extra[] = "{} x";
+  ok = reader->parse(extra, extra + std::strlen(extra), &root, &errs);
+  JSONTEST_ASSERT(!ok);
+  JSONTEST_ASSERT_STRING_EQUAL(
+      "* Line 1, Column 4\n  Extra non-whitespace after JSON value.\n", errs);
+
+  // Comments are not indexed, so the default settings keep OurReader.
+  Json::CharReaderBuilder defaults;
+  defaults.settings_["structuralIndex"] = true;
+  CharReaderPtr commentReader(defaults.newCharReader());
+  char const comment[] = "[1, /* two */ 2]";
+  ok = commentReader->parse(comment, comment + std::strlen(comment), &root,
+                            &errs);
+  JSONTEST_ASSERT(ok);
+  JSONTEST_ASSERT_EQUAL(2, root.size());
+
+  // Both readers accept the same documents, with the same errors, whether
+  // or not failIfExtra has them read what follows the root.
+  char const* const docs[] = {
+      "-28383\"735", "[1] \"", "[1] x", "{} ]", "[1 2] x", "[1, 2 3] ] 4",
+      "{\"a\" 1} }", "{\"a\": 1, \"a\": 2} 3", "7 x", "[1, 2]",
+  };
+  for (bool failIfExtra : {true, false}) {
+    b.settings_["failIfExtra"] = failIfExtra;
+    b.settings_["structuralIndex"] = false;
+    CharReaderPtr plain(b.newCharReader());
+    b.settings_["structuralIndex"] = true;
+    CharReaderPtr indexed(b.newCharReader());
+    for (char const* text : docs) {
+      char const* const end = text + std::strlen(text);
+      Json::String indexedErrs;
+      Json::Value indexedRoot;
+      ok = plain->parse(text, end, &root, &errs);
+      JSONTEST_ASSERT_EQUAL(ok, indexed->parse(text, end, &indexedRoot,
+                                               &indexedErrs))
+          << text;
+      JSONTEST_ASSERT_STRING_EQUAL(errs, indexedErrs);
+      JSONTEST_ASSERT(root == indexedRoot) << text;
+    }
+  }
+}
+
+JSONTEST_FIXTURE_LOCAL(CharReaderTest, parseWithValidateUTF8) {
+  Json::CharReaderBuilder b;
+  CharReaderPtr lenient(b.newCharReader());
+  b.settings_["validateUTF8"] = true;
+  CharReaderPtr reader(b.newCharReader());
+  Json::String errs;
+  Json::Value root;
+  // A long ASCII prefix, so that the invalid bytes are found past the
+  // blocks that are skipped at once.
+  Json::String const prefix = "[\"" + Json::String(70, 'a') + "\", \"";
+  Json::String const valid = prefix + "\xC3\xA9\xE4\xB8\xAD\xF0\x9F\x98\x80\"]";
+  JSONTEST_ASSERT(reader->parse(valid.data(), valid.data() + valid.size(),
+                                &root, &errs));
+  JSONTEST_ASSERT(errs.empty());
+  JSONTEST_ASSERT_STRING_EQUAL("\xC3\xA9\xE4\xB8\xAD\xF0\x9F\x98\x80",
+                               root[1].asString());
+
+  char const* const invalid[] = {
+      "\x80",             // continuation byte without a lead byte
+      "\xC0\xAF",         // overlong encoding of '/'
+      "\xE0\x9F\xBF",     // overlong three-byte sequence
+      "\xED\xA0\x80",     // UTF-16 surrogate
+      "\xF4\x90\x80\x80", // above U+10FFFF
+      "\xF5\x80\x80\x80", // invalid lead byte
+      "\xE4\xB8",         // truncated sequence
+  };
+  for (const char* sequence : invalid) {
+    Json::String const doc = prefix + sequence + "\"]";
+    JSONTEST_ASSERT(
+        !reader->parse(doc.data(), doc.data() + doc.size(), &root, &errs));
+    JSONTEST_ASSERT_STRING_EQUAL(
+        "* Line 1, Column 77\n  Invalid UTF-8 sequence\n", errs);
+    // Without the setting, the bytes are kept as they are.
+    JSONTEST_ASSERT(
+        lenient->parse(doc.data(), doc.data() + doc.size(), &root, &errs));
+    JSONTEST_ASSERT_STRING_EQUAL(sequence, root[1].asString());
+  }
+}
+
+JSONTEST_FIXTURE_LOCAL(CharReaderTest, tryParse) {
+  struct TestData {
+    char const* doc;
+    Json::ParseError::Code code;
+    ptrdiff_t offset;
+  };
+  const TestData tests[] = {
+      {"[1 2]", Json::ParseError::missingArraySeparator, 3},
+      {"{\"a\" 1}", Json::ParseError::missingColon, 5},
+      {"{\"a\": 1 \"b\"}", Json::ParseError::missingObjectSeparator, 8},
+      {"[1, ?]", Json::ParseError::valueExpected, 4},
+      {"[\"\\x\"]", Json::ParseError::badEscape, 1},
+      {"[\"\\u12\"]", Json::ParseError::unicodeEscapeTooShort, 1},
+      {"[1] 2", Json::ParseError::extraCharacters, 4},
+      {"7", Json::ParseError::rootNotContainer, 0},
+      // Offsets count a byte order mark.
+      {"\xEF\xBB\xBF[1,\n2 3]", Json::ParseError::missingArraySeparator, 9},
+      {"\xEF\xBB\xBF[1]\n2", Json::ParseError::extraCharacters, 7},
+  };
+  Json::CharReaderBuilder b;
+  Json::CharReaderBuilder::strictMode(&b.settings_);
+  for (bool structuralIndex : {false, true}) {
+    b.settings_["structuralIndex"] = structuralIndex;
+    CharReaderPtr reader(b.newCharReader());
+    for (const auto& test : tests) {
+      char const* const end = test.doc + std::strlen(test.doc);
+      Json::Value root;
+      Json::ParseError error;
+      JSONTEST_ASSERT(!reader->tryParse(test.doc, end, &root, &error));
+      JSONTEST_ASSERT_EQUAL(test.code, error.code);
+      JSONTEST_ASSERT_EQUAL(test.offset, error.offset);
+      // The same as the first error of parse().
+      Json::String errs;
+      JSONTEST_ASSERT(!reader->parse(test.doc, end, &root, &errs));
+      Json::String const formatted = error.format(test.doc, end);
+      JSONTEST_ASSERT_STRING_EQUAL(formatted, errs.substr(0, formatted.size()));
+    }
+
+    char const dup[] = "{\"a\": 1, \"a\": 2}";
+    Json::Value root;
+    Json::ParseError error;
+    JSONTEST_ASSERT(!reader->tryParse(dup, dup + std::strlen(dup), &root,
+                                      &error));
+    JSONTEST_ASSERT_EQUAL(Json::ParseError::duplicateKey, error.code);
+    JSONTEST_ASSERT_STRING_EQUAL("* Line 1, Column 10\n  Duplicate key\n",
+                                 error.format(dup, dup + std::strlen(dup)));
+
+    char const bom[] = "\xEF\xBB\xBF[1 2]";
+    JSONTEST_ASSERT(!reader->tryParse(bom, bom + std::strlen(bom), &root,
+                                      &error));
+    JSONTEST_ASSERT_EQUAL(6, error.offset);
+    char const bomScalar[] = "\xEF\xBB\xBF"
+                             "7";
+    JSONTEST_ASSERT(!reader->tryParse(bomScalar, bomScalar + 4, &root,
+                                      &error));
+    JSONTEST_ASSERT_EQUAL(Json::ParseError::rootNotContainer, error.code);
+    JSONTEST_ASSERT_EQUAL(0, error.offset);
+
+    char const valid[] = "[1, {\"a\": 2}]";
+    JSONTEST_ASSERT(reader->tryParse(valid, valid + std::strlen(valid), &root,
+                                     &error));
+    JSONTEST_ASSERT_EQUAL(Json::ParseError::none, error.code);
+    JSONTEST_ASSERT_EQUAL(2, root[1]["a"].asInt());
+    JSONTEST_ASSERT(reader->tryParse(valid, valid + std::strlen(valid), &root,
+                                     nullptr));
+  }
+
+  // Limits fail the parse instead of throwing.
+  b.settings_["stackLimit"] = 1;
+  for (bool structuralIndex : {false, true}) {
+    b.settings_["structuralIndex"] = structuralIndex;
+    CharReaderPtr reader(b.newCharReader());
+    char const doc[] = "[[1]]";
+    Json::Value root;
+    Json::ParseError error;
+    JSONTEST_ASSERT(
+        !reader->tryParse(doc, doc + std::strlen(doc), &root, &error));
+    JSONTEST_ASSERT_EQUAL(Json::ParseError::stackLimitExceeded, error.code);
+    JSONTEST_ASSERT_EQUAL(1, error.offset);
+    JSONTEST_ASSERT_THROWS(
+        reader->parse(doc, doc + std::strlen(doc), &root, nullptr));
+  }
+}
+
+// A reader defined outside the library only has parse(), which tryParse()
+// and validate() fall back to.
+JSONTEST_FIXTURE_LOCAL(CharReaderTest, tryParseOtherReader) {
+  struct EmptyArrayReader : Json::CharReader {
+    bool parse(char const* beginDoc, char const* endDoc, Json::Value* root,
+               Json::String* errs) override {
+      *root = Json::Value(Json::arrayValue);
+      bool const ok = Json::String(beginDoc, endDoc) == "[]";
+      if (errs)
+        *errs = ok ? "" : "not []";
+      return ok;
+    }
+  };
+  EmptyArrayReader reader;
+  Json::Value root;
+  Json::ParseError error;
+  char const good[] = "[]";
+  JSONTEST_ASSERT(reader.tryParse(good, good + 2, &root, &error));
+  JSONTEST_ASSERT_EQUAL(Json::ParseError::none, error.code);
+  JSONTEST_ASSERT(root.isArray());
+  JSONTEST_ASSERT(reader.validate(good, good + 2, &error));
+  char const bad[] = "{}";
+  JSONTEST_ASSERT(!reader.tryParse(bad, bad + 2, &root, &error));
+  JSONTEST_ASSERT_EQUAL(Json::ParseError::other, error.code);
+  JSONTEST_ASSERT_EQUAL(0, error.offset);
+  JSONTEST_ASSERT(!reader.validate(bad, bad + 2, nullptr));
+}
+
+JSONTEST_FIXTURE_LOCAL(CharReaderTest, validate) {
+  char const* const docs[] = {
+      "[1, 2.5, -3e2, \"x\\ny\", true, false, null, {}, []]",
+      "{\"a\": {\"b\": [1, {\"c\": \"\\ud83d\\ude00\"}]}}",
+      "[1e-400, 1.]",
+      "[1e999]",
+      "[1e]",
+      "[1 2]",
+      "{\"a\" 1}",
+      "{\"a\": 1, \"b\": 2, \"\\u0061\": 3}",
+      "{\"a\": {\"a\": 1}, \"b\": {\"a\": 1}}",
+      "[\"\\x\"]",
+      "[1] 2",
+      "7",
+      "[[[[1]]]]",
+      "\xEF\xBB\xBF[1 2]",
+      "\xEF\xBB\xBF"
+      "7",
+  };
+  Json::CharReaderBuilder b;
+  Json::CharReaderBuilder::strictMode(&b.settings_);
+  b.settings_["stackLimit"] = 3;
+  for (bool structuralIndex : {false, true}) {
+    b.settings_["structuralIndex"] = structuralIndex;
+    CharReaderPtr reader(b.newCharReader());
+    for (char const* doc : docs) {
+      char const* const end = doc + std::strlen(doc);
+      Json::Value root;
+      Json::ParseError parseError;
+      Json::ParseError error;
+      bool const ok = reader->tryParse(doc, end, &root, &parseError);
+      JSONTEST_ASSERT_EQUAL(ok, reader->validate(doc, end, &error));
+      JSONTEST_ASSERT_EQUAL(parseError.code, error.code);
+      JSONTEST_ASSERT_EQUAL(parseError.offset, error.offset);
+    }
+  }
+
+  CharReaderPtr reader(b.newCharReader());
+  char const dup[] = "{\"a\": 1, \"\\u0061\": 2}";
+  Json::ParseError error;
+  JSONTEST_ASSERT(!reader->validate(dup, dup + std::strlen(dup), &error));
+  JSONTEST_ASSERT_EQUAL(Json::ParseError::duplicateKey, error.code);
+  JSONTEST_ASSERT_EQUAL(9, error.offset);
+  char const deep[] = "[[[[1]]]]";
+  JSONTEST_ASSERT(!reader->validate(deep, deep + std::strlen(deep), &error));
+  JSONTEST_ASSERT_EQUAL(Json::ParseError::stackLimitExceeded, error.code);
+  char const bom[] = "\xEF\xBB\xBF[1]\n2";
+  JSONTEST_ASSERT(!reader->validate(bom, bom + std::strlen(bom), &error));
+  JSONTEST_ASSERT_EQUAL(Json::ParseError::extraCharacters, error.code);
+  JSONTEST_ASSERT_EQUAL(7, error.offset);
+  char const big[] = "[1e999]";
+  JSONTEST_ASSERT(!reader->validate(big, big + std::strlen(big), &error));
+  JSONTEST_ASSERT_EQUAL(Json::ParseError::notANumber, error.code);
+  char const valid[] = "{\"a\": [1, 2], \"b\": {\"a\": 3}}";
+  JSONTEST_ASSERT(reader->validate(valid, valid + std::strlen(valid), &error));
+  JSONTEST_ASSERT_EQUAL(Json::ParseError::none, error.code);
+  JSONTEST_ASSERT(
+      reader->validate(valid, valid + std::strlen(valid), nullptr));
+}
+
+JSONTEST_FIXTURE_LOCAL(CharReaderTest, reformat) {
+  Json::CharReaderBuilder b;
+  Json::StreamWriterBuilder w;
+  auto reformat = [&](Json::String const& doc, Json::ParseError* error) {
+    std::istringstream sin(doc);
+    std::ostringstream sout;
+    bool const ok = Json::reformat(b, w, sin, sout, error);
+    JSONTEST_ASSERT_EQUAL(ok, error->code == Json::ParseError::none);
+    return sout.str();
+  };
+  Json::ParseError error;
+  // The same as parsing and writing, with comments.
+  Json::String const commented = "// head\n"
+                                 "{ \"a\": [1, 2], // two\n"
+                                 "  /* b */ \"b\": {}, \"c\": [ // c\n"
+                                 "    true ] } // tail\n";
+  Json::Value root;
+  JSONTEST_ASSERT(Json::CharReaderConfig::defaults().parse(
+      commented.data(), commented.data() + commented.size(), &root, nullptr));
+  for (char const* indentation : {"", "  "}) {
+    for (char const* commentStyle : {"All", "None"}) {
+      w["indentation"] = indentation;
+      w["commentStyle"] = commentStyle;
+      JSONTEST_ASSERT_STRING_EQUAL(Json::writeString(w, root),
+                                   reformat(commented, &error));
+    }
+  }
+  // But with members in order, all of them, and numbers as they were.
+  w["indentation"] = "";
+  JSONTEST_ASSERT_STRING_EQUAL(
+      R"({"b":1.50,"a":[1E2,7,"x\ny"],"b":-0})",
+      reformat(R"({ "b": 1.50, "a": [ 1E2, 007, "x\ny" ], "b": -0 })",
+               &error));
+  b["rejectDupKeys"] = true;
+  reformat(R"({"a": {"b": 1}, "b": {"b": 2}, "a": 3})", &error);
+  JSONTEST_ASSERT_EQUAL(Json::ParseError::duplicateKey, error.code);
+  JSONTEST_ASSERT_EQUAL(31, error.offset);
+
+  // Across many reads from the stream.
+  Json::String big = "[";
+  Json::String minified = "[";
+  for (int index = 0; index < 50000; ++index) {
+    big += index ? ",\n  \"" : "\n  \"";
+    minified += index ? ",\"" : "\"";
+    Json::String const text(static_cast<size_t>(index % 40), 'x');
+    big += text + "\"";
+    minified += text + "\"";
+  }
+  JSONTEST_ASSERT_STRING_EQUAL(minified + "]", reformat(big + "\n]", &error));
+  reformat(big + ", tru]", &error);
+  JSONTEST_ASSERT_EQUAL(Json::ParseError::valueExpected, error.code);
+  JSONTEST_ASSERT_EQUAL(static_cast<ptrdiff_t>(big.size() + 2), error.offset);
+}
+
+JSONTEST_FIXTURE_LOCAL(CharReaderTest, cursor) {
+  Json::CharReaderBuilder b;
+  Json::String const doc = "// head\n"
+                           "{ \"a\": [1, \"x\", null, true], // a\n"
+                           "  \"skipped\": {\"b\": [1, {\"c\": \"]}\"}]},\n"
+                           "  \"read\": {\"d\": 2.5, \"e\": [] // e\n"
+                           "  }, \"last\": -1 }\n";
+  std::istringstream sin(doc);
+  Json::Cursor cursor(b, sin);
+  using Cursor = Json::Cursor;
+  JSONTEST_ASSERT_EQUAL(Cursor::tokenObjectBegin, cursor.next());
+  JSONTEST_ASSERT_EQUAL(8, cursor.offset());
+  JSONTEST_ASSERT_EQUAL(Cursor::tokenName, cursor.next());
+  JSONTEST_ASSERT_STRING_EQUAL("a", cursor.name());
+  for (Cursor::Kind kind :
+       {Cursor::tokenArrayBegin, Cursor::tokenNumber, Cursor::tokenString,
+        Cursor::tokenNull, Cursor::tokenBoolean, Cursor::tokenArrayEnd})
+    JSONTEST_ASSERT_EQUAL(kind, cursor.next());
+  JSONTEST_ASSERT_EQUAL(Cursor::tokenName, cursor.next());
+  JSONTEST_ASSERT_STRING_EQUAL("skipped", cursor.name());
+  JSONTEST_ASSERT(cursor.skip());
+  JSONTEST_ASSERT_EQUAL(Cursor::tokenObjectEnd, cursor.kind());
+  JSONTEST_ASSERT_EQUAL(Cursor::tokenName, cursor.next());
+  Json::Value value;
+  JSONTEST_ASSERT(cursor.readValue(&value));
+  JSONTEST_ASSERT_EQUAL(Cursor::tokenObjectEnd, cursor.kind());
+  JSONTEST_ASSERT_EQUAL(2.5, value["d"].asDouble());
+  JSONTEST_ASSERT_STRING_EQUAL("// e", value["e"].getComment(
+                                           Json::commentAfterOnSameLine));
+  JSONTEST_ASSERT_EQUAL(0, value.getOffsetStart());
+  JSONTEST_ASSERT_EQUAL(Cursor::tokenName, cursor.next());
+  JSONTEST_ASSERT(cursor.readValue(&value));
+  JSONTEST_ASSERT_EQUAL(-1, value.asInt());
+  JSONTEST_ASSERT_EQUAL(Cursor::tokenObjectEnd, cursor.next());
+  JSONTEST_ASSERT_EQUAL(Cursor::tokenEnd, cursor.next());
+  JSONTEST_ASSERT(!cursor.readValue(&value));
+  JSONTEST_ASSERT_EQUAL(Cursor::tokenEnd, cursor.next());
+
+  // An element at a time, across many reads from the stream.
+  Json::String big = "[";
+  for (int index = 0; index < 20000; ++index)
+    big += (index ? ",\n  {\"id\": " : "\n  {\"id\": ") +
+           std::to_string(index) + ", \"tags\": [\"a\", \"b\"]}";
+  big += "\n]";
+  std::istringstream bigIn(big);
+  Json::Cursor elements(b, bigIn);
+  JSONTEST_ASSERT_EQUAL(Cursor::tokenArrayBegin, elements.next());
+  int count = 0;
+  while (elements.next() == Cursor::tokenObjectBegin) {
+    JSONTEST_ASSERT(elements.readValue(&value));
+    JSONTEST_ASSERT_EQUAL(count++, value["id"].asInt());
+    JSONTEST_ASSERT_EQUAL(2u, value["tags"].size());
+  }
+  JSONTEST_ASSERT_EQUAL(20000, count);
+  JSONTEST_ASSERT_EQUAL(Cursor::tokenArrayEnd, elements.kind());
+  JSONTEST_ASSERT_EQUAL(Cursor::tokenEnd, elements.next());
+
+  // The same errors as tryParse(), whether walked or read.
+  b["rejectDupKeys"] = true;
+  b["failIfExtra"] = true;
+  b["strictRoot"] = true;
+  std::unique_ptr<Json::CharReader> const reader(b.newCharReader());
+  for (Json::String const& bad :
+       {Json::String(R"({"a" 1})"), Json::String("[1 2]"),
+        Json::String(R"({"a": tru})"), Json::String(R"([1, "x\q"])"),
+        Json::String(R"({"a": 1, "a": 2})"), Json::String("[1, [2, {"),
+        Json::String(R"({"a": [1, {"b": }]})"), Json::String("[1] 2"),
+        Json::String("007true"), Json::String("\"x\" // x"),
+        Json::String("[1] // x\n2")}) {
+    Json::ParseError expected;
+    JSONTEST_ASSERT(!reader->tryParse(bad.data(), bad.data() + bad.size(),
+                                      &value, &expected));
+    std::istringstream walkIn(bad);
+    Json::Cursor walk(b, walkIn);
+    while (walk.next() > Cursor::tokenError) {
+    }
+    JSONTEST_ASSERT_EQUAL(Cursor::tokenError, walk.kind());
+    JSONTEST_ASSERT_EQUAL(expected.code, walk.error().code);
+    JSONTEST_ASSERT_EQUAL(expected.offset, walk.error().offset);
+    std::istringstream readIn(bad);
+    Json::Cursor read(b, readIn);
+    read.next();
+    if (read.readValue(&value))
+      read.next();
+    JSONTEST_ASSERT_EQUAL(Cursor::tokenError, read.kind());
+    JSONTEST_ASSERT_EQUAL(expected.code, read.error().code);
+    JSONTEST_ASSERT_EQUAL(expected.offset, read.error().offset);
+  }
+}
+
+// tryParse(), validate(), reformat() and a Cursor, whether walked or read,
+// accept the same documents, and fail with the same errors, on documents
+// made of random pieces and read with random settings.
+JSONTEST_FIXTURE_LOCAL(CharReaderTest, readersAgree) {
+  char const* const pieces[] = {
+      "{", "}", "[", "]", ",", ":", "\"a\"", "\"b\"", "\"x\\n\"", "\"\\q\"",
+      "\"\\u12\"", "'s'", "1", "-0", "007", "1.5e3", "1e999", "+1", "1e",
+      "tru", "true", "false", "null", "NaN", "-Infinity", " ", "\n",
+      "/* c */", "// c\n", "/*", "\xC0", "\xC3\xA9", "\"a\":", "\"a\": 1",
+      "[1, 2]", "{\"b\": [true]}", "\"\\u0061\":",
+  };
+  char const* const settings[] = {
+      "allowComments",      "allowTrailingCommas", "strictRoot",
+      "allowNumericKeys",   "allowSingleQuotes",   "failIfExtra",
+      "rejectDupKeys",      "allowSpecialFloats",  "skipBom",
+      "validateUTF8",       "collectComments",
+      "allowDroppedNullPlaceholders",
+  };
+  std::mt19937 random(1);
+  for (int index = 0; index < 20000; ++index) {
+    Json::CharReaderBuilder b;
+    for (char const* setting : settings)
+      b[setting] = random() % 2 == 0;
+    b["stackLimit"] = random() % 3 == 0 ? 3 : 1000;
+    Json::String doc = random() % 8 == 0 ? "\xEF\xBB\xBF" : "";
+    for (auto count = random() % 40; count > 0; --count)
+      doc += pieces[random() % (sizeof(pieces) / sizeof(*pieces))];
+
+    std::unique_ptr<Json::CharReader> const reader(b.newCharReader());
+    Json::Value root;
+    Json::ParseError expected;
+    bool const ok = reader->tryParse(doc.data(), doc.data() + doc.size(),
+                                     &root, &expected);
+    auto check = [&](bool agrees, Json::ParseError const& error) {
+      JSONTEST_ASSERT_EQUAL(ok, agrees) << doc;
+      JSONTEST_ASSERT_EQUAL(expected.code, error.code) << doc;
+      JSONTEST_ASSERT_EQUAL(expected.offset, error.offset) << doc;
+    };
+    Json::ParseError error;
+    check(reader->validate(doc.data(), doc.data() + doc.size(), &error),
+          error);
+    std::istringstream sin(doc);
+    std::ostringstream sout;
+    check(Json::reformat(b, Json::StreamWriterBuilder(), sin, sout, &error),
+          error);
+    std::istringstream walkIn(doc);
+    Json::Cursor walk(b, walkIn);
+    while (walk.next() > Json::Cursor::tokenError) {
+    }
+    check(walk.kind() == Json::Cursor::tokenEnd, walk.error());
+    std::istringstream readIn(doc);
+    Json::Cursor read(b, readIn);
+    read.next();
+    if (read.readValue(&root))
+      read.next();
+    check(read.kind() == Json::Cursor::tokenEnd, read.error());
+  }
+}
+
+// With rejectDupKeys, each member name is looked up by its hash among
+// those of its object, so that a wide object takes linear time.
+JSONTEST_FIXTURE_LOCAL(CharReaderTest, rejectDupKeysInWideObject) {
+  Json::CharReaderBuilder b;
+  Json::CharReaderBuilder::strictMode(&b.settings_);
+  Json::String doc = "{";
+  for (int i = 0; i < 50000; ++i) {
+    Json::String const name = "\"k" + std::to_string(i) + "\"";
+    doc += (i ? ", " : "") + name + ": {" + name + ": [{" + name + ": 1}]}";
+  }
+  ptrdiff_t const duplicate = static_cast<ptrdiff_t>(doc.size()) + 2;
+  for (Json::String const& text : {doc + "}", doc + ", \"k17\": 0}"}) {
+    Json::ParseError::Code const code = text.size() == doc.size() + 1
+                                            ? Json::ParseError::none
+                                            : Json::ParseError::duplicateKey;
+    ptrdiff_t const offset = code ? duplicate : 0;
+    for (bool structuralIndex : {false, true}) {
+      b["structuralIndex"] = structuralIndex;
+      std::unique_ptr<Json::CharReader> const reader(b.newCharReader());
+      Json::ParseError error;
+      Json::Value root;
+      reader->tryParse(text.data(), text.data() + text.size(), &root, &error);
+      JSONTEST_ASSERT_EQUAL(code, error.code);
+      JSONTEST_ASSERT_EQUAL(offset, error.offset);
+      reader->validate(text.data(), text.data() + text.size(), &error);
+      JSONTEST_ASSERT_EQUAL(code, error.code);
+      JSONTEST_ASSERT_EQUAL(offset, error.offset);
+    }
+    b["structuralIndex"] = false;
+    std::istringstream walkIn(text);
+    Json::Cursor walk(b, walkIn);
+    while (walk.next() > Json::Cursor::tokenError) {
+    }
+    JSONTEST_ASSERT_EQUAL(code, walk.error().code);
+    JSONTEST_ASSERT_EQUAL(offset, walk.error().offset);
+    std::istringstream sin(text);
+    std::ostringstream sout;
+    Json::ParseError error;
+    Json::reformat(b, Json::StreamWriterBuilder(), sin, sout, &error);
+    JSONTEST_ASSERT_EQUAL(code, error.code);
+    JSONTEST_ASSERT_EQUAL(offset, error.offset);
+  }
+}
+
 JSONTEST_FIXTURE_LOCAL(CharReaderTest, testOperator) {
   const std::string styled = R"({ "property" : "value" })";
   std::istringstream iss(styled);
@@ -3206,6 +4105,39 @@ JSONTEST_FIXTURE_LOCAL(CharReaderTest, testOperator) {
   JSONTEST_ASSERT_EQUAL("value", root["property"]);
 }
 
+struct SourceMapTest : JsonTest::TestCase {};
+
+JSONTEST_FIXTURE_LOCAL(SourceMapTest, lineAndColumn) {
+  const Json::String doc = "{\n  \"a\" : 1,\r\n  \"b\" :\r[ true ]\n}";
+  const Json::SourceMap map(doc.data(), doc.data() + doc.size());
+  int line = 0;
+  int column = 0;
+  map.getLineAndColumn(0, &line, &column);
+  JSONTEST_ASSERT_EQUAL(1, line);
+  JSONTEST_ASSERT_EQUAL(1, column);
+  map.getLineAndColumn(1, &line, &column);
+  JSONTEST_ASSERT_EQUAL(1, line);
+  JSONTEST_ASSERT_EQUAL(2, column);
+  JSONTEST_ASSERT_STRING_EQUAL("Line 2, Column 3", map.getLineAndColumn(4));
+  JSONTEST_ASSERT_STRING_EQUAL("Line 3, Column 3", map.getLineAndColumn(16));
+  JSONTEST_ASSERT_STRING_EQUAL("Line 4, Column 1", map.getLineAndColumn(22));
+  JSONTEST_ASSERT_STRING_EQUAL("Line 5, Column 2",
+                               map.getLineAndColumn(ptrdiff_t(doc.size())));
+  JSONTEST_ASSERT_STRING_EQUAL("Line 5, Column 2", map.getLineAndColumn(1000));
+
+  Json::CharReaderBuilder b;
+  CharReaderPtr reader(b.newCharReader());
+  Json::Value root;
+  JSONTEST_ASSERT(
+      reader->parse(doc.data(), doc.data() + doc.size(), &root, nullptr));
+  map.getLineAndColumn(root["b"][0].getOffsetStart(), &line, &column);
+  JSONTEST_ASSERT_EQUAL(4, line);
+  JSONTEST_ASSERT_EQUAL(3, column);
+
+  const Json::SourceMap empty(doc.data(), doc.data());
+  JSONTEST_ASSERT_STRING_EQUAL("Line 1, Column 1", empty.getLineAndColumn(5));
+}
+
 struct CharReaderStrictModeTest : JsonTest::TestCase {};
 
 JSONTEST_FIXTURE_LOCAL(CharReaderStrictModeTest, dupKeys) {
@@ -3667,6 +4599,138 @@ JSONTEST_FIXTURE_LOCAL(BuilderTest, settings) {
   }
 }
 
+JSONTEST_FIXTURE_LOCAL(BuilderTest, writerConfig) {
+  Json::Value root;
+  root["name"] = "caf\xC3\xA9";
+  root["list"].append(1.5);
+  root["list"].append(Json::Value());
+
+  Json::StreamWriterBuilder builder;
+  const Json::StreamWriterConfig defaults(builder);
+  builder["indentation"] = "";
+  builder["emitUTF8"] = true;
+  const Json::StreamWriterConfig compact(builder);
+  builder["indentation"] = "\t";
+  builder["emitUTF8"] = false;
+  JSONTEST_ASSERT_STRING_EQUAL(Json::writeString(builder, root),
+                               defaults.write(root));
+  // Switching configs on the same thread switches writers.
+  for (int i = 0; i < 2; ++i) {
+    JSONTEST_ASSERT_STRING_EQUAL(
+        "{\"list\":[1.5,null],\"name\":\"caf\xC3\xA9\"}",
+        compact.write(root));
+    JSONTEST_ASSERT_STRING_EQUAL(Json::writeString(defaults, root),
+                                 defaults.write(root));
+  }
+  Json::OStringStream sout;
+  compact.write(root, &sout);
+  sout << root;
+  JSONTEST_ASSERT_STRING_EQUAL(compact.write(root) + defaults.write(root),
+                               sout.str());
+  JSONTEST_ASSERT_STRING_EQUAL(
+      defaults.write(root), Json::StreamWriterConfig::defaults().write(root));
+
+  builder["commentStyle"] = "Some";
+  JSONTEST_ASSERT_THROWS(Json::StreamWriterConfig{builder});
+}
+
+JSONTEST_FIXTURE_LOCAL(BuilderTest, serializedSize) {
+  Json::Value root;
+  root["text"] = "tab\t, quote\", caf\xC3\xA9, \x01";
+  root["text"].setComment("// before", Json::commentBefore);
+  root["short"].append(1);
+  root["short"].append(-2.5);
+  root["short"].append(true);
+  root["short"].setComment("// after", Json::commentAfterOnSameLine);
+  for (int i = 0; i < 30; ++i)
+    root["long"].append("element");
+  root["nested"].append(Json::Value(Json::objectValue));
+  root["nested"].append(Json::Value(Json::arrayValue));
+  root["nested"].append(Json::Value());
+  // resize() leaves indices without an element, which are written as nulls.
+  root["short holes"].resize(3);
+  root["long holes"].resize(40);
+  root["long holes"][10] = "ten";
+
+  Json::StreamWriterBuilder builder;
+  const Json::Value settings = builder.settings_;
+  for (int i = 0; i < 5; ++i) {
+    builder.settings_ = settings;
+    if (i == 1)
+      builder["commentStyle"] = "None";
+    if (i == 2)
+      builder["indentation"] = "";
+    if (i == 3)
+      builder["emitUTF8"] = true;
+    if (i == 4)
+      builder["enableYAMLCompatibility"] = true;
+    const Json::String expected = Json::writeString(builder, root);
+    const size_t size = Json::serializedSize(root, builder);
+    JSONTEST_ASSERT_EQUAL(expected.size(), size) << ", i=" << i;
+
+    const Json::StreamWriterConfig config(builder);
+    JSONTEST_ASSERT_EQUAL(size, config.serializedSize(root));
+    Json::String out(size, '\0');
+    JSONTEST_ASSERT_EQUAL(size, config.write(root, &out[0], out.size()));
+    JSONTEST_ASSERT_STRING_EQUAL(expected, out);
+    JSONTEST_ASSERT_THROWS(config.write(root, &out[0], size - 1));
+  }
+}
+
+JSONTEST_FIXTURE_LOCAL(BuilderTest, readerConfig) {
+  Json::CharReaderBuilder builder;
+  const Json::CharReaderConfig defaults(builder);
+  Json::CharReaderBuilder::strictMode(&builder.settings_);
+  const Json::CharReaderConfig strict(builder);
+  const Json::String doc = "{ \"a\" : [1, 2,] } // trailing";
+  for (int i = 0; i < 2; ++i) {
+    Json::Value root;
+    Json::String errs;
+    JSONTEST_ASSERT(defaults.parse(doc.data(), doc.data() + doc.size(), &root,
+                                   &errs));
+    JSONTEST_ASSERT(errs.empty());
+    JSONTEST_ASSERT_EQUAL(2u, root["a"].size());
+    JSONTEST_ASSERT(
+        !strict.parse(doc.data(), doc.data() + doc.size(), &root, &errs));
+    Json::String builderErrs;
+    CharReaderPtr reader(builder.newCharReader());
+    reader->parse(doc.data(), doc.data() + doc.size(), &root, &builderErrs);
+    JSONTEST_ASSERT_STRING_EQUAL(builderErrs, errs);
+  }
+  Json::Value root;
+  JSONTEST_ASSERT(Json::CharReaderConfig::defaults().parse(
+      doc.data(), doc.data() + doc.size(), &root, nullptr));
+}
+
+JSONTEST_FIXTURE_LOCAL(BuilderTest, configThreads) {
+  Json::StreamWriterBuilder writerBuilder;
+  writerBuilder["indentation"] = "";
+  const Json::StreamWriterConfig writerConfig(writerBuilder);
+  const Json::CharReaderConfig readerConfig{Json::CharReaderBuilder()};
+  std::atomic<int> failures(0);
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 4; ++t) {
+    threads.emplace_back([&, t] {
+      for (int i = 0; i < 1000; ++i) {
+        Json::Value value;
+        value["thread"] = t;
+        value["i"] = i;
+        const Json::String text = writerConfig.write(value);
+        Json::Value copy;
+        if (text != "{\"i\":" + std::to_string(i) + ",\"thread\":" +
+                        std::to_string(t) + "}" ||
+            !readerConfig.parse(text.data(), text.data() + text.size(), &copy,
+                                nullptr) ||
+            copy != value)
+          ++failures;
+      }
+    });
+  }
+  for (std::thread& thread : threads)
+    thread.join();
+  JSONTEST_ASSERT_EQUAL(0, failures.load());
+}
+
 struct BomTest : JsonTest::TestCase {};
 
 JSONTEST_FIXTURE_LOCAL(BomTest, skipBom) {
@@ -3693,6 +4757,248 @@ JSONTEST_FIXTURE_LOCAL(BomTest, notSkipBom) {
   JSONTEST_ASSERT(!errs.empty());
 }
 
+struct LazyDocumentTest : JsonTest::TestCase {};
+
+JSONTEST_FIXTURE_LOCAL(LazyDocumentTest, navigate) {
+  char const doc[] = "// settings\n"
+                     "{\n"
+                     "  \"name\": \"lazy\",\n"
+                     "  \"items\": [ {\"id\": 1, \"tags\": [\"a\", \"b\"]},\n"
+                     "             {\"id\": 2, \"tags\": []} ],\n"
+                     "  \"nested\": { \"a\\u0062c\": true, \"dup\": 1, "
+                     "\"dup\": 2,\n"
+                     "              \"deep\": { \"x\": [1.5, null] } },\n"
+                     "  \"name\": \"last\"\n"
+                     "}\n";
+  Json::LazyDocument lazy;
+  Json::String errs;
+  JSONTEST_ASSERT(lazy.parse(doc, doc + std::strlen(doc), &errs));
+  JSONTEST_ASSERT(errs.empty());
+  Json::LazyValue root = lazy.root();
+  JSONTEST_ASSERT(root.isObject());
+  JSONTEST_ASSERT_EQUAL(3, root.size());
+  Json::Value::Members names = root.getMemberNames();
+  JSONTEST_ASSERT_EQUAL(3, names.size());
+  JSONTEST_ASSERT_STRING_EQUAL("items", names[0]);
+  JSONTEST_ASSERT_STRING_EQUAL("name", names[1]);
+  JSONTEST_ASSERT_STRING_EQUAL("nested", names[2]);
+  JSONTEST_ASSERT_STRING_EQUAL("last", root["name"].toValue().asString());
+
+  Json::LazyValue items = root["items"];
+  JSONTEST_ASSERT(items.isArray());
+  JSONTEST_ASSERT_EQUAL(2, items.size());
+  JSONTEST_ASSERT_EQUAL(2, items[1]["id"].toValue().asInt());
+  JSONTEST_ASSERT_EQUAL(Json::intValue, items[1]["id"].type());
+  JSONTEST_ASSERT_EQUAL(2, items[0]["tags"].size());
+  JSONTEST_ASSERT_EQUAL(0, items[1]["tags"].size());
+  JSONTEST_ASSERT(!items[2].exists());
+
+  Json::LazyValue nested = root["nested"];
+  JSONTEST_ASSERT(nested.isMember("abc"));
+  JSONTEST_ASSERT_EQUAL(Json::booleanValue, nested["abc"].type());
+  JSONTEST_ASSERT_EQUAL(2, nested["dup"].toValue().asInt());
+  JSONTEST_ASSERT_EQUAL(3, nested.size());
+  names = nested.getMemberNames();
+  JSONTEST_ASSERT_EQUAL(3, names.size());
+  JSONTEST_ASSERT_STRING_EQUAL("abc", names[0]);
+  JSONTEST_ASSERT_STRING_EQUAL("deep", names[1]);
+  JSONTEST_ASSERT_STRING_EQUAL("dup", names[2]);
+  Json::LazyValue x = nested["deep"]["x"];
+  JSONTEST_ASSERT_EQUAL(Json::realValue, x[0].type());
+  JSONTEST_ASSERT(x[1].exists());
+  JSONTEST_ASSERT(x[1].isNull());
+
+  JSONTEST_ASSERT(!root["missing"].exists());
+  JSONTEST_ASSERT(!root["name"]["missing"].exists());
+  JSONTEST_ASSERT(!root["name"][0].exists());
+  Json::Value value;
+  JSONTEST_ASSERT(!Json::LazyValue().parse(&value, &errs));
+
+  // Subtrees are the same as in the fully parsed document, offsets included.
+  Json::CharReaderBuilder b;
+  CharReaderPtr reader(b.newCharReader());
+  Json::Value full;
+  JSONTEST_ASSERT(reader->parse(doc, doc + std::strlen(doc), &full, &errs));
+  JSONTEST_ASSERT(nested.toValue() == full["nested"]);
+  JSONTEST_ASSERT(root.toValue() == full);
+  Json::Value deep = nested["deep"].toValue();
+  JSONTEST_ASSERT_EQUAL(full["nested"]["deep"].getOffsetStart(),
+                        deep.getOffsetStart());
+  JSONTEST_ASSERT_EQUAL(full["nested"]["deep"].getOffsetLimit(),
+                        deep.getOffsetLimit());
+  JSONTEST_ASSERT_EQUAL(deep.getOffsetStart(), nested["deep"].getOffsetStart());
+}
+
+JSONTEST_FIXTURE_LOCAL(LazyDocumentTest, errors) {
+  Json::LazyDocument lazy;
+  Json::String errs;
+  char const mismatched[] = "[1, {]}";
+  JSONTEST_ASSERT(
+      !lazy.parse(mismatched, mismatched + std::strlen(mismatched), &errs));
+  JSONTEST_ASSERT_STRING_EQUAL(
+      "* Line 1, Column 6\n  Unexpected ']' without a matching '['\n", errs);
+  JSONTEST_ASSERT(!lazy.root().exists());
+  char const unclosed[] = "{\"a\": \"]\"";
+  JSONTEST_ASSERT(
+      !lazy.parse(unclosed, unclosed + std::strlen(unclosed), &errs));
+  JSONTEST_ASSERT_STRING_EQUAL(
+      "* Line 1, Column 1\n  Missing '}' at end of object\n", errs);
+  char const unterminated[] = "[1, /* c ] */ 2 /* ]";
+  JSONTEST_ASSERT(!lazy.parse(unterminated,
+                              unterminated + std::strlen(unterminated), &errs));
+  JSONTEST_ASSERT_STRING_EQUAL(
+      "* Line 1, Column 17\n  Missing '*/' at end of comment\n", errs);
+
+  // Comments are skipped one at a time, whatever follows them.
+  Json::CharReaderBuilder builder;
+  CharReaderPtr reader(builder.newCharReader());
+  for (char const* doc :
+       {"{\"a\": /* c */ 1}", "[1, /* c */\n2]", "[1] /* a */\n//x",
+        "[1, /* a */ /* b */ // c\n /**/2]", "[/* ] */ 1 /*/ */]"}) {
+    char const* const end = doc + std::strlen(doc);
+    JSONTEST_ASSERT(lazy.parse(doc, end, &errs)) << doc << errs;
+    Json::Value full;
+    JSONTEST_ASSERT(reader->parse(doc, end, &full, &errs)) << doc;
+    JSONTEST_ASSERT(lazy.root().toValue() == full) << doc;
+  }
+
+  // Errors in subtrees are only found when they are parsed.
+  char const bad[] = "{\"good\": 1,\n \"bad\": [1, 2 3]}";
+  JSONTEST_ASSERT(lazy.parse(bad, bad + std::strlen(bad), &errs));
+  JSONTEST_ASSERT_EQUAL(1, lazy.root()["good"].toValue().asInt());
+  Json::Value value;
+  JSONTEST_ASSERT(!lazy.root()["bad"].parse(&value, &errs));
+  JSONTEST_ASSERT_STRING_EQUAL(
+      "* Line 2, Column 15\n  Missing ',' or ']' in array declaration\n",
+      errs);
+  JSONTEST_ASSERT(lazy.root()["bad"][0].exists());
+  JSONTEST_ASSERT(!lazy.root()["bad"][2].exists());
+
+  Json::CharReaderBuilder b;
+  Json::CharReaderBuilder::strictMode(&b.settings_);
+  Json::LazyDocument strict(b);
+  char const scalar[] = "1";
+  JSONTEST_ASSERT(!strict.parse(scalar, scalar + 1, &errs));
+  char const extra[] = "{} x";
+  JSONTEST_ASSERT(!strict.parse(extra, extra + std::strlen(extra), &errs));
+  JSONTEST_ASSERT_STRING_EQUAL(
+      "* Line 1, Column 4\n  Extra non-whitespace after JSON value.\n", errs);
+  char const dup[] = "{\"a\": 1, \"a\": 2}";
+  JSONTEST_ASSERT(!strict.parse(dup, dup + std::strlen(dup), &errs));
+  JSONTEST_ASSERT_STRING_EQUAL("* Line 1, Column 10\n  Duplicate key: 'a'\n",
+                               errs);
+}
+
+struct MsgPackTest : JsonTest::TestCase {
+  Json::Value roundTrip(const Json::Value& value) {
+    Json::String const bytes =
+        Json::writeString(Json::MsgPackWriterBuilder(), value);
+    CharReaderPtr reader(Json::MsgPackReaderBuilder().newCharReader());
+    Json::Value decoded;
+    Json::String errs;
+    JSONTEST_ASSERT(reader->parse(bytes.data(), bytes.data() + bytes.size(),
+                                  &decoded, &errs))
+        << errs;
+    return decoded;
+  }
+};
+
+JSONTEST_FIXTURE_LOCAL(MsgPackTest, encoding) {
+  Json::Value root;
+  root["a"].append(1);
+  root["a"].append(-1);
+  root["a"].append(200U);
+  root["a"].append(-200);
+  root["a"].append(1.5);
+  root["a"].append(Json::Value());
+  root["a"].append(true);
+  root["b"] = "x";
+  char const expected[] = "\x82"                            // fixmap 2
+                          "\xa1"
+                          "a"
+                          "\x97"                            // fixarray 7
+                          "\x01\xff"                        // fixint 1, -1
+                          "\xcc\xc8"                        // uint 8
+                          "\xd1\xff\x38"                    // int 16
+                          "\xcb\x3f\xf8\0\0\0\0\0\0"        // float 64
+                          "\xc0\xc3"                        // nil, true
+                          "\xa1"
+                          "b"
+                          "\xa1"
+                          "x";
+  JSONTEST_ASSERT_STRING_EQUAL(
+      Json::String(expected, sizeof(expected) - 1),
+      Json::writeString(Json::MsgPackWriterBuilder(), root));
+}
+
+JSONTEST_FIXTURE_LOCAL(MsgPackTest, roundTrip) {
+  Json::Value root(Json::objectValue);
+  Json::Value& numbers = root["numbers"];
+  for (Json::LargestInt value :
+       {Json::LargestInt(0), Json::LargestInt(127), Json::LargestInt(128),
+        Json::LargestInt(-32), Json::LargestInt(-33), Json::LargestInt(-129),
+        Json::LargestInt(32768), Json::LargestInt(-32769),
+        Json::LargestInt(4294967296), Json::Value::minLargestInt,
+        Json::Value::maxLargestInt})
+    numbers.append(value);
+  for (Json::LargestUInt value :
+       {Json::LargestUInt(0), Json::LargestUInt(256), Json::LargestUInt(65536),
+        Json::Value::maxLargestUInt})
+    numbers.append(value);
+  numbers.append(-0.25);
+  numbers.append(1e300);
+  numbers.append(std::numeric_limits<double>::infinity());
+  for (size_t length : {0, 31, 32, 255, 256, 65535, 65536})
+    root["strings"].append(Json::String(length, 'x'));
+  root["strings"].append(Json::String("nul\0byte", 8));
+  for (int i = 0; i < 70000; ++i)
+    root["large"].append(i);
+  for (int i = 0; i < 20; ++i)
+    root["nested"][std::to_string(i)][0] = Json::Value(Json::objectValue);
+  root["empty"] = Json::Value(Json::arrayValue);
+
+  Json::Value const decoded = roundTrip(root);
+  JSONTEST_ASSERT(decoded == root);
+  // The int/uint distinction is kept.
+  JSONTEST_ASSERT_EQUAL(Json::intValue, decoded["numbers"][0].type());
+  JSONTEST_ASSERT_EQUAL(Json::uintValue, decoded["numbers"][11].type());
+  JSONTEST_ASSERT_EQUAL(Json::realValue, decoded["numbers"][15].type());
+}
+
+JSONTEST_FIXTURE_LOCAL(MsgPackTest, errors) {
+  CharReaderPtr reader(Json::MsgPackReaderBuilder().newCharReader());
+  Json::Value root;
+  Json::String errs;
+  auto parse = [&](const char* bytes, size_t size) {
+    return reader->parse(bytes, bytes + size, &root, &errs);
+  };
+  JSONTEST_ASSERT(!parse("\x92\x01", 2));
+  JSONTEST_ASSERT_STRING_EQUAL(
+      "* Offset 2\n  Unexpected end of MessagePack data.\n", errs);
+  JSONTEST_ASSERT(!parse("\xa3" "ab", 3));
+  JSONTEST_ASSERT(!parse("\xcd\x01", 2));
+  JSONTEST_ASSERT(!parse("\x91\xc4\x01x", 4));
+  JSONTEST_ASSERT_STRING_EQUAL("* Offset 1\n  Unsupported MessagePack type.\n",
+                               errs);
+  JSONTEST_ASSERT(!parse("\x81\x01\x02", 3));
+  JSONTEST_ASSERT_STRING_EQUAL(
+      "* Offset 1\n  MessagePack map keys must be strings.\n", errs);
+  JSONTEST_ASSERT(!parse("\xc0\xc0", 2));
+  JSONTEST_ASSERT_STRING_EQUAL(
+      "* Offset 1\n  Extra data after MessagePack value.\n", errs);
+  // A float 32 is widened.
+  JSONTEST_ASSERT(parse("\xca\x3f\xc0\x00\x00", 5));
+  JSONTEST_ASSERT_EQUAL(1.5, root.asDouble());
+
+  Json::MsgPackReaderBuilder b;
+  b["stackLimit"] = 2;
+  JSONTEST_ASSERT(b.validate(nullptr));
+  CharReaderPtr limited(b.newCharReader());
+  char const deep[] = "\x91\x91\x91\x91\xc0";
+  JSONTEST_ASSERT_THROWS(
+      limited->parse(deep, deep + sizeof(deep) - 1, &root, &errs));
+}
+
 struct IteratorTest : JsonTest::TestCase {};
 
 JSONTEST_FIXTURE_LOCAL(IteratorTest, convert) {
@@ -3850,6 +5156,354 @@ JSONTEST_FIXTURE_LOCAL(RValueTest, moveConstruction) {
   JSONTEST_ASSERT_EQUAL(Json::stringValue, moved["key"].type());
 }
 
+struct FrozenValueTest : JsonTest::TestCase {};
+
+JSONTEST_FIXTURE_LOCAL(FrozenValueTest, accessors) {
+  Json::Value value;
+  value["int"] = -7;
+  value["uint"] = Json::UInt64(1) << 40;
+  value["real"] = 2.5;
+  value["bool"] = true;
+  value["null"] = Json::Value();
+  value["string"] = "text";
+  value["array"].append(1);
+  value["array"].append("two");
+  value["object"]["nested"] = Json::Value(Json::arrayValue);
+  const Json::String keyWithNull("a\0b", 3);
+  value[keyWithNull] = "embedded";
+
+  Json::FrozenDocument doc(value);
+  Json::FrozenValue root = doc.root();
+  JSONTEST_ASSERT(root.isObject());
+  JSONTEST_ASSERT_EQUAL(value.size(), root.size());
+  JSONTEST_ASSERT_EQUAL(-7, root["int"].asInt());
+  JSONTEST_ASSERT(root["int"].isInt());
+  JSONTEST_ASSERT(!root["int"].isUInt());
+  JSONTEST_ASSERT_EQUAL(Json::UInt64(1) << 40, root["uint"].asUInt64());
+  JSONTEST_ASSERT(!root["uint"].isInt());
+  JSONTEST_ASSERT_EQUAL(2.5, root["real"].asDouble());
+  JSONTEST_ASSERT_EQUAL(2, root["real"].asInt());
+  JSONTEST_ASSERT(root["bool"].asBool());
+  JSONTEST_ASSERT(root["null"].isNull());
+  JSONTEST_ASSERT(root.isMember("null"));
+  JSONTEST_ASSERT(!root.isMember("missing"));
+  JSONTEST_ASSERT(root["missing"].isNull());
+  JSONTEST_ASSERT_STRING_EQUAL("text", root["string"].asString());
+  JSONTEST_ASSERT_STRING_EQUAL("text", root["string"].asCString());
+  JSONTEST_ASSERT_STRING_EQUAL("-7", root["int"].asString());
+  JSONTEST_ASSERT_EQUAL(2u, root["array"].size());
+  JSONTEST_ASSERT_STRING_EQUAL("two", root["array"][1].asString());
+  JSONTEST_ASSERT(root["array"][2].isNull());
+  JSONTEST_ASSERT(root["object"]["nested"].isArray());
+  JSONTEST_ASSERT(root["object"]["nested"].empty());
+  JSONTEST_ASSERT(root["object"]["nested"].isConvertibleTo(Json::nullValue));
+  JSONTEST_ASSERT(!root["array"].isConvertibleTo(Json::nullValue));
+  JSONTEST_ASSERT_STRING_EQUAL(
+      "embedded", root[keyWithNull].asString());
+
+  // Members come in the same order as Value's.
+  JSONTEST_ASSERT(root.getMemberNames() == value.getMemberNames());
+  auto valueIt = value.begin();
+  for (auto it = root.begin(); it != root.end(); ++it, ++valueIt) {
+    JSONTEST_ASSERT_STRING_EQUAL(valueIt.name(), it.name());
+    JSONTEST_ASSERT(it.key() == valueIt.key());
+  }
+  JSONTEST_ASSERT(valueIt == value.end());
+  JSONTEST_ASSERT(root.toValue() == value);
+
+  Json::FrozenDocument empty;
+  JSONTEST_ASSERT(empty.root().isNull());
+  Json::FrozenDocument moved(std::move(doc));
+  JSONTEST_ASSERT_STRING_EQUAL("text", moved.root()["string"].asString());
+}
+
+JSONTEST_FIXTURE_LOCAL(FrozenValueTest, lookup) {
+  Json::Value value;
+  for (int i = 0; i < 1000; ++i)
+    value["key" + std::to_string(i)] = i;
+  value["sparse"][10] = 1;
+  Json::FrozenDocument doc(value);
+  Json::FrozenValue root = doc.root();
+  for (int i = 0; i < 1000; ++i)
+    JSONTEST_ASSERT_EQUAL(i, root["key" + std::to_string(i)].asInt());
+  JSONTEST_ASSERT(!root.isMember("key"));
+  JSONTEST_ASSERT(!root.isMember("key1000"));
+  JSONTEST_ASSERT(!root.isMember("key00"));
+  JSONTEST_ASSERT_EQUAL(11u, root["sparse"].size());
+  JSONTEST_ASSERT(root["sparse"][0].isNull());
+  JSONTEST_ASSERT_EQUAL(1, root["sparse"][10].asInt());
+
+  Json::Value deep;
+  Json::Value* node = &deep;
+  for (int i = 0; i < 100000; ++i)
+    node = &node->append(Json::Value());
+  *node = "leaf";
+  Json::FrozenDocument deepDoc(deep);
+  JSONTEST_ASSERT(deepDoc.root().toValue() == deep);
+}
+
+JSONTEST_FIXTURE_LOCAL(FrozenValueTest, snapshot) {
+  Json::Value value;
+  value["int"] = -7;
+  value["uint"] = Json::UInt64(1) << 40;
+  value["real"] = 2.5;
+  value["strings"].append("");
+  value["strings"].append(Json::String("a\0b", 3));
+  value["sparse"][3] = true;
+  value["object"]["nested"] = Json::Value(Json::objectValue);
+  std::ostringstream out;
+  Json::FrozenDocument(value).writeSnapshot(out);
+  const Json::String bytes = out.str();
+  JSONTEST_ASSERT_STRING_EQUAL("JSNP", bytes.substr(0, 4));
+
+  Json::String errs;
+  Json::FrozenDocument copy;
+  JSONTEST_ASSERT(
+      copy.readSnapshot(bytes.data(), bytes.data() + bytes.size(), &errs));
+  JSONTEST_ASSERT_EQUAL(bytes.size() - 24, copy.size());
+  JSONTEST_ASSERT_EQUAL(-7, copy.root()["int"].asInt());
+  JSONTEST_ASSERT(copy.root().toValue()["strings"] == value["strings"]);
+
+  // Viewing in place needs 8-byte aligned bytes, as from mmap.
+  std::vector<std::uint64_t> aligned((bytes.size() + 7) / 8);
+  memcpy(aligned.data(), bytes.data(), bytes.size());
+  const char* begin = reinterpret_cast<const char*>(aligned.data());
+  Json::FrozenValue root;
+  JSONTEST_ASSERT(Json::FrozenDocument::viewSnapshot(
+      begin, begin + bytes.size(), &root, &errs));
+  JSONTEST_ASSERT_EQUAL(Json::UInt64(1) << 40, root["uint"].asUInt64());
+  JSONTEST_ASSERT(root["sparse"][3].asBool());
+  JSONTEST_ASSERT(root.toValue() == copy.root().toValue());
+
+  // Truncated, misaligned and corrupt snapshots are rejected.
+  JSONTEST_ASSERT(!copy.readSnapshot(bytes.data(), bytes.data() + 10, &errs));
+  JSONTEST_ASSERT_STRING_EQUAL("* Truncated snapshot header\n", errs);
+  JSONTEST_ASSERT(!copy.readSnapshot(
+      bytes.data(), bytes.data() + bytes.size() - 8, &errs));
+  JSONTEST_ASSERT_STRING_EQUAL("* Snapshot size does not match its header\n",
+                               errs);
+  JSONTEST_ASSERT(!Json::FrozenDocument::viewSnapshot(
+      begin + 1, begin + bytes.size(), &root, &errs));
+  JSONTEST_ASSERT_STRING_EQUAL("* Snapshot is not aligned to 8 bytes\n", errs);
+  Json::String corrupt = bytes;
+  corrupt[0] = 'X';
+  JSONTEST_ASSERT(!copy.readSnapshot(
+      corrupt.data(), corrupt.data() + corrupt.size(), &errs));
+  JSONTEST_ASSERT_STRING_EQUAL("* Not a snapshot\n", errs);
+  // Changing any single byte of the buffer either keeps a valid layout, or
+  // is detected: it never makes a read go out of bounds.
+  for (size_t i = 24; i < bytes.size(); ++i) {
+    corrupt = bytes;
+    corrupt[i] = static_cast<char>(corrupt[i] ^ 0x41);
+    if (copy.readSnapshot(corrupt.data(), corrupt.data() + corrupt.size(),
+                          &errs))
+      copy.root().toValue();
+  }
+  // The failed reads left the last good document in place.
+  JSONTEST_ASSERT(copy.root().isObject());
+}
+
+struct ParallelTest : JsonTest::TestCase {
+  static Json::Value makeDocument() {
+    Json::Value root;
+    Json::Value& records = root["records"];
+    for (int i = 0; i < 3000; ++i) {
+      Json::Value& record = records[i];
+      record["id"] = i;
+      record["name"] = "record " + std::to_string(i);
+      record["tags"].append(i % 7);
+    }
+    records.setComment("// records", Json::commentBefore);
+    root["sparse"][5000] = true;
+    root["empty"] = Json::Value(Json::objectValue);
+    return root;
+  }
+};
+
+JSONTEST_FIXTURE_LOCAL(ParallelTest, threadPoolRunsEachTaskOnce) {
+  Json::ThreadPoolExecutor pool(4);
+  JSONTEST_ASSERT_EQUAL(4u, pool.concurrency());
+  for (size_t count : std::vector<size_t>{0, 1, 5, 1000}) {
+    std::vector<std::atomic<int>> calls(count);
+    pool.parallelFor(count, [&](size_t i) {
+      ++calls[i];
+      // Nested calls run inline instead of deadlocking.
+      pool.parallelFor(2, [&](size_t) {});
+    });
+    for (auto& c : calls)
+      JSONTEST_ASSERT_EQUAL(1, c.load());
+  }
+#if JSON_USE_EXCEPTION
+  JSONTEST_ASSERT_THROWS(pool.parallelFor(100, [](size_t i) {
+    if (i == 50)
+      throw Json::LogicError("task failed");
+  }));
+  std::atomic<size_t> total{0};
+  pool.parallelFor(10, [&](size_t i) { total += i; });
+  JSONTEST_ASSERT_EQUAL(45u, total.load());
+#endif
+}
+
+JSONTEST_FIXTURE_LOCAL(ParallelTest, copy) {
+  Json::ThreadPoolExecutor pool(4);
+  const Json::Value doc = makeDocument();
+  Json::Value copy = Json::parallelCopy(doc, pool);
+  JSONTEST_ASSERT(copy == doc);
+  JSONTEST_ASSERT_EQUAL(5001u, copy["sparse"].size());
+  JSONTEST_ASSERT(copy["sparse"].isValidIndex(5000));
+  JSONTEST_ASSERT_STRING_EQUAL("// records",
+                               copy["records"].getComment(Json::commentBefore));
+  JSONTEST_ASSERT(copy["empty"].isObject());
+
+  Json::Value scalar = Json::parallelCopy(Json::Value("text"), pool);
+  JSONTEST_ASSERT_STRING_EQUAL("text", scalar.asString());
+}
+
+JSONTEST_FIXTURE_LOCAL(ParallelTest, equals) {
+  Json::ThreadPoolExecutor pool(4);
+  const Json::Value doc = makeDocument();
+  Json::Value other(doc);
+  JSONTEST_ASSERT(Json::parallelEquals(doc, other, pool));
+  other["records"][2999]["tags"][0] = -1;
+  JSONTEST_ASSERT(!Json::parallelEquals(doc, other, pool));
+  other = doc;
+  other["records"].append(Json::Value());
+  JSONTEST_ASSERT(!Json::parallelEquals(doc, other, pool));
+  other = doc;
+  other["extra"] = 1;
+  JSONTEST_ASSERT(!Json::parallelEquals(doc, other, pool));
+  JSONTEST_ASSERT(!Json::parallelEquals(doc, Json::Value(1), pool));
+  JSONTEST_ASSERT(Json::parallelEquals(Json::Value(1), Json::Value(1), pool));
+}
+
+JSONTEST_FIXTURE_LOCAL(ParallelTest, write) {
+  Json::ThreadPoolExecutor pool(4);
+  Json::ThreadPoolExecutor serial(1);
+  Json::Value doc = makeDocument();
+  doc["records"][1500]["name"].setComment("// after",
+                                          Json::commentAfterOnSameLine);
+  doc["records"][2999].setComment("// last", Json::commentAfter);
+  Json::StreamWriterBuilder builder;
+  const Json::Value settings = builder.settings_;
+  for (int i = 0; i < 3; ++i) {
+    builder.settings_ = settings;
+    if (i == 1)
+      builder["commentStyle"] = "None";
+    if (i == 2)
+      builder["indentation"] = "";
+    const Json::String expected = Json::writeString(builder, doc);
+    JSONTEST_ASSERT_STRING_EQUAL(expected,
+                                 Json::parallelWriteString(builder, doc, pool));
+    JSONTEST_ASSERT_STRING_EQUAL(
+        expected, Json::parallelWriteString(builder, doc, serial));
+    Json::OStringStream sout;
+    Json::parallelWrite(builder, doc, pool, sout);
+    JSONTEST_ASSERT_STRING_EQUAL(expected, sout.str());
+  }
+  const Json::Value scalar("text");
+  JSONTEST_ASSERT_STRING_EQUAL(
+      "\"text\"", Json::parallelWriteString(builder, scalar, pool));
+}
+
+JSONTEST_FIXTURE_LOCAL(ParallelTest, parse) {
+  Json::ThreadPoolExecutor pool(4);
+  Json::Value records(Json::arrayValue);
+  for (int i = 0; i < 1200; ++i) {
+    Json::Value& record = records[i];
+    record["id"] = i;
+    record["text"] = "}, {\"id\": " + std::to_string(i) + "}, [";
+    record["items"][0]["n"] = i % 7;
+    record["items"][1]["n"] = i % 11;
+    if (i % 97 == 5)
+      record.setComment("// record " + std::to_string(i),
+                        Json::commentBefore);
+    if (i % 89 == 0)
+      record["id"].setComment("// id", Json::commentAfterOnSameLine);
+  }
+  Json::Value numbers(Json::arrayValue);
+  for (int i = 0; i < 13000; ++i)
+    numbers.append(i * 7919);
+  Json::StreamWriterBuilder writer;
+  Json::CharReaderBuilder builder;
+  for (const Json::Value* doc : {&records, &numbers}) {
+    Json::String text = "\xEF\xBB\xBF" + Json::writeString(writer, *doc);
+    for (int i = 0; i < 2; ++i) {
+      // The second time, with an error near the end.
+      if (i == 1)
+        text[text.size() - text.size() / 7] = '#';
+      Json::Value expected;
+      Json::String expectedErrs;
+      const bool ok = Json::CharReaderConfig(builder).parse(
+          text.data(), text.data() + text.size(), &expected, &expectedErrs);
+      Json::Value root;
+      Json::String errs;
+      JSONTEST_ASSERT_EQUAL(ok, Json::parallelParse(builder, text.data(),
+                                                    text.data() + text.size(),
+                                                    pool, &root, &errs));
+      JSONTEST_ASSERT_STRING_EQUAL(expectedErrs, errs);
+      JSONTEST_ASSERT(root == expected);
+      JSONTEST_ASSERT_STRING_EQUAL(Json::writeString(writer, expected),
+                                   Json::writeString(writer, root));
+      JSONTEST_ASSERT_EQUAL(expected[1000].getOffsetStart(),
+                            root[1000].getOffsetStart());
+      JSONTEST_ASSERT_EQUAL(expected[1000].getOffsetLimit(),
+                            root[1000].getOffsetLimit());
+    }
+  }
+  // A segment deeper than stackLimit, after an error that parse() stops at
+  // before reaching it, fails the parse without throwing.
+  Json::String text = "[1, #";
+  for (int i = 0; i < 20000; ++i)
+    text += ", " + std::to_string(i * 7919);
+  text += ", " + Json::String(1100, '[') + Json::String(1100, ']') + "]";
+  Json::String expectedErrs;
+  Json::Value expected;
+  JSONTEST_ASSERT(!Json::CharReaderConfig(builder).parse(
+      text.data(), text.data() + text.size(), &expected, &expectedErrs));
+  Json::String errs;
+  Json::Value root;
+  JSONTEST_ASSERT(!Json::parallelParse(builder, text.data(),
+                                       text.data() + text.size(), pool, &root,
+                                       &errs));
+  JSONTEST_ASSERT_STRING_EQUAL(expectedErrs, errs);
+
+  const char object[] = "{}";
+  JSONTEST_ASSERT(Json::parallelParse(builder, object, object + 2, pool, &root,
+                                      nullptr));
+  JSONTEST_ASSERT(root.isObject());
+}
+
+JSONTEST_FIXTURE_LOCAL(ParallelTest, parseNestedArrays) {
+  // Most guesses at where an element starts are in the arrays of the
+  // elements, and fail only once the array they are in ends. Reading the
+  // rest of it again from each of them would take quadratic time.
+  Json::ThreadPoolExecutor pool(4);
+  Json::String text = "[";
+  for (int i = 0; i < 8; ++i) {
+    text += i ? ", {\"items\": [" : "{\"items\": [";
+    for (int j = 0; j < 5000; ++j)
+      text += (j ? ", {\"a\": " : "{\"a\": ") + std::to_string(j) + "}";
+    text += "]}";
+  }
+  text += "]";
+  Json::CharReaderBuilder builder;
+  using Clock = std::chrono::steady_clock;
+  Clock::time_point const start = Clock::now();
+  Json::Value expected;
+  JSONTEST_ASSERT(Json::CharReaderConfig(builder).parse(
+      text.data(), text.data() + text.size(), &expected, nullptr));
+  Clock::time_point const parsed = Clock::now();
+  Json::Value root;
+  JSONTEST_ASSERT(Json::parallelParse(builder, text.data(),
+                                      text.data() + text.size(), pool, &root,
+                                      nullptr));
+  Clock::time_point const parallelParsed = Clock::now();
+  JSONTEST_ASSERT(root == expected);
+  // Each segment reads at most about the whole document.
+  JSONTEST_ASSERT(parallelParsed - parsed <
+                  (parsed - start) * 20 + std::chrono::milliseconds(200));
+}
+
 struct FuzzTest : JsonTest::TestCase {};
 
 // Build and run the fuzz test without any fuzzer, so that it's guaranteed not